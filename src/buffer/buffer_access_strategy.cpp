@@ -0,0 +1,58 @@
+//===----------------------------------------------------------------------===//
+//
+//                         BusTub
+//
+// buffer_access_strategy.cpp
+//
+// Identification: src/buffer/buffer_access_strategy.cpp
+//
+// Copyright (c) 2015-2022, Carnegie Mellon University Database Group
+//
+//===----------------------------------------------------------------------===//
+
+#include "buffer/buffer_access_strategy.h"
+
+#include <algorithm>
+
+namespace bustub {
+
+BufferAccessStrategy::BufferAccessStrategy(BufferAccessStrategyType type, size_t pool_size) : type_(type) {
+  size_t ring_size = 0;
+  switch (type_) {
+    case BufferAccessStrategyType::NORMAL:
+      break;
+    case BufferAccessStrategyType::BULKREAD:
+      ring_size = BULKREAD_RING_SIZE;
+      break;
+    case BufferAccessStrategyType::BULKWRITE:
+      ring_size = BULKWRITE_RING_SIZE;
+      break;
+  }
+  // don't let a single operation take over a small pool, but always keep at least one frame to recycle
+  if (ring_size > 0) {
+    ring_size = std::max<size_t>(std::min(ring_size, pool_size / 8), 1);
+  }
+  ring_.assign(ring_size, {INVALID_FRAME_ID, INVALID_PAGE_ID});
+}
+
+auto BufferAccessStrategy::NextVictim(frame_id_t *frame_id, page_id_t *page_id) -> bool {
+  if (ring_.empty()) {
+    return false;
+  }
+  current_ = (current_ + 1) % ring_.size();
+  if (ring_[current_].first == INVALID_FRAME_ID) {
+    return false;
+  }
+  *frame_id = ring_[current_].first;
+  *page_id = ring_[current_].second;
+  return true;
+}
+
+void BufferAccessStrategy::AddFrame(frame_id_t frame_id, page_id_t page_id) {
+  if (ring_.empty()) {
+    return;
+  }
+  ring_[current_] = {frame_id, page_id};
+}
+
+}  // namespace bustub
@@ -12,21 +12,49 @@
 
 #include "buffer/buffer_pool_manager_instance.h"
 
+#include <algorithm>
+#include <chrono>  // NOLINT
+#include <cstring>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
 #include "common/exception.h"
+#include "common/logger.h"
 #include "common/macros.h"
 
 namespace bustub {
 
+static auto ElapsedNanos(std::chrono::steady_clock::time_point start) -> uint64_t {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
 BufferPoolManagerInstance::BufferPoolManagerInstance(size_t pool_size, DiskManager *disk_manager, size_t replacer_k,
-                                                     LogManager *log_manager)
-    : pool_size_(pool_size), disk_manager_(disk_manager), log_manager_(log_manager) {
-  // we allocate a consecutive memory space for the buffer pool
-  pages_ = new Page[pool_size_];
+                                                     LogManager *log_manager, size_t max_pool_size,
+                                                     size_t compressed_cache_size)
+    : pool_size_(pool_size),
+      max_pool_size_(std::max(pool_size, max_pool_size == 0 ? pool_size * BUFFER_POOL_MAX_GROWTH : max_pool_size)),
+      num_constructed_frames_(pool_size),
+      disk_manager_(disk_manager),
+      log_manager_(log_manager) {
+  // we allocate a consecutive memory space for the buffer pool, page-aligned and backed by huge pages if possible.
+  // Room for max_pool_size_ frames is reserved, so that growing the pool never moves a frame.
+  frame_arena_ = new FrameArena(pool_size, max_pool_size_);
+  // the frame descriptors live apart from the frame data, each padded to its own cache line
+  pages_ = static_cast<Page *>(::operator new(max_pool_size_ * sizeof(Page), std::align_val_t{alignof(Page)}));
+  for (size_t i = 0; i < pool_size; ++i) {
+    new (&pages_[i]) Page(frame_arena_->FrameData(static_cast<frame_id_t>(i)));
+  }
+  if (compressed_cache_size > 0) {
+    compressed_cache_ = new CompressedPageCache(compressed_cache_size);
+  }
   page_table_ = new ExtendibleHashTable<page_id_t, frame_id_t>(bucket_size_);
+  frame_hints_ = new std::atomic<frame_id_t>[max_pool_size_]();
   replacer_ = new LRUKReplacer(pool_size, replacer_k);
 
   // Initially, every page is in the free list.
-  for (size_t i = 0; i < pool_size_; ++i) {
+  for (size_t i = 0; i < pool_size; ++i) {
     free_list_.emplace_back(static_cast<int>(i));
   }
 
@@ -37,54 +65,202 @@ BufferPoolManagerInstance::BufferPoolManagerInstance(size_t pool_size, DiskManag
 }
 
 BufferPoolManagerInstance::~BufferPoolManagerInstance() {
-  delete[] pages_;
+  StopBackgroundWriter();
+  {
+    // prefetched pages are read straight into the frames
+    auto lock = LockLatch();
+    io_done_cv_.wait(lock, [&] { return num_pending_reads_ == 0; });
+  }
+  for (size_t i = 0; i < num_constructed_frames_; ++i) {
+    pages_[i].~Page();
+  }
+  ::operator delete(pages_, std::align_val_t{alignof(Page)});
+  delete frame_arena_;
+  delete compressed_cache_;
   delete page_table_;
+  delete[] frame_hints_;
   delete replacer_;
 }
 
 auto BufferPoolManagerInstance::NewPgImp(page_id_t *page_id) -> Page * {
-  std::scoped_lock lock(latch_);
+  return NewPgWithStrategyImp(page_id, nullptr, INVALID_PAGE_ID);
+}
+
+auto BufferPoolManagerInstance::NewPgWithStrategyImp(page_id_t *page_id, BufferAccessStrategy *strategy,
+                                                     page_id_t hint) -> Page * {
+  auto lock = LockLatch();
   frame_id_t fid;
-  if (!GetAvailableFrame(&fid)) {
+  // a read-only pool has nowhere to write the page to
+  if (disk_manager_->IsReadOnly()) {
+    ++num_new_page_failures_;
+    return nullptr;
+  }
+  if (!GetAvailableFrame(&fid, strategy)) {
+    ++num_new_page_failures_;
     page_id = nullptr;
     return nullptr;
   }
-  pages_[fid].page_id_ = AllocatePage();
+  // nobody holds the frame, the latch only makes optimistic readers of its old page fail
+  pages_[fid].WLatch();
+  pages_[fid].page_id_ = AllocatePage(hint);
   pages_[fid].ResetMemory();
+  pages_[fid].WUnlatch();
+  pages_[fid].rec_lsn_ = CleanRecLSN(&pages_[fid]);
   pages_[fid].pin_count_ = 1;
   page_table_->Insert(pages_[fid].page_id_, fid);
+  frame_hints_[pages_[fid].page_id_ % max_pool_size_].store(fid, std::memory_order_relaxed);
   replacer_->RecordAccess(fid);
   replacer_->SetEvictable(fid, false);
+  if (strategy != nullptr) {
+    strategy->AddFrame(fid, pages_[fid].page_id_);
+  }
 
   *page_id = pages_[fid].page_id_;
   return &pages_[fid];
 }
 
 auto BufferPoolManagerInstance::FetchPgImp(page_id_t page_id) -> Page * {
-  std::scoped_lock lock(latch_);
+  return FetchPgWithStrategyImp(page_id, nullptr);
+}
+
+auto BufferPoolManagerInstance::FetchPgWithStrategyImp(page_id_t page_id, BufferAccessStrategy *strategy) -> Page * {
+  auto lock = LockLatch();
   frame_id_t fid;
   // requested page already in buffer pool
   if (page_table_->Find(page_id, fid)) {
+    ++num_hits_;
     ++pages_[fid].pin_count_;
     replacer_->RecordAccess(fid);
     replacer_->SetEvictable(fid, false);
+    // a prefetch is reading the page, wait for it rather than reading the page a second time
+    io_done_cv_.wait(lock, [&] { return !pages_[fid].io_pending_; });
     return &pages_[fid];
   }
-  if (!GetAvailableFrame(&fid)) {
+  if (!GetAvailableFrame(&fid, strategy)) {
+    ++num_fetch_failures_;
     return nullptr;
   }
+  ++num_misses_;
+  pages_[fid].WLatch();
   pages_[fid].page_id_ = page_id;
-  pages_[fid].ResetMemory();
+  if (!BindMappedPage(fid, page_id)) {
+    pages_[fid].ResetMemory();
+    LoadPage(page_id, pages_[fid].data_);
+  }
+  pages_[fid].WUnlatch();
+  pages_[fid].rec_lsn_ = CleanRecLSN(&pages_[fid]);
   pages_[fid].pin_count_ = 1;
   page_table_->Insert(page_id, fid);
-  disk_manager_->ReadPage(page_id, pages_[fid].data_);
+  frame_hints_[page_id % max_pool_size_].store(fid, std::memory_order_relaxed);
   replacer_->RecordAccess(fid);
   replacer_->SetEvictable(fid, false);
+  if (strategy != nullptr) {
+    strategy->AddFrame(fid, page_id);
+  }
   return &pages_[fid];
 }
 
+void BufferPoolManagerInstance::PrefetchImp(const std::vector<page_id_t> &page_ids, BufferAccessStrategy *strategy) {
+  std::vector<std::pair<frame_id_t, page_id_t>> reads;
+  {
+    auto lock = LockLatch();
+    for (page_id_t page_id : page_ids) {
+      frame_id_t fid;
+      if (page_id == INVALID_PAGE_ID || page_table_->Find(page_id, fid)) {
+        continue;
+      }
+      if (!GetAvailableFrame(&fid, strategy)) {
+        break;
+      }
+      Page &page = pages_[fid];
+      // odd until the read completes, so that optimistic readers don't see the frame half filled
+      page.version_.fetch_add(1);
+      page.page_id_ = page_id;
+      page.rec_lsn_ = CleanRecLSN(&page);
+      page.pin_count_ = 1;
+      page.io_pending_ = true;
+      page_table_->Insert(page_id, fid);
+      frame_hints_[page_id % max_pool_size_].store(fid, std::memory_order_relaxed);
+      replacer_->RecordAccess(fid);
+      replacer_->SetEvictable(fid, false);
+      if (strategy != nullptr) {
+        strategy->AddFrame(fid, page_id);
+      }
+      reads.emplace_back(fid, page_id);
+    }
+    num_pending_reads_ += reads.size();
+  }
+  if (reads.empty()) {
+    return;
+  }
+
+  std::vector<DiskRequest> requests;
+  auto start = std::chrono::steady_clock::now();
+  for (auto [fid, page_id] : reads) {
+    // the frame is pinned and pending, nobody else touches its data until the read has completed
+    if (BindMappedPage(fid, page_id)) {
+      CompletePrefetch(fid);
+      continue;
+    }
+    pages_[fid].ResetMemory();
+    if (compressed_cache_ != nullptr && compressed_cache_->Take(page_id, pages_[fid].data_)) {
+      ++num_compressed_hits_;
+      CompletePrefetch(fid);
+      continue;
+    }
+    // like ReadPage(), a failed read leaves the frame zeroed
+    requests.push_back(DiskRequest{false, page_id, pages_[fid].data_, [this, fid = fid, start](int /*error*/) {
+                                     read_latency_.Record(ElapsedNanos(start));
+                                     CompletePrefetch(fid);
+                                   }});
+  }
+  disk_manager_->SubmitAsync(std::move(requests));
+}
+
+void BufferPoolManagerInstance::CompletePrefetch(frame_id_t frame_id) {
+  ++num_prefetch_reads_;
+  auto lock = LockLatch();
+  Page &page = pages_[frame_id];
+  page.io_pending_ = false;
+  page.version_.fetch_add(1);
+  if (--page.pin_count_ == 0) {
+    replacer_->SetEvictable(frame_id, true);
+  }
+  --num_pending_reads_;
+  // notified under the latch, the destructor may destroy the condition variable as soon as it is released
+  io_done_cv_.notify_all();
+}
+
+auto BufferPoolManagerInstance::OptimisticReadImp(page_id_t page_id, uint64_t *version) -> const Page * {
+  // free frames hold INVALID_PAGE_ID
+  if (page_id == INVALID_PAGE_ID) {
+    return nullptr;
+  }
+  std::atomic<frame_id_t> &hint = frame_hints_[page_id % max_pool_size_];
+  const Page *page = &pages_[hint.load(std::memory_order_relaxed)];
+  // the page id is read after the version, so a frame that changes hands in between fails validation
+  *version = page->GetVersion();
+  if (page->page_id_.load(std::memory_order_relaxed) != page_id) {
+    frame_id_t fid;
+    if (!page_table_->Find(page_id, fid)) {
+      return nullptr;
+    }
+    hint.store(fid, std::memory_order_relaxed);
+    page = &pages_[fid];
+    *version = page->GetVersion();
+    if (page->page_id_.load(std::memory_order_relaxed) != page_id) {
+      return nullptr;
+    }
+  }
+  // odd while somebody holds the write latch
+  if (*version % 2 == 1) {
+    return nullptr;
+  }
+  return page;
+}
+
 auto BufferPoolManagerInstance::UnpinPgImp(page_id_t page_id, bool is_dirty) -> bool {
-  std::scoped_lock lock(latch_);
+  auto lock = LockLatch();
   frame_id_t fid;
   if (!page_table_->Find(page_id, fid) || pages_[fid].pin_count_ <= 0) {
     return false;
@@ -93,6 +269,13 @@ auto BufferPoolManagerInstance::UnpinPgImp(page_id_t page_id, bool is_dirty) ->
   if (pages_[fid].pin_count_ == 0) {
     replacer_->SetEvictable(fid, true);
   }
+  // the page could never be written back, the change is rejected
+  if (is_dirty && disk_manager_->IsReadOnly()) {
+    return false;
+  }
+  if (is_dirty && pages_[fid].write_pending_) {
+    pages_[fid].redirtied_ = true;
+  }
   // an already dirty page can't be marked as not dirty
   if (!pages_[fid].is_dirty_) {
     pages_[fid].is_dirty_ = is_dirty;
@@ -101,41 +284,97 @@ auto BufferPoolManagerInstance::UnpinPgImp(page_id_t page_id, bool is_dirty) ->
 }
 
 auto BufferPoolManagerInstance::FlushPgImp(page_id_t page_id) -> bool {
-  std::scoped_lock lock(latch_);
-  frame_id_t fid;
-  if (!page_table_->Find(page_id, fid)) {
+  if (disk_manager_->IsReadOnly()) {
     return false;
   }
-  disk_manager_->WritePage(pages_[fid].page_id_, pages_[fid].data_);
-  pages_[fid].is_dirty_ = false;
+  {
+    auto lock = LockLatch();
+    frame_id_t fid;
+    while (true) {
+      if (!page_table_->Find(page_id, fid)) {
+        return false;
+      }
+      // the frame doesn't hold the page yet, and the page on disk is what it is being filled with
+      if (pages_[fid].io_pending_) {
+        return true;
+      }
+      // the older copy the background writer is writing back must not land on top of ours
+      if (!pages_[fid].write_pending_) {
+        break;
+      }
+      io_done_cv_.wait(lock);
+    }
+    // nothing to write, unless the page is pinned: its holders only report their changes when they unpin it
+    if (!pages_[fid].is_dirty_ && pages_[fid].pin_count_ == 0) {
+      return true;
+    }
+    FlushLogUntil(pages_[fid].GetLSN());
+    WriteToDisk(pages_[fid].page_id_, pages_[fid].data_);
+    pages_[fid].is_dirty_ = false;
+    pages_[fid].rec_lsn_ = CleanRecLSN(&pages_[fid]);
+    ++num_foreground_writes_;
+  }
+  // a flushed page should survive a crash, but other threads needn't wait for the device meanwhile
+  disk_manager_->Sync();
   return true;
 }
 
 void BufferPoolManagerInstance::FlushAllPgsImp() {
-  std::scoped_lock lock(latch_);
-  // pages_ is a pointer-form array, can't use range-for
-  for (size_t i = 0; i < pool_size_; i++) {
-    if (pages_[i].page_id_ != INVALID_PAGE_ID) {
-      disk_manager_->WritePage(pages_[i].page_id_, pages_[i].data_);
-      pages_[i].is_dirty_ = false;
+  {
+    auto lock = LockLatch();
+    // the copies the background writer is writing back may be older than the pages, they must land first
+    io_done_cv_.wait(lock, [&] { return num_pending_writes_ == 0; });
+    std::vector<std::pair<page_id_t, const char *>> dirty;
+    std::vector<frame_id_t> dirty_frames;
+    lsn_t max_lsn = INVALID_LSN;
+    // pages_ is a pointer-form array, can't use range-for
+    for (size_t i = 0; i < pool_size_.load(); i++) {
+      // a clean page is identical to its copy on disk
+      if (pages_[i].page_id_ != INVALID_PAGE_ID && pages_[i].is_dirty_) {
+        dirty.emplace_back(pages_[i].page_id_, pages_[i].data_);
+        dirty_frames.push_back(static_cast<frame_id_t>(i));
+        max_lsn = std::max(max_lsn, pages_[i].GetLSN());
+      }
     }
+    // the pages stay dirty if the log can't be made durable ahead of them
+    FlushLogUntil(max_lsn);
+    for (auto fid : dirty_frames) {
+      pages_[fid].is_dirty_ = false;
+      pages_[fid].rec_lsn_ = CleanRecLSN(&pages_[fid]);
+    }
+    num_foreground_writes_ += dirty.size();
+    // neighbouring pages go out as one write
+    WritePagesToDisk(std::move(dirty));
   }
+  // one flush for all of the pages
+  disk_manager_->Sync();
 }
 
 auto BufferPoolManagerInstance::DeletePgImp(page_id_t page_id) -> bool {
-  std::scoped_lock lock(latch_);
+  // not under the latch, nobody else needs to wait for the log
+  if (log_manager_ != nullptr && !disk_manager_->IsReadOnly()) {
+    FlushLogUntil(log_manager_->GetNextLSN() - 1);
+  }
+  auto lock = LockLatch();
   frame_id_t fid;
+  if (disk_manager_->IsReadOnly()) {
+    return false;
+  }
+  if (compressed_cache_ != nullptr) {
+    compressed_cache_->Remove(page_id);
+  }
   if (!page_table_->Find(page_id, fid)) {
+    DeallocatePage(page_id);
     return true;
   }
   if (pages_[fid].pin_count_ > 0) {
     return false;
   }
-  if (pages_[fid].is_dirty_) {
-    disk_manager_->WritePage(pages_[fid].page_id_, pages_[fid].data_);
-  }
+  // the content of a deleted page is never read again, don't bother writing it back
+  pages_[fid].WLatch();
   pages_[fid].page_id_ = INVALID_PAGE_ID;
   pages_[fid].ResetMemory();
+  pages_[fid].WUnlatch();
   pages_[fid].pin_count_ = 0;
   pages_[fid].is_dirty_ = false;
   page_table_->Remove(page_id);
@@ -145,10 +384,104 @@ auto BufferPoolManagerInstance::DeletePgImp(page_id_t page_id) -> bool {
   return true;
 }
 
-auto BufferPoolManagerInstance::AllocatePage() -> page_id_t { return next_page_id_++; }
+auto BufferPoolManagerInstance::Resize(size_t new_pool_size, std::chrono::milliseconds drain_timeout) -> bool {
+  if (new_pool_size == 0 || new_pool_size > max_pool_size_) {
+    return false;
+  }
+  std::scoped_lock resize_lock(resize_latch_);
+  size_t old_pool_size = pool_size_.load();
+  if (new_pool_size >= old_pool_size) {
+    // descriptors of frames the pool had before are kept, only construct the ones that never existed
+    for (; num_constructed_frames_ < new_pool_size; ++num_constructed_frames_) {
+      new (&pages_[num_constructed_frames_]) Page(frame_arena_->FrameData(num_constructed_frames_));
+    }
+    auto lock = LockLatch();
+    replacer_->Resize(new_pool_size);
+    for (size_t i = old_pool_size; i < new_pool_size; ++i) {
+      free_list_.emplace_back(static_cast<frame_id_t>(i));
+    }
+    pool_size_ = new_pool_size;
+    return true;
+  }
+
+  // frames of [new_pool_size, old_pool_size) taken out of circulation so far. They are neither on the free list nor
+  // in the replacer, so nobody else can take them, while the rest are drained in later rounds.
+  std::vector<bool> retired(old_pool_size - new_pool_size, false);
+  size_t num_retired = 0;
+  auto deadline = std::chrono::steady_clock::now() + drain_timeout;
+  while (true) {
+    {
+      auto lock = LockLatch();
+      free_list_.remove_if([&](frame_id_t fid) {
+        if (static_cast<size_t>(fid) < new_pool_size) {
+          return false;
+        }
+        retired[fid - new_pool_size] = true;
+        ++num_retired;
+        return true;
+      });
+      // evictions may write back dirty pages, bound the time the latch is held for
+      std::vector<frame_id_t> victims;
+      std::vector<std::pair<page_id_t, const char *>> dirty;
+      lsn_t max_lsn = INVALID_LSN;
+      for (size_t i = new_pool_size; i < old_pool_size && victims.size() < RESIZE_BATCH_FRAMES; ++i) {
+        Page &page = pages_[i];
+        if (retired[i - new_pool_size] || page.pin_count_ > 0) {
+          continue;
+        }
+        victims.push_back(static_cast<frame_id_t>(i));
+        if (page.is_dirty_) {
+          dirty.emplace_back(page.page_id_, page.data_);
+          max_lsn = std::max(max_lsn, page.GetLSN());
+        }
+      }
+      FlushLogUntil(max_lsn);
+      // written back as one batch, so EvictFrame() finds them clean
+      for (auto fid : victims) {
+        pages_[fid].is_dirty_ = false;
+      }
+      num_foreground_writes_ += dirty.size();
+      num_dirty_writebacks_ += dirty.size();
+      WritePagesToDisk(std::move(dirty));
+      for (auto fid : victims) {
+        Page &page = pages_[fid];
+        replacer_->Remove(fid);
+        EvictFrame(fid);
+        // optimistic readers of the evicted page must fail
+        page.WLatch();
+        page.page_id_ = INVALID_PAGE_ID;
+        page.WUnlatch();
+        retired[fid - new_pool_size] = true;
+        ++num_retired;
+      }
+      if (num_retired == retired.size()) {
+        replacer_->Resize(new_pool_size);
+        pool_size_ = new_pool_size;
+        break;
+      }
+      // the frames that are still pinned can't be waited for any longer, hand back the drained ones
+      if (std::chrono::steady_clock::now() >= deadline) {
+        for (size_t i = new_pool_size; i < old_pool_size; ++i) {
+          if (retired[i - new_pool_size]) {
+            free_list_.emplace_back(static_cast<frame_id_t>(i));
+          }
+        }
+        return false;
+      }
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  // the removed frames hold nothing, their memory can go back to the system until the pool grows again
+  frame_arena_->Release(static_cast<frame_id_t>(new_pool_size), old_pool_size - new_pool_size);
+  return true;
+}
 
-auto BufferPoolManagerInstance::GetAvailableFrame(frame_id_t *out_frame_id) -> bool {
+auto BufferPoolManagerInstance::GetAvailableFrame(frame_id_t *out_frame_id, BufferAccessStrategy *strategy) -> bool {
   frame_id_t fid;
+  // a bulk operation recycles its own frames before touching anybody else's
+  if (strategy != nullptr && GetRingFrame(strategy, out_frame_id)) {
+    return true;
+  }
   // there is free frame remaining, get first of them
   if (!free_list_.empty()) {
     fid = free_list_.front();
@@ -158,16 +491,288 @@ auto BufferPoolManagerInstance::GetAvailableFrame(frame_id_t *out_frame_id) -> b
   }
   // no free frame, find a replacement
   if (replacer_->Evict(&fid)) {
-    // write back to disk if the page is dirty
-    if (pages_[fid].is_dirty_) {
-      disk_manager_->WritePage(pages_[fid].page_id_, pages_[fid].data_);
-      pages_[fid].is_dirty_ = false;
-    }
-    page_table_->Remove(pages_[fid].page_id_);
+    EvictFrame(fid);
     *out_frame_id = fid;
     return true;
   }
   return false;
 }
 
+auto BufferPoolManagerInstance::GetRingFrame(BufferAccessStrategy *strategy, frame_id_t *out_frame_id) -> bool {
+  frame_id_t fid;
+  page_id_t ring_page_id;
+  if (!strategy->NextVictim(&fid, &ring_page_id)) {
+    return false;
+  }
+  // the page may have been evicted, or fetched by somebody else, since the ring loaded it
+  if (pages_[fid].page_id_ != ring_page_id || pages_[fid].pin_count_ > 0) {
+    return false;
+  }
+  replacer_->Remove(fid);
+  // a bulk operation would only push the pages worth keeping out of the compressed cache
+  EvictFrame(fid, false);
+  *out_frame_id = fid;
+  return true;
+}
+
+void BufferPoolManagerInstance::EvictFrame(frame_id_t frame_id, bool keep_compressed) {
+  ++num_evictions_;
+  // write back to disk if the page is dirty
+  if (pages_[frame_id].is_dirty_) {
+    FlushLogUntil(pages_[frame_id].GetLSN());
+    WriteToDisk(pages_[frame_id].page_id_, pages_[frame_id].data_);
+    pages_[frame_id].is_dirty_ = false;
+    ++num_foreground_writes_;
+    ++num_dirty_writebacks_;
+  }
+  // the page is clean now, so the compressed cache can keep it in place of the disk. A mapped page is cheaper to get
+  // back than a compressed one.
+  bool mapped = pages_[frame_id].data_ != frame_arena_->FrameData(frame_id);
+  if (keep_compressed && !mapped && compressed_cache_ != nullptr &&
+      compressed_cache_->Insert(pages_[frame_id].page_id_, pages_[frame_id].data_)) {
+    ++num_compressed_stores_;
+  }
+  page_table_->Remove(pages_[frame_id].page_id_);
+}
+
+auto BufferPoolManagerInstance::GetStats() -> BufferPoolStats {
+  BufferPoolStats stats;
+  stats.hits_ = num_hits_;
+  stats.misses_ = num_misses_;
+  stats.fetch_failures_ = num_fetch_failures_;
+  stats.new_page_failures_ = num_new_page_failures_;
+  stats.evictions_ = num_evictions_;
+  stats.dirty_writebacks_ = num_dirty_writebacks_;
+  stats.background_writes_ = num_background_writes_;
+  stats.prefetch_reads_ = num_prefetch_reads_;
+  stats.compressed_hits_ = num_compressed_hits_;
+  stats.compressed_stores_ = num_compressed_stores_;
+  stats.latch_waits_ = num_latch_waits_;
+  stats.latch_wait_nanos_ = latch_wait_nanos_;
+  stats.read_latency_ = read_latency_;
+  stats.write_latency_ = write_latency_;
+  return stats;
+}
+
+auto BufferPoolManagerInstance::GetDirtyPageTable() -> std::vector<std::pair<page_id_t, lsn_t>> {
+  std::vector<std::pair<page_id_t, lsn_t>> dirty_pages;
+  {
+    auto lock = LockLatch();
+    // pages the background writer is writing back are still dirty, with their recLSN, until the write is done.
+    // Holders of a pinned page only report their changes when they unpin it, whatever they logged so far is after
+    // its recLSN.
+    for (size_t i = 0; i < pool_size_.load(); i++) {
+      const Page &page = pages_[i];
+      if (page.page_id_ != INVALID_PAGE_ID && (page.is_dirty_ || (page.pin_count_ > 0 && !page.io_pending_))) {
+        dirty_pages.emplace_back(page.page_id_, page.rec_lsn_);
+      }
+    }
+  }
+  // the pages missing from the table have been written back, make sure they survive a crash too
+  disk_manager_->Sync();
+  return dirty_pages;
+}
+
+auto BufferPoolManagerInstance::CleanRecLSN(Page *page) -> lsn_t {
+  if (log_manager_ == nullptr) {
+    return INVALID_LSN;
+  }
+  lsn_t next_lsn = log_manager_->GetNextLSN();
+  if (page->pin_count_ == 0) {
+    return next_lsn;
+  }
+  // pages that aren't logged may keep anything in place of an LSN
+  lsn_t page_lsn = page->GetLSN();
+  return page_lsn < next_lsn ? page_lsn + 1 : next_lsn;
+}
+
+void BufferPoolManagerInstance::FlushLogUntil(lsn_t lsn) {
+  // pages that aren't logged may keep anything in place of an LSN, the log manager caps it at its last record
+  if (log_manager_ != nullptr && lsn > log_manager_->GetPersistentLSN()) {
+    log_manager_->FlushUntil(lsn);
+  }
+}
+
+auto BufferPoolManagerInstance::LockLatch() -> std::unique_lock<std::mutex> {
+  // an uncontended latch is not worth two clock reads
+  std::unique_lock lock(latch_, std::try_to_lock);
+  if (!lock.owns_lock()) {
+    auto start = std::chrono::steady_clock::now();
+    lock.lock();
+    ++num_latch_waits_;
+    latch_wait_nanos_ += ElapsedNanos(start);
+  }
+  return lock;
+}
+
+void BufferPoolManagerInstance::ReadFromDisk(page_id_t page_id, char *data) {
+  auto start = std::chrono::steady_clock::now();
+  disk_manager_->ReadPage(page_id, data);
+  read_latency_.Record(ElapsedNanos(start));
+}
+
+auto BufferPoolManagerInstance::BindMappedPage(frame_id_t frame_id, page_id_t page_id) -> bool {
+  const char *mapped = disk_manager_->MappedPage(page_id);
+  // the mapping is read-only, and only ever handed out for reading: new pages, write and basic guards and dirty
+  // unpins are rejected in that case
+  pages_[frame_id].data_ = mapped != nullptr ? const_cast<char *>(mapped) : frame_arena_->FrameData(frame_id);
+  return mapped != nullptr;
+}
+
+void BufferPoolManagerInstance::LoadPage(page_id_t page_id, char *data) {
+  if (compressed_cache_ != nullptr && compressed_cache_->Take(page_id, data)) {
+    ++num_compressed_hits_;
+    return;
+  }
+  ReadFromDisk(page_id, data);
+}
+
+void BufferPoolManagerInstance::WriteToDisk(page_id_t page_id, const char *data) {
+  auto start = std::chrono::steady_clock::now();
+  disk_manager_->WritePage(page_id, data);
+  write_latency_.Record(ElapsedNanos(start));
+}
+
+void BufferPoolManagerInstance::WritePagesToDisk(std::vector<std::pair<page_id_t, const char *>> pages) {
+  if (pages.empty()) {
+    return;
+  }
+  auto start = std::chrono::steady_clock::now();
+  disk_manager_->WritePages(std::move(pages));
+  write_latency_.Record(ElapsedNanos(start));
+}
+
+void BufferPoolManagerInstance::RunBackgroundWriter() {
+  std::scoped_lock lock(bg_writer_latch_);
+  if (bg_writer_running_) {
+    return;
+  }
+  bg_writer_running_ = true;
+  bg_writer_thread_ = new std::thread(&BufferPoolManagerInstance::BackgroundWriterLoop, this);
+}
+
+void BufferPoolManagerInstance::StopBackgroundWriter() {
+  {
+    std::scoped_lock lock(bg_writer_latch_);
+    if (!bg_writer_running_) {
+      return;
+    }
+    bg_writer_running_ = false;
+  }
+  bg_writer_cv_.notify_all();
+  bg_writer_thread_->join();
+  delete bg_writer_thread_;
+  bg_writer_thread_ = nullptr;
+}
+
+void BufferPoolManagerInstance::BackgroundWriterLoop() {
+  std::unique_lock lock(bg_writer_latch_);
+  while (!bg_writer_cv_.wait_for(lock, bg_writer_delay, [&] { return !bg_writer_running_; })) {
+    lock.unlock();
+    CleanDirtyPages(BG_WRITER_MAX_PAGES);
+    lock.lock();
+  }
+}
+
+auto BufferPoolManagerInstance::CleanDirtyPages(size_t max_pages) -> size_t {
+  // (page id, frame id) of the pages to write, a private copy of their content, and their recLSNs once it is written
+  std::vector<std::pair<page_id_t, frame_id_t>> batch;
+  std::vector<lsn_t> clean_rec_lsns;
+  // taken from an arena rather than the heap, so that the copies are aligned for direct I/O
+  std::unique_ptr<FrameArena> buffer;
+  {
+    auto lock = LockLatch();
+    // never pin more than half of the evictable frames, foreground operations still need victims meanwhile
+    max_pages = std::min(max_pages, replacer_->Size() / 2);
+    if (max_pages == 0) {
+      return 0;
+    }
+    // clean pages are skipped, so look further down the eviction order than max_pages
+    for (auto fid : replacer_->EvictionCandidates(pool_size_.load())) {
+      if (batch.size() == max_pages) {
+        break;
+      }
+      Page &page = pages_[fid];
+      if (!page.is_dirty_) {
+        continue;
+      }
+      // write-ahead logging: the log records describing the page must reach the disk first
+      if (enable_logging && log_manager_ != nullptr && page.GetLSN() > log_manager_->GetPersistentLSN()) {
+        continue;
+      }
+      batch.emplace_back(page.page_id_, fid);
+    }
+    // write in page id order so that neighbouring pages end up as sequential I/O
+    std::sort(batch.begin(), batch.end());
+    if (batch.empty()) {
+      return 0;
+    }
+    buffer = std::make_unique<FrameArena>(batch.size());
+    for (size_t i = 0; i < batch.size(); i++) {
+      Page &page = pages_[batch[i].second];
+      // nobody else holds the page, so its content is stable while we copy it, and the recLSN it gets once the copy
+      // is on disk is the one of a page clean from now on
+      clean_rec_lsns.push_back(CleanRecLSN(&page));
+      // the pin keeps the frame from being evicted and re-read from disk before our write lands
+      ++page.pin_count_;
+      replacer_->SetEvictable(batch[i].second, false);
+      memcpy(buffer->FrameData(static_cast<frame_id_t>(i)), page.data_, BUSTUB_PAGE_SIZE);
+      page.write_pending_ = true;
+      page.redirtied_ = false;
+    }
+    num_pending_writes_ += batch.size();
+  }
+
+  // submitted as one batch, so that the disk can work on all of them at once, then wait for the last one
+  std::mutex done_latch;
+  std::condition_variable done_cv;
+  size_t num_pending = batch.size();
+  std::vector<int> errors(batch.size(), 0);
+  std::vector<DiskRequest> requests;
+  auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < batch.size(); i++) {
+    char *data = buffer->FrameData(static_cast<frame_id_t>(i));
+    requests.push_back(DiskRequest{true, batch[i].first, data, [&, i, start](int error) {
+                                     write_latency_.Record(ElapsedNanos(start));
+                                     std::scoped_lock lock(done_latch);
+                                     errors[i] = error;
+                                     if (--num_pending == 0) {
+                                       done_cv.notify_one();
+                                     }
+                                   }});
+  }
+  disk_manager_->SubmitAsync(std::move(requests));
+  {
+    std::unique_lock lock(done_latch);
+    done_cv.wait(lock, [&] { return num_pending == 0; });
+  }
+
+  size_t num_written = 0;
+  {
+    auto lock = LockLatch();
+    for (size_t i = 0; i < batch.size(); i++) {
+      Page &page = pages_[batch[i].second];
+      page.write_pending_ = false;
+      if (errors[i] != 0) {
+        LOG_WARN("background write of page %d failed: %s", batch[i].first, strerror(errors[i]));
+      } else {
+        ++num_written;
+      }
+      // changes made after the copy, or all of them if the write failed, are still missing on disk: the page stays
+      // dirty with its old recLSN
+      if (!page.redirtied_ && errors[i] == 0) {
+        page.is_dirty_ = false;
+        page.rec_lsn_ = clean_rec_lsns[i];
+      }
+      if (--page.pin_count_ == 0) {
+        replacer_->SetEvictable(batch[i].second, true);
+      }
+    }
+    num_pending_writes_ -= batch.size();
+  }
+  io_done_cv_.notify_all();
+  num_background_writes_ += num_written;
+  return num_written;
+}
+
 }  // namespace bustub
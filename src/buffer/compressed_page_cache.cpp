@@ -0,0 +1,97 @@
+//===----------------------------------------------------------------------===//
+//
+//                         BusTub
+//
+// compressed_page_cache.cpp
+//
+// Identification: src/buffer/compressed_page_cache.cpp
+//
+// Copyright (c) 2015-2022, Carnegie Mellon University Database Group
+//
+//===----------------------------------------------------------------------===//
+
+#include "buffer/compressed_page_cache.h"
+
+#include <array>
+#include <cstring>
+#include <iterator>
+#include <utility>
+
+#include "common/util/lz_codec.h"
+
+namespace bustub {
+
+/** The memory an entry takes besides its compressed data: the list node, the index slot and the allocation. */
+static constexpr size_t ENTRY_OVERHEAD = 96;
+
+CompressedPageCache::CompressedPageCache(size_t capacity) : capacity_(capacity) {}
+
+auto CompressedPageCache::Insert(page_id_t page_id, const char *data) -> bool {
+  // compress before taking the latch, it takes far longer than the bookkeeping
+  std::array<char, MAX_COMPRESSED_SIZE> buffer;
+  size_t compressed_size = LzCodec::Compress(data, BUSTUB_PAGE_SIZE, buffer.data(), buffer.size());
+  std::unique_ptr<char[]> compressed;
+  if (compressed_size != 0) {
+    compressed = std::make_unique<char[]>(compressed_size);
+    std::memcpy(compressed.get(), buffer.data(), compressed_size);
+  }
+
+  std::scoped_lock lock(latch_);
+  // the cached version is outdated either way
+  if (auto it = index_.find(page_id); it != index_.end()) {
+    RemoveEntry(it->second);
+  }
+  if (compressed_size == 0 || compressed_size + ENTRY_OVERHEAD > capacity_) {
+    return false;
+  }
+  entries_.push_front(Entry{page_id, compressed_size, std::move(compressed)});
+  index_[page_id] = entries_.begin();
+  size_ += compressed_size + ENTRY_OVERHEAD;
+  while (size_ > capacity_) {
+    RemoveEntry(std::prev(entries_.end()));
+  }
+  return true;
+}
+
+auto CompressedPageCache::Take(page_id_t page_id, char *data) -> bool {
+  std::unique_ptr<char[]> compressed;
+  size_t compressed_size;
+  {
+    std::scoped_lock lock(latch_);
+    auto it = index_.find(page_id);
+    if (it == index_.end()) {
+      return false;
+    }
+    compressed = std::move(it->second->data_);
+    compressed_size = it->second->size_;
+    RemoveEntry(it->second);
+  }
+  [[maybe_unused]] size_t size = LzCodec::Decompress(compressed.get(), compressed_size, data, BUSTUB_PAGE_SIZE);
+  BUSTUB_ASSERT(size == BUSTUB_PAGE_SIZE, "cached page is corrupted");
+  return true;
+}
+
+void CompressedPageCache::Remove(page_id_t page_id) {
+  std::scoped_lock lock(latch_);
+  if (auto it = index_.find(page_id); it != index_.end()) {
+    RemoveEntry(it->second);
+  }
+}
+
+auto CompressedPageCache::GetSize() -> size_t {
+  std::scoped_lock lock(latch_);
+  return size_;
+}
+
+auto CompressedPageCache::GetNumPages() -> size_t {
+  std::scoped_lock lock(latch_);
+  return entries_.size();
+}
+
+void CompressedPageCache::RemoveEntry(std::list<Entry>::iterator it) {
+  size_ -= it->size_ + ENTRY_OVERHEAD;
+  index_.erase(it->page_id_);
+  entries_.erase(it);
+}
+
+}  // namespace bustub
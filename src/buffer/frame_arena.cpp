@@ -0,0 +1,88 @@
+//===----------------------------------------------------------------------===//
+//
+//                         BusTub
+//
+// frame_arena.cpp
+//
+// Identification: src/buffer/frame_arena.cpp
+//
+// Copyright (c) 2015-2022, Carnegie Mellon University Database Group
+//
+//===----------------------------------------------------------------------===//
+
+#include "buffer/frame_arena.h"
+
+#include <sys/mman.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+
+#include "common/exception.h"
+
+namespace bustub {
+
+static auto MapAnonymous(size_t size, int extra_flags) -> void * {
+  return mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | extra_flags, -1, 0);
+}
+
+FrameArena::FrameArena(size_t num_frames, size_t max_frames) : num_frames_(std::max(num_frames, max_frames)) {
+  size_t size = std::max<size_t>(num_frames_, 1) * BUSTUB_PAGE_SIZE;
+  // pools smaller than a huge page are mostly tests, don't round them up to 2MB
+  if (size < BUSTUB_HUGE_PAGE_SIZE) {
+    void *mem = MapAnonymous(size, MAP_NORESERVE);
+    if (mem == MAP_FAILED) {
+      throw Exception(ExceptionType::OUT_OF_MEMORY, "cannot map " + std::to_string(size) + " bytes of frame memory");
+    }
+    base_ = static_cast<char *>(mem);
+    mapped_size_ = size;
+    return;
+  }
+
+  size_t huge_size = (size + BUSTUB_HUGE_PAGE_SIZE - 1) / BUSTUB_HUGE_PAGE_SIZE * BUSTUB_HUGE_PAGE_SIZE;
+#ifdef MAP_HUGETLB
+  // only succeeds if enough huge pages have been reserved, e.g. through /proc/sys/vm/nr_hugepages
+  void *huge_mem = num_frames >= max_frames ? MapAnonymous(huge_size, MAP_HUGETLB) : MAP_FAILED;
+  if (huge_mem != MAP_FAILED) {
+    base_ = static_cast<char *>(huge_mem);
+    mapped_size_ = huge_size;
+    huge_pages_ = true;
+    return;
+  }
+#endif
+
+  // map one huge page more than needed, so that the frames can start at a huge page boundary, then give back the rest
+  size_t map_size = huge_size + BUSTUB_HUGE_PAGE_SIZE;
+  void *mem = MapAnonymous(map_size, MAP_NORESERVE);
+  if (mem == MAP_FAILED) {
+    throw Exception(ExceptionType::OUT_OF_MEMORY, "cannot map " + std::to_string(map_size) + " bytes of frame memory");
+  }
+  auto start = reinterpret_cast<uintptr_t>(mem);
+  uintptr_t aligned = (start + BUSTUB_HUGE_PAGE_SIZE - 1) / BUSTUB_HUGE_PAGE_SIZE * BUSTUB_HUGE_PAGE_SIZE;
+  size_t head = aligned - start;
+  size_t tail = map_size - head - huge_size;
+  if (head > 0) {
+    munmap(mem, head);
+  }
+  if (tail > 0) {
+    munmap(reinterpret_cast<void *>(aligned + huge_size), tail);
+  }
+  base_ = reinterpret_cast<char *>(aligned);
+  mapped_size_ = huge_size;
+#ifdef MADV_HUGEPAGE
+  // best effort, transparent huge pages may be disabled
+  madvise(base_, mapped_size_, MADV_HUGEPAGE);
+#endif
+}
+
+FrameArena::~FrameArena() { munmap(base_, mapped_size_); }
+
+void FrameArena::Release(frame_id_t first_frame_id, size_t num_frames) {
+  // reserved huge pages can't be handed back piecemeal, they stay with the arena
+  if (huge_pages_ || num_frames == 0) {
+    return;
+  }
+  madvise(FrameData(first_frame_id), num_frames * BUSTUB_PAGE_SIZE, MADV_DONTNEED);
+}
+
+}  // namespace bustub
@@ -110,4 +110,27 @@ auto LRUKReplacer::Size() -> size_t {
   return curr_size_;
 }
 
+auto LRUKReplacer::EvictionCandidates(size_t max_frames) -> std::vector<frame_id_t> {
+  std::scoped_lock<std::mutex> lock(latch_);
+  std::vector<frame_id_t> candidates;
+  // same order as Evict(): frames with less than k accesses first, then the rest
+  for (const auto *list : {&fifo_, &lru_}) {
+    for (auto it = list->begin(); it != list->end() && candidates.size() < max_frames; ++it) {
+      if (id2frame_[*it].evitable_) {
+        candidates.push_back(*it);
+      }
+    }
+  }
+  return candidates;
+}
+
+void LRUKReplacer::Resize(size_t num_frames) {
+  std::scoped_lock<std::mutex> lock(latch_);
+  // a shrinking buffer pool has removed every frame past the new size already
+  for (const auto &entry : id2frame_) {
+    BUSTUB_ASSERT(entry.first < static_cast<frame_id_t>(num_frames), "frame past the new size is still tracked");
+  }
+  replacer_size_ = num_frames;
+}
+
 }  // namespace bustub
@@ -33,6 +33,7 @@
 #include "recovery/log_manager.h"
 #include "storage/disk/disk_manager.h"
 #include "storage/disk/disk_manager_memory.h"
+#include "storage/disk/disk_manager_uring.h"
 #include "type/value_factory.h"
 
 namespace bustub {
@@ -41,11 +42,11 @@ auto BustubInstance::MakeExecutorContext(Transaction *txn) -> std::unique_ptr<Ex
   return std::make_unique<ExecutorContext>(txn, catalog_, buffer_pool_manager_, txn_manager_, lock_manager_);
 }
 
-BustubInstance::BustubInstance(const std::string &db_file_name) {
+BustubInstance::BustubInstance(const std::string &db_file_name, const DiskManagerOptions &disk_options) {
   enable_logging = false;
 
   // Storage related.
-  disk_manager_ = new DiskManager(db_file_name);
+  disk_manager_ = new DiskManagerUring(db_file_name, disk_options);
 
   // Log related.
   log_manager_ = new LogManager(disk_manager_);
@@ -53,7 +54,10 @@ BustubInstance::BustubInstance(const std::string &db_file_name) {
   // We need more frames for GenerateTestTable to work. Therefore, we use 128 instead of the default
   // buffer pool size specified in `config.h`.
   try {
-    buffer_pool_manager_ = new BufferPoolManagerInstance(128, disk_manager_, LRUK_REPLACER_K, log_manager_);
+    auto *bpm = new BufferPoolManagerInstance(128, disk_manager_, LRUK_REPLACER_K, log_manager_);
+    // pages of a file-backed database are worth writing back before they are evicted
+    bpm->RunBackgroundWriter();
+    buffer_pool_manager_ = bpm;
   } catch (NotImplementedException &e) {
     std::cerr << "BufferPoolManager is not implemented, only mock tables are supported." << std::endl;
     buffer_pool_manager_ = nullptr;
@@ -146,6 +150,61 @@ void BustubInstance::CmdDisplayIndices(ResultWriter &writer) {
   writer.EndTable();
 }
 
+auto BustubInstance::GetBufferPoolStats() -> BufferPoolStats {
+  return buffer_pool_manager_ == nullptr ? BufferPoolStats{} : buffer_pool_manager_->GetStats();
+}
+
+void BustubInstance::CmdDisplayBufferPoolStats(const std::vector<std::string> &args, ResultWriter &writer) {
+  BufferPoolStats stats = GetBufferPoolStats();
+  if (args.size() > 1 && args[1] == "snapshot") {
+    bp_stats_snapshot_ = stats;
+    WriteOneCell("Buffer pool stats snapshot taken, use \\bpstats diff to show the activity since.", writer);
+    return;
+  }
+  if (args.size() > 1 && args[1] == "diff") {
+    stats = stats - bp_stats_snapshot_;
+  } else if (args.size() > 1) {
+    throw Exception(fmt::format("unsupported \\bpstats argument: {}", args[1]));
+  }
+
+  writer.BeginTable(false);
+  writer.BeginHeader();
+  writer.WriteHeaderCell("metric");
+  writer.WriteHeaderCell("value");
+  writer.EndHeader();
+  auto write_row = [&](const std::string &metric, const std::string &value) {
+    writer.BeginRow();
+    writer.WriteCell(metric);
+    writer.WriteCell(value);
+    writer.EndRow();
+  };
+  write_row("hits", fmt::format("{}", stats.hits_));
+  write_row("misses", fmt::format("{}", stats.misses_));
+  write_row("hit_ratio", fmt::format("{:.4f}", stats.HitRatio()));
+  write_row("fetch_failures", fmt::format("{}", stats.fetch_failures_));
+  write_row("new_page_failures", fmt::format("{}", stats.new_page_failures_));
+  write_row("evictions", fmt::format("{}", stats.evictions_));
+  write_row("dirty_writebacks", fmt::format("{}", stats.dirty_writebacks_));
+  write_row("background_writes", fmt::format("{}", stats.background_writes_));
+  write_row("prefetch_reads", fmt::format("{}", stats.prefetch_reads_));
+  write_row("compressed_hits", fmt::format("{}", stats.compressed_hits_));
+  write_row("compressed_stores", fmt::format("{}", stats.compressed_stores_));
+  write_row("latch_waits", fmt::format("{}", stats.latch_waits_));
+  write_row("latch_wait_ms", fmt::format("{:.3f}", static_cast<double>(stats.latch_wait_nanos_) / 1e6));
+  // latencies in microseconds
+  for (const auto &[name, histogram] : {std::make_pair("read", &stats.read_latency_),
+                                         std::make_pair("write", &stats.write_latency_)}) {
+    write_row(fmt::format("{}_count", name), fmt::format("{}", histogram->Count()));
+    write_row(fmt::format("{}_mean_us", name), fmt::format("{:.1f}", histogram->Mean() / 1e3));
+    for (double percentile : {50.0, 99.0, 99.9}) {
+      write_row(fmt::format("{}_p{}_us", name, percentile),
+                fmt::format("{:.1f}", static_cast<double>(histogram->ValueAtPercentile(percentile)) / 1e3));
+    }
+    write_row(fmt::format("{}_max_us", name), fmt::format("{:.1f}", static_cast<double>(histogram->Max()) / 1e3));
+  }
+  writer.EndTable();
+}
+
 void BustubInstance::WriteOneCell(const std::string &cell, ResultWriter &writer) {
   writer.BeginTable(true);
   writer.BeginRow();
@@ -159,6 +218,9 @@ void BustubInstance::CmdDisplayHelp(ResultWriter &writer) {
 
 \dt: show all tables
 \di: show all indices
+\bpstats: show buffer pool counters and I/O latencies since startup
+\bpstats snapshot: remember the current buffer pool counters
+\bpstats diff: show buffer pool counters and I/O latencies since the last snapshot
 \help: show this message again
 
 BusTub shell currently only supports a small set of Postgres queries. We'll set
@@ -195,6 +257,10 @@ auto BustubInstance::ExecuteSqlTxn(const std::string &sql, ResultWriter &writer,
       CmdDisplayHelp(writer);
       return true;
     }
+    if (StringUtil::StartsWith(sql, "\\bpstats")) {
+      CmdDisplayBufferPoolStats(StringUtil::Split(sql, ' '), writer);
+      return true;
+    }
     throw Exception(fmt::format("unsupported internal command: {}", sql));
   }
 
@@ -0,0 +1,115 @@
+//===----------------------------------------------------------------------===//
+//
+//                         BusTub
+//
+// latency_histogram.cpp
+//
+// Identification: src/common/latency_histogram.cpp
+//
+// Copyright (c) 2015-2022, Carnegie Mellon University Database Group
+//
+//===----------------------------------------------------------------------===//
+
+#include "common/latency_histogram.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace bustub {
+
+LatencyHistogram::LatencyHistogram(const LatencyHistogram &other) { *this = other; }
+
+auto LatencyHistogram::operator=(const LatencyHistogram &other) -> LatencyHistogram & {
+  for (size_t i = 0; i < NUM_BUCKETS; i++) {
+    counts_[i].store(other.counts_[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+  }
+  sum_.store(other.sum_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+  return *this;
+}
+
+void LatencyHistogram::Record(uint64_t nanos) {
+  counts_[BucketIndex(nanos)].fetch_add(1, std::memory_order_relaxed);
+  sum_.fetch_add(nanos, std::memory_order_relaxed);
+}
+
+auto LatencyHistogram::operator-(const LatencyHistogram &other) const -> LatencyHistogram {
+  LatencyHistogram diff;
+  for (size_t i = 0; i < NUM_BUCKETS; i++) {
+    uint64_t count = counts_[i].load(std::memory_order_relaxed);
+    uint64_t earlier = other.counts_[i].load(std::memory_order_relaxed);
+    diff.counts_[i].store(count > earlier ? count - earlier : 0, std::memory_order_relaxed);
+  }
+  uint64_t sum = sum_.load(std::memory_order_relaxed);
+  uint64_t earlier_sum = other.sum_.load(std::memory_order_relaxed);
+  diff.sum_.store(sum > earlier_sum ? sum - earlier_sum : 0, std::memory_order_relaxed);
+  return diff;
+}
+
+auto LatencyHistogram::Count() const -> uint64_t {
+  uint64_t count = 0;
+  for (const auto &bucket : counts_) {
+    count += bucket.load(std::memory_order_relaxed);
+  }
+  return count;
+}
+
+auto LatencyHistogram::Mean() const -> double {
+  uint64_t count = Count();
+  return count == 0 ? 0 : static_cast<double>(sum_.load(std::memory_order_relaxed)) / static_cast<double>(count);
+}
+
+auto LatencyHistogram::ValueAtPercentile(double percentile) const -> uint64_t {
+  uint64_t count = Count();
+  if (count == 0) {
+    return 0;
+  }
+  percentile = std::clamp(percentile, 0.0, 100.0);
+  // the rank of the value at the percentile, the smallest value counts as rank 1
+  auto rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(percentile / 100 * static_cast<double>(count))));
+  uint64_t seen = 0;
+  for (size_t i = 0; i < NUM_BUCKETS; i++) {
+    seen += counts_[i].load(std::memory_order_relaxed);
+    if (seen >= rank) {
+      return BucketUpperBound(i);
+    }
+  }
+  return Max();
+}
+
+auto LatencyHistogram::Max() const -> uint64_t {
+  for (size_t i = NUM_BUCKETS; i > 0; i--) {
+    if (counts_[i - 1].load(std::memory_order_relaxed) > 0) {
+      return BucketUpperBound(i - 1);
+    }
+  }
+  return 0;
+}
+
+auto LatencyHistogram::BucketIndex(uint64_t nanos) -> size_t {
+  nanos = std::min(nanos, (uint64_t{1} << MAX_VALUE_BITS) - 1);
+  if (nanos < SUB_BUCKETS) {
+    return nanos;
+  }
+  // the highest set bit picks the power of two, the SUB_BUCKET_BITS bits below it the bucket within it
+  int msb = 63 - __builtin_clzll(nanos);
+  int shift = msb - SUB_BUCKET_BITS;
+  return (shift + 1) * SUB_BUCKETS + ((nanos >> shift) - SUB_BUCKETS);
+}
+
+auto LatencyHistogram::BucketLowerBound(size_t index) -> uint64_t {
+  if (index < SUB_BUCKETS) {
+    return index;
+  }
+  uint64_t shift = index / SUB_BUCKETS - 1;
+  return (index % SUB_BUCKETS + SUB_BUCKETS) << shift;
+}
+
+auto LatencyHistogram::BucketUpperBound(size_t index) -> uint64_t {
+  if (index < SUB_BUCKETS) {
+    return index;
+  }
+  uint64_t shift = index / SUB_BUCKETS - 1;
+  return BucketLowerBound(index) + (uint64_t{1} << shift) - 1;
+}
+
+}  // namespace bustub
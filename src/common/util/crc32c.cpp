@@ -0,0 +1,88 @@
+//===----------------------------------------------------------------------===//
+//
+//                         BusTub
+//
+// crc32c.cpp
+//
+// Identification: src/common/util/crc32c.cpp
+//
+// Copyright (c) 2015-2022, Carnegie Mellon University Database Group
+//
+//===----------------------------------------------------------------------===//
+
+#include "common/util/crc32c.h"
+
+#include <array>
+#include <cstring>
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#endif
+
+namespace bustub {
+
+/** The reflected Castagnoli polynomial. */
+static constexpr uint32_t CRC32C_POLYNOMIAL = 0x82f63b78;
+
+static auto MakeTable() -> std::array<uint32_t, 256> {
+  std::array<uint32_t, 256> table{};
+  for (uint32_t i = 0; i < 256; i++) {
+    uint32_t crc = i;
+    for (int bit = 0; bit < 8; bit++) {
+      crc = (crc >> 1) ^ ((crc & 1) != 0 ? CRC32C_POLYNOMIAL : 0);
+    }
+    table[i] = crc;
+  }
+  return table;
+}
+
+static auto ExtendSoftware(uint32_t crc, const uint8_t *data, size_t size) -> uint32_t {
+  static const std::array<uint32_t, 256> TABLE = MakeTable();
+  for (size_t i = 0; i < size; i++) {
+    crc = TABLE[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+  }
+  return crc;
+}
+
+#if defined(__x86_64__)
+/*
+ * compiled for SSE4.2 whatever the flags of the build, and only called once the CPU is known to have it
+ */
+__attribute__((target("sse4.2"))) static auto ExtendHardware(uint32_t crc, const uint8_t *data, size_t size)
+    -> uint32_t {
+  uint64_t crc64 = crc;
+  for (; size >= sizeof(uint64_t); size -= sizeof(uint64_t), data += sizeof(uint64_t)) {
+    uint64_t word;
+    memcpy(&word, data, sizeof(uint64_t));
+    crc64 = _mm_crc32_u64(crc64, word);
+  }
+  auto crc32 = static_cast<uint32_t>(crc64);
+  for (; size > 0; size--) {
+    crc32 = _mm_crc32_u8(crc32, *data++);
+  }
+  return crc32;
+}
+#endif
+
+auto Crc32c::IsHardwareAccelerated() -> bool {
+#if defined(__x86_64__)
+  static const bool HAS_SSE42 = __builtin_cpu_supports("sse4.2");
+  return HAS_SSE42;
+#else
+  return false;
+#endif
+}
+
+auto Crc32c::Extend(uint32_t crc, const char *data, size_t size) -> uint32_t {
+  // the checksum is kept inverted while it is computed
+  crc = ~crc;
+  const auto *bytes = reinterpret_cast<const uint8_t *>(data);
+#if defined(__x86_64__)
+  if (IsHardwareAccelerated()) {
+    return ~ExtendHardware(crc, bytes, size);
+  }
+#endif
+  return ~ExtendSoftware(crc, bytes, size);
+}
+
+}  // namespace bustub
@@ -0,0 +1,192 @@
+//===----------------------------------------------------------------------===//
+//
+//                         BusTub
+//
+// lz_codec.cpp
+//
+// Identification: src/common/util/lz_codec.cpp
+//
+// Copyright (c) 2015-2022, Carnegie Mellon University Database Group
+//
+//===----------------------------------------------------------------------===//
+
+#include "common/util/lz_codec.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+namespace bustub {
+
+static auto Read32(const uint8_t *p) -> uint32_t {
+  uint32_t value;
+  std::memcpy(&value, p, sizeof(value));
+  return value;
+}
+
+/** Write the continuation bytes of a length whose nibble is 15, returns nullptr if they don't fit. */
+static auto WriteLength(uint8_t *op, const uint8_t *oend, size_t length) -> uint8_t * {
+  for (; length >= 255; length -= 255) {
+    if (op == oend) {
+      return nullptr;
+    }
+    *op++ = 255;
+  }
+  if (op == oend) {
+    return nullptr;
+  }
+  *op++ = static_cast<uint8_t>(length);
+  return op;
+}
+
+/** Read the continuation bytes of a length whose nibble is 15, returns false if the input ends before they do. */
+static auto ReadLength(const uint8_t **ip, const uint8_t *iend, size_t *length) -> bool {
+  uint8_t byte;
+  do {
+    if (*ip == iend) {
+      return false;
+    }
+    byte = *(*ip)++;
+    *length += byte;
+  } while (byte == 255);
+  return true;
+}
+
+/** Write a sequence of literals followed by a match, or by nothing if match_length is 0. */
+static auto WriteSequence(uint8_t *op, const uint8_t *oend, const uint8_t *literals, size_t literal_length,
+                          size_t offset, size_t match_length) -> uint8_t * {
+  if (op == oend) {
+    return nullptr;
+  }
+  uint8_t *token = op++;
+  *token = static_cast<uint8_t>(std::min<size_t>(literal_length, 15) << 4);
+  if (literal_length >= 15 && (op = WriteLength(op, oend, literal_length - 15)) == nullptr) {
+    return nullptr;
+  }
+  if (static_cast<size_t>(oend - op) < literal_length) {
+    return nullptr;
+  }
+  std::memcpy(op, literals, literal_length);
+  op += literal_length;
+  if (match_length == 0) {
+    return op;
+  }
+
+  if (oend - op < 2) {
+    return nullptr;
+  }
+  *op++ = static_cast<uint8_t>(offset & 0xff);
+  *op++ = static_cast<uint8_t>(offset >> 8);
+  size_t length = match_length - LzCodec::MIN_MATCH;
+  *token |= static_cast<uint8_t>(std::min<size_t>(length, 15));
+  if (length >= 15) {
+    return WriteLength(op, oend, length - 15);
+  }
+  return op;
+}
+
+auto LzCodec::Compress(const char *src, size_t src_size, char *dst, size_t dst_capacity) -> size_t {
+  const auto *base = reinterpret_cast<const uint8_t *>(src);
+  const uint8_t *iend = base + src_size;
+  auto *op = reinterpret_cast<uint8_t *>(dst);
+  const uint8_t *oend = op + dst_capacity;
+  const uint8_t *anchor = base;
+
+  if (src_size > MATCH_FIND_LIMIT) {
+    // positions of recently seen 4 byte sequences, a stale or colliding slot only costs a failed comparison
+    std::array<uint32_t, 1 << HASH_BITS> table{};
+    const uint8_t *match_limit = iend - LAST_LITERALS;
+    const uint8_t *find_limit = iend - MATCH_FIND_LIMIT;
+    const uint8_t *ip = base;
+    while (ip < find_limit) {
+      uint32_t sequence = Read32(ip);
+      uint32_t &slot = table[Hash(sequence)];
+      const uint8_t *ref = base + slot;
+      slot = static_cast<uint32_t>(ip - base);
+      if (ref >= ip || static_cast<size_t>(ip - ref) > MAX_OFFSET || Read32(ref) != sequence) {
+        // incompressible data is skipped through quickly
+        ip += 1 + ((ip - anchor) >> SKIP_SHIFT);
+        continue;
+      }
+      // the match may start before the position it was found at
+      while (ip > anchor && ref > base && ip[-1] == ref[-1]) {
+        --ip;
+        --ref;
+      }
+      const uint8_t *match_end = ip + MIN_MATCH;
+      const uint8_t *ref_end = ref + MIN_MATCH;
+      while (match_end < match_limit && *match_end == *ref_end) {
+        ++match_end;
+        ++ref_end;
+      }
+      op = WriteSequence(op, oend, anchor, ip - anchor, ip - ref, match_end - ip);
+      if (op == nullptr) {
+        return 0;
+      }
+      ip = match_end;
+      anchor = ip;
+    }
+  }
+
+  op = WriteSequence(op, oend, anchor, iend - anchor, 0, 0);
+  if (op == nullptr) {
+    return 0;
+  }
+  return op - reinterpret_cast<uint8_t *>(dst);
+}
+
+auto LzCodec::Decompress(const char *src, size_t src_size, char *dst, size_t dst_capacity) -> size_t {
+  const auto *ip = reinterpret_cast<const uint8_t *>(src);
+  const uint8_t *iend = ip + src_size;
+  auto *base = reinterpret_cast<uint8_t *>(dst);
+  uint8_t *op = base;
+  const uint8_t *oend = base + dst_capacity;
+
+  while (ip < iend) {
+    uint8_t token = *ip++;
+    size_t literal_length = token >> 4;
+    if (literal_length == 15 && !ReadLength(&ip, iend, &literal_length)) {
+      return 0;
+    }
+    if (static_cast<size_t>(iend - ip) < literal_length || static_cast<size_t>(oend - op) < literal_length) {
+      return 0;
+    }
+    std::memcpy(op, ip, literal_length);
+    ip += literal_length;
+    op += literal_length;
+    // the last sequence has no match
+    if (ip == iend) {
+      break;
+    }
+
+    if (iend - ip < 2) {
+      return 0;
+    }
+    size_t offset = ip[0] | (static_cast<size_t>(ip[1]) << 8);
+    ip += 2;
+    if (offset == 0 || offset > static_cast<size_t>(op - base)) {
+      return 0;
+    }
+    size_t match_length = token & 15;
+    if (match_length == 15 && !ReadLength(&ip, iend, &match_length)) {
+      return 0;
+    }
+    match_length += MIN_MATCH;
+    if (static_cast<size_t>(oend - op) < match_length) {
+      return 0;
+    }
+    const uint8_t *ref = op - offset;
+    if (offset >= match_length) {
+      std::memcpy(op, ref, match_length);
+      op += match_length;
+    } else {
+      // the match overlaps the bytes it produces, e.g. a run of one repeated byte
+      for (size_t i = 0; i < match_length; i++) {
+        *op++ = *ref++;
+      }
+    }
+  }
+  return op - base;
+}
+
+}  // namespace bustub
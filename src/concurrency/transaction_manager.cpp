@@ -33,9 +33,12 @@ auto TransactionManager::Begin(Transaction *txn, IsolationLevel isolation_level)
   }
 
   if (enable_logging) {
+    // appended under the latch, so that a checkpoint finds the transaction exactly if its record comes first
+    std::scoped_lock lock(active_txns_latch_);
     LogRecord record = LogRecord(txn->GetTransactionId(), txn->GetPrevLSN(), LogRecordType::BEGIN);
     lsn_t lsn = log_manager_->AppendLogRecord(&record);
     txn->SetPrevLSN(lsn);
+    active_txns_[txn->GetTransactionId()] = {txn, lsn};
   }
 
   std::unique_lock<std::shared_mutex> l(txn_map_mutex);
@@ -59,6 +62,14 @@ void TransactionManager::Commit(Transaction *txn) {
   }
   write_set->clear();
 
+  if (enable_logging) {
+    lsn_t lsn = LogTransactionEnd(txn, LogRecordType::COMMIT);
+    // the commit is only acknowledged once its record is durable, together with whoever commits meanwhile
+    log_manager_->FlushUntil(lsn);
+  } else {
+    LogTransactionEnd(txn, LogRecordType::INVALID);
+  }
+
   // Release all the locks.
   ReleaseLocks(txn);
   // Release the global transaction latch.
@@ -109,12 +120,45 @@ void TransactionManager::Abort(Transaction *txn) {
   table_write_set->clear();
   index_write_set->clear();
 
+  // no need to wait, a transaction without a durable commit record is rolled back by recovery anyway
+  LogTransactionEnd(txn, enable_logging ? LogRecordType::ABORT : LogRecordType::INVALID);
+
   // Release all the locks.
   ReleaseLocks(txn);
   // Release the global transaction latch.
   global_txn_latch_.RUnlock();
 }
 
+auto TransactionManager::LogTransactionEnd(Transaction *txn, LogRecordType type) -> lsn_t {
+  std::scoped_lock lock(active_txns_latch_);
+  // a transaction that began while logging was enabled leaves the table either way
+  active_txns_.erase(txn->GetTransactionId());
+  if (type == LogRecordType::INVALID) {
+    return INVALID_LSN;
+  }
+  LogRecord record = LogRecord(txn->GetTransactionId(), txn->GetPrevLSN(), type);
+  lsn_t lsn = log_manager_->AppendLogRecord(&record);
+  txn->SetPrevLSN(lsn);
+  return lsn;
+}
+
+auto TransactionManager::LogBeginCheckpoint(std::vector<std::pair<page_id_t, lsn_t>> dirty_pages,
+                                            lsn_t dirty_pages_lsn, lsn_t *min_first_lsn) -> lsn_t {
+  std::vector<std::pair<txn_id_t, lsn_t>> active_txns;
+  *min_first_lsn = INVALID_LSN;
+  std::scoped_lock lock(active_txns_latch_);
+  for (const auto &[txn_id, entry] : active_txns_) {
+    // an active transaction is not deleted before it ends, which takes this latch
+    active_txns.emplace_back(txn_id, entry.first->GetPrevLSN());
+    if (*min_first_lsn == INVALID_LSN || entry.second < *min_first_lsn) {
+      *min_first_lsn = entry.second;
+    }
+  }
+  LogRecord record(INVALID_TXN_ID, dirty_pages_lsn, LogRecordType::BEGIN_CHECKPOINT, std::move(active_txns),
+                   std::move(dirty_pages));
+  return log_manager_->AppendLogRecord(&record);
+}
+
 void TransactionManager::BlockAllTransactions() { global_txn_latch_.WLock(); }
 
 void TransactionManager::ResumeTransactions() { global_txn_latch_.WUnlock(); }
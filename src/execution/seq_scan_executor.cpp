@@ -14,10 +14,33 @@
 
 namespace bustub {
 
-SeqScanExecutor::SeqScanExecutor(ExecutorContext *exec_ctx, const SeqScanPlanNode *plan) : AbstractExecutor(exec_ctx) {}
+SeqScanExecutor::SeqScanExecutor(ExecutorContext *exec_ctx, const SeqScanPlanNode *plan)
+    : AbstractExecutor(exec_ctx), plan_(plan) {}
 
-void SeqScanExecutor::Init() { throw NotImplementedException("SeqScanExecutor is not implemented"); }
+void SeqScanExecutor::Init() {
+  table_info_ = exec_ctx_->GetCatalog()->GetTable(plan_->GetTableOid());
+  auto *bpm = exec_ctx_->GetBufferPoolManager();
+  // A table that takes more than a quarter of the pool would push everybody else's pages out, so it is read through
+  // a small private ring of frames instead.
+  strategy_.reset();
+  if (table_info_->table_->GetNumPages() > bpm->GetPoolSize() / 4) {
+    strategy_ = std::make_unique<BufferAccessStrategy>(BufferAccessStrategyType::BULKREAD, bpm->GetPoolSize());
+  }
+  iter_.emplace(table_info_->table_->Begin(exec_ctx_->GetTransaction(), strategy_.get()));
+}
 
-auto SeqScanExecutor::Next(Tuple *tuple, RID *rid) -> bool { return false; }
+auto SeqScanExecutor::Next(Tuple *tuple, RID *rid) -> bool {
+  const auto end = table_info_->table_->End();
+  while (*iter_ != end) {
+    *tuple = **iter_;
+    *rid = tuple->GetRid();
+    ++(*iter_);
+    if (plan_->filter_predicate_ == nullptr ||
+        plan_->filter_predicate_->Evaluate(tuple, table_info_->schema_).GetAs<bool>()) {
+      return true;
+    }
+  }
+  return false;
+}
 
 }  // namespace bustub
@@ -0,0 +1,91 @@
+//===----------------------------------------------------------------------===//
+//
+//                         BusTub
+//
+// buffer_access_strategy.h
+//
+// Identification: src/include/buffer/buffer_access_strategy.h
+//
+// Copyright (c) 2015-2022, Carnegie Mellon University Database Group
+//
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include <utility>
+#include <vector>
+
+#include "common/config.h"
+#include "common/macros.h"
+
+namespace bustub {
+
+/** The kind of operation a BufferAccessStrategy is created for. */
+enum class BufferAccessStrategyType {
+  /** Regular random access, no ring is used. */
+  NORMAL = 0,
+  /** Large sequential scans. */
+  BULKREAD,
+  /** Bulk inserts into a table heap. */
+  BULKWRITE,
+};
+
+/**
+ * BufferAccessStrategy gives a single operation (a large sequential scan or a bulk insert) a small private ring of
+ * buffer pool frames. Whenever the operation misses in the buffer pool, the buffer pool manager recycles the frame
+ * the ring used furthest in the past instead of asking the shared replacer for a victim. This way a scan over a table
+ * much larger than the pool only ever occupies a handful of frames and leaves the hot pages of everybody else alone.
+ *
+ * A strategy is owned by the operation that created it and must not be shared between threads. All of its state is
+ * only touched by the buffer pool manager while it holds its latch.
+ */
+class BufferAccessStrategy {
+ public:
+  /**
+   * @brief Create a new access strategy.
+   * @param type the kind of operation the strategy is used for
+   * @param pool_size the number of frames of the buffer pool the strategy will be used with. The ring never takes
+   * more than 1/8 of the pool.
+   */
+  BufferAccessStrategy(BufferAccessStrategyType type, size_t pool_size);
+
+  DISALLOW_COPY_AND_MOVE(BufferAccessStrategy);
+
+  ~BufferAccessStrategy() = default;
+
+  /** @return the kind of operation this strategy was created for */
+  auto GetType() const -> BufferAccessStrategyType { return type_; }
+
+  /** @return the number of frames in the ring, 0 for a NORMAL strategy */
+  auto GetRingSize() const -> size_t { return ring_.size(); }
+
+  /**
+   * @brief Advance to the next slot of the ring and report the frame it holds.
+   *
+   * The reported frame is only a candidate: the page may have been evicted or pinned by somebody else since the ring
+   * used it, so the buffer pool manager must check that the frame still holds page_id and is unpinned before reusing
+   * it.
+   *
+   * @param[out] frame_id the frame held by the current slot
+   * @param[out] page_id the page the ring loaded into that frame
+   * @return false if the current slot is still empty (or the ring has no slots), true otherwise
+   */
+  auto NextVictim(frame_id_t *frame_id, page_id_t *page_id) -> bool;
+
+  /**
+   * @brief Remember that the current slot of the ring now holds page_id in frame_id. Must be called after
+   * NextVictim(), whether or not the candidate it returned could be reused.
+   * @param frame_id the frame the page was loaded into
+   * @param page_id the page that was loaded
+   */
+  void AddFrame(frame_id_t frame_id, page_id_t page_id);
+
+ private:
+  BufferAccessStrategyType type_;
+  /** Slots of the ring, each holding a (frame, page) pair or INVALID_FRAME_ID when unused. */
+  std::vector<std::pair<frame_id_t, page_id_t>> ring_;
+  /** Index of the slot returned by the last NextVictim() call. */
+  size_t current_{0};
+};
+
+}  // namespace bustub
@@ -15,11 +15,16 @@
 #include <list>
 #include <mutex>  // NOLINT
 #include <unordered_map>
+#include <utility>
+#include <vector>
 
+#include "buffer/buffer_access_strategy.h"
+#include "buffer/buffer_pool_stats.h"
 #include "buffer/lru_replacer.h"
 #include "recovery/log_manager.h"
 #include "storage/disk/disk_manager.h"
 #include "storage/page/page.h"
+#include "storage/page/page_guard.h"
 
 namespace bustub {
 
@@ -84,9 +89,134 @@ class BufferPoolManager {
     GradingCallback(callback, CallbackType::AFTER, INVALID_PAGE_ID);
   }
 
+  /**
+   * Fetch a page on behalf of a bulk operation. On a miss the frame is taken from the strategy's private ring instead
+   * of the shared replacer, see BufferAccessStrategy.
+   * @param page_id id of page to be fetched
+   * @param strategy the access strategy of the calling operation, nullptr behaves exactly like FetchPage()
+   * @return the requested page
+   */
+  auto FetchPageWithStrategy(page_id_t page_id, BufferAccessStrategy *strategy) -> Page * {
+    return strategy == nullptr ? FetchPgImp(page_id) : FetchPgWithStrategyImp(page_id, strategy);
+  }
+
+  /**
+   * Create a new page on behalf of a bulk operation, taking the frame from the strategy's private ring.
+   * @param[out] page_id id of created page
+   * @param strategy the access strategy of the calling operation, nullptr behaves exactly like NewPage()
+   * @param hint a page the new page should be placed close to on disk, INVALID_PAGE_ID for none
+   * @return nullptr if no new pages could be created, otherwise pointer to new page
+   */
+  auto NewPageWithStrategy(page_id_t *page_id, BufferAccessStrategy *strategy, page_id_t hint = INVALID_PAGE_ID)
+      -> Page * {
+    return strategy == nullptr && hint == INVALID_PAGE_ID ? NewPgImp(page_id)
+                                                          : NewPgWithStrategyImp(page_id, strategy, hint);
+  }
+
+  /**
+   * Fetch a page and wrap it into a guard that unpins it on destruction.
+   * @param page_id id of page to be fetched
+   * @param strategy the access strategy of the calling operation, may be nullptr
+   * @return a guard holding the requested page, or an empty guard if the page could not be fetched. The guard can
+   * change the page, so the guard is always empty if the buffer pool is read-only.
+   */
+  auto FetchPageBasic(page_id_t page_id, BufferAccessStrategy *strategy = nullptr) -> BasicPageGuard {
+    if (IsReadOnly()) {
+      return {this, nullptr};
+    }
+    return {this, FetchPageWithStrategy(page_id, strategy)};
+  }
+
+  /**
+   * Fetch a page, read-latch it, and wrap it into a guard that unlatches and unpins it on destruction.
+   * @param page_id id of page to be fetched
+   * @param strategy the access strategy of the calling operation, may be nullptr
+   * @return a guard holding the requested page, or an empty guard if the page could not be fetched
+   */
+  auto FetchPageRead(page_id_t page_id, BufferAccessStrategy *strategy = nullptr) -> ReadPageGuard {
+    auto *page = FetchPageWithStrategy(page_id, strategy);
+    if (page != nullptr) {
+      page->RLatch();
+    }
+    return {this, page};
+  }
+
+  /**
+   * Fetch a page, write-latch it, and wrap it into a guard that unlatches and unpins it on destruction.
+   * @param page_id id of page to be fetched
+   * @param strategy the access strategy of the calling operation, may be nullptr
+   * @return a guard holding the requested page, or an empty guard if the page could not be fetched, always if the
+   * buffer pool is read-only
+   */
+  auto FetchPageWrite(page_id_t page_id, BufferAccessStrategy *strategy = nullptr) -> WritePageGuard {
+    if (IsReadOnly()) {
+      return {this, nullptr};
+    }
+    auto *page = FetchPageWithStrategy(page_id, strategy);
+    if (page != nullptr) {
+      page->WLatch();
+    }
+    return {this, page};
+  }
+
+  /**
+   * Create a new page and wrap it into a guard that unpins it on destruction. Nobody else can reach the page before
+   * its id is published, so it is not latched.
+   * @param[out] page_id id of created page
+   * @param strategy the access strategy of the calling operation, may be nullptr
+   * @param hint a page the new page should be placed close to on disk, INVALID_PAGE_ID for none
+   * @return a guard holding the new page, or an empty guard if no new page could be created
+   */
+  auto NewPageGuarded(page_id_t *page_id, BufferAccessStrategy *strategy = nullptr, page_id_t hint = INVALID_PAGE_ID)
+      -> BasicPageGuard {
+    return {this, NewPageWithStrategy(page_id, strategy, hint)};
+  }
+
+  /**
+   * Announce that the given pages will be fetched soon. Frames are reserved for the pages that are not resident right
+   * away, and the pages are read into them in the background. Fetching a page that is still being read waits for that
+   * read instead of issuing a second one. Prefetching is only a hint: it stops at the first page no frame can be
+   * found for, without waiting for one.
+   * @param page_ids ids of the pages that will be fetched
+   * @param strategy the access strategy of the calling operation, may be nullptr
+   */
+  void Prefetch(const std::vector<page_id_t> &page_ids, BufferAccessStrategy *strategy = nullptr) {
+    PrefetchImp(page_ids, strategy);
+  }
+
+  /**
+   * Start an optimistic read of a resident page, without pinning or latching it. The caller reads the content of the
+   * returned frame, then calls ValidateVersion(version) on it: only if that returns true was the content consistent,
+   * and did it belong to page_id, the whole time. The frame may be overwritten, or reused for another page, at any
+   * moment, so nothing read from it may be trusted, or used to index into the page, before it has been validated.
+   * @param page_id id of the page to read
+   * @param[out] version the version of the frame when the read started
+   * @return the frame holding the page, nullptr if the page is not resident or is being written. The caller falls
+   * back to FetchPageRead() then.
+   */
+  auto OptimisticRead(page_id_t page_id, uint64_t *version) -> const Page * {
+    return OptimisticReadImp(page_id, version);
+  }
+
   /** @return size of the buffer pool */
   virtual auto GetPoolSize() -> size_t = 0;
 
+  /**
+   * @return true if the pages can't be changed, e.g. because they are served from a read-only mapping. Only
+   * FetchPageRead() hands out pages then, and callers of FetchPage() must not write to them.
+   */
+  virtual auto IsReadOnly() -> bool { return false; }
+
+  /** @return a snapshot of the counters and latency histograms of the buffer pool, all zero if it keeps none */
+  virtual auto GetStats() -> BufferPoolStats { return {}; }
+
+  /**
+   * Snapshot the dirty page table for a fuzzy checkpoint. The recLSN of a dirty page is a lower bound of the LSNs of
+   * the records whose changes to the page have not reached the disk yet, so redo can skip the log before it.
+   * @return the id and the recLSN of every dirty page, and of every pinned one, which may have been changed already
+   */
+  virtual auto GetDirtyPageTable() -> std::vector<std::pair<page_id_t, lsn_t>> = 0;
+
  protected:
   /**
    * Grading function. Do not modify!
@@ -108,6 +238,44 @@ class BufferPoolManager {
    */
   virtual auto FetchPgImp(page_id_t page_id) -> Page * = 0;
 
+  /**
+   * Fetch the requested page, recycling a frame of the given strategy's ring on a miss.
+   * Buffer pools without ring support simply ignore the strategy.
+   * @param page_id id of page to be fetched
+   * @param strategy the access strategy of the calling operation
+   * @return the requested page
+   */
+  virtual auto FetchPgWithStrategyImp(page_id_t page_id, BufferAccessStrategy *strategy) -> Page * {
+    return FetchPgImp(page_id);
+  }
+
+  /**
+   * Creates a new page, recycling a frame of the given strategy's ring.
+   * Buffer pools without ring support or page placement simply ignore the strategy and the hint.
+   * @param[out] page_id id of created page
+   * @param strategy the access strategy of the calling operation, may be nullptr
+   * @param hint a page the new page should be placed close to on disk, INVALID_PAGE_ID for none
+   * @return nullptr if no new pages could be created, otherwise pointer to new page
+   */
+  virtual auto NewPgWithStrategyImp(page_id_t *page_id, BufferAccessStrategy *strategy, page_id_t hint) -> Page * {
+    return NewPgImp(page_id);
+  }
+
+  /**
+   * Start reading the given pages in the background. Buffer pools without background I/O simply ignore the hint.
+   * @param page_ids ids of the pages that will be fetched
+   * @param strategy the access strategy of the calling operation, may be nullptr
+   */
+  virtual void PrefetchImp(const std::vector<page_id_t> &page_ids, BufferAccessStrategy *strategy) {}
+
+  /**
+   * Find the frame of a resident page for an optimistic read. Buffer pools without version support never find one.
+   * @param page_id id of the page to read
+   * @param[out] version the version of the frame when the read started
+   * @return the frame holding the page, nullptr if there is none or it is being written
+   */
+  virtual auto OptimisticReadImp(page_id_t page_id, uint64_t *version) -> const Page * { return nullptr; }
+
   /**
    * Unpin the target page from the buffer pool.
    * @param page_id id of page to be unpinned
@@ -12,11 +12,18 @@
 
 #pragma once
 
+#include <atomic>
+#include <chrono>              // NOLINT
+#include <condition_variable>  // NOLINT
 #include <list>
-#include <mutex>  // NOLINT
-#include <unordered_map>
+#include <mutex>   // NOLINT
+#include <thread>  // NOLINT
+#include <utility>
+#include <vector>
 
 #include "buffer/buffer_pool_manager.h"
+#include "buffer/compressed_page_cache.h"
+#include "buffer/frame_arena.h"
 #include "buffer/lru_k_replacer.h"
 #include "common/config.h"
 #include "container/hash/extendible_hash_table.h"
@@ -28,6 +35,10 @@ namespace bustub {
 
 /**
  * BufferPoolManager reads disk pages to and from its internal buffer pool.
+ *
+ * On a read-only disk manager that maps its pages, see DiskManagerMmap, a fetched page is not copied into its frame:
+ * the frame points straight into the mapping, which must not be written through. Creating and deleting pages fails,
+ * and unpinning a page as dirty returns false without marking it.
  */
 class BufferPoolManagerInstance : public BufferPoolManager {
  public:
@@ -37,9 +48,14 @@ class BufferPoolManagerInstance : public BufferPoolManager {
    * @param disk_manager the disk manager
    * @param replacer_k the lookback constant k for the LRU-K replacer
    * @param log_manager the log manager (for testing only: nullptr = disable logging). Please ignore this for P1.
+   * @param max_pool_size the size the buffer pool may be grown to with Resize(), 0 for BUFFER_POOL_MAX_GROWTH times
+   * pool_size. Only address space is reserved for the frames past pool_size.
+   * @param compressed_cache_size the memory of the compressed cache that evicted pages are kept in, in bytes, 0 for
+   * no compressed cache
    */
   BufferPoolManagerInstance(size_t pool_size, DiskManager *disk_manager, size_t replacer_k = LRUK_REPLACER_K,
-                            LogManager *log_manager = nullptr);
+                            LogManager *log_manager = nullptr, size_t max_pool_size = 0,
+                            size_t compressed_cache_size = 0);
 
   /**
    * @brief Destroy an existing BufferPoolManagerInstance.
@@ -49,11 +65,104 @@ class BufferPoolManagerInstance : public BufferPoolManager {
   /** @brief Return the size (number of frames) of the buffer pool. */
   auto GetPoolSize() -> size_t override { return pool_size_; }
 
+  /** @return true if the disk manager can't write pages */
+  auto IsReadOnly() -> bool override { return disk_manager_->IsReadOnly(); }
+
+  /** @brief Return the size the buffer pool can be grown to. */
+  auto GetMaxPoolSize() -> size_t { return max_pool_size_; }
+
   /** @brief Return the pointer to all the pages in the buffer pool. */
   auto GetPages() -> Page * { return pages_; }
 
+  /**
+   * @brief Change the number of frames of the buffer pool while it is in use.
+   *
+   * Growing hands the new frames to the free list at once. Shrinking drains the frames past the new size in batches
+   * of RESIZE_BATCH_FRAMES, taking the latch for one batch at a time: free frames are taken off the free list, and
+   * unpinned pages are evicted, dirty ones written back. Pinned frames are retried until they are unpinned or the
+   * timeout expires, in which case the drained frames are handed back and the pool keeps its size. The memory of
+   * removed frames is given back to the system, and frame descriptors never move, so guards and optimistic readers
+   * stay valid throughout.
+   *
+   * @param new_pool_size the new number of frames, between 1 and GetMaxPoolSize()
+   * @param drain_timeout how long to wait for pinned frames when shrinking
+   * @return false if the size is out of range or the pool could not be shrunk in time, true otherwise
+   */
+  auto Resize(size_t new_pool_size, std::chrono::milliseconds drain_timeout = std::chrono::seconds(1)) -> bool;
+
+  /**
+   * @brief Start the background writer. Every bg_writer_delay it writes up to BG_WRITER_MAX_PAGES dirty, unpinned
+   * pages back to disk, picking the pages the replacer would evict next, so that foreground operations rarely have to
+   * write a dirty victim themselves. Calling this twice has no effect.
+   */
+  void RunBackgroundWriter();
+
+  /** @brief Stop the background writer and wait for its current round to finish. No-op if it is not running. */
+  void StopBackgroundWriter();
+
+  /**
+   * @brief Run a single round of the background writer on the calling thread.
+   *
+   * Up to max_pages dirty pages that the replacer would evict next are pinned and copied under the latch, then
+   * submitted to the disk manager as one asynchronous batch of writes in page id order. The latch is not held while
+   * they are in flight, so fetches and unpins of other pages are not blocked by the I/O. At most half of the evictable
+   * frames are taken at once, leaving the rest to foreground operations. Pages whose latest log record has not been
+   * flushed yet are skipped. The pages stay dirty until their writes complete, and only become clean if their write
+   * succeeded and they weren't marked dirty again meanwhile. FlushPage() and FlushAllPages() wait for the writes in
+   * flight, so that an outdated copy never lands on top of theirs.
+   *
+   * @param max_pages the maximum number of pages to write
+   * @return the number of pages written
+   */
+  auto CleanDirtyPages(size_t max_pages) -> size_t;
+
+  /** @return the number of pages written back by foreground operations (eviction, flush and delete) */
+  auto GetForegroundWriteCount() const -> size_t { return num_foreground_writes_; }
+
+  /** @return the number of pages written back by the background writer */
+  auto GetBackgroundWriteCount() const -> size_t { return num_background_writes_; }
+
+  /** @return the number of pages read by prefetches */
+  auto GetPrefetchReadCount() const -> size_t { return num_prefetch_reads_; }
+
+  /** @return the compressed cache below the buffer pool, nullptr if it has none */
+  auto GetCompressedCache() -> CompressedPageCache * { return compressed_cache_; }
+
+  /** @brief Take a snapshot of the counters and latency histograms of this buffer pool. */
+  auto GetStats() -> BufferPoolStats override;
+
+  /** @brief Snapshot the dirty page table, see BufferPoolManager::GetDirtyPageTable(). */
+  auto GetDirtyPageTable() -> std::vector<std::pair<page_id_t, lsn_t>> override;
+
  protected:
-  auto GetAvailableFrame(frame_id_t *out_frame_id) -> bool;
+  /**
+   * @brief Find a frame to hold a new page. Caller should acquire the latch before calling this function.
+   *
+   * With a strategy, the frame its ring used furthest in the past is recycled if possible. Otherwise the frame comes
+   * from the free list first and from the replacer second. A dirty victim is written back to disk.
+   *
+   * @param[out] out_frame_id the frame that was found
+   * @param strategy the access strategy of the calling operation, may be nullptr
+   * @return false if every frame is pinned, true otherwise
+   */
+  auto GetAvailableFrame(frame_id_t *out_frame_id, BufferAccessStrategy *strategy = nullptr) -> bool;
+
+  /**
+   * @brief Try to recycle the current frame of the strategy's ring. Caller should acquire the latch before calling
+   * this function.
+   * @param strategy the access strategy of the calling operation
+   * @param[out] out_frame_id the recycled frame
+   * @return false if the ring slot is empty, or its frame was pinned or reused by another page in the meantime
+   */
+  auto GetRingFrame(BufferAccessStrategy *strategy, frame_id_t *out_frame_id) -> bool;
+
+  /**
+   * @brief Write the page held by the frame back to disk if it is dirty and drop it from the page table. Caller should
+   * acquire the latch before calling this function.
+   * @param frame_id the frame to evict
+   * @param keep_compressed whether to add the page to the compressed cache, if there is one
+   */
+  void EvictFrame(frame_id_t frame_id, bool keep_compressed = true);
   /**
    * TODO(P1): Add implementation
    *
@@ -91,6 +200,30 @@ class BufferPoolManagerInstance : public BufferPoolManager {
    */
   auto FetchPgImp(page_id_t page_id) -> Page * override;
 
+  /**
+   * @brief Same as NewPgImp(), but a frame from the strategy's ring is recycled before the free list and the replacer
+   * are consulted, and the new page becomes part of the ring. The disk manager places the page close to the hint.
+   */
+  auto NewPgWithStrategyImp(page_id_t *page_id, BufferAccessStrategy *strategy, page_id_t hint) -> Page * override;
+
+  /**
+   * @brief Same as FetchPgImp(), but on a miss a frame from the strategy's ring is recycled before the free list and
+   * the replacer are consulted, and the fetched page becomes part of the ring. Hits leave the ring unchanged.
+   */
+  auto FetchPgWithStrategyImp(page_id_t page_id, BufferAccessStrategy *strategy) -> Page * override;
+
+  /**
+   * @brief Reserve a frame for every page that is not resident yet, and submit their reads to the disk manager as one
+   * asynchronous batch. A reserved frame is pinned, and its version stays odd, until the read has completed.
+   */
+  void PrefetchImp(const std::vector<page_id_t> &page_ids, BufferAccessStrategy *strategy) override;
+
+  /**
+   * @brief Find the frame of a resident page without taking the latch. The frame is looked up in frame_hints_ first
+   * and in the page table, which has its own latch, second.
+   */
+  auto OptimisticReadImp(page_id_t page_id, uint64_t *version) -> const Page * override;
+
   /**
    * TODO(P1): Add implementation
    *
@@ -111,11 +244,11 @@ class BufferPoolManagerInstance : public BufferPoolManager {
    *
    * @brief Flush the target page to disk.
    *
-   * Use the DiskManager::WritePage() method to flush a page to disk, REGARDLESS of the dirty flag.
-   * Unset the dirty flag of the page after flushing.
+   * Use the DiskManager::WritePage() method to flush a page to disk, and unset the dirty flag of the page after
+   * flushing. A clean page is skipped unless it is pinned, its holders may not have reported their changes yet.
    *
    * @param page_id id of page to be flushed, cannot be INVALID_PAGE_ID
-   * @return false if the page could not be found in the page table, true otherwise
+   * @return false if the page could not be found in the page table or the pool is read-only, true otherwise
    */
   auto FlushPgImp(page_id_t page_id) -> bool override;
 
@@ -129,53 +262,159 @@ class BufferPoolManagerInstance : public BufferPoolManager {
   /**
    * TODO(P1): Add implementation
    *
-   * @brief Delete a page from the buffer pool. If page_id is not in the buffer pool, do nothing and return true. If the
-   * page is pinned and cannot be deleted, return false immediately.
+   * @brief Delete a page from the buffer pool and deallocate it on disk. If page_id is not in the buffer pool, only
+   * deallocate it and return true. If the page is pinned and cannot be deleted, return false immediately.
    *
    * After deleting the page from the page table, stop tracking the frame in the replacer and add the frame
-   * back to the free list. Also, reset the page's memory and metadata. Finally, you should call DeallocatePage() to
-   * imitate freeing the page on the disk.
+   * back to the free list. Also, reset the page's memory and metadata, without writing a dirty page back. Finally,
+   * call DeallocatePage() so that the page id can be reused.
+   *
+   * The free page map is written through and not logged, so the log is made durable up to the last record appended
+   * first: the change that stopped using the page, e.g. a B+ tree merge, must survive a crash if the deallocation
+   * does, or the page could be handed out again while the tree on disk still points to it.
    *
    * @param page_id id of page to be deleted
    * @return false if the page exists but could not be deleted, true if the page didn't exist or deletion succeeded
    */
   auto DeletePgImp(page_id_t page_id) -> bool override;
 
-  /** Number of pages in the buffer pool. */
-  const size_t pool_size_;
-  /** The next page id to be allocated  */
-  std::atomic<page_id_t> next_page_id_ = 0;
+  /** Number of pages in the buffer pool. Only changed by Resize(), while holding the latch. */
+  std::atomic<size_t> pool_size_;
+  /** The largest number of pages the buffer pool can hold, frames are reserved for all of them. */
+  const size_t max_pool_size_;
+  /** Frames whose descriptors have been constructed, the ones of a shrunk pool are kept around for growing again. */
+  size_t num_constructed_frames_;
+  /** Serializes Resize() calls. Taken before latch_. */
+  std::mutex resize_latch_;
+  /** Frames drained while holding the latch once, when shrinking the pool. */
+  static constexpr size_t RESIZE_BATCH_FRAMES = 64;
   /** Bucket size for the extendible hash table */
   const size_t bucket_size_ = 4;
 
-  /** Array of buffer pool pages. */
+  /** Array of buffer pool pages, the descriptors of the frames. */
   Page *pages_;
+  /** The data of all frames, frame i is described by pages_[i]. */
+  FrameArena *frame_arena_;
+  /** Second cache tier holding evicted pages compressed, nullptr if disabled. */
+  CompressedPageCache *compressed_cache_{nullptr};
   /** Pointer to the disk manager. */
-  DiskManager *disk_manager_ __attribute__((__unused__));
-  /** Pointer to the log manager. Please ignore this for P1. */
-  LogManager *log_manager_ __attribute__((__unused__));
+  DiskManager *disk_manager_;
+  /** Pointer to the log manager, nullptr if the pool runs without logging. */
+  LogManager *log_manager_;
   /** Page table for keeping track of buffer pool pages. */
   ExtendibleHashTable<page_id_t, frame_id_t> *page_table_;
   /** Replacer to find unpinned pages for replacement. */
   LRUKReplacer *replacer_;
+  /**
+   * The frame a page was last seen in, at slot page id % max pool size. Only a hint for optimistic reads, which check
+   * the page id of the frame anyway, so it is written without the latch and never cleared.
+   */
+  std::atomic<frame_id_t> *frame_hints_;
   /** List of free frames that don't have any pages on them. */
   std::list<frame_id_t> free_list_;
   /** This latch protects shared data structures. We recommend updating this comment to describe what it protects. */
   std::mutex latch_;
 
   /**
-   * @brief Allocate a page on disk. Caller should acquire the latch before calling this function.
+   * @brief Acquire the latch, counting the acquisitions that have to wait for it and how long they wait.
+   * @return the lock holding the latch
+   */
+  auto LockLatch() -> std::unique_lock<std::mutex>;
+
+  /**
+   * @brief The recLSN of a page that matches its copy on disk from now on. Caller should acquire the latch.
+   *
+   * Records that change an unpinned page are appended after it is pinned, so the next LSN will do. Whoever holds a
+   * pinned page may have appended a record without applying it yet, but only after the last one applied.
+   */
+  auto CleanRecLSN(Page *page) -> lsn_t;
+
+  /**
+   * @brief Write-ahead logging: make the log durable up to the LSN of a page before the page is written back. The
+   * background writer skips such pages instead, foreground write-backs can't wait for a later round.
+   * @throws Exception of type IO if the log can't be written anymore, the page must stay dirty then
+   */
+  void FlushLogUntil(lsn_t lsn);
+
+  /** @brief Read a page from disk, recording the latency of the read. */
+  void ReadFromDisk(page_id_t page_id, char *data);
+
+  /**
+   * @brief Point a frame at the page as mapped by the disk manager, or back at the frame's own memory if the page is
+   * not mapped. Caller should hold the frame exclusively.
+   * @return true if the frame shows the mapped page now, and needs no read
+   */
+  auto BindMappedPage(frame_id_t frame_id, page_id_t page_id) -> bool;
+
+  /** @brief Read a page from the compressed cache if it holds the page, and from disk otherwise. */
+  void LoadPage(page_id_t page_id, char *data);
+
+  /** @brief Write a page to disk, recording the latency of the write. */
+  void WriteToDisk(page_id_t page_id, const char *data);
+
+  /** @brief Write a batch of pages to disk with DiskManager::WritePages(), recording the latency of the batch. */
+  void WritePagesToDisk(std::vector<std::pair<page_id_t, const char *>> pages);
+
+  // counters reported by GetStats(), atomic so that taking a snapshot never takes the latch
+  std::atomic<uint64_t> num_hits_{0};
+  std::atomic<uint64_t> num_misses_{0};
+  std::atomic<uint64_t> num_fetch_failures_{0};
+  std::atomic<uint64_t> num_new_page_failures_{0};
+  std::atomic<uint64_t> num_evictions_{0};
+  std::atomic<uint64_t> num_dirty_writebacks_{0};
+  std::atomic<uint64_t> num_compressed_hits_{0};
+  std::atomic<uint64_t> num_compressed_stores_{0};
+  std::atomic<uint64_t> num_latch_waits_{0};
+  std::atomic<uint64_t> latch_wait_nanos_{0};
+  LatencyHistogram read_latency_;
+  LatencyHistogram write_latency_;
+
+  /** Pages written back by foreground operations. */
+  std::atomic<size_t> num_foreground_writes_{0};
+  /** Pages written back by the background writer. */
+  std::atomic<size_t> num_background_writes_{0};
+
+  /** The background writer thread, nullptr if it is not running. */
+  std::thread *bg_writer_thread_{nullptr};
+  /** True while the background writer should keep running. Protected by bg_writer_latch_. */
+  bool bg_writer_running_{false};
+  /** Protects the background writer state, never held together with latch_. */
+  std::mutex bg_writer_latch_;
+  /** Wakes up the background writer when it has to stop. */
+  std::condition_variable bg_writer_cv_;
+  /** Pages CleanDirtyPages() is writing back, see Page::write_pending_. Protected by latch_. */
+  size_t num_pending_writes_{0};
+
+  /** @brief Main loop of the background writer thread. */
+  void BackgroundWriterLoop();
+
+  /** Pages read by prefetches. */
+  std::atomic<size_t> num_prefetch_reads_{0};
+  /** Prefetch reads submitted to the disk manager that have not completed yet. Protected by latch_. */
+  size_t num_pending_reads_{0};
+  /**
+   * Wakes up fetches waiting for a prefetch to complete, and the destructor waiting for the last one. Also wakes up
+   * flushes waiting for the background writer.
+   */
+  std::condition_variable io_done_cv_;
+
+  /** @brief Finish the prefetch of the page read into the frame, unpinning it. */
+  void CompletePrefetch(frame_id_t frame_id);
+
+  /**
+   * @brief Allocate a page on disk, reusing a deallocated page if there is one. Caller should acquire the latch before
+   * calling this function.
+   * @param hint a page the new page should be placed close to, INVALID_PAGE_ID for none
    * @return the id of the allocated page
    */
-  auto AllocatePage() -> page_id_t;
+  auto AllocatePage(page_id_t hint = INVALID_PAGE_ID) -> page_id_t { return disk_manager_->AllocatePage(hint); }
 
   /**
-   * @brief Deallocate a page on disk. Caller should acquire the latch before calling this function.
+   * @brief Deallocate a page on disk, so that its id can be reused. Caller should acquire the latch before calling
+   * this function.
    * @param page_id id of the page to deallocate
    */
-  void DeallocatePage(__attribute__((unused)) page_id_t page_id) {
-    // This is a no-nop right now without a more complex data structure to track deallocated pages
-  }
+  void DeallocatePage(page_id_t page_id) { disk_manager_->DeallocatePage(page_id); }
 
   // TODO(student): You may add additional private members and helper functions
 };
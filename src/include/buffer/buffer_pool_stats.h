@@ -0,0 +1,80 @@
+//===----------------------------------------------------------------------===//
+//
+//                         BusTub
+//
+// buffer_pool_stats.h
+//
+// Identification: src/include/buffer/buffer_pool_stats.h
+//
+// Copyright (c) 2015-2022, Carnegie Mellon University Database Group
+//
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include <cstdint>
+
+#include "common/latency_histogram.h"
+
+namespace bustub {
+
+/**
+ * BufferPoolStats is a snapshot of the counters of a buffer pool. The counters only ever grow, so subtracting an
+ * earlier snapshot yields what happened in between, e.g. during a benchmark.
+ */
+struct BufferPoolStats {
+  /** Fetches of a page that was resident. */
+  uint64_t hits_{0};
+  /** Fetches of a page that had to be read from disk, prefetches not included. */
+  uint64_t misses_{0};
+  /** Fetches that failed because every frame was pinned. */
+  uint64_t fetch_failures_{0};
+  /** New pages that could not be created because every frame was pinned. */
+  uint64_t new_page_failures_{0};
+  /** Frames taken away from the page they held to hold another one. */
+  uint64_t evictions_{0};
+  /** Evicted pages that were dirty, and had to be written back by the operation that needed the frame. */
+  uint64_t dirty_writebacks_{0};
+  /** Pages written back by the background writer. */
+  uint64_t background_writes_{0};
+  /** Pages read by prefetches. */
+  uint64_t prefetch_reads_{0};
+  /** Misses and prefetches served by the compressed cache instead of the disk. */
+  uint64_t compressed_hits_{0};
+  /** Evicted pages added to the compressed cache. */
+  uint64_t compressed_stores_{0};
+  /** Acquisitions of the buffer pool latch that had to wait for it, and the time they waited in nanoseconds. */
+  uint64_t latch_waits_{0};
+  uint64_t latch_wait_nanos_{0};
+  /** Latencies of the page reads and writes the buffer pool issued to the disk manager. */
+  LatencyHistogram read_latency_;
+  LatencyHistogram write_latency_;
+
+  /** @return the fraction of fetches that found the page resident, 0 if there were none */
+  auto HitRatio() const -> double {
+    uint64_t fetches = hits_ + misses_;
+    return fetches == 0 ? 0 : static_cast<double>(hits_) / static_cast<double>(fetches);
+  }
+
+  /** @return what happened between the earlier snapshot other and this one */
+  auto operator-(const BufferPoolStats &other) const -> BufferPoolStats {
+    BufferPoolStats diff;
+    diff.hits_ = hits_ - other.hits_;
+    diff.misses_ = misses_ - other.misses_;
+    diff.fetch_failures_ = fetch_failures_ - other.fetch_failures_;
+    diff.new_page_failures_ = new_page_failures_ - other.new_page_failures_;
+    diff.evictions_ = evictions_ - other.evictions_;
+    diff.dirty_writebacks_ = dirty_writebacks_ - other.dirty_writebacks_;
+    diff.background_writes_ = background_writes_ - other.background_writes_;
+    diff.prefetch_reads_ = prefetch_reads_ - other.prefetch_reads_;
+    diff.compressed_hits_ = compressed_hits_ - other.compressed_hits_;
+    diff.compressed_stores_ = compressed_stores_ - other.compressed_stores_;
+    diff.latch_waits_ = latch_waits_ - other.latch_waits_;
+    diff.latch_wait_nanos_ = latch_wait_nanos_ - other.latch_wait_nanos_;
+    diff.read_latency_ = read_latency_ - other.read_latency_;
+    diff.write_latency_ = write_latency_ - other.write_latency_;
+    return diff;
+  }
+};
+
+}  // namespace bustub
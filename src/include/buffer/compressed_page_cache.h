@@ -0,0 +1,94 @@
+//===----------------------------------------------------------------------===//
+//
+//                         BusTub
+//
+// compressed_page_cache.h
+//
+// Identification: src/include/buffer/compressed_page_cache.h
+//
+// Copyright (c) 2015-2022, Carnegie Mellon University Database Group
+//
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include <list>
+#include <memory>
+#include <mutex>  // NOLINT
+#include <unordered_map>
+
+#include "common/config.h"
+#include "common/macros.h"
+
+namespace bustub {
+
+/**
+ * CompressedPageCache is a second cache tier below the buffer pool. It holds pages evicted from the pool, compressed
+ * with LzCodec, so that fetching them again costs a decompression instead of a disk read. It only ever holds pages
+ * that are identical to their copy on disk, so a page can be dropped from it at any time.
+ *
+ * The cache is exclusive: a page is handed back to the pool with Take() and removed, and added again when the pool
+ * evicts it. The least recently added pages are dropped when the compressed pages exceed the capacity. Pages that
+ * compress to more than MAX_COMPRESSED_SIZE are not cached at all, their memory is better spent on the pool.
+ */
+class CompressedPageCache {
+ public:
+  /** Pages that don't compress to this size or smaller are not cached. */
+  static constexpr size_t MAX_COMPRESSED_SIZE = BUSTUB_PAGE_SIZE * 3 / 4;
+
+  /**
+   * @brief Create an empty cache.
+   * @param capacity the memory the compressed pages may take, in bytes
+   */
+  explicit CompressedPageCache(size_t capacity);
+
+  DISALLOW_COPY_AND_MOVE(CompressedPageCache);
+
+  /**
+   * @brief Compress and cache a page, replacing the version of it that was cached before.
+   * @param page_id the id of the page
+   * @param data the content of the page, identical to its copy on disk, BUSTUB_PAGE_SIZE bytes
+   * @return false if the page does not compress well enough to be cached, true otherwise
+   */
+  auto Insert(page_id_t page_id, const char *data) -> bool;
+
+  /**
+   * @brief Decompress a page and remove it from the cache.
+   * @param page_id the id of the page
+   * @param[out] data the content of the page, BUSTUB_PAGE_SIZE bytes
+   * @return false if the page is not cached, true otherwise
+   */
+  auto Take(page_id_t page_id, char *data) -> bool;
+
+  /** @brief Remove a page from the cache, e.g. because it was deleted. No-op if it is not cached. */
+  void Remove(page_id_t page_id);
+
+  /** @return the memory the compressed pages may take, in bytes */
+  auto GetCapacity() const -> size_t { return capacity_; }
+
+  /** @return the memory the compressed pages take, in bytes */
+  auto GetSize() -> size_t;
+
+  /** @return the number of cached pages */
+  auto GetNumPages() -> size_t;
+
+ private:
+  struct Entry {
+    page_id_t page_id_;
+    size_t size_;
+    std::unique_ptr<char[]> data_;
+  };
+
+  /** @brief Remove an entry. Caller should acquire the latch before calling this function. */
+  void RemoveEntry(std::list<Entry>::iterator it);
+
+  const size_t capacity_;
+  /** Cached pages, the most recently added first. */
+  std::list<Entry> entries_;
+  std::unordered_map<page_id_t, std::list<Entry>::iterator> index_;
+  /** The memory the compressed pages take, including the bookkeeping for each of them. */
+  size_t size_{0};
+  std::mutex latch_;
+};
+
+}  // namespace bustub
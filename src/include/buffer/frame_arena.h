@@ -0,0 +1,74 @@
+//===----------------------------------------------------------------------===//
+//
+//                         BusTub
+//
+// frame_arena.h
+//
+// Identification: src/include/buffer/frame_arena.h
+//
+// Copyright (c) 2015-2022, Carnegie Mellon University Database Group
+//
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include <cstddef>
+
+#include "common/config.h"
+#include "common/macros.h"
+
+namespace bustub {
+
+/**
+ * FrameArena holds the data of every frame of a buffer pool in a single anonymous memory mapping. Frame i starts at
+ * i * BUSTUB_PAGE_SIZE, so every frame is aligned to the page size, as direct I/O requires.
+ *
+ * The mapping is backed by huge pages when the system has some reserved. Otherwise it is aligned to the huge page
+ * size and transparent huge pages are requested for it, so that a large pool needs few TLB entries either way.
+ *
+ * An arena for a pool that may grow reserves address space for the largest size up front, so frames never move.
+ * Memory is only committed when a frame is first touched, and can be given back with Release().
+ */
+class FrameArena {
+ public:
+  /**
+   * @brief Map zeroed memory for the given number of frames.
+   * @param num_frames the number of frames
+   * @param max_frames the number of frames the arena may have to hold later on, no more than num_frames if the pool
+   * never grows. Explicitly reserved huge pages are only used in that case, since they are committed right away.
+   * @throws Exception OUT_OF_MEMORY if the memory can't be mapped
+   */
+  explicit FrameArena(size_t num_frames, size_t max_frames = 0);
+
+  /** @brief Unmap the memory of all frames. */
+  ~FrameArena();
+
+  DISALLOW_COPY_AND_MOVE(FrameArena);
+
+  /** @return the data of the given frame, BUSTUB_PAGE_SIZE bytes */
+  auto FrameData(frame_id_t frame_id) -> char * { return base_ + static_cast<size_t>(frame_id) * BUSTUB_PAGE_SIZE; }
+
+  /** @return the number of frames the arena can hold */
+  auto GetNumFrames() const -> size_t { return num_frames_; }
+
+  /**
+   * @brief Give the memory of the given frames back to the system. The frames stay mapped, and read as zeroes once
+   * they are touched again.
+   * @param first_frame_id the first frame to release
+   * @param num_frames the number of frames to release
+   */
+  void Release(frame_id_t first_frame_id, size_t num_frames);
+
+  /** @return true if the arena is backed by explicitly reserved huge pages */
+  auto IsHugePageBacked() const -> bool { return huge_pages_; }
+
+ private:
+  /** Start of the frame memory. */
+  char *base_{nullptr};
+  /** Number of bytes mapped at base_. */
+  size_t mapped_size_{0};
+  size_t num_frames_;
+  bool huge_pages_{false};
+};
+
+}  // namespace bustub
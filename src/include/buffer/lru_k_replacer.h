@@ -132,6 +132,24 @@ class LRUKReplacer {
    */
   auto Size() -> size_t;
 
+  /**
+   * @brief Peek at the frames the replacer would evict next, without evicting them.
+   *
+   * The frames are returned in the order Evict() would pick them, so callers such as the background writer can
+   * prepare them for eviction ahead of time.
+   *
+   * @param max_frames the maximum number of frames to return
+   * @return up to max_frames evictable frames, next victim first
+   */
+  auto EvictionCandidates(size_t max_frames) -> std::vector<frame_id_t>;
+
+  /**
+   * @brief Change the number of frames the replacer may be asked to track, when the buffer pool is resized. The
+   * frames past a smaller size must have been removed already.
+   * @param num_frames the new maximum number of frames
+   */
+  void Resize(size_t num_frames);
+
  private:
   class Frame {
    public:
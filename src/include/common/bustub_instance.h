@@ -22,17 +22,18 @@
 #include <utility>
 #include <vector>
 
+#include "buffer/buffer_pool_stats.h"
 #include "catalog/catalog.h"
 #include "common/config.h"
 #include "common/util/string_util.h"
 #include "libfort/lib/fort.hpp"
+#include "storage/disk/disk_manager.h"
 #include "type/value.h"
 
 namespace bustub {
 
 class Transaction;
 class ExecutorContext;
-class DiskManager;
 class BufferPoolManager;
 class LockManager;
 class TransactionManager;
@@ -211,7 +212,12 @@ class BustubInstance {
   auto MakeExecutorContext(Transaction *txn) -> std::unique_ptr<ExecutorContext>;
 
  public:
-  explicit BustubInstance(const std::string &db_file_name);
+  /**
+   * Open a file-backed database.
+   * @param db_file_name the database file
+   * @param disk_options how the database file is opened and synced, e.g. with direct I/O
+   */
+  explicit BustubInstance(const std::string &db_file_name, const DiskManagerOptions &disk_options = {});
 
   BustubInstance();
 
@@ -254,6 +260,12 @@ class BustubInstance {
   ExecutionEngine *execution_engine_;
   std::shared_mutex catalog_lock_;
 
+  /**
+   * Get a snapshot of the counters and latency histograms of the buffer pool. Subtract an earlier snapshot to get the
+   * activity in between, e.g. of a benchmark run.
+   */
+  auto GetBufferPoolStats() -> BufferPoolStats;
+
   auto GetSessionVariable(const std::string &key) -> std::string {
     if (session_variables_.find(key) != session_variables_.end()) {
       return session_variables_[key];
@@ -270,8 +282,11 @@ class BustubInstance {
   void CmdDisplayTables(ResultWriter &writer);
   void CmdDisplayIndices(ResultWriter &writer);
   void CmdDisplayHelp(ResultWriter &writer);
+  void CmdDisplayBufferPoolStats(const std::vector<std::string> &args, ResultWriter &writer);
   void WriteOneCell(const std::string &cell, ResultWriter &writer);
   std::unordered_map<std::string, std::string> session_variables_;
+  /** The buffer pool stats at the last `\bpstats snapshot`, what `\bpstats diff` is relative to. */
+  BufferPoolStats bp_stats_snapshot_;
 };
 
 }  // namespace bustub
@@ -27,6 +27,9 @@ extern std::atomic<bool> enable_logging;
 /** If ENABLE_LOGGING is true, the log should be flushed to disk every LOG_TIMEOUT. */
 extern std::chrono::duration<int64_t> log_timeout;
 
+/** The background writer of a buffer pool wakes up every BG_WRITER_DELAY to clean dirty pages. */
+extern std::chrono::milliseconds bg_writer_delay;
+
 static constexpr int INVALID_PAGE_ID = -1;                                           // invalid page id
 static constexpr int INVALID_TXN_ID = -1;                                            // invalid transaction id
 static constexpr int INVALID_LSN = -1;                                               // invalid log sequence number
@@ -36,11 +39,26 @@ static constexpr int BUFFER_POOL_SIZE = 10;
 static constexpr int LOG_BUFFER_SIZE = ((BUFFER_POOL_SIZE + 1) * BUSTUB_PAGE_SIZE);  // size of a log buffer in byte
 static constexpr int BUCKET_SIZE = 50;                                               // size of extendible hash bucket
 static constexpr int LRUK_REPLACER_K = 10;  // lookback window for lru-k replacer
+static constexpr int INVALID_FRAME_ID = -1;                                          // invalid frame id
+static constexpr int BULKREAD_RING_SIZE = 256 * 1024 / BUSTUB_PAGE_SIZE;             // frames in a sequential scan ring
+static constexpr int BULKWRITE_RING_SIZE = 16 * 1024 * 1024 / BUSTUB_PAGE_SIZE;      // frames in a bulk insert ring
+static constexpr int BG_WRITER_MAX_PAGES = 32;                                       // pages cleaned per writer round
+static constexpr int BUSTUB_HUGE_PAGE_SIZE = 2 * 1024 * 1024;                       // huge page backing frame memory
+static constexpr int BUSTUB_CACHELINE_SIZE = 64;                                     // frame descriptor alignment
+static constexpr int DISK_MANAGER_IO_THREADS = 4;                                    // threads serving async page I/O
+static constexpr int DISK_MANAGER_URING_DEPTH = 64;                                  // io_uring requests in flight
+static constexpr size_t DISK_MANAGER_MAX_WRITEV_PAGES = 256;                         // pages per pwritev() call
+static constexpr int BUFFER_POOL_MAX_GROWTH = 4;                                     // default max / initial pool size
+static constexpr int LOG_GROUP_COMMIT_DELAY_US = 0;                                   // wait of a commit group leader
+static constexpr size_t LOG_GROUP_COMMIT_MAX_BATCH = 64;                             // commits that cut the wait short
+static constexpr size_t LOG_SEGMENT_SIZE = 16 * 1024 * 1024;                         // bytes per log segment file
+static constexpr bool LOG_COMPRESSION = false;                                       // compress flushed log blocks
+static constexpr size_t RECOVERY_REDO_WORKERS = 4;                                   // threads redoing, undoing the log
 
 using frame_id_t = int32_t;    // frame id type
 using page_id_t = int32_t;     // page id type
 using txn_id_t = int32_t;      // transaction id type
-using lsn_t = int32_t;         // log sequence number type
+using lsn_t = int64_t;         // log sequence number type
 using slot_offset_t = size_t;  // slot offset type
 using oid_t = uint16_t;
 
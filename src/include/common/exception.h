@@ -49,6 +49,10 @@ enum class ExceptionType {
   NOT_IMPLEMENTED = 11,
   /** Execution exception. */
   EXECUTION = 12,
+  /** Data on disk in a layout this version does not read. */
+  INCOMPATIBLE_LAYOUT = 13,
+  /** A read or write the system can't go on without failed. */
+  IO = 14,
 };
 
 class Exception : public std::runtime_error {
@@ -104,6 +108,10 @@ class Exception : public std::runtime_error {
         return "Out of Memory";
       case ExceptionType::NOT_IMPLEMENTED:
         return "Not implemented";
+      case ExceptionType::INCOMPATIBLE_LAYOUT:
+        return "Incompatible layout";
+      case ExceptionType::IO:
+        return "I/O";
       default:
         return "Unknown";
     }
@@ -0,0 +1,78 @@
+//===----------------------------------------------------------------------===//
+//
+//                         BusTub
+//
+// latency_histogram.h
+//
+// Identification: src/include/common/latency_histogram.h
+//
+// Copyright (c) 2015-2022, Carnegie Mellon University Database Group
+//
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace bustub {
+
+/**
+ * LatencyHistogram counts latencies, in nanoseconds, in HDR-style log-linear buckets: every power of two is split into
+ * SUB_BUCKETS buckets of equal width, so the value reported for a percentile is within 1 / SUB_BUCKETS of the recorded
+ * one, at any magnitude, with a fixed amount of memory.
+ *
+ * Recording is a single relaxed atomic increment and may happen from any number of threads. Copying a histogram takes
+ * a snapshot of it, and subtracting an earlier snapshot leaves the latencies recorded in between.
+ */
+class LatencyHistogram {
+ public:
+  /** log2 of the number of buckets every power of two is split into. */
+  static constexpr int SUB_BUCKET_BITS = 5;
+  static constexpr uint64_t SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+  /** Latencies are tracked up to 2^MAX_VALUE_BITS ns, about 18 minutes. Larger ones count as that. */
+  static constexpr int MAX_VALUE_BITS = 40;
+  static constexpr size_t NUM_BUCKETS = (MAX_VALUE_BITS - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+  LatencyHistogram() = default;
+  LatencyHistogram(const LatencyHistogram &other);
+  auto operator=(const LatencyHistogram &other) -> LatencyHistogram &;
+
+  /** @brief Record one latency. */
+  void Record(uint64_t nanos);
+
+  /** @return the latencies recorded in this histogram, but not in the earlier snapshot other */
+  auto operator-(const LatencyHistogram &other) const -> LatencyHistogram;
+
+  /** @return the number of recorded latencies */
+  auto Count() const -> uint64_t;
+
+  /** @return the mean of the recorded latencies in nanoseconds, 0 if there are none */
+  auto Mean() const -> double;
+
+  /**
+   * @param percentile the percentile, between 0 and 100
+   * @return the highest latency, in nanoseconds, that is equivalent to the one at the given percentile, 0 if nothing
+   * was recorded
+   */
+  auto ValueAtPercentile(double percentile) const -> uint64_t;
+
+  /** @return the highest latency that is equivalent to the largest recorded one, 0 if nothing was recorded */
+  auto Max() const -> uint64_t;
+
+  /** @return the bucket a latency is counted in */
+  static auto BucketIndex(uint64_t nanos) -> size_t;
+
+  /** @return the smallest and the largest latency that are counted in the given bucket */
+  static auto BucketLowerBound(size_t index) -> uint64_t;
+  static auto BucketUpperBound(size_t index) -> uint64_t;
+
+ private:
+  std::array<std::atomic<uint64_t>, NUM_BUCKETS> counts_{};
+  /** Sum of the recorded latencies, for the mean. */
+  std::atomic<uint64_t> sum_{0};
+};
+
+}  // namespace bustub
@@ -0,0 +1,43 @@
+//===----------------------------------------------------------------------===//
+//
+//                         BusTub
+//
+// crc32c.h
+//
+// Identification: src/include/common/util/crc32c.h
+//
+// Copyright (c) 2015-2022, Carnegie Mellon University Database Group
+//
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace bustub {
+
+/**
+ * Crc32c computes the CRC-32C (Castagnoli) checksum, the one of iSCSI and of the SSE4.2 crc32 instruction. The
+ * instruction is used where the CPU has it, eight bytes at a time, and a table-driven implementation elsewhere. Both
+ * give the same result.
+ */
+class Crc32c {
+ public:
+  /**
+   * @brief Checksum data, or extend the checksum of the data before it.
+   * @param data the data to checksum
+   * @param size the size of the data
+   * @param crc the checksum of the preceding data, 0 if there is none
+   * @return the checksum of the preceding data followed by data
+   */
+  static auto Extend(uint32_t crc, const char *data, size_t size) -> uint32_t;
+
+  /** @return the checksum of data */
+  static auto Value(const char *data, size_t size) -> uint32_t { return Extend(0, data, size); }
+
+  /** @return true if the checksum is computed with the SSE4.2 crc32 instruction */
+  static auto IsHardwareAccelerated() -> bool;
+};
+
+}  // namespace bustub
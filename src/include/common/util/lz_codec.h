@@ -0,0 +1,72 @@
+//===----------------------------------------------------------------------===//
+//
+//                         BusTub
+//
+// lz_codec.h
+//
+// Identification: src/include/common/util/lz_codec.h
+//
+// Copyright (c) 2015-2022, Carnegie Mellon University Database Group
+//
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace bustub {
+
+/**
+ * LzCodec is a fast LZ77 compressor, in the spirit of the LZ4 block format. It trades ratio for speed, so that
+ * compressing a page costs a few microseconds.
+ *
+ * The output is a series of sequences. Each starts with a token byte: the high nibble is the number of literals and
+ * the low nibble the match length minus MIN_MATCH, a nibble of 15 is continued by bytes that are added to it until one
+ * is below 255. Then come the literals and the little endian two byte offset of the match. The last sequence has
+ * literals only.
+ */
+class LzCodec {
+ public:
+  /** Matches are at least this long. */
+  static constexpr size_t MIN_MATCH = 4;
+  /** The largest distance a match can be copied from. */
+  static constexpr size_t MAX_OFFSET = 65535;
+
+  /** @return the size of the buffer compressing size bytes may need, for input that does not compress at all */
+  static constexpr auto MaxCompressedSize(size_t size) -> size_t { return size + size / 255 + 16; }
+
+  /**
+   * @brief Compress src into dst.
+   * @param src the data to compress
+   * @param src_size the size of the data
+   * @param[out] dst the buffer to compress into
+   * @param dst_capacity the size of dst
+   * @return the size of the compressed data, 0 if it does not fit into dst
+   */
+  static auto Compress(const char *src, size_t src_size, char *dst, size_t dst_capacity) -> size_t;
+
+  /**
+   * @brief Decompress src into dst. Malformed input is detected rather than read or written out of bounds.
+   * @param src the compressed data
+   * @param src_size the size of the compressed data
+   * @param[out] dst the buffer to decompress into
+   * @param dst_capacity the size of dst
+   * @return the size of the decompressed data, 0 if src is malformed or does not fit into dst
+   */
+  static auto Decompress(const char *src, size_t src_size, char *dst, size_t dst_capacity) -> size_t;
+
+ private:
+  /** log2 of the number of slots in the table of recent positions the compressor looks for matches in. */
+  static constexpr int HASH_BITS = 12;
+  /** Matches end at least this many bytes before the end of the input, the rest is literals as in LZ4. */
+  static constexpr size_t LAST_LITERALS = 5;
+  /** No match starts this close to the end of the input. */
+  static constexpr size_t MATCH_FIND_LIMIT = 12;
+  /** The compressor skips ahead faster, the longer it has not found a match, once every 2^SKIP_SHIFT bytes. */
+  static constexpr int SKIP_SHIFT = 6;
+
+  static auto Hash(uint32_t sequence) -> uint32_t { return (sequence * 2654435761U) >> (32 - HASH_BITS); }
+};
+
+}  // namespace bustub
@@ -16,6 +16,8 @@
 #include <shared_mutex>
 #include <unordered_map>
 #include <unordered_set>
+#include <utility>
+#include <vector>
 
 #include "common/config.h"
 #include "concurrency/lock_manager.h"
@@ -47,6 +49,7 @@ class TransactionManager {
   /**
    * Commits a transaction.
    * @param txn the transaction to commit
+   * @throws Exception of type IO if its commit record can't be made durable, the commit is not acknowledged then
    */
   void Commit(Transaction *txn);
 
@@ -77,6 +80,18 @@ class TransactionManager {
     return res;
   }
 
+  /**
+   * Append the BEGIN_CHECKPOINT record of a fuzzy checkpoint. It holds the active transaction table, i.e. the last
+   * LSN of every transaction that has logged its BEGIN record but not its COMMIT or ABORT. Transactions keep running,
+   * but none begins or ends while the table is taken and the record appended, so the table is exact as of the record.
+   * @param dirty_pages the dirty page table to log along with it
+   * @param dirty_pages_lsn the next LSN when the dirty page table was taken, logged as the record's prevLSN
+   * @param[out] min_first_lsn the LSN of the oldest BEGIN record among the active transactions, INVALID_LSN if none
+   * @return the LSN of the BEGIN_CHECKPOINT record
+   */
+  auto LogBeginCheckpoint(std::vector<std::pair<page_id_t, lsn_t>> dirty_pages, lsn_t dirty_pages_lsn,
+                          lsn_t *min_first_lsn) -> lsn_t;
+
   /** Prevents all transactions from performing operations, used for checkpointing. */
   void BlockAllTransactions();
 
@@ -84,6 +99,13 @@ class TransactionManager {
   void ResumeTransactions();
 
  private:
+  /**
+   * Take a transaction out of the active transaction table, and append its COMMIT or ABORT record at the same time.
+   * @param type COMMIT or ABORT, INVALID if logging is disabled
+   * @return the LSN of the record, INVALID_LSN if none was appended
+   */
+  auto LogTransactionEnd(Transaction *txn, LogRecordType type) -> lsn_t;
+
   /**
    * Releases all the locks held by the given transaction.
    * @param txn the transaction whose locks should be released
@@ -140,6 +162,11 @@ class TransactionManager {
 
   /** The global transaction latch is used for checkpointing. */
   ReaderWriterLatch global_txn_latch_;
+
+  /** Transactions between their BEGIN and COMMIT or ABORT records, with the LSN of the BEGIN record. */
+  std::unordered_map<txn_id_t, std::pair<Transaction *, lsn_t>> active_txns_;
+  /** Protects active_txns_. */
+  std::mutex active_txns_latch_;
 };
 
 }  // namespace bustub
@@ -12,8 +12,11 @@
 
 #pragma once
 
+#include <memory>
+#include <optional>
 #include <vector>
 
+#include "buffer/buffer_access_strategy.h"
 #include "execution/executor_context.h"
 #include "execution/executors/abstract_executor.h"
 #include "execution/plans/seq_scan_plan.h"
@@ -50,5 +53,11 @@ class SeqScanExecutor : public AbstractExecutor {
  private:
   /** The sequential scan plan node to be executed */
   const SeqScanPlanNode *plan_;
+  /** The table being scanned */
+  const TableInfo *table_info_{nullptr};
+  /** Ring of frames used when the table is too large to be scanned through the shared buffer pool */
+  std::unique_ptr<BufferAccessStrategy> strategy_;
+  /** The current position of the scan */
+  std::optional<TableIterator> iter_;
 };
 }  // namespace bustub
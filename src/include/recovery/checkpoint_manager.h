@@ -19,7 +19,14 @@
 namespace bustub {
 
 /**
- * CheckpointManager creates consistent checkpoints by blocking all other transactions temporarily.
+ * CheckpointManager takes ARIES-style fuzzy checkpoints, without blocking transactions or flushing the buffer pool.
+ *
+ * BeginCheckpoint() logs a BEGIN_CHECKPOINT record holding the active transaction table and the dirty page table,
+ * with the recLSN of every dirty page. Transactions keep running, and the background writer keeps writing dirty pages
+ * back at its own pace. EndCheckpoint() logs the matching END_CHECKPOINT record and forces it to disk. Recovery takes
+ * the tables of the last complete checkpoint, scans forward from the BEGIN_CHECKPOINT record to bring them up to date,
+ * and starts redo at the smallest recLSN. Nothing before that, or before the first record of a transaction active at
+ * the checkpoint, is needed any more, so the log segments holding only such records are deleted at the end.
  */
 class CheckpointManager {
  public:
@@ -31,13 +38,21 @@ class CheckpointManager {
 
   ~CheckpointManager() = default;
 
+  /** Log the BEGIN_CHECKPOINT record with the active transaction table and the dirty page table. */
   void BeginCheckpoint();
+
+  /** Log the END_CHECKPOINT record, wait for it to be durable, and truncate the log recovery has no use for. */
   void EndCheckpoint();
 
  private:
-  TransactionManager *transaction_manager_ __attribute__((__unused__));
-  LogManager *log_manager_ __attribute__((__unused__));
-  BufferPoolManager *buffer_pool_manager_ __attribute__((__unused__));
+  TransactionManager *transaction_manager_;
+  LogManager *log_manager_;
+  BufferPoolManager *buffer_pool_manager_;
+
+  /** LSN of the BEGIN_CHECKPOINT record of the checkpoint in progress. */
+  lsn_t begin_lsn_{INVALID_LSN};
+  /** The first record recovery would need if the checkpoint in progress completes. */
+  lsn_t truncate_lsn_{INVALID_LSN};
 };
 
 }  // namespace bustub
@@ -0,0 +1,37 @@
+//===----------------------------------------------------------------------===//
+//
+//                         BusTub
+//
+// index_undo.h
+//
+// Identification: src/include/recovery/index_undo.h
+//
+// Copyright (c) 2015-2019, Carnegie Mellon University Database Group
+//
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include "concurrency/transaction.h"
+#include "recovery/log_record.h"
+
+namespace bustub {
+
+/**
+ * An index that rolls back its own INDEX_INSERT and INDEX_DELETE records after a crash. Recovery can't: the records
+ * name the leaf the entries were on back then, but splits and merges may have moved them since, and only the index
+ * knows how to compare keys to find them again.
+ */
+class IndexUndo {
+ public:
+  virtual ~IndexUndo() = default;
+
+  /**
+   * Look the entries of the record up by key and roll the change back, logging a CLR for the leaf it is made on.
+   * @param record an INDEX_INSERT or INDEX_DELETE record of this index
+   * @param transaction the transaction being rolled back, its prevLSN is the last record logged for it
+   */
+  virtual void UndoIndexChange(LogRecord *record, Transaction *transaction) = 0;
+};
+
+}  // namespace bustub
@@ -0,0 +1,67 @@
+//===----------------------------------------------------------------------===//
+//
+//                         BusTub
+//
+// log_block.h
+//
+// Identification: src/include/recovery/log_block.h
+//
+// Copyright (c) 2015-2019, Carnegie Mellon University Database Group
+//
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "common/config.h"
+#include "storage/disk/disk_manager.h"
+
+namespace bustub {
+
+/**
+ * The log is written as a sequence of blocks, one per flushed log buffer. A block is framed by a header, so that a
+ * block cut short by a crash in the middle of its write is told apart from a complete one:
+ * -------------------------------------------------------------------------------
+ * | checksum | stored_size | records_size | flags | first_lsn | payload ... |
+ * -------------------------------------------------------------------------------
+ * The payload is stored_size bytes, the records of the buffer, LzCodec compressed if flags has COMPRESSED, and
+ * records_size bytes once decompressed. first_lsn is the LSN of the first record. The checksum is the CRC-32C of the
+ * header after it and of the payload, so a block is intact only if all of it made it to disk.
+ */
+class LogBlock {
+ public:
+  /** Set in the flags of a block whose payload is compressed. */
+  static constexpr uint32_t COMPRESSED = 1;
+  static constexpr size_t HEADER_SIZE = 4 * sizeof(uint32_t) + sizeof(lsn_t);
+  /** @return the size of a block holding size bytes of records, compressed or not */
+  static constexpr auto MaxBlockSize(size_t size) -> size_t { return HEADER_SIZE + size; }
+
+  /**
+   * Frame records_size bytes of records at block + HEADER_SIZE as a block, by filling in the header in front of them.
+   * @return the size of the block
+   */
+  static auto Encode(char *block, size_t records_size, lsn_t first_lsn) -> size_t;
+
+  /**
+   * Frame records_size bytes of records at block + HEADER_SIZE as a block with a compressed payload, written to dest.
+   * @param dest room for MaxBlockSize(records_size) bytes
+   * @return the size of the block, 0 if the records do not compress, Encode() them as they are then
+   */
+  static auto EncodeCompressed(const char *block, size_t records_size, lsn_t first_lsn, char *dest) -> size_t;
+
+  /**
+   * Read the block at offset and check its framing.
+   * @param disk_manager the disk manager owning the log
+   * @param offset the log offset of the block
+   * @param[out] records the records of the block, decompressed
+   * @param[out] first_lsn the LSN of the first record
+   * @return the log offset of the next block, 0 if there is no intact block at offset, i.e. the log ends there, or
+   * with a torn write
+   */
+  static auto Read(DiskManager *disk_manager, size_t offset, std::vector<char> *records, lsn_t *first_lsn) -> size_t;
+};
+
+}  // namespace bustub
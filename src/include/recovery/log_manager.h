@@ -13,62 +13,220 @@
 #pragma once
 
 #include <algorithm>
+#include <atomic>
+#include <chrono>              // NOLINT
 #include <condition_variable>  // NOLINT
+#include <deque>
 #include <future>              // NOLINT
 #include <mutex>               // NOLINT
+#include <thread>              // NOLINT
+#include <utility>
 
+#include "recovery/log_block.h"
 #include "recovery/log_record.h"
 #include "storage/disk/disk_manager.h"
 
 namespace bustub {
 
 /**
- * LogManager maintains a separate thread that is awakened whenever the log buffer is full or whenever a timeout
+ * LogManager maintains a separate thread that is awakened whenever the log buffer is half full or whenever a timeout
  * happens. When the thread is awakened, the log buffer's content is written into the disk log file.
+ *
+ * Appending takes no latch. An appender reserves room for its record in the active log buffer with a single
+ * compare-and-swap on the buffer's state, which holds the bytes reserved and the number of records. The record's LSN
+ * is the LSN of the buffer's first record plus that number, so LSNs follow the order of the records in the buffer.
+ * Appenders then serialize their records in parallel, and add the bytes they copied to the buffer's fill count. The
+ * flusher seals the buffer, makes the other one active, and waits for the fill count to reach the bytes reserved
+ * before writing the sealed buffer out. Appenders only wait if the active buffer is full while the other one is still
+ * being written.
+ *
+ * Commits are flushed in groups. A committing transaction waits in FlushUntil() for its commit record to be durable.
+ * The first one to find no flush in progress becomes the leader: it optionally waits up to the group commit delay for
+ * more commits to join, switches the log buffers and writes and syncs everything appended so far. Everybody else is
+ * a follower and waits for the persistent LSN to pass its record, or to lead the next group once the current flush
+ * is done. Commits arriving during a flush thus pile up and share the next one, so the commit rate grows with the
+ * number of clients instead of being bounded by the latency of a single fdatasync().
+ *
+ * If writing or syncing the log fails, part of the block may have reached the log file, and recovery would stop at it
+ * and never read past it. The log manager then stops writing the log: the persistent LSN stays where it was, and the
+ * commits waiting for the failed flush, and every FlushUntil() after it, throw an Exception of type IO.
+ *
+ * Each buffer is written as one log block, framed by a header with a checksum, see LogBlock. The buffer keeps room for
+ * the header in front of its records, so that an uncompressed block is written from where the records are. With
+ * compression on, the records are compressed into a second area of the buffer, and written from there if they shrink.
  */
 class LogManager {
  public:
-  explicit LogManager(DiskManager *disk_manager)
-      : next_lsn_(0), persistent_lsn_(INVALID_LSN), disk_manager_(disk_manager) {
-    log_buffer_ = new char[LOG_BUFFER_SIZE];
-    flush_buffer_ = new char[LOG_BUFFER_SIZE];
+  /**
+   * @param disk_manager the disk manager owning the log file
+   * @param group_commit_delay how long a commit group leader waits for more commits before flushing, 0 for not at all
+   * @param group_commit_max_batch the number of waiting commits that ends the leader's wait early
+   * @param compress whether to compress the log blocks
+   */
+  explicit LogManager(DiskManager *disk_manager,
+                      std::chrono::microseconds group_commit_delay =
+                          std::chrono::microseconds(LOG_GROUP_COMMIT_DELAY_US),
+                      size_t group_commit_max_batch = LOG_GROUP_COMMIT_MAX_BATCH, bool compress = LOG_COMPRESSION)
+      : persistent_lsn_(INVALID_LSN),
+        disk_manager_(disk_manager),
+        group_commit_delay_(group_commit_delay),
+        group_commit_max_batch_(group_commit_max_batch),
+        compress_(compress) {
+    for (auto &buffer : buffers_) {
+      buffer.block_ = new char[LogBlock::MaxBlockSize(LOG_BUFFER_SIZE)];
+      buffer.data_ = buffer.block_ + LogBlock::HEADER_SIZE;
+      buffer.compressed_ = new char[LogBlock::MaxBlockSize(LOG_BUFFER_SIZE)];
+    }
+    buffers_[0].first_lsn_ = 0;
+    active_buffer_ = &buffers_[0];
+    // the standby buffer stays sealed until it becomes active
+    buffers_[1].state_ = SEALED;
   }
 
   ~LogManager() {
-    delete[] log_buffer_;
-    delete[] flush_buffer_;
-    log_buffer_ = nullptr;
-    flush_buffer_ = nullptr;
+    StopFlushThread();
+    for (auto &buffer : buffers_) {
+      delete[] buffer.block_;
+      delete[] buffer.compressed_;
+      buffer.block_ = buffer.data_ = buffer.compressed_ = nullptr;
+    }
   }
 
+  /** Start the flush thread and set enable_logging. */
   void RunFlushThread();
+  /** Stop the flush thread once it has flushed what is left in the log buffer, and clear enable_logging. */
   void StopFlushThread();
 
+  /**
+   * Append a log record to the active log buffer, waiting for a flush first if the record doesn't fit. Thread-safe
+   * and latch-free unless the buffer is full.
+   * @param log_record the record, its LSN is set by this method
+   * @return the LSN assigned to the record
+   */
   auto AppendLogRecord(LogRecord *log_record) -> lsn_t;
 
-  inline auto GetNextLSN() -> lsn_t { return next_lsn_; }
+  /**
+   * Block until the log is durable up to and including lsn, leading the flush of a commit group if no flush is in
+   * progress. Used for commits, and to force the log ahead of a page that is written back.
+   * @param lsn the LSN to wait for, clamped to the last LSN handed out
+   * @throws Exception of type IO if the log can't be written anymore
+   */
+  void FlushUntil(lsn_t lsn);
+
+  /** Block until everything appended so far is durable. */
+  void Flush() { FlushUntil(GetNextLSN() - 1); }
+
+  /**
+   * Delete the log segments that only hold records before lsn. Only safe once recovery needs none of them, i.e. the
+   * changes of the records are on disk and their transactions have ended, see CheckpointManager.
+   * @param lsn the first record to keep, it must be durable already
+   * @return the number of segments deleted
+   */
+  auto TruncateLog(lsn_t lsn) -> size_t;
+
+  /** Change the group commit delay and batch size, see the constructor. */
+  void SetGroupCommit(std::chrono::microseconds delay, size_t max_batch);
+
+  /** Turn the compression of the log blocks written from now on on or off. */
+  void SetCompression(bool compress);
+
+  /**
+   * Continue an existing log, whose records are durable up to last_lsn, before anything is appended. Recovery does so
+   * to log the compensation of the transactions it rolls back.
+   */
+  void ResumeAfter(lsn_t last_lsn);
+
+  /** @return true once a log write failed, nothing is made durable from then on */
+  auto HasFailed() -> bool;
+
+  /** @return the LSN the next record will get, exact only if nobody appends concurrently */
+  auto GetNextLSN() -> lsn_t;
   inline auto GetPersistentLSN() -> lsn_t { return persistent_lsn_; }
   inline void SetPersistentLSN(lsn_t lsn) { persistent_lsn_ = lsn; }
-  inline auto GetLogBuffer() -> char * { return log_buffer_; }
+  inline auto GetLogBuffer() -> char * { return active_buffer_.load()->data_; }
 
  private:
-  // TODO(students): you may add your own member variables
+  /** Set in the state of a buffer that takes no more records. */
+  static constexpr uint64_t SEALED = uint64_t{1} << 63;
+  /** The state of a buffer holds the bytes reserved in its low bits, and the number of records above them. */
+  static constexpr int RECORD_COUNT_SHIFT = 32;
+  static constexpr uint64_t RESERVED_MASK = (uint64_t{1} << RECORD_COUNT_SHIFT) - 1;
+
+  struct LogBuffer {
+    /** The block the buffer is written as, its records start at data_, after room for the header. */
+    char *block_{nullptr};
+    char *data_{nullptr};
+    /** The block with the records compressed. */
+    char *compressed_{nullptr};
+    /** LSN of the first record, only changed while the buffer is sealed. */
+    std::atomic<lsn_t> first_lsn_{INVALID_LSN};
+    /** SEALED, the number of records and the bytes reserved. */
+    std::atomic<uint64_t> state_{0};
+    /** Bytes serialized into data_ so far, all records are complete once it reaches the bytes reserved. */
+    std::atomic<size_t> filled_{0};
+  };
+
+  static auto ReservedBytes(uint64_t state) -> size_t { return state & RESERVED_MASK; }
+  static auto RecordCount(uint64_t state) -> lsn_t {
+    return static_cast<lsn_t>((state & ~SEALED) >> RECORD_COUNT_SHIFT);
+  }
+
+  /** Serialize a record into dest, which has room for log_record->GetSize() bytes. */
+  static void SerializeLogRecord(LogRecord *log_record, char *dest);
+
+  /**
+   * Flush the active log buffer as the leader, optionally waiting for a group of commits to gather first. Caller should
+   * hold the latch through lock, and make sure that no flush is in progress. The latch is released while writing.
+   */
+  void FlushAsLeader(std::unique_lock<std::mutex> *lock, bool gather_group);
+
+  /** FlushUntil() without the exception, @return false if the log can't be written anymore */
+  auto WaitUntilDurable(lsn_t lsn) -> bool;
+
+  /** Wait until a flush has made buffer inactive, leading it if nobody does. */
+  void WaitForSwitch(LogBuffer *buffer);
+
+  /** Main loop of the flush thread. */
+  void FlushThreadLoop();
 
-  /** The atomic counter which records the next log sequence number. */
-  std::atomic<lsn_t> next_lsn_;
   /** The log records before and including the persistent lsn have been written to disk. */
   std::atomic<lsn_t> persistent_lsn_;
 
-  char *log_buffer_;
-  char *flush_buffer_;
-
+  /** Records are appended to the active buffer, the other one is being written or waiting to become active. */
+  LogBuffer buffers_[2];
+  std::atomic<LogBuffer *> active_buffer_;
+
+  /**
+   * The LSN of the first record of every buffer written since the last truncation, with the log offset it was written
+   * at. Protected by latch_.
+   */
+  std::deque<std::pair<lsn_t, size_t>> flushed_extents_;
+
+  /** True while a leader flushes, everybody else waits for it. */
+  bool flushing_{false};
+  /** Commits waiting in FlushUntil(), including the leader's own. */
+  size_t num_waiting_commits_{0};
+  bool flush_thread_running_{false};
+  /** Set once a log write failed, later buffers are dropped instead of written after the torn one. */
+  bool failed_{false};
+
+  /** Protects the flush state above, and the switch of the active buffer. Appending takes no latch. */
   std::mutex latch_;
 
-  std::thread *flush_thread_ __attribute__((__unused__));
+  std::thread *flush_thread_{nullptr};
 
+  /** Wakes up the flush thread. */
   std::condition_variable cv_;
+  /** Wakes up the leader waiting for its group to fill. */
+  std::condition_variable group_cv_;
+  /** Signals a switched or written buffer, to followers and to appenders waiting for room. */
+  std::condition_variable flushed_cv_;
+
+  DiskManager *disk_manager_;
 
-  DiskManager *disk_manager_ __attribute__((__unused__));
+  std::chrono::microseconds group_commit_delay_;
+  size_t group_commit_max_batch_;
+  bool compress_;
 };
 
 }  // namespace bustub
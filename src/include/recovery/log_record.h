@@ -14,6 +14,8 @@
 
 #include <cassert>
 #include <string>
+#include <utility>
+#include <vector>
 
 #include "common/config.h"
 #include "storage/table/tuple.h"
@@ -32,12 +34,54 @@ enum class LogRecordType {
   ABORT,
   /** Creating a new page in the table heap. */
   NEWPAGE,
+  /** Start of a fuzzy checkpoint, with the active transaction table and the dirty page table. */
+  BEGIN_CHECKPOINT,
+  /** End of a fuzzy checkpoint, its prevLSN is the LSN of the matching BEGIN_CHECKPOINT. */
+  END_CHECKPOINT,
+  /** Inserting entries into a B+ tree leaf on behalf of a transaction. */
+  INDEX_INSERT,
+  /** Removing entries from a B+ tree leaf on behalf of a transaction. */
+  INDEX_DELETE,
+  /** Initializing a B+ tree page, as split or root growth do. Redo only. */
+  INDEX_FORMAT_PAGE,
+  /** Replacing a range of entries of a B+ tree page, as split, merge and redistribution do. Redo only. */
+  INDEX_SPLICE,
+  /** Changing the root page id of a B+ tree in the header page. Redo only. */
+  INDEX_ROOT,
+  /** Compensation of a record undone after a crash, redo only. It carries the action undo took, of another type. */
+  CLR,
+  /**
+   * A structure modification of a B+ tree, the INDEX_FORMAT_PAGE, INDEX_SPLICE and INDEX_ROOT changes of a split, a
+   * merge, a redistribution or a root change, redone all together. Redo only.
+   */
+  INDEX_SMO,
+};
+
+/**
+ * A change to a single page of a B+ tree, in terms of the entry array of the page rather than of keys, so that
+ * recovery can replay it without knowing the key type or the comparator: the entries [index, index + num_removed)
+ * are replaced with the entries. An INDEX_DELETE record carries the removed entries instead, for undo.
+ */
+struct IndexPageChange {
+  /** IndexPageType of the page. */
+  int32_t page_type_{0};
+  int32_t max_size_{0};
+  /** The next page id of a leaf after the change, INVALID_PAGE_ID for internal pages. */
+  page_id_t next_page_id_{INVALID_PAGE_ID};
+  int32_t index_{0};
+  int32_t num_removed_{0};
+  int32_t entry_size_{0};
+  std::vector<char> entries_;
+
+  inline auto GetNumEntries() const -> int32_t {
+    return entry_size_ == 0 ? 0 : static_cast<int32_t>(entries_.size()) / entry_size_;
+  }
 };
 
 /**
  * For every write operation on the table page, you should write ahead a corresponding log record.
  *
- * For EACH log record, HEADER is like (5 fields in common, 20 bytes in total).
+ * For EACH log record, HEADER is like (5 fields in common, 28 bytes in total, LSNs are 8 bytes).
  *---------------------------------------------
  * | size | LSN | transID | prevLSN | LogType |
  *---------------------------------------------
@@ -49,20 +93,55 @@ enum class LogRecordType {
  *----------------------------------------------------------------
  * | HEADER | tuple_rid | tuple_size | tuple_data(char[] array) |
  *---------------------------------------------------------------
- * For update type log record
- *-----------------------------------------------------------------------------------
- * | HEADER | tuple_rid | tuple_size | old_tuple_data | tuple_size | new_tuple_data |
- *-----------------------------------------------------------------------------------
+ * For update type log record, only the parts of the tuple that changed. The tuples are cut into chunks of
+ * UPDATE_DELTA_CHUNK_SIZE bytes, the bitmap has a bit set for every chunk that differs, and the old then the new bytes
+ * of each of those chunks follow in order. A chunk past the end of one of the tuples is shorter on that side.
+ *----------------------------------------------------------------------------------------------------
+ * | HEADER | tuple_rid | old_tuple_size | new_tuple_size | chunk_bitmap | (old_bytes, new_bytes) ... |
+ *----------------------------------------------------------------------------------------------------
  * For new page type log record
  *--------------------------
  * | HEADER | prev_page_id |
  *--------------------------
+ * For begin checkpoint type log record, the last LSN of every active transaction and the recLSN of every dirty page.
+ * Its prevLSN is the next LSN when the dirty page table was taken, or the smallest recLSN of the pages left out of a
+ * table too large for the log buffer: the records from there on may dirty pages missing from it.
+ *-------------------------------------------------------------------------------
+ * | HEADER | num_txns | (txn_id, last_lsn) ... | num_pages | (page_id, rec_lsn) ... |
+ *-------------------------------------------------------------------------------
+ * For index page type log record (INDEX_INSERT/INDEX_DELETE/INDEX_FORMAT_PAGE/INDEX_SPLICE). Structure modifications
+ * are logged within an INDEX_SMO record, without a transaction, they are never undone once they reached the log.
+ * INDEX_INSERT and INDEX_DELETE records name their index as well: undo looks their entries up by key, they may have
+ * moved to another leaf since.
+ *------------------------------------------------------------------------------------------------------------
+ * | HEADER | page_id | page_type | max_size | next_page_id | index | num_removed | entry_size | num_entries |
+ *------------------------------------------------------------------------------------------------------------
+ *-----------------------------------------------------------------------------
+ * | entries(char[] array) | name_size | name(char[] array), INSERT/DELETE only |
+ *-----------------------------------------------------------------------------
+ * For index root type log record
+ *--------------------------------------------------------------
+ * | HEADER | root_page_id | name_size | name(char[] array) |
+ *--------------------------------------------------------------
+ * For index structure modification type log record, its changes are complete records of the types above, without
+ * LSNs or transaction. Every page it changes carries its LSN, so a page has either all of its changes or none.
+ *-------------------------------------------------
+ * | HEADER | num_changes | (change record) ... |
+ *-------------------------------------------------
+ * For compensation log record (CLR), the body of the action it redoes follows, as a record of that type has it. Undo
+ * goes on at undo_next_lsn, the prevLSN of the record compensated, so no record is undone twice.
+ *-------------------------------------------------------------
+ * | HEADER | undo_next_lsn | compensation_type | action body |
+ *-------------------------------------------------------------
  */
 class LogRecord {
   friend class LogManager;
   friend class LogRecovery;
 
  public:
+  /** Size of the header every record starts with: size, txn id and type, and two LSNs. */
+  static constexpr int HEADER_SIZE = 3 * sizeof(int32_t) + 2 * sizeof(lsn_t);
+
   LogRecord() = default;
 
   // constructor for Transaction type(BEGIN/COMMIT/ABORT)
@@ -88,14 +167,10 @@ class LogRecord {
   // constructor for UPDATE type
   LogRecord(txn_id_t txn_id, lsn_t prev_lsn, LogRecordType log_record_type, const RID &update_rid,
             const Tuple &old_tuple, const Tuple &new_tuple)
-      : txn_id_(txn_id),
-        prev_lsn_(prev_lsn),
-        log_record_type_(log_record_type),
-        update_rid_(update_rid),
-        old_tuple_(old_tuple),
-        new_tuple_(new_tuple) {
+      : txn_id_(txn_id), prev_lsn_(prev_lsn), log_record_type_(log_record_type), update_rid_(update_rid) {
+    EncodeUpdateDelta(old_tuple, new_tuple);
     // calculate log record size
-    size_ = HEADER_SIZE + sizeof(RID) + old_tuple.GetLength() + new_tuple.GetLength() + 2 * sizeof(int32_t);
+    size_ = static_cast<int32_t>(HEADER_SIZE + sizeof(RID) + 2 * sizeof(uint32_t) + update_delta_.size());
   }
 
   // constructor for NEWPAGE type
@@ -110,6 +185,63 @@ class LogRecord {
     size_ = HEADER_SIZE + sizeof(page_id_t) * 2;
   }
 
+  // constructor for BEGIN_CHECKPOINT type, prev_lsn is the first record that may dirty pages missing from the table
+  LogRecord(txn_id_t txn_id, lsn_t prev_lsn, LogRecordType log_record_type,
+            std::vector<std::pair<txn_id_t, lsn_t>> active_txns, std::vector<std::pair<page_id_t, lsn_t>> dirty_pages)
+      : txn_id_(txn_id),
+        prev_lsn_(prev_lsn),
+        log_record_type_(log_record_type),
+        active_txns_(std::move(active_txns)),
+        dirty_pages_(std::move(dirty_pages)) {
+    size_ = static_cast<int32_t>(HEADER_SIZE + 2 * sizeof(int32_t) +
+                                 active_txns_.size() * (sizeof(txn_id_t) + sizeof(lsn_t)) +
+                                 dirty_pages_.size() * (sizeof(page_id_t) + sizeof(lsn_t)));
+  }
+
+  // constructor for INDEX_INSERT/INDEX_DELETE/INDEX_FORMAT_PAGE/INDEX_SPLICE type
+  LogRecord(txn_id_t txn_id, lsn_t prev_lsn, LogRecordType log_record_type, page_id_t page_id,
+            IndexPageChange index_change, std::string index_name = "")
+      : txn_id_(txn_id),
+        prev_lsn_(prev_lsn),
+        log_record_type_(log_record_type),
+        page_id_(page_id),
+        index_change_(std::move(index_change)),
+        index_name_(std::move(index_name)) {
+    size_ = static_cast<int32_t>(HEADER_SIZE + sizeof(page_id_t) * 2 + sizeof(int32_t) * 6 +
+                                 index_change_.entries_.size());
+    if (HasIndexName()) {
+      size_ += static_cast<int32_t>(sizeof(int32_t) + index_name_.size());
+    }
+  }
+
+  // constructor for INDEX_ROOT type
+  LogRecord(txn_id_t txn_id, lsn_t prev_lsn, LogRecordType log_record_type, std::string index_name,
+            page_id_t root_page_id)
+      : txn_id_(txn_id),
+        prev_lsn_(prev_lsn),
+        log_record_type_(log_record_type),
+        page_id_(root_page_id),
+        index_name_(std::move(index_name)) {
+    size_ = static_cast<int32_t>(HEADER_SIZE + sizeof(page_id_t) + sizeof(int32_t) + index_name_.size());
+  }
+
+  // constructor for INDEX_SMO type, the changes are INDEX_FORMAT_PAGE, INDEX_SPLICE and INDEX_ROOT records
+  LogRecord(txn_id_t txn_id, lsn_t prev_lsn, LogRecordType log_record_type, std::vector<LogRecord> changes)
+      : txn_id_(txn_id), prev_lsn_(prev_lsn), log_record_type_(log_record_type), smo_changes_(std::move(changes)) {
+    size_ = HEADER_SIZE + static_cast<int32_t>(sizeof(int32_t));
+    for (auto &change : smo_changes_) {
+      size_ += change.GetSize();
+    }
+  }
+
+  // constructor for compensation log record type(CLR), the action is a record of the type undo took
+  LogRecord(LogRecord action, lsn_t undo_next_lsn) : LogRecord(std::move(action)) {
+    compensation_type_ = log_record_type_;
+    log_record_type_ = LogRecordType::CLR;
+    undo_next_lsn_ = undo_next_lsn;
+    size_ += static_cast<int32_t>(sizeof(lsn_t) + sizeof(int32_t));
+  }
+
   ~LogRecord() = default;
 
   inline auto GetDeleteTuple() -> Tuple & { return delete_tuple_; }
@@ -120,14 +252,44 @@ class LogRecord {
 
   inline auto GetInsertRID() -> RID & { return insert_rid_; }
 
-  inline auto GetOriginalTuple() -> Tuple & { return old_tuple_; }
+  inline auto GetUpdateRID() -> RID & { return update_rid_; }
 
-  inline auto GetUpdateTuple() -> Tuple & { return new_tuple_; }
+  /** @return the tuple after the update, given the tuple before it */
+  auto ApplyUpdate(const Tuple &old_tuple) const -> Tuple;
 
-  inline auto GetUpdateRID() -> RID & { return update_rid_; }
+  /** @return the tuple before the update, given the tuple after it */
+  auto RevertUpdate(const Tuple &new_tuple) const -> Tuple;
 
   inline auto GetNewPageRecord() -> page_id_t { return prev_page_id_; }
 
+  inline auto GetActiveTxns() -> std::vector<std::pair<txn_id_t, lsn_t>> & { return active_txns_; }
+
+  inline auto GetDirtyPages() -> std::vector<std::pair<page_id_t, lsn_t>> & { return dirty_pages_; }
+
+  inline auto GetIndexPageId() -> page_id_t { return page_id_; }
+
+  inline auto GetIndexChange() -> IndexPageChange & { return index_change_; }
+
+  inline auto GetIndexName() -> std::string & { return index_name_; }
+
+  /** @return true for an index page change that names its index after the entries, an INSERT or DELETE one */
+  inline auto HasIndexName() -> bool {
+    return GetActionType() == LogRecordType::INDEX_INSERT || GetActionType() == LogRecordType::INDEX_DELETE;
+  }
+
+  inline auto GetRootPageId() -> page_id_t { return page_id_; }
+
+  inline auto GetStructureChanges() -> std::vector<LogRecord> & { return smo_changes_; }
+
+  inline auto GetUndoNextLSN() -> lsn_t { return undo_next_lsn_; }
+
+  inline auto GetCompensationType() -> LogRecordType { return compensation_type_; }
+
+  /** @return the type of the change the record makes to pages, the compensation type for a CLR */
+  inline auto GetActionType() -> LogRecordType {
+    return log_record_type_ == LogRecordType::CLR ? compensation_type_ : log_record_type_;
+  }
+
   inline auto GetSize() -> int32_t { return size_; }
 
   inline auto GetLSN() -> lsn_t { return lsn_; }
@@ -168,15 +330,41 @@ class LogRecord {
   RID insert_rid_;
   Tuple insert_tuple_;
 
-  // case3: for update operation
+  // case3: for update operation, the chunk bitmap and the changed chunks
   RID update_rid_;
-  Tuple old_tuple_;
-  Tuple new_tuple_;
+  uint32_t update_old_size_{0};
+  uint32_t update_new_size_{0};
+  std::vector<char> update_delta_;
 
   // case4: for new page operation
   page_id_t prev_page_id_{INVALID_PAGE_ID};
   page_id_t page_id_{INVALID_PAGE_ID};
-  static const int HEADER_SIZE = 20;
+
+  // case5: for begin checkpoint, the active transaction table and the dirty page table
+  std::vector<std::pair<txn_id_t, lsn_t>> active_txns_;
+  std::vector<std::pair<page_id_t, lsn_t>> dirty_pages_;
+
+  // case6: for index page changes, page_id_ is the page changed
+  IndexPageChange index_change_;
+
+  // case7: for index root changes, page_id_ is the new root page id. Index inserts and deletes name their index too
+  std::string index_name_;
+
+  // case8: for compensation log records, the fields of the action are those of its type
+  lsn_t undo_next_lsn_{INVALID_LSN};
+  LogRecordType compensation_type_{LogRecordType::INVALID};
+
+  // case9: for index structure modifications, the changes to each page in the order they were made
+  std::vector<LogRecord> smo_changes_;
+
+  /** Granularity of the changes an UPDATE record logs. Fixed-size columns and varchar offsets are 4 bytes wide. */
+  static constexpr uint32_t UPDATE_DELTA_CHUNK_SIZE = 4;
+
+  /** Fill update_delta_ with the chunks that differ between both tuples. */
+  void EncodeUpdateDelta(const Tuple &old_tuple, const Tuple &new_tuple);
+
+  /** Patch a copy of from, of from_size bytes, into the tuple of to_size bytes the other side of the delta has. */
+  auto ApplyUpdateDelta(const Tuple &from, uint32_t from_size, uint32_t to_size, bool forward) const -> Tuple;
 };  // namespace bustub
 
 }  // namespace bustub
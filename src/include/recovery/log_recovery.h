@@ -13,45 +13,246 @@
 #pragma once
 
 #include <algorithm>
-#include <mutex>  // NOLINT
+#include <atomic>
+#include <condition_variable>  // NOLINT
+#include <deque>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>   // NOLINT
+#include <string>
+#include <thread>  // NOLINT
 #include <unordered_map>
+#include <utility>
+#include <vector>
 
 #include "buffer/buffer_pool_manager.h"
 #include "concurrency/lock_manager.h"
+#include "recovery/index_undo.h"
+#include "recovery/log_block.h"
+#include "recovery/log_manager.h"
 #include "recovery/log_record.h"
 
 namespace bustub {
 
 /**
  * Read log file from disk, redo and undo.
+ *
+ * Analysis comes first. It scans the log from its start, which the last checkpoint truncated to, notes the first LSN
+ * and the offset of every log block and finds the transactions that never ended. The log ends at the first block that
+ * is missing or fails its checksum, i.e. was torn by the crash. The dirty page table of the last complete checkpoint,
+ * with the pages the records after it touch, tells where redo has to start.
+ *
+ * Redo is a pipeline. The calling thread parses the log sequentially from the redo LSN on and hands the records to a
+ * number of redo workers, partitioned by the page they change. A page always goes to the same worker, which replays
+ * its records in LSN order, so the pages are repaired in parallel without any ordering between the workers. Records
+ * are handed over in batches, and the pages of a batch are prefetched as it is queued, so that the workers find most
+ * of them in the buffer pool.
+ *
+ * Undo rolls back all the transactions that never ended at once. The calling thread merges their prevLSN chains by
+ * LSN, so it reads the log backwards from its end, through a small cache of the blocks read last, instead of jumping
+ * from one transaction to the next. The records are handed to the same kind of workers, partitioned by transaction
+ * this time, which undo the records of a transaction in the order they were read. Every record undone is compensated
+ * with a CLR, whose undo next LSN skips it if undo is interrupted by another crash and runs again, and a transaction
+ * rolled back to its first record is ended with an ABORT record. Index records are handed to the index they name,
+ * which looks their entries up by key: splits and merges may have moved them off the leaf the records name.
  */
 class LogRecovery {
  public:
-  LogRecovery(DiskManager *disk_manager, BufferPoolManager *buffer_pool_manager)
-      : disk_manager_(disk_manager), buffer_pool_manager_(buffer_pool_manager), offset_(0) {
-    log_buffer_ = new char[LOG_BUFFER_SIZE];
-  }
-
-  ~LogRecovery() {
-    delete[] log_buffer_;
-    log_buffer_ = nullptr;
-  }
+  /**
+   * @param disk_manager the disk manager owning the log
+   * @param buffer_pool_manager the buffer pool the pages are repaired in
+   * @param num_workers the number of threads redoing, then undoing the log
+   * @param log_manager the log manager of the restarted system, Analyze() makes its LSNs go on after the ones of the
+   * log. Undo logs its compensation with it, or logs nothing if it is nullptr.
+   */
+  LogRecovery(DiskManager *disk_manager, BufferPoolManager *buffer_pool_manager,
+              size_t num_workers = RECOVERY_REDO_WORKERS, LogManager *log_manager = nullptr)
+      : disk_manager_(disk_manager),
+        buffer_pool_manager_(buffer_pool_manager),
+        log_manager_(log_manager),
+        num_workers_(std::max<size_t>(num_workers, 1)),
+        offset_(disk_manager->GetLogStartOffset()) {}
 
+  /**
+   * Scan the log, and build the active transaction table, the dirty page table and the index of the log blocks. Cuts
+   * the log short at a torn block, and resumes the log manager after the last record.
+   */
+  void Analyze();
+  /** Replay the log from the redo LSN on, on the pages that miss the changes. Runs Analyze() first if need be. */
   void Redo();
+  /**
+   * Have the index of the given name undo its own records, before Undo(). The entries of an index that isn't
+   * registered are looked for on the leaf its records name.
+   */
+  void RegisterIndex(const std::string &index_name, IndexUndo *index) { indexes_[index_name] = index; }
+  /**
+   * Roll back the transactions that never ended, after Redo(), and flush the CLRs and ABORT records logged for them.
+   * Runs Analyze() first if need be.
+   */
   void Undo();
-  auto DeserializeLogRecord(const char *data, LogRecord *log_record) -> bool;
+
+  /**
+   * Deserialize a log record.
+   * @param data the serialized record
+   * @param size the bytes available at data
+   * @param[out] log_record the record
+   * @return false if there is no complete record at data, i.e. the end of the log has been reached
+   */
+  static auto DeserializeLogRecord(const char *data, size_t size, LogRecord *log_record) -> bool;
+
+  /** @return the LSN of the BEGIN_CHECKPOINT record of the last complete checkpoint, INVALID_LSN if there is none */
+  auto GetCheckpointLSN() const -> lsn_t { return checkpoint_lsn_; }
+  /** @return the first record redo has to look at, INVALID_LSN if the log is empty */
+  auto GetRedoLSN() const -> lsn_t { return redo_lsn_; }
+  /** @return the transactions that never ended, with the LSN of their last record */
+  auto GetActiveTransactions() const -> const std::unordered_map<txn_id_t, lsn_t> & { return active_txn_; }
+  /** @return the pages that may miss changes, with the first record that may have changed them */
+  auto GetDirtyPageTable() const -> const std::unordered_map<page_id_t, lsn_t> & { return dirty_page_table_; }
+  /** @return the number of records Redo() replayed on a page */
+  auto GetNumRedone() const -> size_t { return num_redone_; }
+  /** @return the number of records Undo() rolled back, or skipped as compensated already */
+  auto GetNumUndone() const -> size_t { return num_undone_; }
+  /** @return the number of log blocks Undo() read from disk, and the number of reads its block cache saved */
+  auto GetNumLogBlockReads() const -> std::pair<size_t, size_t> { return {num_block_reads_, num_block_cache_hits_}; }
 
  private:
-  DiskManager *disk_manager_ __attribute__((__unused__));
-  BufferPoolManager *buffer_pool_manager_ __attribute__((__unused__));
+  /** Records handed to a worker at once. */
+  static constexpr size_t REDO_BATCH_SIZE = 64;
+  /** Batches queued per worker before the parser waits for it. */
+  static constexpr size_t REDO_QUEUE_DEPTH = 16;
+  /** Log blocks undo keeps in memory. The chains of the transactions rolled back are read backwards block by block. */
+  static constexpr size_t UNDO_BLOCK_CACHE_SIZE = 16;
+
+  /** A record to redo on one of the pages it changes, or to undo on the page it changed. */
+  struct RedoItem {
+    page_id_t page_id_;
+    LogRecord record_;
+  };
+
+  /** A thread redoing or undoing the records of its share of the pages or transactions, in the order queued. */
+  struct RedoWorker {
+    std::thread thread_;
+    std::mutex latch_;
+    /** Signals a queued batch to the worker, and room in the queue to the parser. */
+    std::condition_variable cv_;
+    std::deque<std::vector<RedoItem>> batches_;
+    /** Set once the parser has queued the last batch. */
+    bool done_{false};
+  };
+
+  /**
+   * Read the log from offset on, up to its end or its first torn block.
+   * @param offset the log offset of a block
+   * @param visit called with every record and the offset of its block, in log order
+   * @return the offset one past the last intact block
+   */
+  auto ScanLog(size_t offset, const std::function<void(LogRecord *, size_t)> &visit) -> size_t;
+
+  /** A log block read by undo, with the offset of each of its records. */
+  struct CachedLogBlock {
+    size_t offset_;
+    lsn_t first_lsn_;
+    std::vector<char> records_;
+    std::vector<size_t> record_offsets_;
+  };
+
+  /** Read the record lsn from its block, after Analyze(). @return false if the log has no such record */
+  auto ReadLogRecord(lsn_t lsn, LogRecord *log_record) -> bool;
+
+  /** @return the block at offset, from the block cache or read into it, nullptr if it can't be read */
+  auto ReadLogBlock(size_t offset) -> const CachedLogBlock *;
+
+  /** @return the offset of the log block holding the record lsn, or of the first block after it */
+  auto FindLogBlock(lsn_t lsn) const -> size_t;
+
+  /** @return the pages a record changes, each once, INVALID_PAGE_ID for the previous page of a first table page */
+  static auto GetPageIds(LogRecord *record) -> std::vector<page_id_t>;
+
+  /** Start num_workers_ workers, which call apply on each item queued to them. */
+  auto StartWorkers(void (LogRecovery::*apply)(RedoItem *)) -> std::vector<std::unique_ptr<RedoWorker>>;
+
+  /** Queue a batch to a worker, prefetching its pages, and waiting for room if the worker's queue is full. */
+  void QueueBatch(RedoWorker *worker, std::vector<RedoItem> batch);
+
+  /** Queue the batches left, and wait for the workers to be done with them. */
+  void StopWorkers(std::vector<std::unique_ptr<RedoWorker>> *workers, std::vector<std::vector<RedoItem>> *batches);
 
-  /** Maintain active transactions and its corresponding latest lsn. */
+  /** Main loop of a worker. */
+  void WorkerLoop(RedoWorker *worker, void (LogRecovery::*apply)(RedoItem *));
+
+  /** Replay a record on one page, unless the page has it already. */
+  void RedoOnPage(RedoItem *item);
+
+  /** @return the entry array of a B+ tree page, whatever its key type */
+  static auto GetIndexEntries(Page *page) -> char *;
+
+  /**
+   * Replace the entries [index, index + num_removed) of a B+ tree page with num_entries entries.
+   * @return false if the page has no such entries or no room for the new ones, it is left alone then
+   */
+  static auto SpliceIndexEntries(Page *page, size_t entry_size, int index, int num_removed, const char *entries,
+                                 int num_entries) -> bool;
+
+  /** Replay an index page change on the latched page. */
+  static void RedoIndexChange(Page *page, LogRecord *record);
+
+  /** Replay an index root change on the latched header page. */
+  static void RedoRootChange(Page *page, LogRecord *record);
+
+  /** @return the record undo goes on with after record, in the chain of its transaction */
+  static auto GetUndoNextLSN(LogRecord *record) -> lsn_t;
+
+  /** Undo a record of a transaction that never ended, logging a CLR for it, or skip a CLR. */
+  void UndoRecord(RedoItem *item);
+
+  /** Roll back the tuple an INSERT, MARKDELETE or UPDATE record changed, unless it is rolled back already. */
+  void UndoTableChange(Page *page, LogRecord *record);
+
+  /**
+   * Roll back the entries an INDEX_INSERT or INDEX_DELETE record of an index that isn't registered changed, on the
+   * latched leaf the record names, unless they are rolled back already.
+   */
+  void UndoIndexChange(Page *page, LogRecord *record);
+
+  /**
+   * Log the CLR compensating a record undone on the latched page, and stamp the page with it.
+   * @param action the change undo made, a record of the type the CLR redoes
+   */
+  void LogCompensation(Page *page, LogRecord *record, LogRecord action);
+
+  DiskManager *disk_manager_;
+  BufferPoolManager *buffer_pool_manager_;
+  LogManager *log_manager_;
+  size_t num_workers_;
+
+  /**
+   * Maintain active transactions and its corresponding latest lsn. During undo, each entry is only updated by the
+   * worker undoing the transaction.
+   */
   std::unordered_map<txn_id_t, lsn_t> active_txn_;
-  /** Mapping the log sequence number to log file offset for undos. */
-  std::unordered_map<lsn_t, int> lsn_mapping_;
+  /** The first LSN and the log offset of every log block, in log order. */
+  std::vector<std::pair<lsn_t, size_t>> log_blocks_;
+  /** The last record in the log. */
+  lsn_t last_lsn_{INVALID_LSN};
+  /** The indexes undoing their own records, by name. */
+  std::unordered_map<std::string, IndexUndo *> indexes_;
+  /** Pages that may miss changes after a crash, with their recLSN. */
+  std::unordered_map<page_id_t, lsn_t> dirty_page_table_;
+  lsn_t checkpoint_lsn_{INVALID_LSN};
+  lsn_t redo_lsn_{INVALID_LSN};
+  bool analyzed_{false};
+  std::atomic<size_t> num_redone_{0};
+  std::atomic<size_t> num_undone_{0};
+
+  /** The log blocks undo read last, the most recently used first, and where each is in the list. */
+  std::list<CachedLogBlock> block_cache_;
+  std::unordered_map<size_t, std::list<CachedLogBlock>::iterator> block_cache_index_;
+  size_t num_block_reads_{0};
+  size_t num_block_cache_hits_{0};
 
-  int offset_ __attribute__((__unused__));  // NOLINT
-  char *log_buffer_;
+  /** Log offset to read from next, starting where the last checkpoint truncated the log. */
+  size_t offset_;
 };
 
 }  // namespace bustub
@@ -13,15 +13,61 @@
 #pragma once
 
 #include <atomic>
+#include <condition_variable>  // NOLINT
+#include <cstdint>
+#include <deque>
 #include <fstream>
+#include <functional>
 #include <future>  // NOLINT
 #include <mutex>   // NOLINT
 #include <string>
+#include <thread>  // NOLINT
+#include <utility>
+#include <vector>
 
 #include "common/config.h"
 
 namespace bustub {
 
+/**
+ * Called once an asynchronous read or write has completed, with 0 if it succeeded or the errno it failed with. A page
+ * whose write failed is not on disk, whoever wrote it must keep it dirty.
+ */
+using IoCallback = std::function<void(int error)>;
+
+/** A page read or write submitted with DiskManager::SubmitAsync(). */
+struct DiskRequest {
+  /** True for a write of data_ to the page, false for a read of the page into data_. */
+  bool is_write_;
+  page_id_t page_id_;
+  /** BUSTUB_PAGE_SIZE bytes, which must stay valid until the callback runs. Only read from for writes. */
+  char *data_;
+  IoCallback callback_;
+};
+
+/** When DiskManager makes the pages it has written durable with fdatasync(). */
+enum class DbSyncPolicy {
+  /** Never, the OS writes pages back whenever it sees fit. Fine for tests and throwaway databases. */
+  NONE,
+  /** On every write, by opening the file with O_DSYNC. Every written page is durable, at the cost of a flush each. */
+  EVERY_WRITE,
+  /** When Sync() is called, e.g. by FlushAllPages(), so that a whole batch of writes pays for a single flush. */
+  ON_SYNC,
+};
+
+/** How DiskManager opens and syncs the database file, and how it splits up the log. */
+struct DiskManagerOptions {
+  /**
+   * Open the database file with O_DIRECT, so that pages are cached by the buffer pool only and not a second time by
+   * the OS. Buffers must then be aligned to BUSTUB_PAGE_SIZE, as the frames of a buffer pool are, others are copied
+   * through an aligned bounce buffer. Falls back to buffered I/O on file systems without direct I/O, e.g. tmpfs.
+   */
+  bool direct_io_{false};
+  DbSyncPolicy sync_policy_{DbSyncPolicy::ON_SYNC};
+  /** Size of a log segment file. Must stay the same for the lifetime of a log, as offsets map to segments by it. */
+  size_t log_segment_size_{LOG_SEGMENT_SIZE};
+};
+
 /**
  * DiskManager takes care of the allocation and deallocation of pages within a database. It performs the reading and
  * writing of pages to and from disk, providing a logical file layer within the context of a database management system.
@@ -31,13 +77,15 @@ class DiskManager {
   /**
    * Creates a new disk manager that writes to the specified database file.
    * @param db_file the file name of the database file to write to
+   * @param options how to open and sync the database file
    */
-  explicit DiskManager(const std::string &db_file);
+  explicit DiskManager(const std::string &db_file, const DiskManagerOptions &options = {});
 
   /** FOR TEST / LEADERBOARD ONLY, used by DiskManagerMemory */
   DiskManager() = default;
 
-  virtual ~DiskManager() = default;
+  /** Closes the database file if ShutDown() has not. */
+  virtual ~DiskManager();
 
   /**
    * Shut down the disk manager and close all the file resources.
@@ -45,34 +93,153 @@ class DiskManager {
   void ShutDown();
 
   /**
-   * Write a page to the database file.
+   * Write a page to the database file. Pages are written with positional I/O and without a latch, so any number of
+   * threads may read and write different pages at the same time.
    * @param page_id id of the page
    * @param page_data raw page data
+   * @return 0, or the errno the write failed with
+   */
+  virtual auto WritePage(page_id_t page_id, const char *page_data) -> int;
+
+  /**
+   * Write a number of pages at once. The pages are sorted by id, and every run of adjacent pages is written with a
+   * single pwritev() call, of up to DISK_MANAGER_MAX_WRITEV_PAGES pages, so that flushing a large pool takes far fewer
+   * system calls and gives the device large sequential writes. Disk managers without a database file write the pages
+   * one by one with WritePage().
+   * @param pages (page id, raw page data) of every page to write, each id at most once
    */
-  virtual void WritePage(page_id_t page_id, const char *page_data);
+  virtual void WritePages(std::vector<std::pair<page_id_t, const char *>> pages);
 
   /**
-   * Read a page from the database file.
+   * Read a page from the database file. The part of the page past the end of the file reads as zeroes.
    * @param page_id id of the page
    * @param[out] page_data output buffer
+   * @return 0, or the errno the read failed with
+   */
+  virtual auto ReadPage(page_id_t page_id, char *page_data) -> int;
+
+  /**
+   * Submit page reads and writes without waiting for them. Each request's callback runs once it has completed, on a
+   * thread of the disk manager, so callbacks should be short and must not wait for other requests. Requests for the
+   * same page may complete in any order. All requests must have completed before the disk manager is destroyed.
+   *
+   * The default implementation hands the requests to DISK_MANAGER_IO_THREADS threads calling ReadPage() and
+   * WritePage(), so that it works for every subclass, and passes their results to the callbacks.
+   *
+   * @param requests the reads and writes to submit
+   */
+  virtual void SubmitAsync(std::vector<DiskRequest> requests);
+
+  /** Read a page without waiting for it, see SubmitAsync(). */
+  void ReadPageAsync(page_id_t page_id, char *page_data, IoCallback callback) {
+    SubmitAsync({DiskRequest{false, page_id, page_data, std::move(callback)}});
+  }
+
+  /** Write a page without waiting for it, see SubmitAsync(). */
+  void WritePageAsync(page_id_t page_id, const char *page_data, IoCallback callback) {
+    SubmitAsync({DiskRequest{true, page_id, const_cast<char *>(page_data), std::move(callback)}});
+  }
+
+  /**
+   * @return the page as mapped into memory by the disk manager, for the buffer pool to point a frame at instead of
+   * copying it, or nullptr if the page is not mapped. Only read-only disk managers map pages, see DiskManagerMmap.
+   */
+  virtual auto MappedPage(page_id_t page_id) -> const char * { return nullptr; }
+
+  /** @return true if pages can't be written, e.g. on a read-only replica */
+  virtual auto IsReadOnly() const -> bool { return false; }
+
+  /**
+   * Make the pages written so far durable with fdatasync(), unless the sync policy is NONE. Pages written with the
+   * EVERY_WRITE policy are durable already, so this is a cheap no-op for them.
    */
-  virtual void ReadPage(page_id_t page_id, char *page_data);
+  void Sync();
+
+  /** @return true if the database file bypasses the OS page cache, see DiskManagerOptions::direct_io_ */
+  auto UsesDirectIo() const -> bool { return direct_io_; }
+
+  /** @return the number of fdatasync() calls on the database file */
+  auto GetNumSyncs() const -> int { return num_syncs_; }
+
+  /** @return the size of the database file in bytes, as far as it has been written by this disk manager */
+  auto GetDbFileSize() const -> size_t { return db_file_size_.load(std::memory_order_acquire); }
+
+  /**
+   * Allocate a page in the database file. Deallocated pages are reused before the file grows, starting with the first
+   * free page at or after the hint, so that related pages stay close to each other on disk.
+   * @param hint the page the new page belongs next to, e.g. the page it is split from, INVALID_PAGE_ID for none
+   * @return the id of the allocated page
+   */
+  auto AllocatePage(page_id_t hint = INVALID_PAGE_ID) -> page_id_t;
+
+  /**
+   * Deallocate a page, so that AllocatePage() can hand its id out again. The free page map is written through to its
+   * file before returning. Deallocating a page that is already free has no effect.
+   * @param page_id id of the page to deallocate
+   */
+  void DeallocatePage(page_id_t page_id);
+
+  /**
+   * Make sure that AllocatePage() never hands out page_id by growing the file, e.g. for a page that recovery replays
+   * changes to before it has reached the file.
+   * @param page_id id of a page in use
+   */
+  void MarkAllocated(page_id_t page_id);
+
+  /** @return one past the highest page id allocated so far, recovered from the file size on restart */
+  auto GetNumPages() -> page_id_t;
+
+  /** @return the number of deallocated pages waiting to be reused */
+  auto GetNumFreePages() -> size_t;
 
   /**
-   * Flush the entire log buffer into disk.
+   * Append the entire log buffer to the log, and make it durable with fdatasync() before returning. The log manager
+   * calls this once for a whole group of commits, see LogManager::FlushUntil().
+   *
+   * The log is a sequence of segment files of log_segment_size_ bytes each, the first one named like the database
+   * file with a .log extension, the next ones with the segment number appended, e.g. test.log, test.log.1, test.log.2.
+   * A log offset is a 64-bit position in this sequence, and lives in segment offset / log_segment_size_. A write that
+   * crosses the end of a segment continues in a new one.
    * @param log_data raw log data
    * @param size size of log entry
+   * @return false if the log could not be written or synced. Part of it may have reached the log nonetheless, so
+   * nothing appended after it is readable by recovery.
    */
-  void WriteLog(char *log_data, int size);
+  auto WriteLog(char *log_data, int size) -> bool;
 
   /**
-   * Read a log entry from the log file.
-   * @param[out] log_data output buffer
+   * Read from the log, possibly across segments.
+   * @param[out] log_data output buffer, zeroed past the end of the log
    * @param size size of the log entry
-   * @param offset offset of the log entry in the file
-   * @return true if the read was successful, false otherwise
+   * @param offset log offset of the log entry
+   * @return false if offset is past the end of the log, or before its start, i.e. truncated
+   */
+  auto ReadLog(char *log_data, int size, size_t offset) -> bool;
+
+  /**
+   * Move the start of the log to offset, e.g. once a checkpoint has made the records before it unnecessary for
+   * recovery, and delete the segments that lie entirely before it. The segment being appended to is always kept. The
+   * start is kept in a file next to the segments, since it need not be at the start of a segment.
+   * @param offset the log offset of the first record still needed
+   * @return the number of segments deleted
+   */
+  auto TruncateLog(size_t offset) -> size_t;
+
+  /**
+   * Cut the log short at offset, dropping everything written after it, e.g. a log block the crash tore. Recovery does
+   * so before anything is appended, or the records appended would follow the torn block and never be read again.
+   * @param offset the new end of the log
    */
-  auto ReadLog(char *log_data, int size, int offset) -> bool;
+  void TruncateLogEnd(size_t offset);
+
+  /** @return the log offset one past the last byte written, i.e. where the next WriteLog() goes */
+  auto GetLogEndOffset() -> size_t;
+
+  /** @return the log offset of the first record not truncated yet, where recovery starts reading */
+  auto GetLogStartOffset() -> size_t;
+
+  /** @return the number of log segment files on disk */
+  auto GetNumLogSegments() -> size_t;
 
   /** @return the number of disk flushes */
   auto GetNumFlushes() const -> int;
@@ -93,19 +260,75 @@ class DiskManager {
   inline auto HasFlushLogFuture() -> bool { return flush_log_f_ != nullptr; }
 
  protected:
-  auto GetFileSize(const std::string &file_name) -> int;
-  // stream to write log file
-  std::fstream log_io_;
+  auto GetFileSize(const std::string &file_name) -> int64_t;
+  // descriptor of the log segment being appended to, -1 until the first write after the previous one has filled up
+  int log_fd_{-1};
   std::string log_name_;
-  // stream to write db file
-  std::fstream db_io_;
+  size_t log_segment_size_{LOG_SEGMENT_SIZE};
+  // the oldest segment on disk, and the log offsets of the first record in the log and one past the last byte written
+  size_t log_first_segment_{0};
+  size_t log_start_offset_{0};
+  size_t log_end_offset_{0};
+  // protects the log segments, WriteLog() appends while a checkpoint truncates and recovery reads
+  std::mutex log_latch_;
+  /** @return the file name of log segment segment */
+  auto LogSegmentName(size_t segment) const -> std::string;
+  /** @return the name of the file holding the log start offset */
+  auto LogStartName() const -> std::string;
+  /** Replace the log start offset on disk. Caller should hold log_latch_. */
+  void WriteLogStart(size_t offset);
+  /** Find the log segments left behind by an earlier run, and open the last one for appending. */
+  void OpenLog();
+  // descriptor of the db file, read and written with pread / pwrite so that no latch is needed
+  int db_fd_{-1};
   std::string file_name_;
+  // size of the db file, read when it is opened and raised by every write past its end
+  std::atomic<size_t> db_file_size_{0};
+  /** Raise the cached size of the db file to at least size. */
+  void GrowDbFileSize(size_t size);
+  /** @return true if data can't be handed to the db file as it is, because direct I/O needs an aligned buffer */
+  auto NeedsBounceBuffer(const char *data) const -> bool {
+    return direct_io_ && reinterpret_cast<uintptr_t>(data) % BUSTUB_PAGE_SIZE != 0;
+  }
+  bool direct_io_{false};
+  DbSyncPolicy sync_policy_{DbSyncPolicy::NONE};
+  std::atomic<int> num_syncs_{0};
   int num_flushes_{0};
-  int num_writes_{0};
+  std::atomic<int> num_writes_{0};
   bool flush_log_{false};
   std::future<void> *flush_log_f_{nullptr};
-  // With multiple buffer pool instances, need to protect file access
-  std::mutex db_io_latch_;
+
+  // free page map: bit i is set if page i has been deallocated. It is kept in a file next to the database file, one
+  // BUSTUB_PAGE_SIZE block per FREE_PAGE_MAP_BLOCK_PAGES pages, and written through on every change.
+  static constexpr size_t FREE_PAGE_MAP_BLOCK_PAGES = BUSTUB_PAGE_SIZE * 8;
+  static constexpr size_t FREE_PAGE_MAP_BLOCK_WORDS = BUSTUB_PAGE_SIZE / sizeof(uint64_t);
+  std::vector<uint64_t> free_page_map_;
+  size_t num_free_pages_{0};
+  page_id_t next_page_id_{0};
+  std::fstream fsm_io_;
+  std::string fsm_name_;
+  // protects the free page map and next_page_id_
+  std::mutex alloc_latch_;
+
+  // threads serving SubmitAsync() by default, started on the first submission and stopped by StopIoThreads()
+  std::vector<std::thread> io_threads_;
+  std::deque<DiskRequest> io_queue_;
+  bool io_running_{false};
+  // protects the I/O queue
+  std::mutex io_latch_;
+  std::condition_variable io_queue_cv_;
+  /** Stop the I/O threads once every queued request has completed. */
+  void StopIoThreads();
+
+ private:
+  /** Main loop of an I/O thread. */
+  void IoThreadLoop();
+  /** Load the free page map of an existing database file. */
+  void LoadFreePageMap();
+  /** Write the block of the free page map that covers the given page. */
+  void WriteFreePageMapBlock(page_id_t page_id);
+  /** @return the first free page at or after start, wrapping around to the start of the file */
+  auto FindFreePage(page_id_t start) -> page_id_t;
 };
 
 }  // namespace bustub
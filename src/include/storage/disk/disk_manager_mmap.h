@@ -0,0 +1,90 @@
+//===----------------------------------------------------------------------===//
+//
+//                         BusTub
+//
+// disk_manager_mmap.h
+//
+// Identification: src/include/storage/disk/disk_manager_mmap.h
+//
+// Copyright (c) 2015-2022, Carnegie Mellon University Database Group
+//
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include <atomic>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "storage/disk/disk_manager.h"
+
+namespace bustub {
+
+/** The access pattern a DiskManagerMmap advises the kernel of, see madvise(2). */
+enum class MmapAccessPattern { NORMAL, SEQUENTIAL, RANDOM };
+
+/**
+ * DiskManagerMmap serves an existing database file read-only through a shared memory mapping, e.g. for a reporting
+ * replica. A buffer pool on top of it points its frames straight at the mapping instead of copying pages into them,
+ * see MappedPage(), so the OS page cache is the only copy of the data.
+ *
+ * The kernel is advised of the access pattern as it shows: a streak of reads of adjacent pages switches the mapping
+ * to MADV_SEQUENTIAL, so that the kernel reads ahead aggressively, and a streak of reads all over the file switches it
+ * to MADV_RANDOM, so that it doesn't read ahead at all.
+ *
+ * Every write is rejected with an exception. The file is mapped at its size when it is opened, pages appended later
+ * by the primary are read with pread() but not mapped: reading past the mapping looks up the size of the file again.
+ */
+class DiskManagerMmap : public DiskManager {
+ public:
+  /** Reads in a row of the same kind that switch the advised access pattern. */
+  static constexpr int ADVISE_STREAK = 16;
+
+  /**
+   * Open and map an existing database file read-only.
+   * @param db_file the file name of the database file
+   * @throws Exception if the file can't be opened or mapped
+   */
+  explicit DiskManagerMmap(const std::string &db_file);
+
+  /** Unmaps the database file. */
+  ~DiskManagerMmap() override;
+
+  /** Copy a page out of the mapping. The part of the page past the end of the file reads as zeroes. */
+  auto ReadPage(page_id_t page_id, char *page_data) -> int override;
+
+  /** @throws Exception always, the database file is read-only */
+  auto WritePage(page_id_t page_id, const char *page_data) -> int override;
+
+  /** @throws Exception always, the database file is read-only */
+  void WritePages(std::vector<std::pair<page_id_t, const char *>> pages) override;
+
+  /** Serves the reads right away, the pages are in memory already. @throws Exception if any request is a write */
+  void SubmitAsync(std::vector<DiskRequest> requests) override;
+
+  /** @return the page within the mapping, nullptr if it lies past the end of the mapped file */
+  auto MappedPage(page_id_t page_id) -> const char * override;
+
+  auto IsReadOnly() const -> bool override { return true; }
+
+  /** Advise the kernel of an access pattern for the whole mapping, until the reads show a different one. */
+  void Advise(MmapAccessPattern pattern);
+
+  /** @return the access pattern the kernel was advised of last */
+  auto GetAccessPattern() const -> MmapAccessPattern { return pattern_.load(std::memory_order_relaxed); }
+
+ private:
+  /** Track the streak of sequential or random reads, and advise the kernel once it is long enough. */
+  void RecordAccess(page_id_t page_id);
+
+  char *data_{nullptr};
+  size_t mapped_size_{0};
+  std::atomic<MmapAccessPattern> pattern_{MmapAccessPattern::NORMAL};
+  // the access pattern is a heuristic, so these are updated without a latch and races only blur it
+  std::atomic<page_id_t> last_page_id_{INVALID_PAGE_ID};
+  /** Positive for a streak of sequential reads, negative for a streak of random ones. */
+  std::atomic<int> streak_{0};
+};
+
+}  // namespace bustub
@@ -0,0 +1,114 @@
+//===----------------------------------------------------------------------===//
+//
+//                         BusTub
+//
+// disk_manager_uring.h
+//
+// Identification: src/include/storage/disk/disk_manager_uring.h
+//
+// Copyright (c) 2015-2022, Carnegie Mellon University Database Group
+//
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include <condition_variable>  // NOLINT
+#include <cstdint>
+#include <mutex>  // NOLINT
+#include <string>
+#include <thread>  // NOLINT
+#include <utility>
+#include <vector>
+
+#include "storage/disk/disk_manager.h"
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+namespace bustub {
+
+/**
+ * DiskManagerUring serves asynchronous page reads and writes through io_uring. A batch of requests is submitted to the
+ * kernel with a single system call, up to queue_depth requests are in flight at once, and a completion thread reaps
+ * them and runs their callbacks. Synchronous reads and writes are served by DiskManager as before.
+ *
+ * The ring is set up through the raw system calls, so no library is needed. If the kernel does not support io_uring,
+ * or it is forbidden, e.g. by a seccomp filter, asynchronous I/O falls back to the thread pool of DiskManager.
+ */
+class DiskManagerUring : public DiskManager {
+ public:
+  /**
+   * Creates a new disk manager that writes to the specified database file.
+   * @param db_file the file name of the database file to write to
+   * @param options how to open and sync the database file
+   * @param queue_depth the maximum number of asynchronous requests in flight
+   * @param use_uring false to always use the thread pool, e.g. to compare the two
+   */
+  explicit DiskManagerUring(const std::string &db_file, const DiskManagerOptions &options = {},
+                            size_t queue_depth = DISK_MANAGER_URING_DEPTH, bool use_uring = true);
+
+  /** Waits for the requests in flight, then tears down the ring. */
+  ~DiskManagerUring() override;
+
+  /** Submit the requests to the ring, waiting for room if queue_depth requests are in flight already. */
+  void SubmitAsync(std::vector<DiskRequest> requests) override;
+
+  /** @return true if asynchronous I/O goes through io_uring, false if it falls back to the thread pool */
+  auto UsesUring() const -> bool { return ring_fd_ >= 0; }
+
+ private:
+  struct InFlightRequest;
+
+  /** Set up the ring, returns false if the kernel refuses to. */
+  auto SetUpRing(size_t queue_depth) -> bool;
+  /** Tear down whatever SetUpRing() has set up. */
+  void TearDownRing();
+  /** Push an entry to the submission queue. Caller should hold sq_latch_, and make sure there is room. */
+  void PushSqe(uint8_t opcode, InFlightRequest *request);
+  /**
+   * Hand the last to_submit pushed entries to the kernel. Caller should hold sq_latch_. If the kernel refuses them,
+   * they are taken back off the submission queue and no longer count as in flight, and their requests are appended to
+   * refused with the errno, for the caller to pass to Refuse() once it released sq_latch_.
+   */
+  void EnterRing(unsigned to_submit, std::vector<std::pair<InFlightRequest *, int>> *refused);
+  /** Main loop of the completion thread. */
+  void CompletionLoop();
+  /** Submit the rest of a request again after res bytes of it, or none if res is negative, went through. */
+  void Resubmit(InFlightRequest *request, int res);
+  /**
+   * Run the callback of a completed request, res is the result of its read or write. Short writes and interrupted
+   * requests are resubmitted instead.
+   */
+  void Complete(InFlightRequest *request, int res);
+  /** Run the callback of a request the kernel refused with the error. */
+  void Refuse(InFlightRequest *request, int error);
+
+  int ring_fd_{-1};
+  size_t queue_depth_{0};
+
+  // the rings shared with the kernel, as mapped by SetUpRing()
+  void *sq_ring_{nullptr};
+  size_t sq_ring_size_{0};
+  void *cq_ring_{nullptr};
+  size_t cq_ring_size_{0};
+  io_uring_sqe *sqes_{nullptr};
+  size_t sqes_size_{0};
+  unsigned *sq_tail_{nullptr};
+  unsigned sq_mask_{0};
+  unsigned *sq_array_{nullptr};
+  unsigned *cq_head_{nullptr};
+  unsigned *cq_tail_{nullptr};
+  unsigned cq_mask_{0};
+  io_uring_cqe *cqes_{nullptr};
+
+  /** Requests submitted but not completed yet. Protected by sq_latch_. */
+  size_t num_in_flight_{0};
+  /** Protects the submission queue. */
+  std::mutex sq_latch_;
+  /** Wakes up submitters waiting for room, and the destructor waiting for the last completion. */
+  std::condition_variable in_flight_cv_;
+  /** Reaps completions while the ring is set up. */
+  std::thread completion_thread_;
+};
+
+}  // namespace bustub
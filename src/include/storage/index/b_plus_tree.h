@@ -10,21 +10,74 @@
 //===----------------------------------------------------------------------===//
 #pragma once
 
+#include <atomic>
+#include <deque>
+#include <optional>
 #include <queue>
 #include <string>
 #include <vector>
 
+#include "buffer/buffer_pool_manager.h"
+#include "common/macros.h"
+#include "common/rwlatch.h"
 #include "concurrency/transaction.h"
+#include "recovery/index_undo.h"
+#include "recovery/log_manager.h"
 #include "storage/index/index_iterator.h"
 #include "storage/page/b_plus_tree_internal_page.h"
 #include "storage/page/b_plus_tree_leaf_page.h"
+#include "storage/page/page_guard.h"
 
 namespace bustub {
 
 #define BPLUSTREE_TYPE BPlusTree<KeyType, ValueType, KeyComparator>
 
-enum class Operation{
-  Read, Insert, Remove
+enum class Operation { Read, Insert, Remove };
+
+/**
+ * Context keeps track of the latches a modifying operation holds on its way down the tree. Pages are latched top-down,
+ * so the back of write_set_ is the deepest page latched so far and the page in front of it is its parent. The root
+ * latch and the page guards are released when the context goes out of scope, also when an exception is thrown.
+ */
+class Context {
+ public:
+  Context() = default;
+  ~Context() { ReleaseRootLatch(); }
+
+  DISALLOW_COPY_AND_MOVE(Context);
+
+  /** @brief Write-lock the latch protecting the root page id, and unlock it once the context goes away. */
+  void LockRoot(ReaderWriterLatch *root_latch) {
+    root_latch->WLock();
+    root_latch_ = root_latch;
+  }
+
+  /** @brief Unlock the root latch if this context still holds it. */
+  void ReleaseRootLatch() {
+    if (root_latch_ != nullptr) {
+      root_latch_->WUnlock();
+      root_latch_ = nullptr;
+    }
+  }
+
+  /** @return true if the root page id may still be changed by this operation */
+  auto IsRootLocked() const -> bool { return root_latch_ != nullptr; }
+
+  /** The write-latched pages on the path from the highest page that may change down to the current page. */
+  std::deque<WritePageGuard> write_set_;
+  /** Pages that were emptied by the operation, deleted once every latch has been released. */
+  std::vector<page_id_t> deleted_pages_;
+  /**
+   * A structure modification is logged as a single record once it is complete, so that recovery redoes all of it or
+   * nothing. Until then, the pages it changed stay latched: the ones still in write_set_, and the ones here, those it
+   * left behind on its way up, siblings, new pages and the header page.
+   */
+  std::vector<WritePageGuard> smo_guards_;
+  /** The changes of the structure modification so far, in the order they were made. */
+  std::vector<LogRecord> smo_changes_;
+
+ private:
+  ReaderWriterLatch *root_latch_{nullptr};
 };
 
 /**
@@ -36,15 +89,29 @@ enum class Operation{
  * (2) support insert & remove
  * (3) The structure should shrink and grow dynamically
  * (4) Implement index iterator for range scan
+ *
+ * Pages are only ever accessed through page guards, so every pin and latch is released on all paths, early returns
+ * and exceptions included. Readers descend to the leaf reading internal pages optimistically, without pinning or
+ * latching them, and crab down with read latches when that keeps failing. Writers first do the same and write-latch
+ * the leaf only, and retry holding write latches on the path from the highest page that may change when the leaf
+ * would split or underflow.
+ *
+ * With a log manager, every change to a page is logged physiologically, by the range of entries it replaced, before
+ * the latch on the page is released. Inserts into and removals from a leaf are logged on behalf of the transaction,
+ * to be undone if it never ends. A split, merge, redistribution or root change is logged as a single record without a
+ * transaction once it is complete, while every page it changed is still latched: it is only ever redone, all of it.
+ * Recovery hands the inserts and removals of transactions that never ended back to the tree, which undoes them by key,
+ * wherever the entries went since.
  */
 INDEX_TEMPLATE_ARGUMENTS
-class BPlusTree {
+class BPlusTree : public IndexUndo {
   using InternalPage = BPlusTreeInternalPage<KeyType, page_id_t, KeyComparator>;
   using LeafPage = BPlusTreeLeafPage<KeyType, ValueType, KeyComparator>;
 
  public:
   explicit BPlusTree(std::string name, BufferPoolManager *buffer_pool_manager, const KeyComparator &comparator,
-                     int leaf_max_size = LEAF_PAGE_SIZE, int internal_max_size = INTERNAL_PAGE_SIZE);
+                     int leaf_max_size = LEAF_PAGE_SIZE, int internal_max_size = INTERNAL_PAGE_SIZE,
+                     LogManager *log_manager = nullptr);
 
   // Returns true if this B+ tree has no keys and values.
   auto IsEmpty() const -> bool;
@@ -54,8 +121,6 @@ class BPlusTree {
 
   // Remove a key and its value from this B+ tree.
   void Remove(const KeyType &key, Transaction *transaction = nullptr);
-  
-  void SetPageParentId(page_id_t child, page_id_t parent);
 
   // return the value associated with a given key
   auto GetValue(const KeyType &key, std::vector<ValueType> *result, Transaction *transaction = nullptr) -> bool;
@@ -80,28 +145,79 @@ class BPlusTree {
   // read data from file and remove one by one
   void RemoveFromFile(const std::string &file_name, Transaction *transaction = nullptr);
 
+  /**
+   * Roll back an insert or a removal of a transaction that never ended, after a crash. Its leaf change is logged as a
+   * CLR, and the splits and merges it takes are logged as usual, while logging is still off for recovery.
+   */
+  void UndoIndexChange(LogRecord *record, Transaction *transaction) override;
+
  private:
-  void UpdateRootPageId(int insert_record = 0);
+  void UpdateRootPageId(Context *ctx, int insert_record = 0);
+
+  /*
+   * Insert and Remove, undo_next_lsn is set when they roll back a record of the transaction: the leaf change is then
+   * logged as a CLR going on with undo at undo_next_lsn.
+   */
+  auto InsertEntry(const KeyType &key, const ValueType &value, Transaction *transaction,
+                   std::optional<lsn_t> undo_next_lsn) -> bool;
+  void RemoveEntry(const KeyType &key, Transaction *transaction, std::optional<lsn_t> undo_next_lsn);
+
+  // used for insert
+  void StartNewTree(Context *ctx, const KeyType &key, const ValueType &value, Transaction *transaction,
+                    std::optional<lsn_t> undo_next_lsn);
+  auto InsertIntoLeaf(LeafPage *leaf, const KeyType &key, const ValueType &value, Transaction *transaction,
+                      std::optional<lsn_t> undo_next_lsn) -> int;
+  void InsertIntoParent(Context *ctx, KeyType key, page_id_t new_page_id);
 
   // used for remove
-  void HandleUnderflow(BPlusTreePage* page, Transaction *transaction = nullptr);
-  void GetSiblings(BPlusTreePage* page, page_id_t& left, page_id_t& right, Transaction* trx);
-  auto TryBorrow(BPlusTreePage* page, BPlusTreePage* sibling_page, InternalPage* parent_page, bool is_left_sibling) -> bool;
-  void MergePage(BPlusTreePage* left_page, BPlusTreePage* right_page, BPlusTreePage* parent_page, Transaction* trx);
+  void RemoveFromLeaf(LeafPage *leaf, const KeyType &key, Transaction *transaction,
+                      std::optional<lsn_t> undo_next_lsn);
+  void HandleUnderflow(Context *ctx);
+  void AdjustRoot(Context *ctx);
 
   // Concurrency control
-  auto IsPageSafe(BPlusTreePage* tree_page, Operation op) -> bool;
-  void ReleaseWLatches(Transaction* trx);
-  auto GetPageFromTrx(page_id_t page_id, Transaction* trx) -> Page*;
-
-  // auto GetLeafPage(const KeyType& key) -> Page*;
-  auto GetLeafPage(const KeyType& key, Transaction* trx, Operation op, bool is_first_pass = true) -> Page*;
-
+  auto IsPageSafe(const BPlusTreePage *tree_page, Operation op, bool is_root) const -> bool;
+  template <class GuardType>
+  auto TryFindLeafByVersion(const KeyType &key, bool leftmost, GuardType *leaf, bool *is_root) -> bool;
+  auto FindLeafRead(const KeyType &key, bool leftmost) -> ReadPageGuard;
+  auto FindLeafOptimistic(const KeyType &key, bool *is_root) -> WritePageGuard;
+  void FindLeafPessimistic(const KeyType &key, Operation op, Context *ctx);
+
+  // Logging
+  /** @return true if the changes to the pages are logged: logging is on, or recovery is undoing changes */
+  auto IsLogging() const -> bool { return log_manager_ != nullptr && (enable_logging || num_undos_ > 0); }
+  /** @return the change that replaced num_removed entries of a page with the entries [index, index + num_entries) */
+  template <class PageType>
+  static auto MakePageChange(PageType *page, int index, int num_removed, int num_entries) -> IndexPageChange;
+  /**
+   * Log that a leaf insert or removal replaced num_removed entries of a write-latched leaf with the entries
+   * [index, index + num_entries), and set the LSN of the leaf. The record is chained to the transaction, if any, as a
+   * CLR if undo_next_lsn is set.
+   */
+  void LogPageChange(LogRecordType type, LeafPage *leaf, int index, int num_removed, int num_entries,
+                     Transaction *transaction, std::optional<lsn_t> undo_next_lsn);
+  /**
+   * Add to the structure modification under way that num_removed entries of a page were replaced with the entries
+   * [index, index + num_entries). The page must stay latched in the context until the modification is logged.
+   */
+  template <class PageType>
+  void LogStructureChange(Context *ctx, LogRecordType type, PageType *page, int index, int num_removed,
+                          int num_entries);
+  /** Add a freshly filled page, all of its entries and its header, to the structure modification under way. */
+  template <class PageType>
+  void LogNewPage(Context *ctx, PageType *page) {
+    LogStructureChange(ctx, LogRecordType::INDEX_FORMAT_PAGE, page, 0, 0, page->GetSize());
+  }
+  /** Log the structure modification under way as a single record, and set the LSN of every page it changed. */
+  void LogStructureModification(Context *ctx);
 
   /* Debug Routines for FREE!! */
-  void ToGraph(BPlusTreePage *page, BufferPoolManager *bpm, std::ofstream &out) const;
+  void ToGraph(page_id_t page_id, BufferPoolManager *bpm, std::ofstream &out) const;
+
+  void ToString(page_id_t page_id, BufferPoolManager *bpm) const;
 
-  void ToString(BPlusTreePage *page, BufferPoolManager *bpm) const;
+  /** How often a descent without latches is tried before crabbing down with latches. */
+  static constexpr int OPTIMISTIC_DESCENT_ATTEMPTS = 3;
 
   // member variable
   std::string index_name_;
@@ -110,7 +226,12 @@ class BPlusTree {
   KeyComparator comparator_;
   int leaf_max_size_;
   int internal_max_size_;
+  /** Logs the changes to the pages of the tree, nullptr to not log them. */
+  LogManager *log_manager_;
+  /** Protects root_page_id_. Taken before the latch of any page. */
   ReaderWriterLatch root_latch_;
+  /** The changes recovery is undoing, they are logged before logging is turned on. */
+  std::atomic<int> num_undos_{0};
 };
 
 }  // namespace bustub
@@ -13,42 +13,73 @@
  * For range scan of b+ tree
  */
 #pragma once
+#include <optional>
+
 #include "storage/page/b_plus_tree_leaf_page.h"
+#include "storage/page/page_guard.h"
 
 namespace bustub {
 
+INDEX_TEMPLATE_ARGUMENTS
+class BPlusTree;
+
 #define INDEXITERATOR_TYPE IndexIterator<KeyType, ValueType, KeyComparator>
 
+/**
+ * IndexIterator walks the leaves of a B+ tree from left to right. It keeps the leaf it currently points into pinned
+ * and read-latched, so the entry returned by operator* stays valid until the iterator moves on. Iterators are
+ * move-only; a default-constructed iterator is the end iterator.
+ *
+ * Moving to the next leaf never holds two leaf latches at once, so a merge may free the next leaf in between. The
+ * iterator notices that the leaf it left has changed since and looks the last key it returned up in the tree again.
+ */
 INDEX_TEMPLATE_ARGUMENTS
 class IndexIterator {
  public:
-  // you may define your own constructor based on your member variables
   IndexIterator() = default;
-  IndexIterator(page_id_t pg_id, int idx, BufferPoolManager* bpm) :
-    pg_id_(pg_id), idx_(idx), index_bpm_(bpm) {}
+
+  /**
+   * @brief Start iterating at the given slot of a leaf. Leaves that have no entry left at that slot are skipped.
+   * @param tree the tree to look keys up in again
+   * @param bpm the buffer pool manager of the tree
+   * @param comparator the key comparator of the tree, which must outlive the iterator
+   * @param guard the read-latched leaf to start from
+   * @param index the slot of the first entry
+   * @param start_key the key the scan started at, std::nullopt if it started at the first entry of the tree
+   */
+  IndexIterator(BPlusTree<KeyType, ValueType, KeyComparator> *tree, BufferPoolManager *bpm,
+                const KeyComparator *comparator, ReadPageGuard guard, int index, std::optional<KeyType> start_key);
   ~IndexIterator();  // NOLINT
 
+  IndexIterator(IndexIterator &&that) noexcept = default;
+  auto operator=(IndexIterator &&that) noexcept -> IndexIterator & = default;
+
   auto IsEnd() -> bool;
 
   auto operator*() -> const MappingType &;
 
   auto operator++() -> IndexIterator &;
 
-  auto operator==(const IndexIterator &it) const -> bool { 
-    return pg_id_ == it.pg_id_ && idx_ == it.idx_;
-  }
+  auto operator==(const IndexIterator &itr) const -> bool { return page_id_ == itr.page_id_ && index_ == itr.index_; }
 
-  auto operator!=(const IndexIterator &itr) const -> bool { 
-    return pg_id_ != it.pg_id_ || idx_ != it.idx_;
-  }
+  auto operator!=(const IndexIterator &itr) const -> bool { return !(*this == itr); }
 
  private:
-  // add your own private member variables here
-  page_id_t pg_id_ = INVALID_PAGE_ID;
-  Page* pg_ = nullptr;
-  B_PLUS_TREE_LEAF_PAGE_TYPE* leaf_page_ = nullptr;
-  int idx_ = 0;
-  BufferPoolManager* index_bpm_ = nullptr;
+  /** Follow the leaf chain until index_ points at an entry, or the last leaf is exhausted. */
+  void SkipExhaustedLeaves();
+
+  /** Start over from the tree at the first entry after last_key_, or at the start of the scan if there is none. */
+  void Reseek();
+
+  BPlusTree<KeyType, ValueType, KeyComparator> *tree_{nullptr};
+  BufferPoolManager *bpm_{nullptr};
+  const KeyComparator *comparator_{nullptr};
+  ReadPageGuard guard_;
+  page_id_t page_id_{INVALID_PAGE_ID};
+  int index_{0};
+  std::optional<KeyType> start_key_;
+  /** The last key of the last leaf left behind, every entry up to it has been visited. */
+  std::optional<KeyType> last_key_;
 };
 
 }  // namespace bustub
@@ -17,7 +17,7 @@
 namespace bustub {
 
 #define B_PLUS_TREE_INTERNAL_PAGE_TYPE BPlusTreeInternalPage<KeyType, ValueType, KeyComparator>
-#define INTERNAL_PAGE_HEADER_SIZE 24
+#define INTERNAL_PAGE_HEADER_SIZE 28
 #define INTERNAL_PAGE_SIZE ((BUSTUB_PAGE_SIZE - INTERNAL_PAGE_HEADER_SIZE) / (sizeof(MappingType)))
 /**
  * Store n indexed keys and n+1 child pointers (page_id) within internal page.
@@ -36,19 +36,53 @@ INDEX_TEMPLATE_ARGUMENTS
 class BPlusTreeInternalPage : public BPlusTreePage {
  public:
   // must call initialize method after "create" a new node
-  void Init(page_id_t page_id, page_id_t parent_id = INVALID_PAGE_ID, int max_size = INTERNAL_PAGE_SIZE);
+  void Init(page_id_t page_id, int max_size = INTERNAL_PAGE_SIZE);
 
   auto KeyAt(int index) const -> KeyType;
   void SetKeyAt(int index, const KeyType &key);
   auto ValueAt(int index) const -> ValueType;
-  void Insert(const KeyType& key, const ValueType& value, const KeyComparator& comparator);
-  void SetKV(int index, KeyType key, ValueType value);
-  auto ArrayIndex(const page_id_t& child_id) const -> int;
-  void SetValueAt(int index, ValueType v);
-  void RemoveAt(int index);
+  void SetValueAt(int index, const ValueType &value);
+  auto GetItem(int index) const -> const MappingType &;
+
+  /** @return the index of the given child pointer, -1 if this page doesn't point to it */
+  auto ValueIndex(const ValueType &value) const -> int;
+
+  /** @return the child pointer of the subtree that may contain key */
+  auto Lookup(const KeyType &key, const KeyComparator &comparator) const -> ValueType;
+
+  /** Turn a freshly initialized page into a root with two children, old_value on the left of new_key. */
+  void PopulateNewRoot(const ValueType &old_value, const KeyType &new_key, const ValueType &new_value);
+
+  /**
+   * Insert new_key and new_value right after the child pointer old_value. The page must not be full.
+   * @return the size of the page after the insertion
+   */
+  auto InsertNodeAfter(const ValueType &old_value, const KeyType &new_key, const ValueType &new_value) -> int;
+
+  /**
+   * Insert new_key and new_value right after the child pointer old_value into a full page, then move the upper half
+   * of the entries to a freshly initialized recipient. The first key of the recipient is the key to push up.
+   */
+  void InsertAndSplitTo(const ValueType &old_value, const KeyType &new_key, const ValueType &new_value,
+                        BPlusTreeInternalPage *recipient);
+
+  /** Remove the entry at index, shifting the following entries down. */
+  void Remove(int index);
+
+  /** Remove the only child pointer left in the page. Used when the root is collapsed. */
+  auto RemoveAndReturnOnlyChild() -> ValueType;
+
+  /** Append all entries to recipient, the left sibling. middle_key is the parent's separator between both pages. */
+  void MoveAllTo(BPlusTreeInternalPage *recipient, const KeyType &middle_key);
+
+  /** Move the first child to the end of recipient, the left sibling. middle_key is the parent's separator. */
+  void MoveFirstToEndOf(BPlusTreeInternalPage *recipient, const KeyType &middle_key);
+
+  /** Move the last child to the front of recipient, the right sibling. middle_key is the parent's separator. */
+  void MoveLastToFrontOf(BPlusTreeInternalPage *recipient, const KeyType &middle_key);
+
  private:
   // Flexible array member for page data.
-  MappingType array_[1]; // std::pair<KeyType, ValueType>
-
+  MappingType array_[1];
 };
 }  // namespace bustub
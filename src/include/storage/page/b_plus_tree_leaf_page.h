@@ -18,7 +18,7 @@
 namespace bustub {
 
 #define B_PLUS_TREE_LEAF_PAGE_TYPE BPlusTreeLeafPage<KeyType, ValueType, KeyComparator>
-#define LEAF_PAGE_HEADER_SIZE 28
+#define LEAF_PAGE_HEADER_SIZE 32
 #define LEAF_PAGE_SIZE ((BUSTUB_PAGE_SIZE - LEAF_PAGE_HEADER_SIZE) / sizeof(MappingType))
 
 /**
@@ -31,29 +31,54 @@ namespace bustub {
  * | HEADER | KEY(1) + RID(1) | KEY(2) + RID(2) | ... | KEY(n) + RID(n)
  *  ----------------------------------------------------------------------
  *
- *  Header format (size in byte, 28 bytes in total):
+ *  Header format (size in byte, 32 bytes in total):
  *  ---------------------------------------------------------------------
- * | PageType (4) | LSN (4) | CurrentSize (4) | MaxSize (4) |
+ * | PageType (4) | LayoutVersion (4) | LSN (8) | CurrentSize (4) |
  *  ---------------------------------------------------------------------
- *  -----------------------------------------------
- * | ParentPageId (4) | PageId (4) | NextPageId (4)
- *  -----------------------------------------------
+ *  --------------------------------------------
+ * | MaxSize (4) | PageId (4) | NextPageId (4) |
+ *  --------------------------------------------
  */
 INDEX_TEMPLATE_ARGUMENTS
 class BPlusTreeLeafPage : public BPlusTreePage {
  public:
   // After creating a new leaf page from buffer pool, must call initialize
   // method to set default values
-  void Init(page_id_t page_id, page_id_t parent_id = INVALID_PAGE_ID, int max_size = LEAF_PAGE_SIZE);
+  void Init(page_id_t page_id, int max_size = LEAF_PAGE_SIZE);
   // helper methods
   auto GetNextPageId() const -> page_id_t;
   void SetNextPageId(page_id_t next_page_id);
   auto KeyAt(int index) const -> KeyType;
-  void SetKV(int index, KeyType key, ValueType value);
-  void Insert(const KeyType& key, const ValueType& value, const KeyComparator& comparator);
-  void Remove(const KeyType& key, const KeyComparator& comparator);
-  void MoveSplitedData(B_PLUS_TREE_LEAF_PAGE_TYPE* target_leaf);
-  auto Lowerbound(const KeyType& key, const KeyComparator& comparator) const -> int;
+  auto ValueAt(int index) const -> ValueType;
+  auto GetItem(int index) const -> const MappingType &;
+
+  /** @return the index of the first key that is not less than key, GetSize() if there is none */
+  auto KeyIndex(const KeyType &key, const KeyComparator &comparator) const -> int;
+
+  /** @return true and the value associated with key if the key is present, false otherwise */
+  auto Lookup(const KeyType &key, ValueType *value, const KeyComparator &comparator) const -> bool;
+
+  /**
+   * Insert key and value in key order. The page may reach its max size, the caller splits it then.
+   * @return the size of the page after the insertion, unchanged if the key already existed
+   */
+  auto Insert(const KeyType &key, const ValueType &value, const KeyComparator &comparator) -> int;
+
+  /** @return the size of the page after removing key, unchanged if the key didn't exist */
+  auto RemoveAndDeleteRecord(const KeyType &key, const KeyComparator &comparator) -> int;
+
+  /** Move the upper half of the entries to a freshly initialized recipient, the new right sibling. */
+  void MoveHalfTo(BPlusTreeLeafPage *recipient);
+
+  /** Append all entries to recipient, the left sibling, and hand over the next page id. */
+  void MoveAllTo(BPlusTreeLeafPage *recipient);
+
+  /** Move the first entry to the end of recipient, the left sibling. */
+  void MoveFirstToEndOf(BPlusTreeLeafPage *recipient);
+
+  /** Move the last entry to the front of recipient, the right sibling. */
+  void MoveLastToFrontOf(BPlusTreeLeafPage *recipient);
+
  private:
   page_id_t next_page_id_;
   // Flexible array member for page data.
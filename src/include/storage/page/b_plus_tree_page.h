@@ -33,17 +33,18 @@ enum class IndexPageType { INVALID_INDEX_PAGE = 0, LEAF_PAGE, INTERNAL_PAGE };
  * It actually serves as a header part for each B+ tree page and
  * contains information shared by both leaf page and internal page.
  *
- * Header format (size in byte, 24 bytes in total):
- * ----------------------------------------------------------------------------
- * | PageType (4) | LSN (4) | CurrentSize (4) | MaxSize (4) |
- * ----------------------------------------------------------------------------
- * | ParentPageId (4) | PageId(4) |
- * ----------------------------------------------------------------------------
+ * Pages don't know their parent: every operation reaches a page from the root and keeps the guards of the pages on
+ * its path, which is all it needs to go back up.
+ *
+ * Header format (size in byte, 28 bytes in total), starting with the header every page has, see Page:
+ * --------------------------------------------------------------------------------------------
+ * | PageType (4) | LayoutVersion (4) | LSN (8) | CurrentSize (4) | MaxSize (4) | PageId(4) |
+ * --------------------------------------------------------------------------------------------
  */
 class BPlusTreePage {
  public:
   auto IsLeafPage() const -> bool;
-  auto IsRootPage() const -> bool;
+  /** Set the page type, when formatting the page. Stamps the current layout version as well. */
   void SetPageType(IndexPageType page_type);
 
   auto GetSize() const -> int;
@@ -54,9 +55,6 @@ class BPlusTreePage {
   void SetMaxSize(int max_size);
   auto GetMinSize() const -> int;
 
-  auto GetParentPageId() const -> page_id_t;
-  void SetParentPageId(page_id_t parent_page_id);
-
   auto GetPageId() const -> page_id_t;
   void SetPageId(page_id_t page_id);
 
@@ -64,12 +62,15 @@ class BPlusTreePage {
 
  private:
   // member variable, attributes that both internal and leaf page share
-  IndexPageType page_type_ __attribute__((__unused__)); // 避免编译器产生变量未使用warning
-  lsn_t lsn_ __attribute__((__unused__)); // log sequence number, used in project 4
-  int size_ __attribute__((__unused__)); // # of <K, V> pairs in page
-  int max_size_ __attribute__((__unused__)); // max # of <K, V>
-  page_id_t parent_page_id_ __attribute__((__unused__));
-  page_id_t page_id_ __attribute__((__unused__));
+  IndexPageType page_type_;
+  uint32_t layout_version_;
+  // log sequence number, as bytes so that the header has no padding for the entries of the pages to move into
+  char lsn_[sizeof(lsn_t)];
+  int size_;      // # of <K, V> pairs in page
+  int max_size_;  // max # of <K, V>
+  page_id_t page_id_;
 };
 
+static_assert(sizeof(BPlusTreePage) == 28);
+
 }  // namespace bustub
@@ -21,14 +21,21 @@ namespace bustub {
  * our case, we will contain information about table/index name (length less than
  * 32 bytes) and their corresponding root_id
  *
+ * The page starts with the common page header, so that the LSN of the last record logged for it is where the buffer
+ * pool and recovery look for it. A page of zeroes is an empty header page.
+ *
  * Format (size in byte):
- *  -----------------------------------------------------------------
- * | RecordCount (4) | Entry_1 name (32) | Entry_1 root_id (4) | ... |
- *  -----------------------------------------------------------------
+ *  ------------------------------------------------------------------------------------------------------------
+ * | PageId (4) | LayoutVersion (4) | LSN (8) | RecordCount (4) | Entry_1 name (32) | Entry_1 root_id (4) | ... |
+ *  ------------------------------------------------------------------------------------------------------------
  */
 class HeaderPage : public Page {
  public:
-  void Init() { SetRecordCount(0); }
+  void Init() {
+    memcpy(GetData(), &HEADER_PAGE_ID, sizeof(page_id_t));
+    SetLayoutVersion();
+    SetRecordCount(0);
+  }
   /**
    * Record related
    */
@@ -41,6 +48,10 @@ class HeaderPage : public Page {
   auto GetRecordCount() -> int;
 
  private:
+  static constexpr size_t OFFSET_RECORD_COUNT = SIZE_PAGE_HEADER;
+  static constexpr size_t OFFSET_RECORDS = OFFSET_RECORD_COUNT + 4;
+  static constexpr size_t RECORD_SIZE = 36;
+
   /**
    * helper functions
    */
@@ -12,10 +12,14 @@
 
 #pragma once
 
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
 #include <cstring>
 #include <iostream>
 
 #include "common/config.h"
+#include "common/macros.h"
 #include "common/rwlatch.h"
 
 namespace bustub {
@@ -24,21 +28,37 @@ namespace bustub {
  * Page is the basic unit of storage within the database system. Page provides a wrapper for actual data pages being
  * held in main memory. Page also contains book-keeping information that is used by the buffer pool manager, e.g.
  * pin count, dirty flag, page id, etc.
+ *
+ * The data itself is not stored inline. Inside a buffer pool, a Page is the descriptor of a frame, pointing into the
+ * pool's frame arena, and descriptors are padded to a cache line so that latching or pinning one frame doesn't
+ * contend with its neighbours. A page constructed on its own allocates its own page-aligned data.
  */
-class Page {
+class alignas(BUSTUB_CACHELINE_SIZE) Page {
   // There is book-keeping information inside the page that should only be relevant to the buffer pool manager.
   friend class BufferPoolManagerInstance;
 
  public:
-  /** Constructor. Zeros out the page data. */
-  Page() { ResetMemory(); }
+  /** Constructor. Allocates the page data and zeros it out. */
+  Page()
+      : data_(static_cast<char *>(std::aligned_alloc(BUSTUB_PAGE_SIZE, BUSTUB_PAGE_SIZE))), owns_data_(true) {
+    ResetMemory();
+  }
 
-  /** Default destructor. */
-  ~Page() = default;
+  /** Destructor. Frees the page data if the page allocated it. */
+  ~Page() {
+    if (owns_data_) {
+      std::free(data_);
+    }
+  }
+
+  DISALLOW_COPY_AND_MOVE(Page);
 
   /** @return the actual data contained within this page */
   inline auto GetData() -> char * { return data_; }
 
+  /** @return the actual data contained within this page, read-only */
+  inline auto GetData() const -> const char * { return data_; }
+
   /** @return the page id of this page */
   inline auto GetPageId() -> page_id_t { return page_id_; }
 
@@ -48,11 +68,17 @@ class Page {
   /** @return true if the page in memory has been modified from the page on disk, false otherwise */
   inline auto IsDirty() -> bool { return is_dirty_; }
 
-  /** Acquire the page write latch. */
-  inline void WLatch() { rwlatch_.WLock(); }
+  /** Acquire the page write latch. The version of the page is odd until the latch is released. */
+  inline void WLatch() {
+    rwlatch_.WLock();
+    version_.fetch_add(1);
+  }
 
   /** Release the page write latch. */
-  inline void WUnlatch() { rwlatch_.WUnlock(); }
+  inline void WUnlatch() {
+    version_.fetch_add(1);
+    rwlatch_.WUnlock();
+  }
 
   /** Acquire the page read latch. */
   inline void RLatch() { rwlatch_.RLock(); }
@@ -60,34 +86,86 @@ class Page {
   /** Release the page read latch. */
   inline void RUnlatch() { rwlatch_.RUnlock(); }
 
+  /**
+   * @return the version of the page. It is bumped when the page is write-latched and again when it is unlatched, so it
+   * is odd while the content may be changing. See BufferPoolManager::OptimisticRead().
+   */
+  inline auto GetVersion() const -> uint64_t { return version_.load(std::memory_order_acquire); }
+
+  /** @return true if the page has not been write-latched since GetVersion() returned version */
+  inline auto ValidateVersion(uint64_t version) const -> bool {
+    // the fence keeps the reads of the content and of the page id from being reordered after the load below
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return version_.load(std::memory_order_relaxed) == version;
+  }
+
   /** @return the page LSN. */
   inline auto GetLSN() -> lsn_t { return *reinterpret_cast<lsn_t *>(GetData() + OFFSET_LSN); }
 
   /** Sets the page LSN. */
   inline void SetLSN(lsn_t lsn) { memcpy(GetData() + OFFSET_LSN, &lsn, sizeof(lsn_t)); }
 
+  /** @return the layout version the page was formatted with, 0 if it never was */
+  inline auto GetLayoutVersion() const -> uint32_t {
+    return *reinterpret_cast<const uint32_t *>(GetData() + OFFSET_LAYOUT_VERSION);
+  }
+
+  /**
+   * Version of the page header layout, stamped into every table and B+ tree page when it is formatted. Version 1 is
+   * the one with 64-bit LSNs; pages before it had no version, and a 32-bit LSN where it is now.
+   */
+  static constexpr uint32_t LAYOUT_VERSION = 1;
+
+  /**
+   * Every page formatted by a table or an index starts with the same header, the first field is up to the page type:
+   * --------------------------------------------------------
+   * | PageId or PageType (4) | LayoutVersion (4) | LSN (8) |
+   * --------------------------------------------------------
+   */
+  static constexpr size_t SIZE_PAGE_HEADER = 16;
+  static constexpr size_t OFFSET_PAGE_START = 0;
+  static constexpr size_t OFFSET_LAYOUT_VERSION = 4;
+  static constexpr size_t OFFSET_LSN = 8;
+
  protected:
   static_assert(sizeof(page_id_t) == 4);
-  static_assert(sizeof(lsn_t) == 4);
+  static_assert(sizeof(lsn_t) == 8);
 
-  static constexpr size_t SIZE_PAGE_HEADER = 8;
-  static constexpr size_t OFFSET_PAGE_START = 0;
-  static constexpr size_t OFFSET_LSN = 4;
+  /** Stamp the current layout version, when formatting the page. */
+  inline void SetLayoutVersion() { memcpy(GetData() + OFFSET_LAYOUT_VERSION, &LAYOUT_VERSION, sizeof(uint32_t)); }
 
  private:
+  /** Constructor for a frame descriptor of a buffer pool. The data is owned by the buffer pool. */
+  explicit Page(char *data) : data_(data) { ResetMemory(); }
+
   /** Zeroes out the data that is held within the page. */
   inline void ResetMemory() { memset(data_, OFFSET_PAGE_START, BUSTUB_PAGE_SIZE); }
 
-  /** The actual data that is stored within a page. */
-  char data_[BUSTUB_PAGE_SIZE]{};
-  /** The ID of this page. */
-  page_id_t page_id_ = INVALID_PAGE_ID;
+  /** The actual data that is stored within a page, BUSTUB_PAGE_SIZE bytes. */
+  char *data_;
+  /** True if data_ was allocated by the page itself rather than handed in by a buffer pool. */
+  bool owns_data_{false};
+  /**
+   * The ID of this page. Atomic because optimistic readers look at it without the buffer pool latch; it only changes
+   * while the version is odd, so a reader that saw the wrong page fails validation.
+   */
+  std::atomic<page_id_t> page_id_{INVALID_PAGE_ID};
   /** The pin count of this page. */
   int pin_count_ = 0;
   /** True if the page is dirty, i.e. it is different from its corresponding page on disk. */
   bool is_dirty_ = false;
+  /** While the page is dirty, no record before its recLSN has changes that are missing from the page on disk. */
+  lsn_t rec_lsn_ = INVALID_LSN;
+  /** True while a prefetch is reading the page into the frame. */
+  bool io_pending_ = false;
+  /** True while the background writer writes a copy of the page back. It stays dirty until the copy is on disk. */
+  bool write_pending_ = false;
+  /** True if the page was marked dirty while write_pending_, the copy being written back is outdated then. */
+  bool redirtied_ = false;
   /** Page latch. */
   ReaderWriterLatch rwlatch_;
+  /** Bumped on every write latch and unlatch, including the ones of the buffer pool when it reuses the frame. */
+  std::atomic<uint64_t> version_{0};
 };
 
 }  // namespace bustub
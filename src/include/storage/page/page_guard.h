@@ -0,0 +1,213 @@
+//===----------------------------------------------------------------------===//
+//
+//                         BusTub
+//
+// page_guard.h
+//
+// Identification: src/include/storage/page/page_guard.h
+//
+// Copyright (c) 2015-2022, Carnegie Mellon University Database Group
+//
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include <type_traits>
+
+#include "storage/page/page.h"
+
+namespace bustub {
+
+class BufferPoolManager;
+class ReadPageGuard;
+class WritePageGuard;
+
+/**
+ * BasicPageGuard keeps a page pinned in the buffer pool for as long as the guard lives, and unpins it when the guard
+ * is destroyed or dropped. The page is only reported dirty when it was accessed through one of the mutable accessors.
+ *
+ * Guards are move-only: exactly one guard is responsible for unpinning a page. A default-constructed or moved-from
+ * guard holds no page, and so does a guard returned for a page the buffer pool could not bring in.
+ */
+class BasicPageGuard {
+ public:
+  BasicPageGuard() = default;
+
+  /**
+   * @brief Take over the responsibility of unpinning a page.
+   * @param bpm the buffer pool manager the page was pinned in
+   * @param page a page pinned by the caller, may be nullptr
+   */
+  BasicPageGuard(BufferPoolManager *bpm, Page *page) : bpm_(bpm), page_(page) {}
+
+  BasicPageGuard(const BasicPageGuard &) = delete;
+  auto operator=(const BasicPageGuard &) -> BasicPageGuard & = delete;
+
+  /** @brief Move the page over from another guard, which is left empty. */
+  BasicPageGuard(BasicPageGuard &&that) noexcept;
+
+  /** @brief Drop the page held by this guard, then move the page over from another guard, which is left empty. */
+  auto operator=(BasicPageGuard &&that) noexcept -> BasicPageGuard &;
+
+  ~BasicPageGuard();
+
+  /** @brief Unpin the page now instead of at destruction. The guard is empty afterwards. No-op on an empty guard. */
+  void Drop();
+
+  /**
+   * @brief Read-latch the guarded page and hand it over to a ReadPageGuard, without unpinning it in between. This
+   * guard is empty afterwards.
+   */
+  auto UpgradeRead() -> ReadPageGuard;
+
+  /**
+   * @brief Write-latch the guarded page and hand it over to a WritePageGuard, without unpinning it in between. This
+   * guard is empty afterwards. A page that was marked dirty stays dirty.
+   */
+  auto UpgradeWrite() -> WritePageGuard;
+
+  /** @return the id of the guarded page, INVALID_PAGE_ID if the guard is empty */
+  auto PageId() const -> page_id_t { return page_ == nullptr ? INVALID_PAGE_ID : page_->GetPageId(); }
+
+  /** @return the content of the guarded page, read-only */
+  auto GetData() const -> const char * { return page_->GetData(); }
+
+  /** @return the content of the guarded page. The page is marked dirty. */
+  auto GetDataMut() -> char * {
+    is_dirty_ = true;
+    return page_->GetData();
+  }
+
+  /**
+   * @brief View the guarded page as T, read-only. T is either a subclass of Page, such as TablePage, or a layout
+   * type placed over the page content, such as a B+ tree node.
+   */
+  template <class T>
+  auto As() const -> const T * {
+    if constexpr (std::is_base_of_v<Page, T>) {
+      return static_cast<const T *>(page_);
+    } else {
+      return reinterpret_cast<const T *>(GetData());
+    }
+  }
+
+  /** @brief Same as As(), but the view is mutable and the page is marked dirty. */
+  template <class T>
+  auto AsMut() -> T * {
+    if constexpr (std::is_base_of_v<Page, T>) {
+      is_dirty_ = true;
+      return static_cast<T *>(page_);
+    } else {
+      return reinterpret_cast<T *>(GetDataMut());
+    }
+  }
+
+ private:
+  friend class ReadPageGuard;
+  friend class WritePageGuard;
+
+  BufferPoolManager *bpm_{nullptr};
+  Page *page_{nullptr};
+  bool is_dirty_{false};
+};
+
+/**
+ * ReadPageGuard keeps a page pinned and read-latched for as long as the guard lives. Destroying or dropping the guard
+ * releases the latch first and unpins the page second.
+ */
+class ReadPageGuard {
+ public:
+  ReadPageGuard() = default;
+
+  /**
+   * @brief Take over the responsibility of unlatching and unpinning a page.
+   * @param bpm the buffer pool manager the page was pinned in
+   * @param page a page pinned and read-latched by the caller, may be nullptr
+   */
+  ReadPageGuard(BufferPoolManager *bpm, Page *page) : guard_(bpm, page) {}
+
+  ReadPageGuard(const ReadPageGuard &) = delete;
+  auto operator=(const ReadPageGuard &) -> ReadPageGuard & = delete;
+  ReadPageGuard(ReadPageGuard &&that) noexcept = default;
+
+  /** @brief Unlatch and unpin the page held by this guard, then move the page over from another guard. */
+  auto operator=(ReadPageGuard &&that) noexcept -> ReadPageGuard &;
+
+  ~ReadPageGuard();
+
+  /** @brief Unlatch and unpin the page now. The guard is empty afterwards. No-op on an empty guard. */
+  void Drop();
+
+  /** @return the id of the guarded page, INVALID_PAGE_ID if the guard is empty */
+  auto PageId() const -> page_id_t { return guard_.PageId(); }
+
+  /** @return the content of the guarded page */
+  auto GetData() const -> const char * { return guard_.GetData(); }
+
+  /** @brief View the guarded page as T, see BasicPageGuard::As(). */
+  template <class T>
+  auto As() const -> const T * {
+    return guard_.As<T>();
+  }
+
+ private:
+  friend class BasicPageGuard;
+
+  BasicPageGuard guard_;
+};
+
+/**
+ * WritePageGuard keeps a page pinned and write-latched for as long as the guard lives. Destroying or dropping the
+ * guard releases the latch first and unpins the page second, dirty if it was accessed through a mutable accessor.
+ */
+class WritePageGuard {
+ public:
+  WritePageGuard() = default;
+
+  /**
+   * @brief Take over the responsibility of unlatching and unpinning a page.
+   * @param bpm the buffer pool manager the page was pinned in
+   * @param page a page pinned and write-latched by the caller, may be nullptr
+   */
+  WritePageGuard(BufferPoolManager *bpm, Page *page) : guard_(bpm, page) {}
+
+  WritePageGuard(const WritePageGuard &) = delete;
+  auto operator=(const WritePageGuard &) -> WritePageGuard & = delete;
+  WritePageGuard(WritePageGuard &&that) noexcept = default;
+
+  /** @brief Unlatch and unpin the page held by this guard, then move the page over from another guard. */
+  auto operator=(WritePageGuard &&that) noexcept -> WritePageGuard &;
+
+  ~WritePageGuard();
+
+  /** @brief Unlatch and unpin the page now. The guard is empty afterwards. No-op on an empty guard. */
+  void Drop();
+
+  /** @return the id of the guarded page, INVALID_PAGE_ID if the guard is empty */
+  auto PageId() const -> page_id_t { return guard_.PageId(); }
+
+  /** @return the content of the guarded page, read-only */
+  auto GetData() const -> const char * { return guard_.GetData(); }
+
+  /** @return the content of the guarded page. The page is marked dirty. */
+  auto GetDataMut() -> char * { return guard_.GetDataMut(); }
+
+  /** @brief View the guarded page as T, see BasicPageGuard::As(). */
+  template <class T>
+  auto As() const -> const T * {
+    return guard_.As<T>();
+  }
+
+  /** @brief View the guarded page as a mutable T and mark it dirty, see BasicPageGuard::AsMut(). */
+  template <class T>
+  auto AsMut() -> T * {
+    return guard_.AsMut<T>();
+  }
+
+ private:
+  friend class BasicPageGuard;
+
+  BasicPageGuard guard_;
+};
+
+}  // namespace bustub
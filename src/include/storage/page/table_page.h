@@ -32,10 +32,10 @@ namespace bustub {
  *                                ^
  *                                free space pointer
  *
- *  Header format (size in bytes):
- *  ----------------------------------------------------------------------------
- *  | PageId (4)| LSN (4)| PrevPageId (4)| NextPageId (4)| FreeSpacePointer(4) |
- *  ----------------------------------------------------------------------------
+ *  Header format (size in bytes), starting with the header every page has, see Page:
+ *  ----------------------------------------------------------------------------------------------------
+ *  | PageId (4)| LayoutVersion (4)| LSN (8)| PrevPageId (4)| NextPageId (4)| FreeSpacePointer(4) |
+ *  ----------------------------------------------------------------------------------------------------
  *  ----------------------------------------------------------------
  *  | TupleCount (4) | Tuple_1 offset (4) | Tuple_1 size (4) | ... |
  *  ----------------------------------------------------------------
@@ -54,13 +54,17 @@ class TablePage : public Page {
   void Init(page_id_t page_id, uint32_t page_size, page_id_t prev_page_id, LogManager *log_manager, Transaction *txn);
 
   /** @return the page ID of this table page */
-  auto GetTablePageId() -> page_id_t { return *reinterpret_cast<page_id_t *>(GetData()); }
+  auto GetTablePageId() const -> page_id_t { return *reinterpret_cast<const page_id_t *>(GetData()); }
 
   /** @return the page ID of the previous table page */
-  auto GetPrevPageId() -> page_id_t { return *reinterpret_cast<page_id_t *>(GetData() + OFFSET_PREV_PAGE_ID); }
+  auto GetPrevPageId() const -> page_id_t {
+    return *reinterpret_cast<const page_id_t *>(GetData() + OFFSET_PREV_PAGE_ID);
+  }
 
   /** @return the page ID of the next table page */
-  auto GetNextPageId() -> page_id_t { return *reinterpret_cast<page_id_t *>(GetData() + OFFSET_NEXT_PAGE_ID); }
+  auto GetNextPageId() const -> page_id_t {
+    return *reinterpret_cast<const page_id_t *>(GetData() + OFFSET_NEXT_PAGE_ID);
+  }
 
   /** Set the page id of the previous page in the table. */
   void SetPrevPageId(page_id_t prev_page_id) {
@@ -121,7 +125,7 @@ class TablePage : public Page {
    * @param lock_manager the lock manager
    * @return true if the read is successful (i.e. the tuple exists)
    */
-  auto GetTuple(const RID &rid, Tuple *tuple, Transaction *txn, LockManager *lock_manager) -> bool;
+  auto GetTuple(const RID &rid, Tuple *tuple, Transaction *txn, LockManager *lock_manager) const -> bool;
 
   /** @return the rid of the first tuple in this page */
 
@@ -129,29 +133,38 @@ class TablePage : public Page {
    * @param[out] first_rid the RID of the first tuple in this page
    * @return true if the first tuple exists, false otherwise
    */
-  auto GetFirstTupleRid(RID *first_rid) -> bool;
+  auto GetFirstTupleRid(RID *first_rid) const -> bool;
 
   /**
    * @param cur_rid the RID of the current tuple
    * @param[out] next_rid the RID of the tuple following the current tuple
    * @return true if the next tuple exists, false otherwise
    */
-  auto GetNextTupleRid(const RID &cur_rid, RID *next_rid) -> bool;
+  auto GetNextTupleRid(const RID &cur_rid, RID *next_rid) const -> bool;
+
+  /**
+   * A cheap check callers can make before latching the page for writing or marking it dirty.
+   * @param tuple the tuple to insert
+   * @return true if the tuple fits into the free space of this page
+   */
+  auto HasSpaceFor(const Tuple &tuple) const -> bool { return GetFreeSpaceRemaining() >= tuple.size_ + SIZE_TUPLE; }
 
  private:
   static_assert(sizeof(page_id_t) == 4);
 
-  static constexpr size_t SIZE_TABLE_PAGE_HEADER = 24;
+  static constexpr size_t SIZE_TABLE_PAGE_HEADER = 32;
   static constexpr size_t SIZE_TUPLE = 8;
-  static constexpr size_t OFFSET_PREV_PAGE_ID = 8;
-  static constexpr size_t OFFSET_NEXT_PAGE_ID = 12;
-  static constexpr size_t OFFSET_FREE_SPACE = 16;
-  static constexpr size_t OFFSET_TUPLE_COUNT = 20;
-  static constexpr size_t OFFSET_TUPLE_OFFSET = 24;  // Naming things is hard.
-  static constexpr size_t OFFSET_TUPLE_SIZE = 28;
+  static constexpr size_t OFFSET_PREV_PAGE_ID = SIZE_PAGE_HEADER;
+  static constexpr size_t OFFSET_NEXT_PAGE_ID = 20;
+  static constexpr size_t OFFSET_FREE_SPACE = 24;
+  static constexpr size_t OFFSET_TUPLE_COUNT = 28;
+  static constexpr size_t OFFSET_TUPLE_OFFSET = 32;  // Naming things is hard.
+  static constexpr size_t OFFSET_TUPLE_SIZE = 36;
 
   /** @return pointer to the end of the current free space, see header comment */
-  auto GetFreeSpacePointer() -> uint32_t { return *reinterpret_cast<uint32_t *>(GetData() + OFFSET_FREE_SPACE); }
+  auto GetFreeSpacePointer() const -> uint32_t {
+    return *reinterpret_cast<const uint32_t *>(GetData() + OFFSET_FREE_SPACE);
+  }
 
   /** Sets the pointer, this should be the end of the current free space. */
   void SetFreeSpacePointer(uint32_t free_space_pointer) {
@@ -162,18 +175,20 @@ class TablePage : public Page {
    * @note returned tuple count may be an overestimate because some slots may be empty
    * @return at least the number of tuples in this page
    */
-  auto GetTupleCount() -> uint32_t { return *reinterpret_cast<uint32_t *>(GetData() + OFFSET_TUPLE_COUNT); }
+  auto GetTupleCount() const -> uint32_t {
+    return *reinterpret_cast<const uint32_t *>(GetData() + OFFSET_TUPLE_COUNT);
+  }
 
   /** Set the number of tuples in this page. */
   void SetTupleCount(uint32_t tuple_count) { memcpy(GetData() + OFFSET_TUPLE_COUNT, &tuple_count, sizeof(uint32_t)); }
 
-  auto GetFreeSpaceRemaining() -> uint32_t {
+  auto GetFreeSpaceRemaining() const -> uint32_t {
     return GetFreeSpacePointer() - SIZE_TABLE_PAGE_HEADER - SIZE_TUPLE * GetTupleCount();
   }
 
   /** @return tuple offset at slot slot_num */
-  auto GetTupleOffsetAtSlot(uint32_t slot_num) -> uint32_t {
-    return *reinterpret_cast<uint32_t *>(GetData() + OFFSET_TUPLE_OFFSET + SIZE_TUPLE * slot_num);
+  auto GetTupleOffsetAtSlot(uint32_t slot_num) const -> uint32_t {
+    return *reinterpret_cast<const uint32_t *>(GetData() + OFFSET_TUPLE_OFFSET + SIZE_TUPLE * slot_num);
   }
 
   /** Set tuple offset at slot slot_num. */
@@ -182,8 +197,8 @@ class TablePage : public Page {
   }
 
   /** @return tuple size at slot slot_num */
-  auto GetTupleSize(uint32_t slot_num) -> uint32_t {
-    return *reinterpret_cast<uint32_t *>(GetData() + OFFSET_TUPLE_SIZE + SIZE_TUPLE * slot_num);
+  auto GetTupleSize(uint32_t slot_num) const -> uint32_t {
+    return *reinterpret_cast<const uint32_t *>(GetData() + OFFSET_TUPLE_SIZE + SIZE_TUPLE * slot_num);
   }
 
   /** Set tuple size at slot slot_num. */
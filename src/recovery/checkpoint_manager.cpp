@@ -12,16 +12,46 @@
 
 #include "recovery/checkpoint_manager.h"
 
+#include <algorithm>
+#include <utility>
+
+#include "common/macros.h"
+
 namespace bustub {
 
 void CheckpointManager::BeginCheckpoint() {
-  // Block all the transactions and ensure that both the WAL and all dirty buffer pool pages are persisted to disk,
-  // creating a consistent checkpoint. Do NOT allow transactions to resume at the end of this method, resume them
-  // in CheckpointManager::EndCheckpoint() instead. This is for grading purposes.
+  // records appended from here on may dirty pages that the dirty page table below misses
+  lsn_t dirty_pages_lsn = log_manager_->GetNextLSN();
+  auto dirty_pages = buffer_pool_manager_->GetDirtyPageTable();
+  truncate_lsn_ = dirty_pages_lsn;
+  for (const auto &[page_id, rec_lsn] : dirty_pages) {
+    truncate_lsn_ = std::min(truncate_lsn_, rec_lsn);
+  }
+
+  // a record has to fit into the log buffer. Keep the pages dirty for longest, the ones left out are dirty from the
+  // recLSN of the first of them on at most. Analysis takes every page the records from there on touch as dirty, just
+  // like the pages dirtied after the table was taken.
+  size_t max_pages = (LOG_BUFFER_SIZE / 2) / (sizeof(page_id_t) + sizeof(lsn_t));
+  if (dirty_pages.size() > max_pages) {
+    std::sort(dirty_pages.begin(), dirty_pages.end(), [](const auto &a, const auto &b) { return a.second < b.second; });
+    dirty_pages_lsn = std::min(dirty_pages_lsn, dirty_pages[max_pages].second);
+    dirty_pages.resize(max_pages);
+  }
+  lsn_t min_first_lsn;
+  begin_lsn_ = transaction_manager_->LogBeginCheckpoint(std::move(dirty_pages), dirty_pages_lsn, &min_first_lsn);
+  // undo follows the active transactions back to their BEGIN records
+  if (min_first_lsn != INVALID_LSN) {
+    truncate_lsn_ = std::min(truncate_lsn_, min_first_lsn);
+  }
 }
 
 void CheckpointManager::EndCheckpoint() {
-  // Allow transactions to resume, completing the checkpoint.
+  BUSTUB_ASSERT(begin_lsn_ != INVALID_LSN, "no checkpoint in progress");
+  LogRecord record(INVALID_TXN_ID, begin_lsn_, LogRecordType::END_CHECKPOINT);
+  log_manager_->FlushUntil(log_manager_->AppendLogRecord(&record));
+  // only a complete checkpoint counts for recovery, so its records must be on disk before the log before it goes
+  log_manager_->TruncateLog(truncate_lsn_);
+  begin_lsn_ = INVALID_LSN;
 }
 
 }  // namespace bustub
@@ -0,0 +1,99 @@
+//===----------------------------------------------------------------------===//
+//
+//                         BusTub
+//
+// log_block.cpp
+//
+// Identification: src/recovery/log_block.cpp
+//
+// Copyright (c) 2015-2019, Carnegie Mellon University Database Group
+//
+//===----------------------------------------------------------------------===//
+
+#include "recovery/log_block.h"
+
+#include <cstring>
+
+#include "common/util/crc32c.h"
+#include "common/util/lz_codec.h"
+
+namespace bustub {
+
+/*
+ * fill in the header of a block whose payload is in place, the checksum last since it covers the rest
+ */
+static auto FinishBlock(char *block, uint32_t stored_size, uint32_t records_size, uint32_t flags, lsn_t first_lsn)
+    -> size_t {
+  char *pos = block + sizeof(uint32_t);
+  auto put = [&pos](const void *field, size_t size) {
+    memcpy(pos, field, size);
+    pos += size;
+  };
+  put(&stored_size, sizeof(uint32_t));
+  put(&records_size, sizeof(uint32_t));
+  put(&flags, sizeof(uint32_t));
+  put(&first_lsn, sizeof(lsn_t));
+  uint32_t checksum = Crc32c::Value(block + sizeof(uint32_t), LogBlock::HEADER_SIZE - sizeof(uint32_t) + stored_size);
+  memcpy(block, &checksum, sizeof(uint32_t));
+  return LogBlock::HEADER_SIZE + stored_size;
+}
+
+auto LogBlock::Encode(char *block, size_t records_size, lsn_t first_lsn) -> size_t {
+  auto size = static_cast<uint32_t>(records_size);
+  return FinishBlock(block, size, size, 0, first_lsn);
+}
+
+auto LogBlock::EncodeCompressed(const char *block, size_t records_size, lsn_t first_lsn, char *dest) -> size_t {
+  // only worth it if the payload gets smaller
+  size_t stored_size = LzCodec::Compress(block + HEADER_SIZE, records_size, dest + HEADER_SIZE, records_size - 1);
+  if (stored_size == 0) {
+    return 0;
+  }
+  return FinishBlock(dest, static_cast<uint32_t>(stored_size), static_cast<uint32_t>(records_size), COMPRESSED,
+                     first_lsn);
+}
+
+auto LogBlock::Read(DiskManager *disk_manager, size_t offset, std::vector<char> *records, lsn_t *first_lsn)
+    -> size_t {
+  char header[HEADER_SIZE];
+  if (!disk_manager->ReadLog(header, HEADER_SIZE, offset)) {
+    return 0;
+  }
+  uint32_t checksum;
+  uint32_t stored_size;
+  uint32_t records_size;
+  uint32_t flags;
+  const char *pos = header;
+  auto get = [&pos](void *field, size_t size) {
+    memcpy(field, pos, size);
+    pos += size;
+  };
+  get(&checksum, sizeof(uint32_t));
+  get(&stored_size, sizeof(uint32_t));
+  get(&records_size, sizeof(uint32_t));
+  get(&flags, sizeof(uint32_t));
+  get(first_lsn, sizeof(lsn_t));
+  // the log is zeroed past its end, and a torn header may claim anything
+  bool compressed = (flags & COMPRESSED) != 0;
+  if (records_size == 0 || records_size > static_cast<uint32_t>(LOG_BUFFER_SIZE) || (flags & ~COMPRESSED) != 0 ||
+      (compressed ? stored_size >= records_size : stored_size != records_size)) {
+    return 0;
+  }
+
+  std::vector<char> block(HEADER_SIZE + stored_size);
+  if (!disk_manager->ReadLog(block.data(), static_cast<int>(block.size()), offset) ||
+      Crc32c::Value(block.data() + sizeof(uint32_t), block.size() - sizeof(uint32_t)) != checksum) {
+    return 0;
+  }
+  if (!compressed) {
+    records->assign(block.begin() + HEADER_SIZE, block.end());
+  } else {
+    records->resize(records_size);
+    if (LzCodec::Decompress(block.data() + HEADER_SIZE, stored_size, records->data(), records_size) != records_size) {
+      return 0;
+    }
+  }
+  return offset + block.size();
+}
+
+}  // namespace bustub
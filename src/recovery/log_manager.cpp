@@ -12,43 +12,360 @@
 
 #include "recovery/log_manager.h"
 
+#include <cstring>
+#include <string>
+#include <utility>
+
+#include "common/exception.h"
+#include "common/logger.h"
+#include "common/macros.h"
+
 namespace bustub {
 /*
  * set enable_logging = true
  * Start a separate thread to execute flush to disk operation periodically
- * The flush can be triggered when timeout or the log buffer is full or buffer
- * pool manager wants to force flush (it only happens when the flushed page has
- * a larger LSN than persistent LSN)
+ * The flush can be triggered when timeout or the log buffer is half full. Commits and the buffer pool flush the log
+ * themselves with FlushUntil(), the thread only bounds how long a record stays in memory.
  *
  * This thread runs forever until system shutdown/StopFlushThread
  */
-void LogManager::RunFlushThread() {}
+void LogManager::RunFlushThread() {
+  std::scoped_lock lock(latch_);
+  if (flush_thread_running_) {
+    return;
+  }
+  flush_thread_running_ = true;
+  enable_logging = true;
+  flush_thread_ = new std::thread(&LogManager::FlushThreadLoop, this);
+}
 
 /*
  * Stop and join the flush thread, set enable_logging = false
  */
-void LogManager::StopFlushThread() {}
+void LogManager::StopFlushThread() {
+  {
+    std::scoped_lock lock(latch_);
+    if (!flush_thread_running_) {
+      return;
+    }
+    flush_thread_running_ = false;
+    enable_logging = false;
+  }
+  cv_.notify_all();
+  flush_thread_->join();
+  delete flush_thread_;
+  flush_thread_ = nullptr;
+  // records appended while the thread was stopping, a failed log has nothing to tell about them anymore
+  WaitUntilDurable(GetNextLSN() - 1);
+}
+
+void LogManager::FlushThreadLoop() {
+  std::unique_lock lock(latch_);
+  auto reserved = [&] { return ReservedBytes(active_buffer_.load()->state_.load()); };
+  while (flush_thread_running_) {
+    cv_.wait_for(lock, log_timeout, [&] { return !flush_thread_running_ || reserved() >= LOG_BUFFER_SIZE / 2; });
+    // a leader is flushing already, whatever it leaves behind is picked up next round
+    if (!flushing_ && reserved() > 0) {
+      FlushAsLeader(&lock, false);
+    }
+  }
+}
 
 /*
  * append a log record into log buffer
  * you MUST set the log record's lsn within this method
  * @return: lsn that is assigned to this log record
- *
- *
- * example below
- * // First, serialize the must have fields(20 bytes in total)
- * log_record.lsn_ = next_lsn_++;
- * memcpy(log_buffer_ + offset_, &log_record, 20);
- * int pos = offset_ + 20;
- *
- * if (log_record.log_record_type_ == LogRecordType::INSERT) {
- *    memcpy(log_buffer_ + pos, &log_record.insert_rid_, sizeof(RID));
- *    pos += sizeof(RID);
- *    // we have provided serialize function for tuple class
- *    log_record.insert_tuple_.SerializeTo(log_buffer_ + pos);
- *  }
- *
  */
-auto LogManager::AppendLogRecord(LogRecord *log_record) -> lsn_t { return INVALID_LSN; }
+auto LogManager::AppendLogRecord(LogRecord *log_record) -> lsn_t {
+  auto size = static_cast<size_t>(log_record->GetSize());
+  BUSTUB_ASSERT(size <= static_cast<size_t>(LOG_BUFFER_SIZE), "log record does not fit into the log buffer");
+  while (true) {
+    LogBuffer *buffer = active_buffer_.load(std::memory_order_acquire);
+    uint64_t state = buffer->state_.load(std::memory_order_acquire);
+    if ((state & SEALED) != 0) {
+      // the flush leader is switching to the other buffer, or we read a stale active buffer
+      std::this_thread::yield();
+      continue;
+    }
+    size_t offset = ReservedBytes(state);
+    if (offset + size > static_cast<size_t>(LOG_BUFFER_SIZE)) {
+      WaitForSwitch(buffer);
+      continue;
+    }
+    // reserve room and an LSN at once, so that LSNs follow the order of the records in the buffer
+    uint64_t reserved = state + size + (uint64_t{1} << RECORD_COUNT_SHIFT);
+    if (!buffer->state_.compare_exchange_weak(state, reserved, std::memory_order_acq_rel)) {
+      continue;
+    }
+    // the buffer cannot be sealed and reused before our bytes are counted in filled_
+    log_record->lsn_ = buffer->first_lsn_.load(std::memory_order_relaxed) + RecordCount(state);
+    SerializeLogRecord(log_record, buffer->data_ + offset);
+    buffer->filled_.fetch_add(size, std::memory_order_release);
+    if (offset < LOG_BUFFER_SIZE / 2 && offset + size >= LOG_BUFFER_SIZE / 2) {
+      cv_.notify_one();
+    }
+    return log_record->lsn_;
+  }
+}
+
+void LogManager::WaitForSwitch(LogBuffer *buffer) {
+  std::unique_lock lock(latch_);
+  while (active_buffer_.load() == buffer) {
+    if (!flushing_) {
+      FlushAsLeader(&lock, false);
+    } else {
+      flushed_cv_.wait(lock);
+    }
+  }
+}
+
+void LogManager::ResumeAfter(lsn_t last_lsn) {
+  std::scoped_lock lock(latch_);
+  LogBuffer *buffer = active_buffer_.load();
+  BUSTUB_ASSERT(ReservedBytes(buffer->state_.load()) == 0, "the log must be resumed before records are appended");
+  buffer->first_lsn_ = last_lsn + 1;
+  persistent_lsn_ = last_lsn;
+}
+
+auto LogManager::GetNextLSN() -> lsn_t {
+  LogBuffer *buffer = active_buffer_.load();
+  uint64_t state = buffer->state_.load();
+  return buffer->first_lsn_.load() + RecordCount(state);
+}
+
+/*
+ * wait for the log to be durable up to lsn, as a follower of the flush in progress or as the leader of the next one
+ */
+void LogManager::FlushUntil(lsn_t lsn) {
+  if (!WaitUntilDurable(lsn)) {
+    throw Exception(ExceptionType::IO, "can't write the log, LSN " + std::to_string(lsn) + " is not durable");
+  }
+}
+
+auto LogManager::WaitUntilDurable(lsn_t lsn) -> bool {
+  std::unique_lock lock(latch_);
+  lsn = std::min<lsn_t>(lsn, GetNextLSN() - 1);
+  if (persistent_lsn_ >= lsn) {
+    return true;
+  }
+  ++num_waiting_commits_;
+  if (num_waiting_commits_ >= group_commit_max_batch_) {
+    group_cv_.notify_one();
+  }
+  while (persistent_lsn_ < lsn && !failed_) {
+    if (!flushing_) {
+      FlushAsLeader(&lock, true);
+    } else {
+      flushed_cv_.wait(lock);
+    }
+  }
+  --num_waiting_commits_;
+  return persistent_lsn_ >= lsn;
+}
+
+auto LogManager::HasFailed() -> bool {
+  std::scoped_lock lock(latch_);
+  return failed_;
+}
+
+auto LogManager::TruncateLog(lsn_t lsn) -> size_t {
+  std::scoped_lock lock(latch_);
+  BUSTUB_ASSERT(lsn <= persistent_lsn_ + 1, "the log can only be truncated up to what is durable");
+  // the offset of the record itself is not known, the buffer it was written with starts early enough
+  size_t num_extents = 0;
+  while (num_extents < flushed_extents_.size() && flushed_extents_[num_extents].first <= lsn) {
+    ++num_extents;
+  }
+  if (num_extents == 0) {
+    return 0;
+  }
+  size_t offset = flushed_extents_[num_extents - 1].second;
+  flushed_extents_.erase(flushed_extents_.begin(), flushed_extents_.begin() + (num_extents - 1));
+  return disk_manager_->TruncateLog(offset);
+}
+
+void LogManager::SetGroupCommit(std::chrono::microseconds delay, size_t max_batch) {
+  std::scoped_lock lock(latch_);
+  group_commit_delay_ = delay;
+  group_commit_max_batch_ = max_batch;
+}
+
+void LogManager::SetCompression(bool compress) {
+  std::scoped_lock lock(latch_);
+  compress_ = compress;
+}
+
+void LogManager::FlushAsLeader(std::unique_lock<std::mutex> *lock, bool gather_group) {
+  flushing_ = true;
+  if (gather_group && group_commit_delay_.count() > 0) {
+    // commits that arrive meanwhile append to the buffer and wait as followers
+    group_cv_.wait_for(*lock, group_commit_delay_, [&] {
+      return num_waiting_commits_ >= group_commit_max_batch_ ||
+             ReservedBytes(active_buffer_.load()->state_.load()) >= LOG_BUFFER_SIZE / 2;
+    });
+  }
+  LogBuffer *buffer = active_buffer_.load();
+  if (ReservedBytes(buffer->state_.load()) == 0) {
+    flushing_ = false;
+    flushed_cv_.notify_all();
+    return;
+  }
+  // from here on, appenders wait for the switch instead of reserving room in the buffer
+  uint64_t state = buffer->state_.fetch_or(SEALED, std::memory_order_acq_rel);
+  size_t size = ReservedBytes(state);
+  lsn_t num_records = RecordCount(state);
+
+  // the other buffer was written by the previous flush, so it is free to take over
+  LogBuffer *standby = buffer == &buffers_[0] ? &buffers_[1] : &buffers_[0];
+  standby->first_lsn_.store(buffer->first_lsn_.load() + num_records, std::memory_order_relaxed);
+  standby->filled_.store(0, std::memory_order_relaxed);
+  standby->state_.store(0, std::memory_order_release);
+  active_buffer_.store(standby, std::memory_order_release);
+  // appenders waiting for room can go on with the empty buffer
+  flushed_cv_.notify_all();
+
+  flushed_extents_.emplace_back(buffer->first_lsn_.load(), disk_manager_->GetLogEndOffset());
+  bool compress = compress_;
+  bool failed = failed_;
+
+  lock->unlock();
+  // appenders that reserved room before the seal may still be copying their records
+  while (buffer->filled_.load(std::memory_order_acquire) < size) {
+    std::this_thread::yield();
+  }
+  if (failed) {
+    // recovery would not read the records past the torn block anyway, the buffer is only switched to make room
+    lock->lock();
+    flushing_ = false;
+    flushed_cv_.notify_all();
+    return;
+  }
+  char *block = buffer->block_;
+  size_t block_size = 0;
+  if (compress) {
+    block_size = LogBlock::EncodeCompressed(buffer->block_, size, buffer->first_lsn_.load(), buffer->compressed_);
+    block = block_size != 0 ? buffer->compressed_ : block;
+  }
+  if (block_size == 0) {
+    block_size = LogBlock::Encode(buffer->block_, size, buffer->first_lsn_.load());
+  }
+  bool written = disk_manager_->WriteLog(block, static_cast<int>(block_size));
+  lock->lock();
+
+  if (written) {
+    persistent_lsn_ = buffer->first_lsn_.load() + num_records - 1;
+  } else {
+    LOG_WARN("can't write the log, nothing is made durable anymore");
+    failed_ = true;
+  }
+  flushing_ = false;
+  flushed_cv_.notify_all();
+}
+
+/*
+ * serialize the header fields (28 bytes in total), then the body of the record type
+ */
+void LogManager::SerializeLogRecord(LogRecord *log_record, char *dest) {
+  char *pos = dest;
+  auto put = [&pos](const void *field, size_t size) {
+    memcpy(pos, field, size);
+    pos += size;
+  };
+  put(&log_record->size_, sizeof(int32_t));
+  put(&log_record->lsn_, sizeof(lsn_t));
+  put(&log_record->txn_id_, sizeof(txn_id_t));
+  put(&log_record->prev_lsn_, sizeof(lsn_t));
+  auto type = static_cast<int32_t>(log_record->log_record_type_);
+  put(&type, sizeof(int32_t));
+
+  // a CLR is followed by the body of its action
+  LogRecordType body_type = log_record->log_record_type_;
+  if (body_type == LogRecordType::CLR) {
+    put(&log_record->undo_next_lsn_, sizeof(lsn_t));
+    auto compensation_type = static_cast<int32_t>(log_record->compensation_type_);
+    put(&compensation_type, sizeof(int32_t));
+    body_type = log_record->compensation_type_;
+  }
+  switch (body_type) {
+    case LogRecordType::INSERT:
+      put(&log_record->insert_rid_, sizeof(RID));
+      log_record->insert_tuple_.SerializeTo(pos);
+      pos += sizeof(int32_t) + log_record->insert_tuple_.GetLength();
+      break;
+    case LogRecordType::MARKDELETE:
+    case LogRecordType::APPLYDELETE:
+    case LogRecordType::ROLLBACKDELETE:
+      put(&log_record->delete_rid_, sizeof(RID));
+      log_record->delete_tuple_.SerializeTo(pos);
+      pos += sizeof(int32_t) + log_record->delete_tuple_.GetLength();
+      break;
+    case LogRecordType::UPDATE:
+      put(&log_record->update_rid_, sizeof(RID));
+      put(&log_record->update_old_size_, sizeof(uint32_t));
+      put(&log_record->update_new_size_, sizeof(uint32_t));
+      put(log_record->update_delta_.data(), log_record->update_delta_.size());
+      break;
+    case LogRecordType::NEWPAGE:
+      put(&log_record->prev_page_id_, sizeof(page_id_t));
+      put(&log_record->page_id_, sizeof(page_id_t));
+      break;
+    case LogRecordType::BEGIN_CHECKPOINT: {
+      auto num_txns = static_cast<int32_t>(log_record->active_txns_.size());
+      put(&num_txns, sizeof(int32_t));
+      for (const auto &[txn_id, last_lsn] : log_record->active_txns_) {
+        put(&txn_id, sizeof(txn_id_t));
+        put(&last_lsn, sizeof(lsn_t));
+      }
+      auto num_pages = static_cast<int32_t>(log_record->dirty_pages_.size());
+      put(&num_pages, sizeof(int32_t));
+      for (const auto &[page_id, rec_lsn] : log_record->dirty_pages_) {
+        put(&page_id, sizeof(page_id_t));
+        put(&rec_lsn, sizeof(lsn_t));
+      }
+      break;
+    }
+    case LogRecordType::INDEX_INSERT:
+    case LogRecordType::INDEX_DELETE:
+    case LogRecordType::INDEX_FORMAT_PAGE:
+    case LogRecordType::INDEX_SPLICE: {
+      const IndexPageChange &change = log_record->index_change_;
+      int32_t num_entries = change.GetNumEntries();
+      put(&log_record->page_id_, sizeof(page_id_t));
+      put(&change.page_type_, sizeof(int32_t));
+      put(&change.max_size_, sizeof(int32_t));
+      put(&change.next_page_id_, sizeof(page_id_t));
+      put(&change.index_, sizeof(int32_t));
+      put(&change.num_removed_, sizeof(int32_t));
+      put(&change.entry_size_, sizeof(int32_t));
+      put(&num_entries, sizeof(int32_t));
+      put(change.entries_.data(), change.entries_.size());
+      if (log_record->HasIndexName()) {
+        auto name_size = static_cast<int32_t>(log_record->index_name_.size());
+        put(&name_size, sizeof(int32_t));
+        put(log_record->index_name_.data(), log_record->index_name_.size());
+      }
+      break;
+    }
+    case LogRecordType::INDEX_ROOT: {
+      auto name_size = static_cast<int32_t>(log_record->index_name_.size());
+      put(&log_record->page_id_, sizeof(page_id_t));
+      put(&name_size, sizeof(int32_t));
+      put(log_record->index_name_.data(), log_record->index_name_.size());
+      break;
+    }
+    case LogRecordType::INDEX_SMO: {
+      auto num_changes = static_cast<int32_t>(log_record->smo_changes_.size());
+      put(&num_changes, sizeof(int32_t));
+      for (auto &change : log_record->smo_changes_) {
+        SerializeLogRecord(&change, pos);
+        pos += change.GetSize();
+      }
+      break;
+    }
+    default:
+      break;
+  }
+  BUSTUB_ASSERT(pos - dest == log_record->GetSize(), "log record size does not match its content");
+}
 
 }  // namespace bustub
@@ -0,0 +1,82 @@
+//===----------------------------------------------------------------------===//
+//
+//                         BusTub
+//
+// log_record.cpp
+//
+// Identification: src/recovery/log_record.cpp
+//
+// Copyright (c) 2015-2019, Carnegie Mellon University Database Group
+//
+//===----------------------------------------------------------------------===//
+
+#include "recovery/log_record.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace bustub {
+
+/*
+ * bytes of both tuples past the end of the shorter one always differ, so an unchanged chunk covers the same bytes of
+ * both tuples, which is all of it, or the tail of two tuples of the same size
+ */
+void LogRecord::EncodeUpdateDelta(const Tuple &old_tuple, const Tuple &new_tuple) {
+  update_old_size_ = old_tuple.GetLength();
+  update_new_size_ = new_tuple.GetLength();
+  uint32_t num_chunks = (std::max(update_old_size_, update_new_size_) + UPDATE_DELTA_CHUNK_SIZE - 1) /
+                        UPDATE_DELTA_CHUNK_SIZE;
+  update_delta_.assign((num_chunks + 7) / 8, 0);
+  for (uint32_t chunk = 0; chunk < num_chunks; chunk++) {
+    uint32_t begin = chunk * UPDATE_DELTA_CHUNK_SIZE;
+    uint32_t end = begin + UPDATE_DELTA_CHUNK_SIZE;
+    uint32_t old_end = std::min(end, update_old_size_);
+    uint32_t new_end = std::min(end, update_new_size_);
+    if (old_end == new_end && memcmp(old_tuple.GetData() + begin, new_tuple.GetData() + begin, old_end - begin) == 0) {
+      continue;
+    }
+    update_delta_[chunk / 8] = static_cast<char>(update_delta_[chunk / 8] | (1 << (chunk % 8)));
+    update_delta_.insert(update_delta_.end(), old_tuple.GetData() + std::min(begin, update_old_size_),
+                         old_tuple.GetData() + old_end);
+    update_delta_.insert(update_delta_.end(), new_tuple.GetData() + std::min(begin, update_new_size_),
+                         new_tuple.GetData() + new_end);
+  }
+}
+
+auto LogRecord::ApplyUpdateDelta(const Tuple &from, uint32_t from_size, uint32_t to_size, bool forward) const
+    -> Tuple {
+  // a serialized tuple is its length followed by its data
+  std::vector<char> raw(sizeof(uint32_t) + to_size, 0);
+  memcpy(raw.data(), &to_size, sizeof(uint32_t));
+  char *data = raw.data() + sizeof(uint32_t);
+  memcpy(data, from.GetData(), std::min({from.GetLength(), from_size, to_size}));
+
+  uint32_t num_chunks = (std::max(from_size, to_size) + UPDATE_DELTA_CHUNK_SIZE - 1) / UPDATE_DELTA_CHUNK_SIZE;
+  const char *pos = update_delta_.data() + (num_chunks + 7) / 8;
+  for (uint32_t chunk = 0; chunk < num_chunks; chunk++) {
+    if ((update_delta_[chunk / 8] & (1 << (chunk % 8))) == 0) {
+      continue;
+    }
+    uint32_t begin = chunk * UPDATE_DELTA_CHUNK_SIZE;
+    uint32_t end = begin + UPDATE_DELTA_CHUNK_SIZE;
+    uint32_t old_bytes = std::min(end, update_old_size_) - std::min(begin, update_old_size_);
+    uint32_t new_bytes = std::min(end, update_new_size_) - std::min(begin, update_new_size_);
+    const char *to_bytes = forward ? pos + old_bytes : pos;
+    uint32_t num_to_bytes = forward ? new_bytes : old_bytes;
+    memcpy(data + begin, to_bytes, num_to_bytes);
+    pos += old_bytes + new_bytes;
+  }
+  Tuple tuple;
+  tuple.DeserializeFrom(raw.data());
+  return tuple;
+}
+
+auto LogRecord::ApplyUpdate(const Tuple &old_tuple) const -> Tuple {
+  return ApplyUpdateDelta(old_tuple, update_old_size_, update_new_size_, true);
+}
+
+auto LogRecord::RevertUpdate(const Tuple &new_tuple) const -> Tuple {
+  return ApplyUpdateDelta(new_tuple, update_new_size_, update_old_size_, false);
+}
+
+}  // namespace bustub
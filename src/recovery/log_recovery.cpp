@@ -12,6 +12,21 @@
 
 #include "recovery/log_recovery.h"
 
+#include <algorithm>
+#include <cinttypes>
+#include <cstring>
+#include <memory>
+#include <queue>
+#include <utility>
+#include <vector>
+
+#include "common/exception.h"
+#include "common/logger.h"
+#include "common/macros.h"
+
+#include "storage/page/b_plus_tree_internal_page.h"
+#include "storage/page/b_plus_tree_leaf_page.h"
+#include "storage/page/header_page.h"
 #include "storage/page/table_page.h"
 
 namespace bustub {
@@ -20,21 +35,857 @@ namespace bustub {
  * @return: true means deserialize succeed, otherwise can't deserialize cause
  * incomplete log record
  */
-auto LogRecovery::DeserializeLogRecord(const char *data, LogRecord *log_record) -> bool { return false; }
+auto LogRecovery::DeserializeLogRecord(const char *data, size_t size, LogRecord *log_record) -> bool {
+  if (size < static_cast<size_t>(LogRecord::HEADER_SIZE)) {
+    return false;
+  }
+  const char *pos = data;
+  auto get = [&pos](void *field, size_t field_size) {
+    memcpy(field, pos, field_size);
+    pos += field_size;
+  };
+  int32_t record_size;
+  get(&record_size, sizeof(int32_t));
+  // the log is zeroed past its end
+  if (record_size < LogRecord::HEADER_SIZE || static_cast<size_t>(record_size) > size) {
+    return false;
+  }
+  *log_record = LogRecord();
+  log_record->size_ = record_size;
+  get(&log_record->lsn_, sizeof(lsn_t));
+  get(&log_record->txn_id_, sizeof(txn_id_t));
+  get(&log_record->prev_lsn_, sizeof(lsn_t));
+  int32_t type;
+  get(&type, sizeof(int32_t));
+  log_record->log_record_type_ = static_cast<LogRecordType>(type);
+
+  auto get_tuple = [&pos](Tuple *tuple) {
+    tuple->DeserializeFrom(pos);
+    pos += sizeof(int32_t) + tuple->GetLength();
+  };
+  LogRecordType body_type = log_record->log_record_type_;
+  if (body_type == LogRecordType::CLR) {
+    if (record_size < LogRecord::HEADER_SIZE + static_cast<int32_t>(sizeof(lsn_t) + sizeof(int32_t))) {
+      return false;
+    }
+    get(&log_record->undo_next_lsn_, sizeof(lsn_t));
+    get(&type, sizeof(int32_t));
+    log_record->compensation_type_ = static_cast<LogRecordType>(type);
+    body_type = log_record->compensation_type_;
+  }
+  switch (body_type) {
+    case LogRecordType::INSERT:
+      get(&log_record->insert_rid_, sizeof(RID));
+      get_tuple(&log_record->insert_tuple_);
+      break;
+    case LogRecordType::MARKDELETE:
+    case LogRecordType::APPLYDELETE:
+    case LogRecordType::ROLLBACKDELETE:
+      get(&log_record->delete_rid_, sizeof(RID));
+      get_tuple(&log_record->delete_tuple_);
+      break;
+    case LogRecordType::UPDATE:
+      get(&log_record->update_rid_, sizeof(RID));
+      get(&log_record->update_old_size_, sizeof(uint32_t));
+      get(&log_record->update_new_size_, sizeof(uint32_t));
+      // the delta takes the rest of the record
+      if (pos - data > record_size) {
+        return false;
+      }
+      log_record->update_delta_.assign(pos, data + record_size);
+      pos = data + record_size;
+      break;
+    case LogRecordType::NEWPAGE:
+      get(&log_record->prev_page_id_, sizeof(page_id_t));
+      get(&log_record->page_id_, sizeof(page_id_t));
+      break;
+    case LogRecordType::BEGIN_CHECKPOINT: {
+      int32_t num_txns;
+      get(&num_txns, sizeof(int32_t));
+      log_record->active_txns_.resize(num_txns);
+      for (auto &[txn_id, last_lsn] : log_record->active_txns_) {
+        get(&txn_id, sizeof(txn_id_t));
+        get(&last_lsn, sizeof(lsn_t));
+      }
+      int32_t num_pages;
+      get(&num_pages, sizeof(int32_t));
+      log_record->dirty_pages_.resize(num_pages);
+      for (auto &[page_id, rec_lsn] : log_record->dirty_pages_) {
+        get(&page_id, sizeof(page_id_t));
+        get(&rec_lsn, sizeof(lsn_t));
+      }
+      break;
+    }
+    case LogRecordType::INDEX_INSERT:
+    case LogRecordType::INDEX_DELETE:
+    case LogRecordType::INDEX_FORMAT_PAGE:
+    case LogRecordType::INDEX_SPLICE: {
+      IndexPageChange &change = log_record->index_change_;
+      int32_t num_entries;
+      get(&log_record->page_id_, sizeof(page_id_t));
+      get(&change.page_type_, sizeof(int32_t));
+      get(&change.max_size_, sizeof(int32_t));
+      get(&change.next_page_id_, sizeof(page_id_t));
+      get(&change.index_, sizeof(int32_t));
+      get(&change.num_removed_, sizeof(int32_t));
+      get(&change.entry_size_, sizeof(int32_t));
+      get(&num_entries, sizeof(int32_t));
+      // a torn record must not make us read past its end
+      if (change.entry_size_ < 0 || num_entries < 0 ||
+          static_cast<int64_t>(change.entry_size_) * num_entries > record_size - (pos - data)) {
+        return false;
+      }
+      change.entries_.resize(static_cast<size_t>(change.entry_size_) * num_entries);
+      get(change.entries_.data(), change.entries_.size());
+      if (log_record->HasIndexName()) {
+        int32_t name_size;
+        if (record_size - (pos - data) < static_cast<int64_t>(sizeof(int32_t))) {
+          return false;
+        }
+        get(&name_size, sizeof(int32_t));
+        if (name_size < 0 || name_size > record_size - (pos - data)) {
+          return false;
+        }
+        log_record->index_name_.assign(pos, name_size);
+        pos += name_size;
+      }
+      break;
+    }
+    case LogRecordType::INDEX_ROOT: {
+      int32_t name_size;
+      get(&log_record->page_id_, sizeof(page_id_t));
+      get(&name_size, sizeof(int32_t));
+      if (name_size < 0 || name_size > record_size - (pos - data)) {
+        return false;
+      }
+      log_record->index_name_.assign(pos, name_size);
+      pos += name_size;
+      break;
+    }
+    case LogRecordType::INDEX_SMO: {
+      int32_t num_changes;
+      get(&num_changes, sizeof(int32_t));
+      for (int32_t i = 0; i < num_changes; i++) {
+        // each change is a record of its own, which must end within this one
+        LogRecord change;
+        if (pos - data >= record_size ||
+            !DeserializeLogRecord(pos, static_cast<size_t>(record_size - (pos - data)), &change)) {
+          return false;
+        }
+        LogRecordType change_type = change.GetLogRecordType();
+        if (change_type != LogRecordType::INDEX_FORMAT_PAGE && change_type != LogRecordType::INDEX_SPLICE &&
+            change_type != LogRecordType::INDEX_ROOT) {
+          return false;
+        }
+        pos += change.GetSize();
+        log_record->smo_changes_.push_back(std::move(change));
+      }
+      break;
+    }
+    default:
+      break;
+  }
+  return pos - data == record_size;
+}
+
+/*
+ * read the log block by block, the first one that is missing or fails its checks ends the log: it was cut short by
+ * the crash, and nothing after it was acknowledged
+ */
+auto LogRecovery::ScanLog(size_t offset, const std::function<void(LogRecord *, size_t)> &visit) -> size_t {
+  std::vector<char> records;
+  lsn_t first_lsn;
+  LogRecord record;
+  size_t next_offset;
+  while ((next_offset = LogBlock::Read(disk_manager_, offset, &records, &first_lsn)) != 0) {
+    size_t pos = 0;
+    lsn_t lsn = first_lsn;
+    while (pos < records.size() && DeserializeLogRecord(records.data() + pos, records.size() - pos, &record) &&
+           record.GetLSN() == lsn) {
+      visit(&record, offset);
+      pos += record.GetSize();
+      lsn++;
+    }
+    if (pos != records.size()) {
+      LOG_WARN("log block at offset %zu is corrupt past its record %" PRId64, offset, lsn);
+      break;
+    }
+    offset = next_offset;
+  }
+  return offset;
+}
+
+auto LogRecovery::FindLogBlock(lsn_t lsn) const -> size_t {
+  // the block holding lsn is the last one starting at or before it
+  auto next = std::upper_bound(log_blocks_.begin(), log_blocks_.end(), lsn,
+                               [](lsn_t lsn, const std::pair<lsn_t, size_t> &block) { return lsn < block.first; });
+  return next == log_blocks_.begin() ? next->second : std::prev(next)->second;
+}
+
+auto LogRecovery::ReadLogRecord(lsn_t lsn, LogRecord *log_record) -> bool {
+  if (log_blocks_.empty() || lsn < log_blocks_.front().first || lsn > last_lsn_) {
+    return false;
+  }
+  const CachedLogBlock *block = ReadLogBlock(FindLogBlock(lsn));
+  if (block == nullptr || static_cast<size_t>(lsn - block->first_lsn_) >= block->record_offsets_.size()) {
+    return false;
+  }
+  size_t pos = block->record_offsets_[lsn - block->first_lsn_];
+  return DeserializeLogRecord(block->records_.data() + pos, block->records_.size() - pos, log_record) &&
+         log_record->GetLSN() == lsn;
+}
+
+auto LogRecovery::ReadLogBlock(size_t offset) -> const CachedLogBlock * {
+  auto cached = block_cache_index_.find(offset);
+  if (cached != block_cache_index_.end()) {
+    block_cache_.splice(block_cache_.begin(), block_cache_, cached->second);
+    ++num_block_cache_hits_;
+    return &block_cache_.front();
+  }
+  CachedLogBlock block{offset, INVALID_LSN, {}, {}};
+  if (LogBlock::Read(disk_manager_, offset, &block.records_, &block.first_lsn_) == 0) {
+    return nullptr;
+  }
+  ++num_block_reads_;
+  // records have no fixed size, their offsets are found once by walking their size fields
+  size_t pos = 0;
+  int32_t record_size;
+  while (pos + sizeof(int32_t) <= block.records_.size()) {
+    memcpy(&record_size, block.records_.data() + pos, sizeof(int32_t));
+    if (record_size < LogRecord::HEADER_SIZE || static_cast<size_t>(record_size) > block.records_.size() - pos) {
+      break;
+    }
+    block.record_offsets_.push_back(pos);
+    pos += record_size;
+  }
+  if (block_cache_.size() == UNDO_BLOCK_CACHE_SIZE) {
+    block_cache_index_.erase(block_cache_.back().offset_);
+    block_cache_.pop_back();
+  }
+  block_cache_.push_front(std::move(block));
+  block_cache_index_[offset] = block_cache_.begin();
+  return &block_cache_.front();
+}
+
+auto LogRecovery::GetPageIds(LogRecord *record) -> std::vector<page_id_t> {
+  switch (record->GetActionType()) {
+    case LogRecordType::INSERT:
+      return {record->GetInsertRID().GetPageId()};
+    case LogRecordType::MARKDELETE:
+    case LogRecordType::APPLYDELETE:
+    case LogRecordType::ROLLBACKDELETE:
+      return {record->GetDeleteRID().GetPageId()};
+    case LogRecordType::UPDATE:
+      return {record->GetUpdateRID().GetPageId()};
+    case LogRecordType::NEWPAGE:
+      // the previous page is linked to the new one
+      return {record->page_id_, record->GetNewPageRecord()};
+    case LogRecordType::INDEX_INSERT:
+    case LogRecordType::INDEX_DELETE:
+    case LogRecordType::INDEX_FORMAT_PAGE:
+    case LogRecordType::INDEX_SPLICE:
+      return {record->GetIndexPageId()};
+    case LogRecordType::INDEX_ROOT:
+      return {HEADER_PAGE_ID};
+    case LogRecordType::INDEX_SMO: {
+      std::vector<page_id_t> page_ids;
+      for (auto &change : record->GetStructureChanges()) {
+        page_id_t page_id = GetPageIds(&change).front();
+        if (std::find(page_ids.begin(), page_ids.end(), page_id) == page_ids.end()) {
+          page_ids.push_back(page_id);
+        }
+      }
+      return page_ids;
+    }
+    default:
+      return {};
+  }
+}
+
+/*
+ * analysis phase, reads the log from its start to its end. The last complete checkpoint provides the dirty page table
+ * as of its BEGIN_CHECKPOINT record, or rather as of the record's prevLSN, when the table was taken or from when on the
+ * pages it had no room for were dirty. Every page a record from there on touches is added to it.
+ */
+void LogRecovery::Analyze() {
+  active_txn_.clear();
+  log_blocks_.clear();
+  last_lsn_ = INVALID_LSN;
+  dirty_page_table_.clear();
+  checkpoint_lsn_ = INVALID_LSN;
+  redo_lsn_ = INVALID_LSN;
+
+  // the checkpoint being read, and the last complete one
+  LogRecord pending_checkpoint;
+  LogRecord checkpoint;
+  // pages touched by every record, with the first record touching them, for the log after the checkpoint
+  std::vector<std::pair<page_id_t, lsn_t>> touched_pages;
+  lsn_t first_lsn = INVALID_LSN;
+
+  size_t end = ScanLog(offset_, [&](LogRecord *record, size_t offset) {
+    lsn_t lsn = record->GetLSN();
+    if (first_lsn == INVALID_LSN) {
+      first_lsn = lsn;
+    }
+    if (log_blocks_.empty() || log_blocks_.back().second != offset) {
+      log_blocks_.emplace_back(lsn, offset);
+    }
+    last_lsn_ = lsn;
+    for (page_id_t page_id : GetPageIds(record)) {
+      if (page_id != INVALID_PAGE_ID) {
+        touched_pages.emplace_back(page_id, lsn);
+      }
+    }
+    switch (record->GetLogRecordType()) {
+      case LogRecordType::COMMIT:
+      case LogRecordType::ABORT:
+        active_txn_.erase(record->GetTxnId());
+        break;
+      case LogRecordType::BEGIN_CHECKPOINT:
+        pending_checkpoint = *record;
+        break;
+      case LogRecordType::END_CHECKPOINT:
+        if (pending_checkpoint.GetLSN() == record->GetPrevLSN()) {
+          checkpoint = pending_checkpoint;
+        }
+        break;
+      default:
+        // structure modifications of the indexes belong to no transaction, a CLR keeps its transaction going
+        if (record->GetTxnId() != INVALID_TXN_ID) {
+          active_txn_[record->GetTxnId()] = lsn;
+        }
+        break;
+    }
+  });
+  // the log goes on from the last intact block, the records appended after a torn one would be lost to the next scan
+  if (end < disk_manager_->GetLogEndOffset()) {
+    LOG_WARN("log is torn at offset %zu, cutting it short", end);
+    disk_manager_->TruncateLogEnd(end);
+  }
+  analyzed_ = true;
+  // the pages on disk carry LSNs of the log, new records must not fall behind them whether undo runs or not
+  if (log_manager_ != nullptr && last_lsn_ != INVALID_LSN && log_manager_->GetNextLSN() <= last_lsn_) {
+    log_manager_->ResumeAfter(last_lsn_);
+  }
+  if (first_lsn == INVALID_LSN) {
+    return;
+  }
+
+  // without a checkpoint, every page the log touches may miss changes
+  lsn_t dirty_pages_lsn = first_lsn;
+  if (checkpoint.GetLSN() != INVALID_LSN) {
+    checkpoint_lsn_ = checkpoint.GetLSN();
+    dirty_pages_lsn = checkpoint.GetPrevLSN();
+    for (const auto &[page_id, rec_lsn] : checkpoint.GetDirtyPages()) {
+      dirty_page_table_[page_id] = rec_lsn;
+    }
+  }
+  for (const auto &[page_id, lsn] : touched_pages) {
+    if (lsn >= dirty_pages_lsn) {
+      dirty_page_table_.emplace(page_id, lsn);
+    }
+  }
+  // no page touched before the checkpoint misses changes unless the checkpoint lists it
+  redo_lsn_ = checkpoint_lsn_ != INVALID_LSN ? dirty_pages_lsn : first_lsn;
+  for (const auto &[page_id, rec_lsn] : dirty_page_table_) {
+    redo_lsn_ = std::min(redo_lsn_, rec_lsn);
+  }
+}
 
 /*
  *redo phase on TABLE PAGE level(table/table_page.h)
- *read log file from the beginning to end (you must prefetch log records into
- *log buffer to reduce unnecessary I/O operations), remember to compare page's
- *LSN with log_record's sequence number, and also build active_txn_ table &
- *lsn_mapping_ table
+ *the calling thread parses the log from the redo LSN on and queues every record that changes a dirty page to the
+ *worker owning the page, which compares the page's LSN with the record's and replays the record if the page misses it
  */
-void LogRecovery::Redo() {}
+void LogRecovery::Redo() {
+  if (!analyzed_) {
+    Analyze();
+  }
+  if (redo_lsn_ == INVALID_LSN) {
+    return;
+  }
+  // the records before the redo LSN are either on disk or of no dirty page
+  auto workers = StartWorkers(&LogRecovery::RedoOnPage);
+  std::vector<std::vector<RedoItem>> batches(num_workers_);
+  // pages that never reached the file are past its end, the next pages allocated must come after them
+  page_id_t max_page_id = INVALID_PAGE_ID;
+  ScanLog(FindLogBlock(redo_lsn_), [&](LogRecord *record, size_t offset) {
+    for (page_id_t page_id : GetPageIds(record)) {
+      max_page_id = std::max(max_page_id, page_id);
+      auto dirty_page = dirty_page_table_.find(page_id);
+      // the page on disk has every change before its recLSN
+      if (dirty_page == dirty_page_table_.end() || record->GetLSN() < dirty_page->second) {
+        continue;
+      }
+      size_t worker = std::hash<page_id_t>()(page_id) % num_workers_;
+      batches[worker].push_back(RedoItem{page_id, *record});
+      if (batches[worker].size() == REDO_BATCH_SIZE) {
+        QueueBatch(workers[worker].get(), std::move(batches[worker]));
+        batches[worker].clear();
+      }
+    }
+  });
+  StopWorkers(&workers, &batches);
+  if (max_page_id != INVALID_PAGE_ID) {
+    disk_manager_->MarkAllocated(max_page_id);
+  }
+}
+
+auto LogRecovery::StartWorkers(void (LogRecovery::*apply)(RedoItem *)) -> std::vector<std::unique_ptr<RedoWorker>> {
+  std::vector<std::unique_ptr<RedoWorker>> workers;
+  for (size_t i = 0; i < num_workers_; i++) {
+    workers.push_back(std::make_unique<RedoWorker>());
+    workers.back()->thread_ = std::thread(&LogRecovery::WorkerLoop, this, workers.back().get(), apply);
+  }
+  return workers;
+}
+
+void LogRecovery::StopWorkers(std::vector<std::unique_ptr<RedoWorker>> *workers,
+                              std::vector<std::vector<RedoItem>> *batches) {
+  for (size_t i = 0; i < workers->size(); i++) {
+    RedoWorker *worker = (*workers)[i].get();
+    if (!(*batches)[i].empty()) {
+      QueueBatch(worker, std::move((*batches)[i]));
+      (*batches)[i].clear();
+    }
+    {
+      std::scoped_lock lock(worker->latch_);
+      worker->done_ = true;
+    }
+    worker->cv_.notify_all();
+  }
+  for (auto &worker : *workers) {
+    worker->thread_.join();
+  }
+}
+
+void LogRecovery::QueueBatch(RedoWorker *worker, std::vector<RedoItem> batch) {
+  std::vector<page_id_t> page_ids;
+  for (const auto &item : batch) {
+    page_ids.push_back(item.page_id_);
+  }
+  // the reads overlap with the work on the batches queued before
+  buffer_pool_manager_->Prefetch(page_ids);
+  std::unique_lock lock(worker->latch_);
+  worker->cv_.wait(lock, [&] { return worker->batches_.size() < REDO_QUEUE_DEPTH; });
+  worker->batches_.push_back(std::move(batch));
+  lock.unlock();
+  worker->cv_.notify_all();
+}
+
+void LogRecovery::WorkerLoop(RedoWorker *worker, void (LogRecovery::*apply)(RedoItem *)) {
+  while (true) {
+    std::vector<RedoItem> batch;
+    {
+      std::unique_lock lock(worker->latch_);
+      worker->cv_.wait(lock, [&] { return !worker->batches_.empty() || worker->done_; });
+      if (worker->batches_.empty()) {
+        return;
+      }
+      batch = std::move(worker->batches_.front());
+      worker->batches_.pop_front();
+    }
+    // the parser may be waiting for room
+    worker->cv_.notify_all();
+    for (auto &item : batch) {
+      (this->*apply)(&item);
+    }
+  }
+}
+
+void LogRecovery::RedoOnPage(RedoItem *item) {
+  LogRecord &record = item->record_;
+  Page *page;
+  // frames pinned by prefetches and the other workers are released shortly
+  while ((page = buffer_pool_manager_->FetchPage(item->page_id_)) == nullptr) {
+    std::this_thread::yield();
+  }
+  page->WLatch();
+  auto *table_page = reinterpret_cast<TablePage *>(page);
+  lsn_t lsn = record.GetLSN();
+  bool redo = page->GetLSN() < lsn;
+  // a CLR redoes the action undo took
+  switch (record.GetActionType()) {
+    case LogRecordType::INSERT:
+      if (redo) {
+        RID rid;
+        // the page is replayed in order, so the tuple ends up in the slot it was inserted into at first
+        table_page->InsertTuple(record.GetInsertTuple(), &rid, nullptr, nullptr, nullptr);
+        if (!(rid == record.GetInsertRID())) {
+          LOG_WARN("redo inserted a tuple into %s instead of %s", rid.ToString().c_str(),
+                   record.GetInsertRID().ToString().c_str());
+        }
+      }
+      break;
+    case LogRecordType::MARKDELETE:
+      if (redo) {
+        table_page->MarkDelete(record.GetDeleteRID(), nullptr, nullptr, nullptr);
+      }
+      break;
+    case LogRecordType::APPLYDELETE:
+      if (redo) {
+        table_page->ApplyDelete(record.GetDeleteRID(), nullptr, nullptr);
+      }
+      break;
+    case LogRecordType::ROLLBACKDELETE:
+      if (redo) {
+        table_page->RollbackDelete(record.GetDeleteRID(), nullptr, nullptr);
+      }
+      break;
+    case LogRecordType::UPDATE:
+      if (redo) {
+        // the page misses the update, so it holds the tuple the update was made to
+        Tuple old_tuple;
+        if (table_page->GetTuple(record.GetUpdateRID(), &old_tuple, nullptr, nullptr)) {
+          table_page->UpdateTuple(record.ApplyUpdate(old_tuple), &old_tuple, record.GetUpdateRID(), nullptr, nullptr,
+                                  nullptr);
+        } else {
+          LOG_WARN("redo found no tuple to update at %s", record.GetUpdateRID().ToString().c_str());
+        }
+      }
+      break;
+    case LogRecordType::NEWPAGE:
+      if (item->page_id_ == record.page_id_) {
+        // a page that never made it to disk is all zeroes, whatever the LSN of the record
+        redo = redo || table_page->GetTablePageId() != record.page_id_;
+        if (redo) {
+          table_page->Init(record.page_id_, BUSTUB_PAGE_SIZE, record.GetNewPageRecord(), nullptr, nullptr);
+        }
+      } else if (redo) {
+        table_page->SetNextPageId(record.page_id_);
+      }
+      break;
+    case LogRecordType::INDEX_FORMAT_PAGE:
+      // like a new table page, whatever the LSN of the record
+      redo = redo || reinterpret_cast<BPlusTreePage *>(page->GetData())->GetPageId() != record.GetIndexPageId();
+      if (redo) {
+        RedoIndexChange(page, &record);
+      }
+      break;
+    case LogRecordType::INDEX_INSERT:
+    case LogRecordType::INDEX_DELETE:
+    case LogRecordType::INDEX_SPLICE:
+      if (redo) {
+        RedoIndexChange(page, &record);
+      }
+      break;
+    case LogRecordType::INDEX_ROOT:
+      if (redo) {
+        RedoRootChange(page, &record);
+      }
+      break;
+    case LogRecordType::INDEX_SMO: {
+      // the page carries the LSN of the whole modification, so it misses either all of its changes or none of them
+      bool first = true;
+      for (auto &change : record.GetStructureChanges()) {
+        if (GetPageIds(&change).front() != item->page_id_) {
+          continue;
+        }
+        if (first && change.GetLogRecordType() == LogRecordType::INDEX_FORMAT_PAGE) {
+          // like a new table page, whatever the LSN of the record
+          redo = redo || reinterpret_cast<BPlusTreePage *>(page->GetData())->GetPageId() != change.GetIndexPageId();
+        }
+        first = false;
+        if (redo && change.GetLogRecordType() == LogRecordType::INDEX_ROOT) {
+          RedoRootChange(page, &change);
+        } else if (redo) {
+          RedoIndexChange(page, &change);
+        }
+      }
+      break;
+    }
+    default:
+      redo = false;
+      break;
+  }
+  if (redo) {
+    page->SetLSN(lsn);
+    ++num_redone_;
+  }
+  page->WUnlatch();
+  buffer_pool_manager_->UnpinPage(item->page_id_, redo);
+}
+
+auto LogRecovery::GetIndexEntries(Page *page) -> char * {
+  const auto *tree_page = reinterpret_cast<const BPlusTreePage *>(page->GetData());
+  return page->GetData() + (tree_page->IsLeafPage() ? LEAF_PAGE_HEADER_SIZE : INTERNAL_PAGE_HEADER_SIZE);
+}
+
+auto LogRecovery::SpliceIndexEntries(Page *page, size_t entry_size, int index, int num_removed, const char *entries,
+                                     int num_entries) -> bool {
+  auto *tree_page = reinterpret_cast<BPlusTreePage *>(page->GetData());
+  int size = tree_page->GetSize();
+  if (index < 0 || num_removed < 0 || index + num_removed > size ||
+      (size - num_removed + num_entries) * entry_size > BUSTUB_PAGE_SIZE - LEAF_PAGE_HEADER_SIZE) {
+    return false;
+  }
+  char *array = GetIndexEntries(page);
+  memmove(array + (index + num_entries) * entry_size, array + (index + num_removed) * entry_size,
+          (size - index - num_removed) * entry_size);
+  if (num_entries > 0) {
+    memcpy(array + index * entry_size, entries, num_entries * entry_size);
+  }
+  tree_page->SetSize(size - num_removed + num_entries);
+  return true;
+}
+
+void LogRecovery::RedoIndexChange(Page *page, LogRecord *record) {
+  auto *tree_page = reinterpret_cast<BPlusTreePage *>(page->GetData());
+  IndexPageChange &change = record->GetIndexChange();
+  bool applied;
+  switch (record->GetActionType()) {
+    case LogRecordType::INDEX_FORMAT_PAGE:
+      tree_page->SetPageType(static_cast<IndexPageType>(change.page_type_));
+      tree_page->SetPageId(record->GetIndexPageId());
+      tree_page->SetMaxSize(change.max_size_);
+      tree_page->SetSize(0);
+      applied = SpliceIndexEntries(page, change.entry_size_, 0, 0, change.entries_.data(), change.GetNumEntries());
+      break;
+    case LogRecordType::INDEX_DELETE:
+      applied = SpliceIndexEntries(page, change.entry_size_, change.index_, change.num_removed_, nullptr, 0);
+      break;
+    default:
+      applied = SpliceIndexEntries(page, change.entry_size_, change.index_, change.num_removed_,
+                                   change.entries_.data(), change.GetNumEntries());
+      break;
+  }
+  if (!applied) {
+    // a page deleted while dirty is left behind on disk as it was last written, and may not match its records
+    LOG_WARN("redo of index record %" PRId64 " doesn't fit page %d", record->GetLSN(), record->GetIndexPageId());
+    return;
+  }
+  if (tree_page->IsLeafPage()) {
+    // the next page id closes the header of a leaf
+    memcpy(page->GetData() + LEAF_PAGE_HEADER_SIZE - sizeof(page_id_t), &change.next_page_id_, sizeof(page_id_t));
+  }
+}
+
+void LogRecovery::RedoRootChange(Page *page, LogRecord *record) {
+  auto *header_page = reinterpret_cast<HeaderPage *>(page);
+  if (!header_page->UpdateRecord(record->GetIndexName(), record->GetRootPageId())) {
+    header_page->InsertRecord(record->GetIndexName(), record->GetRootPageId());
+  }
+}
+
+auto LogRecovery::GetUndoNextLSN(LogRecord *record) -> lsn_t {
+  return record->GetLogRecordType() == LogRecordType::CLR ? record->GetUndoNextLSN() : record->GetPrevLSN();
+}
+
+void LogRecovery::UndoRecord(RedoItem *item) {
+  LogRecord &record = item->record_;
+  auto index = indexes_.end();
+  if (record.GetLogRecordType() == LogRecordType::INDEX_INSERT ||
+      record.GetLogRecordType() == LogRecordType::INDEX_DELETE) {
+    index = indexes_.find(record.GetIndexName());
+  }
+  if (index != indexes_.end()) {
+    // the index logs the CLR on behalf of the transaction, chained to the records logged for it so far
+    txn_id_t txn_id = record.GetTxnId();
+    Transaction txn(txn_id);
+    txn.SetPrevLSN(active_txn_.at(txn_id));
+    index->second->UndoIndexChange(&record, &txn);
+    active_txn_.at(txn_id) = txn.GetPrevLSN();
+  } else if (item->page_id_ != INVALID_PAGE_ID) {
+    // only the records that changed a page are queued with one
+    Page *page;
+    while ((page = buffer_pool_manager_->FetchPage(item->page_id_)) == nullptr) {
+      std::this_thread::yield();
+    }
+    page->WLatch();
+    if (record.GetLogRecordType() == LogRecordType::INDEX_INSERT ||
+        record.GetLogRecordType() == LogRecordType::INDEX_DELETE) {
+      UndoIndexChange(page, &record);
+    } else {
+      UndoTableChange(page, &record);
+    }
+    page->WUnlatch();
+    buffer_pool_manager_->UnpinPage(item->page_id_, true);
+  }
+  ++num_undone_;
+  // the transaction is rolled back to its first record
+  if (GetUndoNextLSN(&record) == INVALID_LSN && log_manager_ != nullptr) {
+    txn_id_t txn_id = record.GetTxnId();
+    LogRecord abort(txn_id, active_txn_.at(txn_id), LogRecordType::ABORT);
+    active_txn_.at(txn_id) = log_manager_->AppendLogRecord(&abort);
+  }
+}
+
+/*
+ * undo may be interrupted by a crash before its CLR reached the log, and run again on a page that has the change
+ * rolled back already. Such a change is left alone, but compensated all the same.
+ */
+void LogRecovery::UndoTableChange(Page *page, LogRecord *record) {
+  auto *table_page = reinterpret_cast<TablePage *>(page);
+  txn_id_t txn_id = record->GetTxnId();
+  Tuple tuple;
+  switch (record->GetLogRecordType()) {
+    case LogRecordType::INSERT: {
+      const RID &rid = record->GetInsertRID();
+      // an empty slot is a tuple deleted already
+      if (table_page->GetTuple(rid, &tuple, nullptr, nullptr)) {
+        table_page->ApplyDelete(rid, nullptr, nullptr);
+      }
+      LogCompensation(page, record,
+                      LogRecord(txn_id, INVALID_LSN, LogRecordType::APPLYDELETE, rid, record->GetInsertTuple()));
+      break;
+    }
+    case LogRecordType::MARKDELETE: {
+      const RID &rid = record->GetDeleteRID();
+      // clearing the delete flag is idempotent
+      table_page->RollbackDelete(rid, nullptr, nullptr);
+      LogCompensation(page, record,
+                      LogRecord(txn_id, INVALID_LSN, LogRecordType::ROLLBACKDELETE, rid, record->GetDeleteTuple()));
+      break;
+    }
+    case LogRecordType::UPDATE: {
+      const RID &rid = record->GetUpdateRID();
+      if (!table_page->GetTuple(rid, &tuple, nullptr, nullptr)) {
+        LOG_WARN("undo found no tuple to update at %s", rid.ToString().c_str());
+        break;
+      }
+      // reverting the chunks the update changed is harmless on a tuple that has them reverted already
+      Tuple old_tuple = record->RevertUpdate(tuple);
+      Tuple replaced;
+      table_page->UpdateTuple(old_tuple, &replaced, rid, nullptr, nullptr, nullptr);
+      LogCompensation(page, record, LogRecord(txn_id, INVALID_LSN, LogRecordType::UPDATE, rid, tuple, old_tuple));
+      break;
+    }
+    default:
+      break;
+  }
+}
+
+void LogRecovery::UndoIndexChange(Page *page, LogRecord *record) {
+  LOG_WARN("index %s isn't registered, undoing record %" PRId64 " on page %d", record->GetIndexName().c_str(),
+           record->GetLSN(), record->GetIndexPageId());
+  auto *tree_page = reinterpret_cast<BPlusTreePage *>(page->GetData());
+  IndexPageChange &change = record->GetIndexChange();
+  auto entry_size = static_cast<size_t>(change.entry_size_);
+  int size = tree_page->GetSize();
+  const char *array = GetIndexEntries(page);
+  std::vector<char> before(array, array + size * entry_size);
+  for (int i = 0; i < change.GetNumEntries(); i++) {
+    const char *entry = change.entries_.data() + i * entry_size;
+    int index = 0;
+    while (index < size && memcmp(array + index * entry_size, entry, entry_size) != 0) {
+      index++;
+    }
+    // an entry that is already in place is left alone
+    bool undone = false;
+    if (record->GetLogRecordType() == LogRecordType::INDEX_INSERT && index < size) {
+      undone = SpliceIndexEntries(page, entry_size, index, 1, nullptr, 0);
+    } else if (record->GetLogRecordType() == LogRecordType::INDEX_DELETE && index == size) {
+      undone = SpliceIndexEntries(page, entry_size, std::min(change.index_ + i, size), 0, entry, 1);
+    }
+    if (undone) {
+      size = tree_page->GetSize();
+    }
+  }
+
+  // the CLR replaces the entries that differ, between the ones in front and at the back that didn't change
+  auto old_size = static_cast<int>(before.size() / entry_size);
+  int front = 0;
+  while (front < std::min(old_size, size) &&
+         memcmp(before.data() + front * entry_size, array + front * entry_size, entry_size) == 0) {
+    front++;
+  }
+  int back = 0;
+  while (back < std::min(old_size, size) - front &&
+         memcmp(before.data() + (old_size - back - 1) * entry_size, array + (size - back - 1) * entry_size,
+                entry_size) == 0) {
+    back++;
+  }
+  IndexPageChange splice;
+  splice.page_type_ = static_cast<int32_t>(tree_page->IsLeafPage() ? IndexPageType::LEAF_PAGE
+                                                                   : IndexPageType::INTERNAL_PAGE);
+  splice.max_size_ = tree_page->GetMaxSize();
+  if (tree_page->IsLeafPage()) {
+    memcpy(&splice.next_page_id_, page->GetData() + LEAF_PAGE_HEADER_SIZE - sizeof(page_id_t), sizeof(page_id_t));
+  }
+  splice.index_ = front;
+  splice.num_removed_ = old_size - front - back;
+  splice.entry_size_ = change.entry_size_;
+  splice.entries_.assign(array + front * entry_size, array + (size - back) * entry_size);
+  LogCompensation(page, record,
+                  LogRecord(record->GetTxnId(), INVALID_LSN, LogRecordType::INDEX_SPLICE, record->GetIndexPageId(),
+                            std::move(splice)));
+}
+
+void LogRecovery::LogCompensation(Page *page, LogRecord *record, LogRecord action) {
+  if (log_manager_ == nullptr) {
+    return;
+  }
+  LogRecord clr(std::move(action), record->GetPrevLSN());
+  clr.prev_lsn_ = active_txn_.at(record->GetTxnId());
+  lsn_t lsn = log_manager_->AppendLogRecord(&clr);
+  active_txn_.at(record->GetTxnId()) = lsn;
+  page->SetLSN(lsn);
+}
 
 /*
- *undo phase on TABLE PAGE level(table/table_page.h)
- *iterate through active txn map and undo each operation
+ *undo phase, follows the prevLSN chains of the transactions that never ended back to their first records, all at
+ *once: the next record to undo is always the one with the highest LSN left in any chain. Table records are undone on
+ *the slot they name. Index records are undone by key by the index they name, or on the leaf they name if it wasn't
+ *registered, which only holds as long as no split or merge moved the entries.
  */
-void LogRecovery::Undo() {}
+void LogRecovery::Undo() {
+  if (!analyzed_) {
+    Analyze();
+  }
+  std::priority_queue<std::pair<lsn_t, txn_id_t>> chains;
+  for (const auto &[txn_id, last_lsn] : active_txn_) {
+    chains.emplace(last_lsn, txn_id);
+  }
+  auto workers = StartWorkers(&LogRecovery::UndoRecord);
+  std::vector<std::vector<RedoItem>> batches(num_workers_);
+  std::vector<txn_id_t> rolled_back;
+  LogRecord record;
+  while (!chains.empty()) {
+    auto [lsn, txn_id] = chains.top();
+    chains.pop();
+    if (!ReadLogRecord(lsn, &record)) {
+      LOG_WARN("undo of transaction %d stopped, record %" PRId64 " is not in the log", txn_id, lsn);
+      continue;
+    }
+    lsn_t undo_next_lsn = GetUndoNextLSN(&record);
+    if (undo_next_lsn != INVALID_LSN) {
+      chains.emplace(undo_next_lsn, txn_id);
+    } else {
+      rolled_back.push_back(txn_id);
+    }
+    // the other records, CLRs among them, change nothing on undo, they only move the chain on
+    page_id_t page_id = INVALID_PAGE_ID;
+    switch (record.GetLogRecordType()) {
+      case LogRecordType::INSERT:
+      case LogRecordType::MARKDELETE:
+      case LogRecordType::UPDATE:
+        page_id = GetPageIds(&record)[0];
+        break;
+      case LogRecordType::INDEX_INSERT:
+      case LogRecordType::INDEX_DELETE:
+        // a registered index finds the entries itself
+        if (indexes_.count(record.GetIndexName()) == 0) {
+          page_id = GetPageIds(&record)[0];
+        }
+        break;
+      default:
+        break;
+    }
+    // the records of a transaction go to a single worker, which keeps them in order
+    size_t worker = std::hash<txn_id_t>()(txn_id) % num_workers_;
+    batches[worker].push_back(RedoItem{page_id, record});
+    if (batches[worker].size() == REDO_BATCH_SIZE) {
+      QueueBatch(workers[worker].get(), std::move(batches[worker]));
+      batches[worker].clear();
+    }
+  }
+  StopWorkers(&workers, &batches);
+  if (log_manager_ != nullptr) {
+    for (txn_id_t txn_id : rolled_back) {
+      active_txn_.erase(txn_id);
+    }
+    log_manager_->Flush();
+  }
+}
 
 }  // namespace bustub
@@ -10,115 +10,602 @@
 //
 //===----------------------------------------------------------------------===//
 
+#include <dirent.h>
+#include <fcntl.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <algorithm>
 #include <cassert>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
 #include <cstring>
 #include <iostream>
+#include <memory>
 #include <mutex>  // NOLINT
 #include <string>
 #include <thread>  // NOLINT
+#include <vector>
 
 #include "common/exception.h"
 #include "common/logger.h"
+#include "common/macros.h"
 #include "storage/disk/disk_manager.h"
 
 namespace bustub {
 
 static char *buffer_used;
 
+/** pread() until count bytes are read or the file ends, returns the number of bytes read or -1 on error */
+static auto PreadFull(int fd, char *buf, size_t count, off_t offset) -> ssize_t {
+  size_t done = 0;
+  while (done < count) {
+    ssize_t n = pread(fd, buf + done, count - done, offset + static_cast<off_t>(done));
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n < 0) {
+      return -1;
+    }
+    if (n == 0) {
+      break;
+    }
+    done += n;
+  }
+  return static_cast<ssize_t>(done);
+}
+
+/** pwrite() until count bytes are written, returns false on error */
+static auto PwriteFull(int fd, const char *buf, size_t count, off_t offset) -> bool {
+  size_t done = 0;
+  while (done < count) {
+    ssize_t n = pwrite(fd, buf + done, count - done, offset + static_cast<off_t>(done));
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      // no progress, and nothing in errno to tell why
+      if (n == 0) {
+        errno = EIO;
+      }
+      return false;
+    }
+    done += n;
+  }
+  return true;
+}
+
+/** write() until count bytes are written, for files opened with O_APPEND. Returns false on error. */
+static auto WriteFull(int fd, const char *buf, size_t count) -> bool {
+  size_t done = 0;
+  while (done < count) {
+    ssize_t n = write(fd, buf + done, count - done);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    done += n;
+  }
+  return true;
+}
+
+/** fdatasync() the file, returns false on error */
+static auto DataSync(int fd) -> bool {
+  while (fdatasync(fd) != 0) {
+    if (errno != EINTR) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/** fsync() the directory holding file_name, so that files created in or removed from it survive a crash */
+static void SyncDirectory(const std::string &file_name) {
+  std::string::size_type slash = file_name.rfind('/');
+  std::string dir = slash == std::string::npos ? "." : file_name.substr(0, std::max<std::string::size_type>(slash, 1));
+  int fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+  if (fd < 0) {
+    return;
+  }
+  if (fsync(fd) != 0) {
+    LOG_DEBUG("I/O error while syncing %s: %s", dir.c_str(), strerror(errno));
+  }
+  close(fd);
+}
+
+/** pwritev() until all of the buffers are written, returns false on error. The iovecs are consumed along the way. */
+static auto PwritevFull(int fd, iovec *iov, int iovcnt, off_t offset) -> bool {
+  while (iovcnt > 0) {
+    ssize_t n = pwritev(fd, iov, iovcnt, offset);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    offset += n;
+    // skip the buffers written in full, and the written part of the next one
+    while (iovcnt > 0 && static_cast<size_t>(n) >= iov->iov_len) {
+      n -= static_cast<ssize_t>(iov->iov_len);
+      ++iov;
+      --iovcnt;
+    }
+    if (iovcnt > 0) {
+      iov->iov_base = static_cast<char *>(iov->iov_base) + n;
+      iov->iov_len -= n;
+    }
+  }
+  return true;
+}
+
+/** @return a BUSTUB_PAGE_SIZE buffer aligned for direct I/O, one per thread */
+static auto BounceBuffer() -> char * {
+  struct FreeDeleter {
+    void operator()(char *buf) const { std::free(buf); }  // NOLINT
+  };
+  thread_local std::unique_ptr<char, FreeDeleter> buffer(
+      static_cast<char *>(std::aligned_alloc(BUSTUB_PAGE_SIZE, BUSTUB_PAGE_SIZE)));
+  return buffer.get();
+}
+
+/**
+ * Open the db file with the flags the options ask for. A file system that doesn't support O_DIRECT fails the open with
+ * EINVAL, the file is opened for buffered I/O then.
+ */
+static auto OpenDbFile(const std::string &db_file, int flags, const DiskManagerOptions &options, bool *direct_io)
+    -> int {
+  if (options.sync_policy_ == DbSyncPolicy::EVERY_WRITE) {
+    flags |= O_DSYNC;
+  }
+  *direct_io = false;
+  if (options.direct_io_) {
+    int fd = open(db_file.c_str(), flags | O_DIRECT, 0644);
+    if (fd >= 0 || errno != EINVAL) {
+      *direct_io = fd >= 0;
+      return fd;
+    }
+    LOG_DEBUG("direct I/O is not supported for %s, falling back to buffered I/O", db_file.c_str());
+  }
+  return open(db_file.c_str(), flags, 0644);
+}
+
 /**
  * Constructor: open/create a single database file & log file
  * @input db_file: database file name
  */
-DiskManager::DiskManager(const std::string &db_file) : file_name_(db_file) {
+DiskManager::DiskManager(const std::string &db_file, const DiskManagerOptions &options)
+    : file_name_(db_file), sync_policy_(options.sync_policy_) {
   std::string::size_type n = file_name_.rfind('.');
   if (n == std::string::npos) {
     LOG_DEBUG("wrong file format");
     return;
   }
   log_name_ = file_name_.substr(0, n) + ".log";
+  fsm_name_ = file_name_.substr(0, n) + ".fsm";
 
-  log_io_.open(log_name_, std::ios::binary | std::ios::in | std::ios::app | std::ios::out);
-  // directory or file does not exist
-  if (!log_io_.is_open()) {
-    log_io_.clear();
-    // create a new file
-    log_io_.open(log_name_, std::ios::binary | std::ios::trunc | std::ios::out | std::ios::in);
-    if (!log_io_.is_open()) {
-      throw Exception("can't open dblog file");
-    }
-  }
+  log_segment_size_ = std::max<size_t>(options.log_segment_size_, 1);
+  OpenLog();
 
-  std::scoped_lock scoped_db_io_latch(db_io_latch_);
-  db_io_.open(db_file, std::ios::binary | std::ios::in | std::ios::out);
+  db_fd_ = OpenDbFile(db_file, O_RDWR, options, &direct_io_);
   // directory or file does not exist
-  if (!db_io_.is_open()) {
-    db_io_.clear();
+  if (db_fd_ < 0) {
     // create a new file
-    db_io_.open(db_file, std::ios::binary | std::ios::trunc | std::ios::out | std::ios::in);
-    if (!db_io_.is_open()) {
+    db_fd_ = OpenDbFile(db_file, O_RDWR | O_CREAT | O_TRUNC, options, &direct_io_);
+    if (db_fd_ < 0) {
       throw Exception("can't open db file");
     }
+    // a free page map left behind by an earlier database of the same name doesn't apply to the new one
+    std::remove(fsm_name_.c_str());
+  } else {
+    struct stat stat_buf;
+    if (fstat(db_fd_, &stat_buf) != 0) {
+      throw Exception("can't stat db file");
+    }
+    db_file_size_ = stat_buf.st_size;
+    // every page below the end of the file has been allocated at some point
+    next_page_id_ = (db_file_size_ + BUSTUB_PAGE_SIZE - 1) / BUSTUB_PAGE_SIZE;
+    LoadFreePageMap();
   }
   buffer_used = nullptr;
 }
 
+DiskManager::~DiskManager() {
+  StopIoThreads();
+  if (db_fd_ >= 0) {
+    close(db_fd_);
+  }
+  if (log_fd_ >= 0) {
+    close(log_fd_);
+  }
+}
+
 /**
  * Close all file streams
  */
 void DiskManager::ShutDown() {
+  StopIoThreads();
+  if (db_fd_ >= 0) {
+    close(db_fd_);
+    db_fd_ = -1;
+  }
   {
-    std::scoped_lock scoped_db_io_latch(db_io_latch_);
-    db_io_.close();
+    std::scoped_lock scoped_alloc_latch(alloc_latch_);
+    fsm_io_.close();
+  }
+  if (log_fd_ >= 0) {
+    close(log_fd_);
+    log_fd_ = -1;
   }
-  log_io_.close();
 }
 
 /**
  * Write the contents of the specified page into disk file
  */
-void DiskManager::WritePage(page_id_t page_id, const char *page_data) {
-  std::scoped_lock scoped_db_io_latch(db_io_latch_);
+auto DiskManager::WritePage(page_id_t page_id, const char *page_data) -> int {
   size_t offset = static_cast<size_t>(page_id) * BUSTUB_PAGE_SIZE;
-  // set write cursor to offset
   num_writes_ += 1;
-  db_io_.seekp(offset);
-  db_io_.write(page_data, BUSTUB_PAGE_SIZE);
-  // check for I/O error
-  if (db_io_.bad()) {
-    LOG_DEBUG("I/O error while writing");
+  if (NeedsBounceBuffer(page_data)) {
+    char *bounce = BounceBuffer();
+    memcpy(bounce, page_data, BUSTUB_PAGE_SIZE);
+    page_data = bounce;
+  }
+  if (!PwriteFull(db_fd_, page_data, BUSTUB_PAGE_SIZE, offset)) {
+    int error = errno;
+    LOG_DEBUG("I/O error while writing: %s", strerror(error));
+    return error;
+  }
+  GrowDbFileSize(offset + BUSTUB_PAGE_SIZE);
+  return 0;
+}
+
+/**
+ * Write the pages sorted by id, one pwritev() per run of adjacent pages
+ */
+void DiskManager::WritePages(std::vector<std::pair<page_id_t, const char *>> pages) {
+  if (db_fd_ < 0) {
+    for (const auto &[page_id, page_data] : pages) {
+      WritePage(page_id, page_data);
+    }
     return;
   }
-  // needs to flush to keep disk file in sync
-  db_io_.flush();
+  std::sort(pages.begin(), pages.end(), [](const auto &a, const auto &b) { return a.first < b.first; });
+  // direct I/O on an unaligned buffer needs an aligned copy, which must live until its run is written
+  struct FreeDeleter {
+    void operator()(char *buf) const { std::free(buf); }  // NOLINT
+  };
+  std::vector<std::unique_ptr<char, FreeDeleter>> bounce;
+  std::vector<iovec> iov;
+  iov.reserve(std::min(pages.size(), DISK_MANAGER_MAX_WRITEV_PAGES));
+  size_t run_start = 0;
+  for (size_t i = 0; i < pages.size(); i++) {
+    const char *page_data = pages[i].second;
+    if (NeedsBounceBuffer(page_data)) {
+      bounce.emplace_back(static_cast<char *>(std::aligned_alloc(BUSTUB_PAGE_SIZE, BUSTUB_PAGE_SIZE)));
+      memcpy(bounce.back().get(), page_data, BUSTUB_PAGE_SIZE);
+      page_data = bounce.back().get();
+    }
+    iov.push_back(iovec{const_cast<char *>(page_data), BUSTUB_PAGE_SIZE});
+    bool run_ends = i + 1 == pages.size() || pages[i + 1].first != pages[i].first + 1 ||
+                    iov.size() == DISK_MANAGER_MAX_WRITEV_PAGES;
+    if (!run_ends) {
+      continue;
+    }
+    size_t offset = static_cast<size_t>(pages[run_start].first) * BUSTUB_PAGE_SIZE;
+    num_writes_ += static_cast<int>(iov.size());
+    if (PwritevFull(db_fd_, iov.data(), static_cast<int>(iov.size()), offset)) {
+      GrowDbFileSize(offset + iov.size() * BUSTUB_PAGE_SIZE);
+    } else {
+      LOG_DEBUG("I/O error while writing");
+    }
+    iov.clear();
+    bounce.clear();
+    run_start = i + 1;
+  }
+}
+
+void DiskManager::GrowDbFileSize(size_t size) {
+  // the file only ever grows, raise the cached size unless a concurrent write raised it further
+  size_t current = db_file_size_.load(std::memory_order_relaxed);
+  while (current < size && !db_file_size_.compare_exchange_weak(current, size, std::memory_order_release)) {
+  }
 }
 
 /**
  * Read the contents of the specified page into the given memory area
  */
-void DiskManager::ReadPage(page_id_t page_id, char *page_data) {
-  std::scoped_lock scoped_db_io_latch(db_io_latch_);
-  int offset = page_id * BUSTUB_PAGE_SIZE;
+auto DiskManager::ReadPage(page_id_t page_id, char *page_data) -> int {
+  size_t offset = static_cast<size_t>(page_id) * BUSTUB_PAGE_SIZE;
   // check if read beyond file length
-  if (offset > GetFileSize(file_name_)) {
+  if (offset > db_file_size_.load(std::memory_order_acquire)) {
     LOG_DEBUG("I/O error reading past end of file");
-    // std::cerr << "I/O error while reading" << std::endl;
-  } else {
-    // set read cursor to offset
-    db_io_.seekp(offset);
-    db_io_.read(page_data, BUSTUB_PAGE_SIZE);
-    if (db_io_.bad()) {
-      LOG_DEBUG("I/O error while reading");
+    return 0;
+  }
+  char *buf = NeedsBounceBuffer(page_data) ? BounceBuffer() : page_data;
+  ssize_t read_count = PreadFull(db_fd_, buf, BUSTUB_PAGE_SIZE, offset);
+  if (read_count < 0) {
+    int error = errno;
+    LOG_DEBUG("I/O error while reading: %s", strerror(error));
+    return error;
+  }
+  if (buf != page_data) {
+    memcpy(page_data, buf, read_count);
+  }
+  // if file ends before reading BUSTUB_PAGE_SIZE
+  if (read_count < BUSTUB_PAGE_SIZE) {
+    LOG_DEBUG("Read less than a page");
+    memset(page_data + read_count, 0, BUSTUB_PAGE_SIZE - read_count);
+  }
+  return 0;
+}
+
+/**
+ * Flush the written pages to the device, as the sync policy asks
+ */
+void DiskManager::Sync() {
+  if (db_fd_ < 0 || sync_policy_ != DbSyncPolicy::ON_SYNC) {
+    return;
+  }
+  num_syncs_ += 1;
+  while (fdatasync(db_fd_) != 0) {
+    if (errno != EINTR) {
+      LOG_DEBUG("I/O error while syncing: %s", strerror(errno));
+      return;
+    }
+  }
+}
+
+/**
+ * Queue the requests for the I/O threads, starting them on the first call
+ */
+void DiskManager::SubmitAsync(std::vector<DiskRequest> requests) {
+  if (requests.empty()) {
+    return;
+  }
+  {
+    std::scoped_lock scoped_io_latch(io_latch_);
+    if (!io_running_) {
+      io_running_ = true;
+      for (int i = 0; i < DISK_MANAGER_IO_THREADS; i++) {
+        io_threads_.emplace_back(&DiskManager::IoThreadLoop, this);
+      }
+    }
+    for (auto &request : requests) {
+      io_queue_.push_back(std::move(request));
+    }
+  }
+  io_queue_cv_.notify_all();
+}
+
+void DiskManager::IoThreadLoop() {
+  std::unique_lock lock(io_latch_);
+  while (true) {
+    io_queue_cv_.wait(lock, [&] { return !io_queue_.empty() || !io_running_; });
+    // the queue is drained before stopping, somebody is waiting for every queued request
+    if (io_queue_.empty()) {
+      return;
+    }
+    DiskRequest request = std::move(io_queue_.front());
+    io_queue_.pop_front();
+    lock.unlock();
+
+    int error = request.is_write_ ? WritePage(request.page_id_, request.data_)
+                                  : ReadPage(request.page_id_, request.data_);
+    request.callback_(error);
+
+    lock.lock();
+  }
+}
+
+void DiskManager::StopIoThreads() {
+  {
+    std::scoped_lock scoped_io_latch(io_latch_);
+    if (!io_running_) {
       return;
     }
-    // if file ends before reading BUSTUB_PAGE_SIZE
-    int read_count = db_io_.gcount();
-    if (read_count < BUSTUB_PAGE_SIZE) {
-      LOG_DEBUG("Read less than a page");
-      db_io_.clear();
-      // std::cerr << "Read less than a page" << std::endl;
-      memset(page_data + read_count, 0, BUSTUB_PAGE_SIZE - read_count);
+    io_running_ = false;
+  }
+  io_queue_cv_.notify_all();
+  for (auto &thread : io_threads_) {
+    thread.join();
+  }
+  io_threads_.clear();
+}
+
+/**
+ * Hand out the first free page at or after the hint, or grow the file if no page is free
+ */
+auto DiskManager::AllocatePage(page_id_t hint) -> page_id_t {
+  std::scoped_lock scoped_alloc_latch(alloc_latch_);
+  if (num_free_pages_ == 0) {
+    return next_page_id_++;
+  }
+  page_id_t page_id = FindFreePage(hint == INVALID_PAGE_ID ? 0 : hint);
+  free_page_map_[page_id / 64] &= ~(uint64_t{1} << (page_id % 64));
+  num_free_pages_--;
+  WriteFreePageMapBlock(page_id);
+  return page_id;
+}
+
+/**
+ * Mark the page as free in the free page map
+ */
+void DiskManager::DeallocatePage(page_id_t page_id) {
+  std::scoped_lock scoped_alloc_latch(alloc_latch_);
+  if (page_id < 0 || page_id >= next_page_id_) {
+    LOG_DEBUG("deallocating a page that was never allocated");
+    return;
+  }
+  size_t word = page_id / 64;
+  uint64_t bit = uint64_t{1} << (page_id % 64);
+  if (word >= free_page_map_.size()) {
+    // grow by whole blocks, they are written as a whole
+    free_page_map_.resize((word / FREE_PAGE_MAP_BLOCK_WORDS + 1) * FREE_PAGE_MAP_BLOCK_WORDS, 0);
+  }
+  if ((free_page_map_[word] & bit) != 0) {
+    return;
+  }
+  free_page_map_[word] |= bit;
+  num_free_pages_++;
+  WriteFreePageMapBlock(page_id);
+}
+
+void DiskManager::MarkAllocated(page_id_t page_id) {
+  std::scoped_lock scoped_alloc_latch(alloc_latch_);
+  next_page_id_ = std::max(next_page_id_, page_id + 1);
+}
+
+auto DiskManager::GetNumPages() -> page_id_t {
+  std::scoped_lock scoped_alloc_latch(alloc_latch_);
+  return next_page_id_;
+}
+
+auto DiskManager::GetNumFreePages() -> size_t {
+  std::scoped_lock scoped_alloc_latch(alloc_latch_);
+  return num_free_pages_;
+}
+
+auto DiskManager::FindFreePage(page_id_t start) -> page_id_t {
+  size_t num_words = free_page_map_.size();
+  size_t start_word = start / 64;
+  if (start_word >= num_words) {
+    start_word = 0;
+    start = 0;
+  }
+  // free pages at or after start in its own word first
+  uint64_t bits = free_page_map_[start_word] & (~uint64_t{0} << (start % 64));
+  if (bits != 0) {
+    return static_cast<page_id_t>(start_word * 64 + __builtin_ctzll(bits));
+  }
+  // then the following words, wrapping around up to the pages before start in its own word
+  for (size_t i = 1; i <= num_words; i++) {
+    size_t word = (start_word + i) % num_words;
+    if (free_page_map_[word] != 0) {
+      return static_cast<page_id_t>(word * 64 + __builtin_ctzll(free_page_map_[word]));
+    }
+  }
+  UNREACHABLE("the free page map has no free page although num_free_pages_ > 0");
+}
+
+void DiskManager::LoadFreePageMap() {
+  fsm_io_.open(fsm_name_, std::ios::binary | std::ios::in | std::ios::out);
+  if (!fsm_io_.is_open()) {
+    fsm_io_.clear();
+    return;
+  }
+  int64_t size = GetFileSize(fsm_name_);
+  size_t num_blocks = size < 0 ? 0 : static_cast<size_t>(size) / BUSTUB_PAGE_SIZE;
+  free_page_map_.assign(num_blocks * FREE_PAGE_MAP_BLOCK_WORDS, 0);
+  fsm_io_.seekg(0);
+  fsm_io_.read(reinterpret_cast<char *>(free_page_map_.data()), num_blocks * BUSTUB_PAGE_SIZE);
+  if (fsm_io_.bad()) {
+    LOG_DEBUG("I/O error while reading the free page map");
+    free_page_map_.clear();
+    return;
+  }
+  fsm_io_.clear();
+  for (size_t word = 0; word < free_page_map_.size(); word++) {
+    for (int bit = 0; bit < 64; bit++) {
+      if ((free_page_map_[word] & (uint64_t{1} << bit)) == 0) {
+        continue;
+      }
+      // pages past the end of the file were never written, they are handed out by growing the file again
+      if (static_cast<page_id_t>(word * 64 + bit) >= next_page_id_) {
+        free_page_map_[word] &= ~(uint64_t{1} << bit);
+      } else {
+        num_free_pages_++;
+      }
+    }
+  }
+}
+
+void DiskManager::WriteFreePageMapBlock(page_id_t page_id) {
+  // memory-backed disk managers keep the map in memory only
+  if (fsm_name_.empty()) {
+    return;
+  }
+  if (!fsm_io_.is_open()) {
+    fsm_io_.clear();
+    fsm_io_.open(fsm_name_, std::ios::binary | std::ios::trunc | std::ios::out | std::ios::in);
+    if (!fsm_io_.is_open()) {
+      throw Exception("can't open free page map file");
+    }
+  }
+  size_t block = page_id / FREE_PAGE_MAP_BLOCK_PAGES;
+  fsm_io_.seekp(block * BUSTUB_PAGE_SIZE);
+  fsm_io_.write(reinterpret_cast<const char *>(free_page_map_.data() + block * FREE_PAGE_MAP_BLOCK_WORDS),
+                BUSTUB_PAGE_SIZE);
+  if (fsm_io_.bad()) {
+    LOG_DEBUG("I/O error while writing the free page map");
+    return;
+  }
+  fsm_io_.flush();
+}
+
+auto DiskManager::LogStartName() const -> std::string { return log_name_ + ".start"; }
+
+auto DiskManager::LogSegmentName(size_t segment) const -> std::string {
+  // the first segment is the plain .log file, so that a log written before segments existed reads as one
+  return segment == 0 ? log_name_ : log_name_ + "." + std::to_string(segment);
+}
+
+void DiskManager::OpenLog() {
+  std::string::size_type slash = log_name_.rfind('/');
+  std::string dir = slash == std::string::npos ? "." : log_name_.substr(0, std::max<std::string::size_type>(slash, 1));
+  std::string base = slash == std::string::npos ? log_name_ : log_name_.substr(slash + 1);
+  bool found = false;
+  size_t first_segment = 0;
+  size_t last_segment = 0;
+  if (DIR *dir_stream = opendir(dir.c_str()); dir_stream != nullptr) {
+    while (dirent *entry = readdir(dir_stream)) {
+      std::string name = entry->d_name;
+      size_t segment;
+      if (name == base) {
+        segment = 0;
+      } else if (name.size() > base.size() + 1 && name.compare(0, base.size() + 1, base + ".") == 0 &&
+                 name.find_first_not_of("0123456789", base.size() + 1) == std::string::npos) {
+        segment = std::stoul(name.substr(base.size() + 1));
+      } else {
+        continue;
+      }
+      first_segment = found ? std::min(first_segment, segment) : segment;
+      last_segment = found ? std::max(last_segment, segment) : segment;
+      found = true;
+    }
+    closedir(dir_stream);
+  }
+
+  log_fd_ = open(LogSegmentName(last_segment).c_str(), O_RDWR | O_APPEND | O_CREAT, 0644);
+  // directory does not exist
+  if (log_fd_ < 0) {
+    throw Exception("can't open dblog file");
+  }
+  struct stat stat_buf;
+  if (fstat(log_fd_, &stat_buf) != 0) {
+    throw Exception("can't stat dblog file");
+  }
+  auto size = static_cast<size_t>(stat_buf.st_size);
+  if (size > log_segment_size_) {
+    LOG_DEBUG("log segment %zu is larger than the segment size, ignoring its tail", last_segment);
+    size = log_segment_size_;
+  }
+  log_first_segment_ = first_segment;
+  log_end_offset_ = last_segment * log_segment_size_ + size;
+  // the first record need not be at the start of the oldest segment, the last truncation left its offset behind
+  log_start_offset_ = first_segment * log_segment_size_;
+  if (int fd = open(LogStartName().c_str(), O_RDONLY); fd >= 0) {
+    uint64_t start;
+    if (PreadFull(fd, reinterpret_cast<char *>(&start), sizeof(start), 0) == sizeof(start)) {
+      log_start_offset_ = std::clamp<size_t>(start, log_start_offset_, log_end_offset_);
     }
+    close(fd);
+  }
+  if (size == log_segment_size_) {
+    // full already, the next write starts a new segment
+    close(log_fd_);
+    log_fd_ = -1;
   }
 }
 
@@ -126,13 +613,13 @@ void DiskManager::ReadPage(page_id_t page_id, char *page_data) {
  * Write the contents of the log into disk file
  * Only return when sync is done, and only perform sequence write
  */
-void DiskManager::WriteLog(char *log_data, int size) {
+auto DiskManager::WriteLog(char *log_data, int size) -> bool {
   // enforce swap log buffer
   assert(log_data != buffer_used);
   buffer_used = log_data;
 
   if (size == 0) {  // no effect on num_flushes_ if log buffer is empty
-    return;
+    return true;
   }
 
   flush_log_ = true;
@@ -143,17 +630,50 @@ void DiskManager::WriteLog(char *log_data, int size) {
   }
 
   num_flushes_ += 1;
-  // sequence write
-  log_io_.write(log_data, size);
-
-  // check for I/O error
-  if (log_io_.bad()) {
-    LOG_DEBUG("I/O error while writing log");
-    return;
+  std::scoped_lock lock(log_latch_);
+  // sequence write, segments are opened for appending
+  size_t done = 0;
+  while (done < static_cast<size_t>(size)) {
+    if (log_fd_ < 0) {
+      size_t segment = log_end_offset_ / log_segment_size_;
+      log_fd_ = open(LogSegmentName(segment).c_str(), O_RDWR | O_APPEND | O_CREAT | O_TRUNC, 0644);
+      if (log_fd_ < 0) {
+        LOG_DEBUG("can't create log segment %zu: %s", segment, strerror(errno));
+        flush_log_ = false;
+        return false;
+      }
+      // the new segment must survive a crash along with the records in it
+      SyncDirectory(log_name_);
+    }
+    size_t chunk = std::min(size - done, log_segment_size_ - log_end_offset_ % log_segment_size_);
+    if (!WriteFull(log_fd_, log_data + done, chunk)) {
+      LOG_DEBUG("I/O error while writing log");
+      flush_log_ = false;
+      return false;
+    }
+    done += chunk;
+    log_end_offset_ += chunk;
+    if (log_end_offset_ % log_segment_size_ == 0) {
+      bool synced = DataSync(log_fd_);
+      if (!synced) {
+        LOG_DEBUG("I/O error while syncing log: %s", strerror(errno));
+      }
+      close(log_fd_);
+      log_fd_ = -1;
+      if (!synced) {
+        flush_log_ = false;
+        return false;
+      }
+    }
+  }
+  // a commit is only durable once its log record is on the device
+  if (log_fd_ >= 0 && !DataSync(log_fd_)) {
+    LOG_DEBUG("I/O error while syncing log: %s", strerror(errno));
+    flush_log_ = false;
+    return false;
   }
-  // needs to flush to keep disk file in sync
-  log_io_.flush();
   flush_log_ = false;
+  return true;
 }
 
 /**
@@ -161,29 +681,126 @@ void DiskManager::WriteLog(char *log_data, int size) {
  * Always read from the beginning and perform sequence read
  * @return: false means already reach the end
  */
-auto DiskManager::ReadLog(char *log_data, int size, int offset) -> bool {
-  if (offset >= GetFileSize(log_name_)) {
-    // LOG_DEBUG("end of log file");
-    // LOG_DEBUG("file size is %d", GetFileSize(log_name_));
+auto DiskManager::ReadLog(char *log_data, int size, size_t offset) -> bool {
+  std::scoped_lock lock(log_latch_);
+  if (offset < log_start_offset_ || offset >= log_end_offset_) {
     return false;
   }
-  log_io_.seekp(offset);
-  log_io_.read(log_data, size);
-
-  if (log_io_.bad()) {
-    LOG_DEBUG("I/O error while reading log");
-    return false;
+  size_t done = 0;
+  while (done < static_cast<size_t>(size) && offset + done < log_end_offset_) {
+    size_t position = offset + done;
+    size_t segment = position / log_segment_size_;
+    size_t in_segment = position % log_segment_size_;
+    size_t chunk = std::min({size - done, log_segment_size_ - in_segment, log_end_offset_ - position});
+    int fd = open(LogSegmentName(segment).c_str(), O_RDONLY);
+    if (fd < 0) {
+      LOG_DEBUG("can't open log segment %zu: %s", segment, strerror(errno));
+      return false;
+    }
+    ssize_t read_count = PreadFull(fd, log_data + done, chunk, static_cast<off_t>(in_segment));
+    close(fd);
+    if (read_count < 0) {
+      LOG_DEBUG("I/O error while reading log");
+      return false;
+    }
+    done += read_count;
+    if (static_cast<size_t>(read_count) < chunk) {
+      break;
+    }
   }
   // if log file ends before reading "size"
-  int read_count = log_io_.gcount();
-  if (read_count < size) {
-    log_io_.clear();
-    memset(log_data + read_count, 0, size - read_count);
+  if (done < static_cast<size_t>(size)) {
+    memset(log_data + done, 0, size - done);
   }
-
   return true;
 }
 
+auto DiskManager::TruncateLog(size_t offset) -> size_t {
+  std::scoped_lock lock(log_latch_);
+  size_t start = std::min(std::max(offset, log_start_offset_), log_end_offset_);
+  if (start != log_start_offset_) {
+    // recorded before any segment goes, so that a restart never looks for the first record in a deleted one
+    WriteLogStart(start);
+    log_start_offset_ = start;
+  }
+  // the last segment stays even if it is full, so that the end of the log is found again on restart
+  size_t last_segment = log_end_offset_ == 0 ? 0 : (log_end_offset_ - 1) / log_segment_size_;
+  size_t keep_from = std::min(start / log_segment_size_, last_segment);
+  size_t num_removed = 0;
+  for (size_t segment = log_first_segment_; segment < keep_from; segment++) {
+    if (std::remove(LogSegmentName(segment).c_str()) == 0) {
+      num_removed++;
+    }
+  }
+  log_first_segment_ = std::max(log_first_segment_, keep_from);
+  if (num_removed > 0) {
+    SyncDirectory(log_name_);
+  }
+  return num_removed;
+}
+
+void DiskManager::WriteLogStart(size_t offset) {
+  // written aside and renamed over the old one, a crash leaves either of them behind but never half of one
+  std::string temp_name = LogStartName() + ".tmp";
+  int fd = open(temp_name.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    LOG_DEBUG("can't create %s: %s", temp_name.c_str(), strerror(errno));
+    return;
+  }
+  uint64_t start = offset;
+  bool written = WriteFull(fd, reinterpret_cast<const char *>(&start), sizeof(start)) && DataSync(fd);
+  close(fd);
+  if (!written || std::rename(temp_name.c_str(), LogStartName().c_str()) != 0) {
+    LOG_DEBUG("I/O error while writing the log start offset");
+    return;
+  }
+  SyncDirectory(log_name_);
+}
+
+void DiskManager::TruncateLogEnd(size_t offset) {
+  std::scoped_lock lock(log_latch_);
+  if (offset < log_start_offset_ || offset >= log_end_offset_) {
+    return;
+  }
+  size_t segment = offset / log_segment_size_;
+  size_t last_segment = (log_end_offset_ - 1) / log_segment_size_;
+  if (log_fd_ >= 0) {
+    close(log_fd_);
+    log_fd_ = -1;
+  }
+  for (size_t later = segment + 1; later <= last_segment; later++) {
+    std::remove(LogSegmentName(later).c_str());
+  }
+  int fd = open(LogSegmentName(segment).c_str(), O_RDWR | O_APPEND);
+  if (fd < 0 || ftruncate(fd, static_cast<off_t>(offset % log_segment_size_)) != 0 || !DataSync(fd)) {
+    LOG_DEBUG("can't cut log segment %zu short: %s", segment, strerror(errno));
+  }
+  log_end_offset_ = offset;
+  // appends go on in the segment cut short, a segment cut down to nothing is started afresh by the next write
+  if (fd >= 0 && offset % log_segment_size_ != 0) {
+    log_fd_ = fd;
+  } else if (fd >= 0) {
+    close(fd);
+  }
+  SyncDirectory(log_name_);
+}
+
+auto DiskManager::GetLogEndOffset() -> size_t {
+  std::scoped_lock lock(log_latch_);
+  return log_end_offset_;
+}
+
+auto DiskManager::GetLogStartOffset() -> size_t {
+  std::scoped_lock lock(log_latch_);
+  return log_start_offset_;
+}
+
+auto DiskManager::GetNumLogSegments() -> size_t {
+  std::scoped_lock lock(log_latch_);
+  size_t last_segment = log_end_offset_ == 0 ? 0 : (log_end_offset_ - 1) / log_segment_size_;
+  return last_segment - log_first_segment_ + 1;
+}
+
 /**
  * Returns number of flushes made so far
  */
@@ -202,10 +819,10 @@ auto DiskManager::GetFlushState() const -> bool { return flush_log_; }
 /**
  * Private helper function to get disk file size
  */
-auto DiskManager::GetFileSize(const std::string &file_name) -> int {
+auto DiskManager::GetFileSize(const std::string &file_name) -> int64_t {
   struct stat stat_buf;
   int rc = stat(file_name.c_str(), &stat_buf);
-  return rc == 0 ? static_cast<int>(stat_buf.st_size) : -1;
+  return rc == 0 ? static_cast<int64_t>(stat_buf.st_size) : -1;
 }
 
 }  // namespace bustub
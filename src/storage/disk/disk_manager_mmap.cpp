@@ -0,0 +1,140 @@
+//===----------------------------------------------------------------------===//
+//
+//                         BusTub
+//
+// disk_manager_mmap.cpp
+//
+// Identification: src/storage/disk/disk_manager_mmap.cpp
+//
+// Copyright (c) 2015-2022, Carnegie Mellon University Database Group
+//
+//===----------------------------------------------------------------------===//
+
+#include "storage/disk/disk_manager_mmap.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <string>
+
+#include "common/exception.h"
+#include "common/logger.h"
+
+namespace bustub {
+
+DiskManagerMmap::DiskManagerMmap(const std::string &db_file) {
+  file_name_ = db_file;
+  db_fd_ = open(db_file.c_str(), O_RDONLY);
+  if (db_fd_ < 0) {
+    throw Exception("can't open db file");
+  }
+  struct stat stat_buf;
+  if (fstat(db_fd_, &stat_buf) != 0) {
+    throw Exception("can't stat db file");
+  }
+  db_file_size_ = stat_buf.st_size;
+  next_page_id_ = (db_file_size_ + BUSTUB_PAGE_SIZE - 1) / BUSTUB_PAGE_SIZE;
+  // an empty file can't be mapped, all of its pages are past the end anyway
+  if (db_file_size_ == 0) {
+    return;
+  }
+  void *mem = mmap(nullptr, db_file_size_, PROT_READ, MAP_SHARED, db_fd_, 0);
+  if (mem == MAP_FAILED) {
+    throw Exception(ExceptionType::OUT_OF_MEMORY, "can't map db file");
+  }
+  data_ = static_cast<char *>(mem);
+  mapped_size_ = db_file_size_;
+}
+
+DiskManagerMmap::~DiskManagerMmap() {
+  if (data_ != nullptr) {
+    munmap(data_, mapped_size_);
+  }
+}
+
+auto DiskManagerMmap::ReadPage(page_id_t page_id, char *page_data) -> int {
+  size_t offset = static_cast<size_t>(page_id) * BUSTUB_PAGE_SIZE;
+  if (offset >= mapped_size_) {
+    // appended after the file was mapped, or not there at all. The primary may have grown the file since we last
+    // looked, and pages past the size we know of would not be read
+    struct stat stat_buf;
+    if (fstat(db_fd_, &stat_buf) == 0) {
+      GrowDbFileSize(stat_buf.st_size);
+    }
+    return DiskManager::ReadPage(page_id, page_data);
+  }
+  RecordAccess(page_id);
+  size_t size = std::min<size_t>(BUSTUB_PAGE_SIZE, mapped_size_ - offset);
+  memcpy(page_data, data_ + offset, size);
+  memset(page_data + size, 0, BUSTUB_PAGE_SIZE - size);
+  return 0;
+}
+
+auto DiskManagerMmap::WritePage(page_id_t page_id, const char *page_data) -> int {
+  throw Exception("can't write page " + std::to_string(page_id) + ", the db file is read-only");
+}
+
+void DiskManagerMmap::WritePages(std::vector<std::pair<page_id_t, const char *>> pages) {
+  throw Exception("can't write pages, the db file is read-only");
+}
+
+void DiskManagerMmap::SubmitAsync(std::vector<DiskRequest> requests) {
+  // checked up front, so that either all of the requests are served or none
+  if (std::any_of(requests.begin(), requests.end(), [](const auto &request) { return request.is_write_; })) {
+    throw Exception("can't write pages, the db file is read-only");
+  }
+  for (auto &request : requests) {
+    request.callback_(ReadPage(request.page_id_, request.data_));
+  }
+}
+
+auto DiskManagerMmap::MappedPage(page_id_t page_id) -> const char * {
+  size_t offset = static_cast<size_t>(page_id) * BUSTUB_PAGE_SIZE;
+  // a page cut short by the end of the file would expose bytes past it, copy it instead
+  if (page_id < 0 || offset + BUSTUB_PAGE_SIZE > mapped_size_) {
+    return nullptr;
+  }
+  RecordAccess(page_id);
+  return data_ + offset;
+}
+
+void DiskManagerMmap::Advise(MmapAccessPattern pattern) {
+  pattern_.store(pattern, std::memory_order_relaxed);
+  if (data_ == nullptr) {
+    return;
+  }
+  int advice = pattern == MmapAccessPattern::SEQUENTIAL ? MADV_SEQUENTIAL
+               : pattern == MmapAccessPattern::RANDOM   ? MADV_RANDOM
+                                                        : MADV_NORMAL;
+  if (madvise(data_, mapped_size_, advice) != 0) {
+    LOG_DEBUG("madvise failed: %s", strerror(errno));
+  }
+}
+
+void DiskManagerMmap::RecordAccess(page_id_t page_id) {
+  page_id_t last = last_page_id_.exchange(page_id, std::memory_order_relaxed);
+  // re-reading the same page says nothing about the pattern
+  if (page_id == last) {
+    return;
+  }
+  int streak = streak_.load(std::memory_order_relaxed);
+  if (page_id == last + 1) {
+    streak = std::max(streak, 0) + 1;
+  } else {
+    streak = std::min(streak, 0) - 1;
+  }
+  streak = std::clamp(streak, -ADVISE_STREAK, ADVISE_STREAK);
+  streak_.store(streak, std::memory_order_relaxed);
+  MmapAccessPattern pattern = GetAccessPattern();
+  if (streak == ADVISE_STREAK && pattern != MmapAccessPattern::SEQUENTIAL) {
+    Advise(MmapAccessPattern::SEQUENTIAL);
+  } else if (streak == -ADVISE_STREAK && pattern != MmapAccessPattern::RANDOM) {
+    Advise(MmapAccessPattern::RANDOM);
+  }
+}
+
+}  // namespace bustub
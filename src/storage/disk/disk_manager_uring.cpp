@@ -0,0 +1,339 @@
+//===----------------------------------------------------------------------===//
+//
+//                         BusTub
+//
+// disk_manager_uring.cpp
+//
+// Identification: src/storage/disk/disk_manager_uring.cpp
+//
+// Copyright (c) 2015-2022, Carnegie Mellon University Database Group
+//
+//===----------------------------------------------------------------------===//
+
+#include "storage/disk/disk_manager_uring.h"
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+#include "common/logger.h"
+
+namespace bustub {
+
+struct DiskManagerUring::InFlightRequest {
+  DiskRequest request_;
+  iovec iov_;
+  /** Aligned copy of the page for direct I/O on an unaligned buffer, nullptr if the buffer is used as it is. */
+  char *bounce_{nullptr};
+  /** Bytes of the page written so far, a short write is resubmitted for the rest. */
+  size_t done_{0};
+};
+
+static auto IoUringSetup(unsigned entries, io_uring_params *params) -> int {
+  return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+static auto IoUringEnter(int ring_fd, unsigned to_submit, unsigned min_complete, unsigned flags) -> int {
+  return static_cast<int>(syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete, flags, nullptr, 0));
+}
+
+DiskManagerUring::DiskManagerUring(const std::string &db_file, const DiskManagerOptions &options,
+                                   size_t queue_depth, bool use_uring)
+    : DiskManager(db_file, options) {
+  if (!use_uring) {
+    return;
+  }
+  if (!SetUpRing(std::max<size_t>(queue_depth, 1))) {
+    LOG_DEBUG("io_uring is not available, falling back to I/O threads");
+    TearDownRing();
+    return;
+  }
+  completion_thread_ = std::thread(&DiskManagerUring::CompletionLoop, this);
+}
+
+DiskManagerUring::~DiskManagerUring() {
+  if (ring_fd_ < 0) {
+    return;
+  }
+  std::vector<std::pair<InFlightRequest *, int>> refused;
+  {
+    std::unique_lock lock(sq_latch_);
+    in_flight_cv_.wait(lock, [&] { return num_in_flight_ == 0; });
+    // a no-op without a request tells the completion thread to stop
+    PushSqe(IORING_OP_NOP, nullptr);
+    EnterRing(1, &refused);
+  }
+  if (!refused.empty()) {
+    // nothing can wake the completion thread up anymore, leave it and the ring it waits on be
+    LOG_WARN("can't stop the io_uring completion thread");
+    completion_thread_.detach();
+    return;
+  }
+  completion_thread_.join();
+  TearDownRing();
+}
+
+auto DiskManagerUring::SetUpRing(size_t queue_depth) -> bool {
+  io_uring_params params;
+  std::memset(&params, 0, sizeof(params));
+  ring_fd_ = IoUringSetup(static_cast<unsigned>(queue_depth), &params);
+  if (ring_fd_ < 0) {
+    return false;
+  }
+  // the kernel rounds the number of entries up to a power of two
+  queue_depth_ = std::min<size_t>(queue_depth, params.sq_entries);
+
+  sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+  bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+  if (single_mmap) {
+    sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+  }
+  sq_ring_ = mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_,
+                  IORING_OFF_SQ_RING);
+  if (sq_ring_ == MAP_FAILED) {
+    sq_ring_ = nullptr;
+    return false;
+  }
+  if (single_mmap) {
+    cq_ring_ = sq_ring_;
+  } else {
+    cq_ring_ = mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_,
+                    IORING_OFF_CQ_RING);
+    if (cq_ring_ == MAP_FAILED) {
+      cq_ring_ = nullptr;
+      return false;
+    }
+  }
+  sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+  void *sqes = mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQES);
+  if (sqes == MAP_FAILED) {
+    return false;
+  }
+  sqes_ = static_cast<io_uring_sqe *>(sqes);
+
+  auto *sq = static_cast<char *>(sq_ring_);
+  sq_tail_ = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+  sq_mask_ = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+  sq_array_ = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+  auto *cq = static_cast<char *>(cq_ring_);
+  cq_head_ = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+  cq_tail_ = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+  cq_mask_ = *reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+  cqes_ = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+  return true;
+}
+
+void DiskManagerUring::TearDownRing() {
+  if (sqes_ != nullptr) {
+    munmap(sqes_, sqes_size_);
+    sqes_ = nullptr;
+  }
+  if (cq_ring_ != nullptr && cq_ring_ != sq_ring_) {
+    munmap(cq_ring_, cq_ring_size_);
+  }
+  cq_ring_ = nullptr;
+  if (sq_ring_ != nullptr) {
+    munmap(sq_ring_, sq_ring_size_);
+    sq_ring_ = nullptr;
+  }
+  if (ring_fd_ >= 0) {
+    close(ring_fd_);
+    ring_fd_ = -1;
+  }
+}
+
+void DiskManagerUring::SubmitAsync(std::vector<DiskRequest> requests) {
+  if (ring_fd_ < 0) {
+    DiskManager::SubmitAsync(std::move(requests));
+    return;
+  }
+
+  // like ReadPage(), a read past the end of the file leaves the buffer alone. Their callbacks run once the latch is
+  // released, so that they may submit more requests.
+  std::vector<IoCallback> past_end;
+  std::vector<std::pair<InFlightRequest *, int>> refused;
+  std::unique_lock lock(sq_latch_);
+  unsigned to_submit = 0;
+  for (auto &request : requests) {
+    size_t offset = static_cast<size_t>(request.page_id_) * BUSTUB_PAGE_SIZE;
+    if (!request.is_write_ && offset > db_file_size_.load(std::memory_order_acquire)) {
+      LOG_DEBUG("I/O error reading past end of file");
+      past_end.push_back(std::move(request.callback_));
+      continue;
+    }
+    if (num_in_flight_ == queue_depth_) {
+      // hand over what we have so far, their completions make room for the rest
+      EnterRing(to_submit, &refused);
+      to_submit = 0;
+      in_flight_cv_.wait(lock, [&] { return num_in_flight_ < queue_depth_; });
+    }
+    auto *in_flight = new InFlightRequest{std::move(request), {}};
+    in_flight->iov_.iov_base = in_flight->request_.data_;
+    if (NeedsBounceBuffer(in_flight->request_.data_)) {
+      in_flight->bounce_ = static_cast<char *>(std::aligned_alloc(BUSTUB_PAGE_SIZE, BUSTUB_PAGE_SIZE));
+      if (in_flight->request_.is_write_) {
+        memcpy(in_flight->bounce_, in_flight->request_.data_, BUSTUB_PAGE_SIZE);
+      }
+      in_flight->iov_.iov_base = in_flight->bounce_;
+    }
+    in_flight->iov_.iov_len = BUSTUB_PAGE_SIZE;
+    if (in_flight->request_.is_write_) {
+      num_writes_ += 1;
+    }
+    PushSqe(in_flight->request_.is_write_ ? IORING_OP_WRITEV : IORING_OP_READV, in_flight);
+    ++num_in_flight_;
+    ++to_submit;
+  }
+  EnterRing(to_submit, &refused);
+  lock.unlock();
+  if (!refused.empty()) {
+    in_flight_cv_.notify_all();
+  }
+  for (auto &callback : past_end) {
+    callback(0);
+  }
+  for (auto [request, error] : refused) {
+    Refuse(request, error);
+  }
+}
+
+void DiskManagerUring::PushSqe(uint8_t opcode, InFlightRequest *request) {
+  // only submitters write the tail, and they hold sq_latch_
+  unsigned tail = *sq_tail_;
+  unsigned index = tail & sq_mask_;
+  io_uring_sqe *sqe = &sqes_[index];
+  std::memset(sqe, 0, sizeof(*sqe));
+  sqe->opcode = opcode;
+  sqe->fd = -1;
+  if (request != nullptr) {
+    sqe->fd = db_fd_;
+    sqe->addr = reinterpret_cast<uint64_t>(&request->iov_);
+    sqe->len = 1;
+    sqe->off = static_cast<uint64_t>(request->request_.page_id_) * BUSTUB_PAGE_SIZE + request->done_;
+  }
+  sqe->user_data = reinterpret_cast<uint64_t>(request);
+  sq_array_[index] = index;
+  // the kernel must see the entry before the new tail
+  __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+}
+
+void DiskManagerUring::EnterRing(unsigned to_submit, std::vector<std::pair<InFlightRequest *, int>> *refused) {
+  while (to_submit > 0) {
+    int submitted = IoUringEnter(ring_fd_, to_submit, 0, 0);
+    if (submitted < 0) {
+      if (errno == EINTR || errno == EAGAIN || errno == EBUSY) {
+        continue;
+      }
+      int error = errno;
+      LOG_DEBUG("io_uring_enter failed: %s", strerror(error));
+      // the kernel consumes entries in order and only while we enter the ring, so the refused ones are the last
+      unsigned tail = *sq_tail_ - to_submit;
+      for (unsigned i = 0; i < to_submit; i++) {
+        auto *request = reinterpret_cast<InFlightRequest *>(sqes_[(tail + i) & sq_mask_].user_data);
+        if (request != nullptr) {
+          --num_in_flight_;
+        }
+        refused->emplace_back(request, error);
+      }
+      __atomic_store_n(sq_tail_, tail, __ATOMIC_RELEASE);
+      return;
+    }
+    to_submit -= submitted;
+  }
+}
+
+void DiskManagerUring::CompletionLoop() {
+  while (true) {
+    unsigned head = *cq_head_;
+    if (head == __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE)) {
+      if (IoUringEnter(ring_fd_, 0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR) {
+        LOG_DEBUG("io_uring_enter failed: %s", strerror(errno));
+      }
+      continue;
+    }
+    io_uring_cqe cqe = cqes_[head & cq_mask_];
+    // the slot may be reused by the kernel from now on
+    __atomic_store_n(cq_head_, head + 1, __ATOMIC_RELEASE);
+    auto *request = reinterpret_cast<InFlightRequest *>(cqe.user_data);
+    if (request == nullptr) {
+      return;
+    }
+    Complete(request, cqe.res);
+  }
+}
+
+void DiskManagerUring::Resubmit(InFlightRequest *request, int res) {
+  if (res > 0) {
+    request->done_ += res;
+    request->iov_.iov_base = static_cast<char *>(request->iov_.iov_base) + res;
+    request->iov_.iov_len -= res;
+  }
+  std::vector<std::pair<InFlightRequest *, int>> refused;
+  {
+    // the request still counts as in flight, so the entry it had is free for it
+    std::scoped_lock lock(sq_latch_);
+    PushSqe(request->request_.is_write_ ? IORING_OP_WRITEV : IORING_OP_READV, request);
+    EnterRing(1, &refused);
+  }
+  if (!refused.empty()) {
+    in_flight_cv_.notify_all();
+    Refuse(request, refused[0].second);
+  }
+}
+
+void DiskManagerUring::Complete(InFlightRequest *request, int res) {
+  DiskRequest &disk_request = request->request_;
+  if (res == -EINTR || res == -EAGAIN ||
+      (disk_request.is_write_ && res > 0 && request->done_ + res < BUSTUB_PAGE_SIZE)) {
+    Resubmit(request, res);
+    return;
+  }
+  int error = 0;
+  if (res < 0) {
+    error = -res;
+    LOG_DEBUG("I/O error while %s: %s", disk_request.is_write_ ? "writing" : "reading", strerror(error));
+  } else if (disk_request.is_write_) {
+    if (request->done_ + res < BUSTUB_PAGE_SIZE) {
+      // the write made no progress, trying again would not either
+      error = EIO;
+      LOG_DEBUG("I/O error while writing: wrote %zu bytes of a page", request->done_);
+    } else {
+      GrowDbFileSize((static_cast<size_t>(disk_request.page_id_) + 1) * BUSTUB_PAGE_SIZE);
+    }
+  } else {
+    if (request->bounce_ != nullptr) {
+      memcpy(disk_request.data_, request->bounce_, res);
+    }
+    if (res < BUSTUB_PAGE_SIZE) {
+      // if file ends before reading BUSTUB_PAGE_SIZE
+      memset(disk_request.data_ + res, 0, BUSTUB_PAGE_SIZE - res);
+    }
+  }
+  std::free(request->bounce_);  // NOLINT
+  // make room before running the callback, so that it may submit more requests
+  {
+    std::scoped_lock lock(sq_latch_);
+    --num_in_flight_;
+  }
+  in_flight_cv_.notify_all();
+  disk_request.callback_(error);
+  delete request;
+}
+
+void DiskManagerUring::Refuse(InFlightRequest *request, int error) {
+  LOG_DEBUG("I/O error while %s: %s", request->request_.is_write_ ? "writing" : "reading", strerror(error));
+  std::free(request->bounce_);  // NOLINT
+  request->request_.callback_(error);
+  delete request;
+}
+
+}  // namespace bustub
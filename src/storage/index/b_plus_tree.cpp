@@ -1,4 +1,8 @@
+#include <cstring>
+#include <optional>
 #include <string>
+#include <type_traits>
+#include <utility>
 
 #include "common/exception.h"
 #include "common/logger.h"
@@ -9,21 +13,20 @@
 namespace bustub {
 INDEX_TEMPLATE_ARGUMENTS
 BPLUSTREE_TYPE::BPlusTree(std::string name, BufferPoolManager *buffer_pool_manager, const KeyComparator &comparator,
-                          int leaf_max_size, int internal_max_size)
+                          int leaf_max_size, int internal_max_size, LogManager *log_manager)
     : index_name_(std::move(name)),
       root_page_id_(INVALID_PAGE_ID),
       buffer_pool_manager_(buffer_pool_manager),
       comparator_(comparator),
       leaf_max_size_(leaf_max_size),
-      internal_max_size_(internal_max_size) {}
+      internal_max_size_(internal_max_size),
+      log_manager_(log_manager) {}
 
 /*
  * Helper function to decide whether current b+tree is empty
  */
 INDEX_TEMPLATE_ARGUMENTS
-auto BPLUSTREE_TYPE::IsEmpty() const -> bool { 
-  return root_page_id_ == INVALID_PAGE_ID;
- }
+auto BPLUSTREE_TYPE::IsEmpty() const -> bool { return root_page_id_ == INVALID_PAGE_ID; }
 /*****************************************************************************
  * SEARCH
  *****************************************************************************/
@@ -32,166 +35,227 @@ auto BPLUSTREE_TYPE::IsEmpty() const -> bool {
  * This method is used for point query
  * @return : true means key exists
  */
-
 INDEX_TEMPLATE_ARGUMENTS
-auto BPLUSTREE_TYPE::GetLeafPage(const KeyType& key, Transaction* trx, Operation op, bool is_first_pass = true) -> Page* {
-
-  if (trx == nullptr && op != Operation::Read) {
-    throw std::logic_error("tring to remove or insert on a null tree");
+auto BPLUSTREE_TYPE::GetValue(const KeyType &key, std::vector<ValueType> *result, Transaction *transaction) -> bool {
+  ReadPageGuard guard = FindLeafRead(key, false);
+  if (guard.PageId() == INVALID_PAGE_ID) {
+    return false;
   }
-  if (!is_first_pass) {
-    root_latch_.WLock();
-    trx->AddIntoPageSet(nullptr);
+  ValueType value;
+  if (!guard.As<LeafPage>()->Lookup(key, &value, comparator_)) {
+    return false;
   }
+  result->push_back(value);
+  return true;
+}
 
-  page_id_t next_page_id = root_page_id_;
-  Page* prev_page = nullptr;
-  while (true) {
-    // 读: 每次操作释放父节点的读锁
-    // 写: 当前页安全才释放父节点的写锁
-    Page* page = buffer_pool_manager_->FetchPage(next_page_id);
-    auto tree_node_page = reinterpret_cast<BPlusTree*>(page->GetData());
-    if (is_first_pass) {
-
-      if (tree_node_page->IsLeafPage() && op != Operation::Read) {
-        page->WLatch();
-        trx->AddIntoPageSet(page);
-      } else {
-        page->RLatch();
-      }
-      if (prev_page == nullptr) {
-        root_latch_.RUnlock(); 
-      } else {
-        prev_page->RUnlatch();
-        buffer_pool_manager_->UnpinPage(prev_page->GetPageId(), false);
+/*****************************************************************************
+ * CONCURRENCY CONTROL
+ *****************************************************************************/
+/*
+ * A page is safe if the operation can't propagate any change to its parent: an insert doesn't split it and a remove
+ * doesn't make it underflow. The root underflows when it is left with a single child, or without any entry at all.
+ */
+INDEX_TEMPLATE_ARGUMENTS
+auto BPLUSTREE_TYPE::IsPageSafe(const BPlusTreePage *tree_page, Operation op, bool is_root) const -> bool {
+  switch (op) {
+    case Operation::Read:
+      return true;
+    case Operation::Insert:
+      // a leaf splits as soon as it is full, an internal page when a child is added while it is full
+      if (tree_page->IsLeafPage()) {
+        return tree_page->GetSize() + 1 < tree_page->GetMaxSize();
       }
-
-    } else { // second pass
-
-      assert(op != Operation::Read);
-      page->WLatch();
-      if (IsPageSafe(tree_node_page, op)) {
-        ReleaseWLatches(trx);
+      return tree_page->GetSize() < tree_page->GetMaxSize();
+    case Operation::Remove:
+      if (is_root) {
+        return tree_page->GetSize() > (tree_page->IsLeafPage() ? 1 : 2);
       }
-      trx->AddIntoPageSet(page);
-    }
+      return tree_page->GetSize() > tree_page->GetMinSize();
+  }
+  return false;
+}
 
-    if (tree_node_page->IsLeafPage()) {
-      if (is_first_pass && !IsPageSafe(tree_node_page, op)) {
-        ReleaseWLatches(trx);
-        return GetLeafPage(key, trx, op, false);
+/*
+ * Descend to the leaf covering the key, or to the leftmost leaf, without pinning or latching internal pages, and latch
+ * the leaf with the latch of the guard type. Each internal page is copied and validated before any of its keys is
+ * compared, since the frame may be overwritten at any moment. A child is only the one the key leads to while its
+ * parent is unchanged: splitting, merging or deleting the child changes the parent, so the parent is validated again
+ * after the child has been read, and after the leaf has been latched. The root latch is held until the root page is
+ * known to be internal, or until a leaf root is latched.
+ * @return : false if a page was not resident or was written concurrently, the leaf guard is empty then. True
+ * otherwise, with an empty leaf guard if the tree is empty.
+ */
+INDEX_TEMPLATE_ARGUMENTS
+template <class GuardType>
+auto BPLUSTREE_TYPE::TryFindLeafByVersion(const KeyType &key, bool leftmost, GuardType *leaf, bool *is_root) -> bool {
+  root_latch_.RLock();
+  if (root_page_id_ == INVALID_PAGE_ID) {
+    root_latch_.RUnlock();
+    *leaf = {};
+    return true;
+  }
+  page_id_t page_id = root_page_id_;
+  bool root_latched = true;
+  const Page *parent = nullptr;
+  uint64_t parent_version = 0;
+  alignas(BUSTUB_CACHELINE_SIZE) char node[BUSTUB_PAGE_SIZE];
+  while (true) {
+    uint64_t version;
+    const Page *page = buffer_pool_manager_->OptimisticRead(page_id, &version);
+    bool is_leaf = page != nullptr && reinterpret_cast<const BPlusTreePage *>(page->GetData())->IsLeafPage();
+    bool valid = page != nullptr && page->ValidateVersion(version) &&
+                 (parent == nullptr || parent->ValidateVersion(parent_version));
+    if (valid && is_leaf) {
+      if constexpr (std::is_same_v<GuardType, ReadPageGuard>) {
+        *leaf = buffer_pool_manager_->FetchPageRead(page_id);
       } else {
-        return page;
+        *leaf = buffer_pool_manager_->FetchPageWrite(page_id);
       }
+      valid = parent == nullptr || parent->ValidateVersion(parent_version);
+    }
+    *is_root = root_latched;
+    if (root_latched) {
+      root_latch_.RUnlock();
+      root_latched = false;
+    }
+    if (!valid) {
+      leaf->Drop();
+      return false;
     }
-    auto internal_page = static_cast<InternalPage*>(tree_node_page);
-    next_page_id = internal_page->ValueAt(internal_page->GetSize() - 1);
-    
-    for (int i = 1; i < internal_page->GetSize(); ++i) {
-      if (comparator_(internal_page->KeyAt(i), key) > 0) {
-        next_page_id = internal_page->ValueAt(i - 1);
-        break;
+    if (is_leaf) {
+      if (leaf->PageId() == INVALID_PAGE_ID) {
+        throw Exception(ExceptionType::OUT_OF_MEMORY, "B+ tree: buffer pool is full");
       }
+      return true;
     }
-    prev_page = page;
-    // if (tree_node_page->IsLeafPage()) {
-    //   return page;
-    // }
-    // auto internal_page = static_cast<InternalPage*>(tree_node_page);
-    // next_page_id = internal_page->ValueAt(internal_page->GetSize() - 1);
-    // for (int i = 1; i < internal_page->GetSize(); ++i) {
-    //   if (comparator_(internal_page->KeyAt(i), key) > 0) {
-    //     next_page_id = internal_page->VauleAt(i - 1);
-    //     break;
-    //   }
-    // }
-    // buffer_pool_manager_->UnpinPage(internal_page->GetPageId(), false);
+    memcpy(node, page->GetData(), BUSTUB_PAGE_SIZE);
+    if (!page->ValidateVersion(version)) {
+      return false;
+    }
+    const auto *internal = reinterpret_cast<const InternalPage *>(node);
+    page_id = leftmost ? internal->ValueAt(0) : internal->Lookup(key, comparator_);
+    parent = page;
+    parent_version = version;
   }
 }
 
+/*
+ * Find the leaf covering the key, or the leftmost leaf, and read-latch it. Unless descending without latches keeps
+ * failing, crab down holding read latches, releasing the latch of a parent as soon as its child is latched.
+ * @return : the read-latched leaf, an empty guard if the tree is empty
+ */
 INDEX_TEMPLATE_ARGUMENTS
-auto BPLUSTREE_TYPE::GetValue(const KeyType &key, std::vector<ValueType> *result, Transaction *transaction) -> bool {
-  // read latch
+auto BPLUSTREE_TYPE::FindLeafRead(const KeyType &key, bool leftmost) -> ReadPageGuard {
+  ReadPageGuard leaf;
+  bool is_root;
+  for (int attempt = 0; attempt < OPTIMISTIC_DESCENT_ATTEMPTS; attempt++) {
+    if (TryFindLeafByVersion(key, leftmost, &leaf, &is_root)) {
+      return leaf;
+    }
+  }
   root_latch_.RLock();
-  if (IsEmpty()) {
+  if (root_page_id_ == INVALID_PAGE_ID) {
     root_latch_.RUnlock();
-    return false;
+    return {};
   }
-  Page* target_page = GetLeafPage(key);
-  auto target_leaf_page = reinterpret_cast<LeafPage*>(page);
-  bool exist = false;
-  for (int i = 0; i < target_leaf_page->GetSize(); ++i) {
-    if (comparator_(key, target_leaf_page->KeyAt(i)) == 0) {
-      result->emplace_back(target_leaf_page->ValueAt(i));
-      exist = true;
+  ReadPageGuard guard = buffer_pool_manager_->FetchPageRead(root_page_id_);
+  root_latch_.RUnlock();
+  while (true) {
+    if (guard.PageId() == INVALID_PAGE_ID) {
+      throw Exception(ExceptionType::OUT_OF_MEMORY, "B+ tree: buffer pool is full");
+    }
+    if (guard.As<BPlusTreePage>()->IsLeafPage()) {
+      return guard;
     }
+    const auto *internal = guard.As<InternalPage>();
+    page_id_t child_page_id = leftmost ? internal->ValueAt(0) : internal->Lookup(key, comparator_);
+    // the child is latched before the assignment releases its parent
+    guard = buffer_pool_manager_->FetchPageRead(child_page_id);
   }
-  target_page->RUnlatch();
-  buffer_pool_manager_->UnpinPage(target_page->GetPageId(), false);
-
-  return exist;
 }
 
+/*
+ * First pass of insert and remove: descend like a reader does, and write-latch the leaf only. When crabbing down, the
+ * read latch on the parent of the leaf (the root latch if the leaf is the root) is held until the leaf is
+ * write-latched, so the leaf can't be split, merged or deleted in between.
+ * @return : the write-latched leaf, an empty guard if the tree is empty
+ */
 INDEX_TEMPLATE_ARGUMENTS
-auto BPLUSTREE_TYPE::IsPageSafe(BPlusTreePage* tree_page, Operation op) -> bool {
-  if (op == Operation::Read) {
-    return true;
-  }
-  if (op == Operation::Insert) {
-    if (tree_page->IsLeafPage()) {
-      return tree_page->GetSize() < tree_page->GetMaxSize() - 1;
-    } else {
-      return tree_page->GetSize() < tree_page->GetMaxSize();
+auto BPLUSTREE_TYPE::FindLeafOptimistic(const KeyType &key, bool *is_root) -> WritePageGuard {
+  WritePageGuard leaf;
+  for (int attempt = 0; attempt < OPTIMISTIC_DESCENT_ATTEMPTS; attempt++) {
+    if (TryFindLeafByVersion(key, false, &leaf, is_root)) {
+      return leaf;
     }
   }
-
-  if (op == Operation::Remove) {
-    if (tree_page->IsRootPage()) {
-      if (tree_page->IsLeafPage()) {
-        return tree_page->GetSize() > 1;
-      } else {
-        return tree_page->GetSize() > 2;
+  root_latch_.RLock();
+  if (root_page_id_ == INVALID_PAGE_ID) {
+    root_latch_.RUnlock();
+    return {};
+  }
+  page_id_t page_id = root_page_id_;
+  bool root_latched = true;
+  ReadPageGuard parent_guard;
+  while (true) {
+    ReadPageGuard guard = buffer_pool_manager_->FetchPageRead(page_id);
+    if (guard.PageId() == INVALID_PAGE_ID) {
+      if (root_latched) {
+        root_latch_.RUnlock();
       }
-    } else {
-      return tree_page->GetSize() > tree_page->GetMinSize();
+      throw Exception(ExceptionType::OUT_OF_MEMORY, "B+ tree: buffer pool is full");
     }
-  }
-}
-
-INDEX_TEMPLATE_ARGUMENTS
-void BPLUSTREE_TYPE::ReleaseWLatches(Transaction* trx) {
-  if (trx == nullptr) {
-    return;
-  }
-  auto pages = trx->GetPageSet();
-  while (!pages->empty()) {
-    Page* page = pages->front();
-    pages->pop_front();
-    if (page == nullptr) {
-      root_latch_.WUnlock(); 
-      // lock(), unlock() 独占锁
-      // lock_shared(), unlock_shared() 共享锁
-      // unlock() 可以解锁 lock_shared()上的锁
-      // 但 unlock_shared()不能解锁lock()上的锁
-    } else {
-      page->WUnlatch();
-      buffer_pool_manager_->UnpinPage(page->GetPageId(), true);
+    if (guard.As<BPlusTreePage>()->IsLeafPage()) {
+      guard.Drop();
+      WritePageGuard leaf_guard = buffer_pool_manager_->FetchPageWrite(page_id);
+      *is_root = root_latched;
+      if (root_latched) {
+        root_latch_.RUnlock();
+      }
+      if (leaf_guard.PageId() == INVALID_PAGE_ID) {
+        throw Exception(ExceptionType::OUT_OF_MEMORY, "B+ tree: buffer pool is full");
+      }
+      return leaf_guard;
+    }
+    page_id = guard.As<InternalPage>()->Lookup(key, comparator_);
+    parent_guard = std::move(guard);
+    if (root_latched) {
+      root_latch_.RUnlock();
+      root_latched = false;
     }
   }
 }
 
+/*
+ * Second pass of insert and remove, taken when the leaf turned out to be unsafe: crab down holding write latches.
+ * Whenever a page is safe for the operation, the latches on its ancestors and the root latch are released, since
+ * nothing above it can change anymore. The caller must hold the root latch in the context, and the tree must not be
+ * empty. On return, the leaf is at the back of the context's write set.
+ */
 INDEX_TEMPLATE_ARGUMENTS
-auto BPLUSTREE_TYPE::GetPageFromTrx(page_id_t page_id, Transaction* trx) -> Page* {
-  assert(trx != nullptr);
-  auto pages = trx->GetPageSet();
-  for (auto it = pages->rbegin(); it != pages->rend(); ++it) {
-    Page* page = *it;
-    if (page != nullptr && page->GetPageId() == page_id) {
-      return page;
+void BPLUSTREE_TYPE::FindLeafPessimistic(const KeyType &key, Operation op, Context *ctx) {
+  page_id_t page_id = root_page_id_;
+  bool is_root = true;
+  while (true) {
+    WritePageGuard guard = buffer_pool_manager_->FetchPageWrite(page_id);
+    if (guard.PageId() == INVALID_PAGE_ID) {
+      throw Exception(ExceptionType::OUT_OF_MEMORY, "B+ tree: buffer pool is full");
+    }
+    const auto *tree_page = guard.As<BPlusTreePage>();
+    if (IsPageSafe(tree_page, op, is_root)) {
+      ctx->write_set_.clear();
+      ctx->ReleaseRootLatch();
     }
+    bool is_leaf = tree_page->IsLeafPage();
+    if (!is_leaf) {
+      page_id = guard.As<InternalPage>()->Lookup(key, comparator_);
+    }
+    ctx->write_set_.push_back(std::move(guard));
+    if (is_leaf) {
+      return;
+    }
+    is_root = false;
   }
-  throw std::logic_error("error getting page from transaction");
-  return nullptr;
 }
 
 /*****************************************************************************
@@ -206,122 +270,155 @@ auto BPLUSTREE_TYPE::GetPageFromTrx(page_id_t page_id, Transaction* trx) -> Page
  */
 INDEX_TEMPLATE_ARGUMENTS
 auto BPLUSTREE_TYPE::Insert(const KeyType &key, const ValueType &value, Transaction *transaction) -> bool {
-  root_latch_.RLock();
-  LeafPage* leaf_page = nullptr;
-  // 1. tree is empty, insert a node treated as leaf node
-  if (IsEmpty()) { 
-    root_latch_.RUnlock();
-    root_latch_.WLock();
-    if (IsEmpty()) {
-      Page* page = buffer_pool_manager_->NewPage(&root_page_id_);
-      UpdateRootPageId(1);
-      leaf_page = reinterpret_cast<LeafPage*>(page->GetData());
-      leaf_page->Init(root_page_id_, INVALID_PAGE_ID, leaf_max_size_);
-      leaf_page->SetKV(0, key, value);
-      leaf_page->IncreaseSize(1);
-      leaf_page->SetNextPageId(INVALID_PAGE_ID);
-      buffer_pool_manager_->UnpinPage(root_page_id_, false); // false means not dirty
-      root_latch_.WUnlock();
-      return true;
-    }
-    root_latch_.WUnlock();
-    root_latch_.RLock();
-  }
-  
-  Page* page = GetLeafPage(key, transaction, Operation::Insert);
-  leaf_page = reinterpret_cast<LeafPage*>(page->GetData());
-  
-  // 2. a node with the intended key to insert already exists,
-  //    return false
-  for (int i = 0; i < leaf_page->GetSize(); ++i) {
-    if (comparator_(leaf_page->KeyAt(i), key) == 0) { 
-      ReleaseWLatches(transaction);
-      buffer_pool_manager_->UnpinPage(leaf_page->GetPageId(), false);
-      return false;
+  return InsertEntry(key, value, transaction, std::nullopt);
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+auto BPLUSTREE_TYPE::InsertEntry(const KeyType &key, const ValueType &value, Transaction *transaction,
+                                 std::optional<lsn_t> undo_next_lsn) -> bool {
+  ValueType existing;
+  // 1. most inserts don't split the leaf, and only need a write latch on the leaf itself
+  {
+    bool is_root = false;
+    WritePageGuard leaf_guard = FindLeafOptimistic(key, &is_root);
+    if (leaf_guard.PageId() != INVALID_PAGE_ID) {
+      const auto *leaf = leaf_guard.As<LeafPage>();
+      if (leaf->Lookup(key, &existing, comparator_)) {
+        return false;
+      }
+      if (IsPageSafe(leaf, Operation::Insert, is_root)) {
+        InsertIntoLeaf(leaf_guard.AsMut<LeafPage>(), key, value, transaction, undo_next_lsn);
+        return true;
+      }
     }
   }
-  
-  leaf_page->Insert(key, value, comparator_);
-  if (leaf_page->GetSize < leaf_max_size_) {
-    ReleaseWLatches(transaction); // 可以去掉, 能到这步说明该是安全的, 祖先节点也不持有其他锁
-    buffer_pool_manager_->UnpinPage(leaf_page->GetPageId(), true);
+
+  // 2. the tree is empty or the leaf splits, latch everything that may change
+  Context ctx;
+  ctx.LockRoot(&root_latch_);
+  if (IsEmpty()) {
+    StartNewTree(&ctx, key, value, transaction, undo_next_lsn);
+    return true;
+  }
+  FindLeafPessimistic(key, Operation::Insert, &ctx);
+  auto &leaf_guard = ctx.write_set_.back();
+  if (leaf_guard.As<LeafPage>()->Lookup(key, &existing, comparator_)) {
+    return false;
+  }
+  auto *leaf = leaf_guard.AsMut<LeafPage>();
+  if (InsertIntoLeaf(leaf, key, value, transaction, undo_next_lsn) < leaf->GetMaxSize()) {
     return true;
   }
 
-  // 3. leaf node reaches max capacity, split it
-  // 分裂时新建的页还未加到树中, 不会被其他事务访问, 无需加锁, 只需用完unpin
-  page_id_t new_leaf_id;
-  Page* new_page = buffer_pool_manager_->NewPage(&new_leaf_id);
-  auto new_leaf_page = reinterpret_cast<LeafPage*>(new_page->GetData());
-  new_leaf_page->Init(new_leaf_id, leaf_page->GetParentPageId(), leaf_max_size_);
-  new_leaf_page->SetNextPageId(leaf_page->GetNextPageId());
-  leaf_page->SetNextPageId(new_leaf_id);
-  leaf_page->MoveSplitedData(new_leaf_page); // move half of leaf_page's data to new_leaf_page
+  // 3. the leaf is full, move its upper half to a new leaf on its right
+  page_id_t new_page_id;
+  WritePageGuard new_guard =
+      buffer_pool_manager_->NewPageGuarded(&new_page_id, nullptr, leaf_guard.PageId()).UpgradeWrite();
+  if (new_guard.PageId() == INVALID_PAGE_ID) {
+    throw Exception(ExceptionType::OUT_OF_MEMORY, "B+ tree: buffer pool is full");
+  }
+  auto *new_leaf = new_guard.AsMut<LeafPage>();
+  new_leaf->Init(new_page_id, leaf_max_size_);
+  leaf->MoveHalfTo(new_leaf);
+  LogNewPage(&ctx, new_leaf);
+  LogStructureChange(&ctx, LogRecordType::INDEX_SPLICE, leaf, leaf->GetSize(), new_leaf->GetSize(), 0);
+  ctx.smo_guards_.push_back(std::move(new_guard));
+  InsertIntoParent(&ctx, new_leaf->KeyAt(0), new_page_id);
+  LogStructureModification(&ctx);
+  return true;
+}
 
-  BPlusTreePage* old_node = leaf_page;
-  BPlusTreePage* new_node = new_leaf_page;
-  KeyType split = new_node->KeyAt(0);
+/*
+ * Create a leaf holding a single entry as the root of an empty tree. The caller must hold the root latch in the
+ * context. The empty leaf and the root page id are logged as a structure modification, before the entry.
+ */
+INDEX_TEMPLATE_ARGUMENTS
+void BPLUSTREE_TYPE::StartNewTree(Context *ctx, const KeyType &key, const ValueType &value, Transaction *transaction,
+                                  std::optional<lsn_t> undo_next_lsn) {
+  page_id_t page_id;
+  WritePageGuard guard = buffer_pool_manager_->NewPageGuarded(&page_id).UpgradeWrite();
+  if (guard.PageId() == INVALID_PAGE_ID) {
+    throw Exception(ExceptionType::OUT_OF_MEMORY, "B+ tree: buffer pool is full");
+  }
+  auto *leaf = guard.AsMut<LeafPage>();
+  leaf->Init(page_id, leaf_max_size_);
+  LogNewPage(ctx, leaf);
+  ctx->smo_guards_.push_back(std::move(guard));
+  root_page_id_ = page_id;
+  UpdateRootPageId(ctx, 1);
+  LogStructureModification(ctx);
+  InsertIntoLeaf(leaf, key, value, transaction, undo_next_lsn);
+}
+
+/*
+ * Insert key & value into a write-latched leaf that doesn't hold the key yet, and log it.
+ * @return : the size of the leaf after the insertion
+ */
+INDEX_TEMPLATE_ARGUMENTS
+auto BPLUSTREE_TYPE::InsertIntoLeaf(LeafPage *leaf, const KeyType &key, const ValueType &value,
+                                    Transaction *transaction, std::optional<lsn_t> undo_next_lsn) -> int {
+  int size = leaf->Insert(key, value, comparator_);
+  LogPageChange(LogRecordType::INDEX_INSERT, leaf, leaf->KeyIndex(key, comparator_), 0, 1, transaction,
+                undo_next_lsn);
+  return size;
+}
+
+/*
+ * The page at the back of the context's write set was split, and its upper half moved to new_page_id. Add the new
+ * page to the parent right after the split page, splitting the parent in turn when it is full, up to a new root.
+ * The pages left behind stay latched in the context, for the structure modification to be logged.
+ * @param key : the smallest key of the new page, separating it from the split page
+ */
+INDEX_TEMPLATE_ARGUMENTS
+void BPLUSTREE_TYPE::InsertIntoParent(Context *ctx, KeyType key, page_id_t new_page_id) {
   while (true) {
-    // 3.1 old page is root, create a new parent node
-    if (old_node->IsRootPage()) {
-      root_latch_.RUnlock();
-      root_latch_.WLock();
-      Page* new_root_page = buffer_pool_manager_->NewPage(&root_page_id_);
-      auto new_root_node = reinterpret_cast<InternalPage*>(new_root_page->GetData());
-      new_root_node->Init(root_page_id_, INVALID_PAGE_ID, internal_max_size_);
-      new_root_node->SetKV(0, split, old_node->GetPageId());
-      new_root_node->SetKV(1, split, new_node->GetPageId());
-      new_root_node->IncreaseSize(2);
-      old_node->SetParentPageId(root_page_id_);
-      new_node->SetParentPageId(root_page_id_);
-      UpdateRootPageId();
-      ReleaseWLatches(transaction); // 释放节点锁 和 root_latch_
-      buffer_pool_manager_->UnpinPage(root_page_id_, true);
-      break;
-    }
-    
-    // 3.2 old page is not root, add the splited page to old page's parent as well
-    page_id_t parent_page_id = old_node->GetParentPageId();
-    // Page* parent_page = buffer_pool_manager_->FetchPage(parent_page_id);
-    Page* parent_page = GetPageFromTrx(parent_page_id, transaction);
-    auto parent_node = reinterpret_cast<InternalPage*>(parent_page->GetData());
-    parent_node->Insert(split, new_node->GetPageId(), comparator_);
-    new_node->SetParentPageId(parent_node->GetPageId());
-    if (parent_node->GetSize() <= internal_max_size_) {
-      ReleaseWLatches(transaction);
-      buffer_pool_manager_->UnpinPage(new_leaf_id, true);
-      buffer_pool_manager_->UnpinPage(parent_page_id, true);
-      break;
-    }
-
-    // parent has m + 1 children after insertion, split needed
-    page_id_t parent_sibling_page_id;
-    Page* parent_sibling_page = buffer_pool_manager_->NewPage(&parent_sibling_page_id);
-    auto parent_sibling_node = reinterpret_cast<InternalPage*>(parent_sibling_page->GetData());
-    parent_sibling_node->Init(parent_sibling_page_id, parent_node->GetParentPageId(), internal_max_size_);
-    // int new_sibling_size = internal_max_size_ / 2; // sibling of the splited parent
-    size_t offset = (parent_node->GetSize() + 1) / 2;
-    for (int i = offset; i < parent_node.GetSize(); ++i) {
-      parent_sibling_node->SetKV(i - offset, parent_node->KeyAt(i), parent_node->ValueAt(i));
-      Page* pg = buffer_pool_manager_->FetchPage(parent_node->ValueAt(i));
-      auto node = reinterpret_cast<BPlusTreePage*>(pg->GetData());
-      node->SetParentPageId(parent_sibling_page_id);
-      buffer_pool_manager_->UnpinPage(node->GetPageId(), true);
-    }
-    parent_sibling_node->SetSize(internal_max_size_ - offset);
-    parent_node->SetSize(offset);
-
-    buffer_pool_manager_->UnpinPage(old_node->GetPageId(), true);
-    buffer_pool_manager_->UnpinPage(new_node->GetPageId(), true);
-    old_node = parent_node;
-    new_node = parent_sibling_node;
-    split = parent_sibling_node.KeyAt(0);
-  }
-  ReleaseWLatches(transaction);
-  // buffer_pool_manager_->UnpinPage(old_node->GetPageId(), true);
-  buffer_pool_manager_->UnpinPage(new_node->GetPageId(), true);
+    page_id_t old_page_id = ctx->write_set_.back().PageId();
+    ctx->smo_guards_.push_back(std::move(ctx->write_set_.back()));
+    ctx->write_set_.pop_back();
+
+    // the root itself was split: it was unsafe, so the root latch is still held
+    if (ctx->write_set_.empty()) {
+      BUSTUB_ASSERT(ctx->IsRootLocked(), "the root latch must be held to split the root");
+      page_id_t root_page_id;
+      WritePageGuard root_guard = buffer_pool_manager_->NewPageGuarded(&root_page_id).UpgradeWrite();
+      if (root_guard.PageId() == INVALID_PAGE_ID) {
+        throw Exception(ExceptionType::OUT_OF_MEMORY, "B+ tree: buffer pool is full");
+      }
+      auto *root = root_guard.AsMut<InternalPage>();
+      root->Init(root_page_id, internal_max_size_);
+      root->PopulateNewRoot(old_page_id, key, new_page_id);
+      LogNewPage(ctx, root);
+      ctx->smo_guards_.push_back(std::move(root_guard));
+      root_page_id_ = root_page_id;
+      UpdateRootPageId(ctx);
+      return;
+    }
 
-  return true;
+    auto *parent = ctx->write_set_.back().AsMut<InternalPage>();
+    if (parent->GetSize() < parent->GetMaxSize()) {
+      parent->InsertNodeAfter(old_page_id, key, new_page_id);
+      LogStructureChange(ctx, LogRecordType::INDEX_SPLICE, parent, parent->ValueIndex(new_page_id), 0, 1);
+      return;
+    }
+
+    // the parent is full as well, split it and push the middle key one level up
+    page_id_t sibling_page_id;
+    WritePageGuard sibling_guard =
+        buffer_pool_manager_->NewPageGuarded(&sibling_page_id, nullptr, ctx->write_set_.back().PageId()).UpgradeWrite();
+    if (sibling_guard.PageId() == INVALID_PAGE_ID) {
+      throw Exception(ExceptionType::OUT_OF_MEMORY, "B+ tree: buffer pool is full");
+    }
+    auto *sibling = sibling_guard.AsMut<InternalPage>();
+    sibling->Init(sibling_page_id, internal_max_size_);
+    int old_size = parent->GetSize();
+    parent->InsertAndSplitTo(old_page_id, key, new_page_id, sibling);
+    LogNewPage(ctx, sibling);
+    // the new entry may have ended up anywhere in the parent
+    LogStructureChange(ctx, LogRecordType::INDEX_SPLICE, parent, 0, old_size, parent->GetSize());
+    key = sibling->KeyAt(0);
+    new_page_id = sibling_page_id;
+    ctx->smo_guards_.push_back(std::move(sibling_guard));
+  }
 }
 
 /*****************************************************************************
@@ -336,222 +433,214 @@ auto BPLUSTREE_TYPE::Insert(const KeyType &key, const ValueType &value, Transact
  */
 INDEX_TEMPLATE_ARGUMENTS
 void BPLUSTREE_TYPE::Remove(const KeyType &key, Transaction *transaction) {
-  root_latch_.RLock();
-  if (IsEmpty()) {
-    root_latch_.RUnlock();
-    return;
-  }
-  Page* page = GetLeafPage(key, transaction, Operation::Remove);
-  auto leaf_page = reinterpret_cast<LeafPage*>(page->GetData());
-  leaf_page->Remove(key, comparator_);
-
-  if (leaf_page->GetSieze() < leaf_page->GetMinSize()) {
-    HandleUnderflow(leaf_page, transaction);
-  }
-  ReleaseWLatches(transaction);
-  auto deleted_pages = transaction->GetDeletedPageSet();
-  for (auto& pg_id : *deleted_pages) {
-    buffer_pool_manager_->DeletePage(pg_id);
-  }
-  deleted_pages->clear();
+  RemoveEntry(key, transaction, std::nullopt);
 }
 
 INDEX_TEMPLATE_ARGUMENTS
-void BPLUSTREE_TYPE::HandleUnderflow(BPlusTreePage* page, Transaction *transaction) {
-  // 1. root underflow
-  if (page->IsRootPage()) {
-    if (page->GetSize() > 1 || (page->IsLeafPage() && page->GetSize() == 1)) {
+void BPLUSTREE_TYPE::RemoveEntry(const KeyType &key, Transaction *transaction, std::optional<lsn_t> undo_next_lsn) {
+  ValueType existing;
+  // 1. most removes leave the leaf at least half full, and only need a write latch on the leaf itself
+  {
+    bool is_root = false;
+    WritePageGuard leaf_guard = FindLeafOptimistic(key, &is_root);
+    if (leaf_guard.PageId() == INVALID_PAGE_ID) {
+      return;
+    }
+    const auto *leaf = leaf_guard.As<LeafPage>();
+    if (!leaf->Lookup(key, &existing, comparator_)) {
+      return;
+    }
+    if (IsPageSafe(leaf, Operation::Remove, is_root)) {
+      RemoveFromLeaf(leaf_guard.AsMut<LeafPage>(), key, transaction, undo_next_lsn);
       return;
     }
-    if (page->IsLeafPage()) { // root is leaf, size == 0
-      transaction->AddIntoDeletedPageSet(page->GetPageId());
-      root_latch_.RUnlock();
-      root_latch_.WLock();
-      root_page_id_ = INVALID_PAGE_ID;
-    } else { // root is normal(internal), size == 1
-      root_latch_.RUnlock();
-      root_latch_.WLock();
-      auto old_root_page = static_cast<InternalPage*>(page);
-      root_page_id_ = old_root_page->ValueAt(0);
-      auto new_root_page = reinterpret_cast<InternalPage*>(buffer_pool_manager_->FetchPage(root_page_id_)->GetData());
-      new_root_page->SetParentPageId(INVALID_PAGE_ID);
-      buffer_pool_manager_->UnpinPage(root_page_id_, true);
-    }
-    // root_latch_.RUnlock();
-    // root_latch_.WLock();
-    // auto old_root_page = static_cast<InternalPage*>(page);
-    // root_page_id_ = old_root_page->ValueAt(0);
-    // auto new_root_page = reinterpret_cast<InternalPage*>(buffer_pool_manager_->FetchPage(root_page_id_)->GetData());
-    // new_root_page->SetParentPageId(INVALID_PAGE_ID);
-    // buffer_pool_manager_->UnpinPage(root_page_id_, true);
-    UpdateRootPageId();
-    return;
-  }
-
-  page_id_t left_page_id;
-  page_id_t right_page_id;
-  GetSiblings(page, left_page_id, right_page_id, transaction);
-  if (left_page_id == INVALID_PAGE_ID && right_page_id == INVALID_PAGE_ID) {
-    throw std::logic_error("non-root page" + std::to_string(page->GetPageId()) + "has no siblig");
-  }
-
-  BPlusTreePage* left_page = nullptr;
-  BPlusTreePage* right_page = nullptr;
-  Page* left = nullptr;
-  Page* right = nullptr;
-  if (left_page_id != INVALID_PAGE_ID) {
-    left = buffer_pool_manager_->FetchPage(left_page_id);
-    left->WLatch();
-    left_page = reinterpret_cast<InternalPage*>(left->GetData());
-  }
-  if (right_page_id != INVALID_PAGE_ID) {
-    right = buffer_pool_manager_->FetchPage(right_page_id);
-    right->WLatch();
-    right_page = reinterpret_cast<InternalPage*>(right->GetData());
   }
-  auto parent_page = reinterpret_cast<InternalPage*>(GetPageFromTrx(page->GetParentPageId(), trx)->GetData());
 
-  // 2. steal from either sibling
-  if (TryBorrow(page, left_page, parent_page, true) || TryBorrow(page, right_page, parent_page, false)) {
-    if (left_page_id != INVALID_PAGE_ID) {
-      left->WUnlatch();
-      buffer_pool_manager_->UnpinPage(left_page_id, true);
+  // 2. the leaf underflows, latch everything that may change
+  {
+    Context ctx;
+    ctx.LockRoot(&root_latch_);
+    if (IsEmpty()) {
+      return;
     }
-    if (right_page_id != INVALID_PAGE_ID) {
-      right->WUnlatch();
-      buffer_pool_manager_->UnpinPage(right_page_id, true);
+    FindLeafPessimistic(key, Operation::Remove, &ctx);
+    if (!ctx.write_set_.back().As<LeafPage>()->Lookup(key, &existing, comparator_)) {
+      return;
+    }
+    RemoveFromLeaf(ctx.write_set_.back().AsMut<LeafPage>(), key, transaction, undo_next_lsn);
+    HandleUnderflow(&ctx);
+    LogStructureModification(&ctx);
+
+    // 3. pages that were merged away can only be deleted once they are neither latched nor pinned
+    ctx.write_set_.clear();
+    ctx.smo_guards_.clear();
+    ctx.ReleaseRootLatch();
+    for (auto page_id : ctx.deleted_pages_) {
+      buffer_pool_manager_->DeletePage(page_id);
     }
-    // ReleaseWLatches(transaction);
-    // buffer_pool_manager_->UnpinPage(parent_page->GetPageId(), true);
-    return;
   }
-  // 3. merge with either sibling
-  if (left_page != nullptr) {
-    // left->WLatch();
-    MergePage(left_page, page, parent_page, transaction);
-    left->WUnlatch();
-    buffer_pool_manager_->UnpinPage(left_page_id, true);
-  } else {
-    // right->WLatch();
-    MergePage(page, right_page, parent_page, transaction);
-    right->WUnlatch();
-    buffer_pool_manager_->UnpinPage(right_page_id, true);
-  }
-  // if (left_page_id != INVALID_PAGE_ID) {
-  // }
-  // if (right_page_id != INVALID_PAGE_ID) {
-  // }
-  if (parent_page->GetSize() < parent_page->GetMinSize()) {
-    HandleUnderflow(parent_page, transaction);
-  }
-  // ReleaseWLatches(transaction);
-  // buffer_pool_manager_->UnpinPage(parent_page->GetPageId(), true);
 }
 
+/*
+ * Remove key from a write-latched leaf that holds it, and log it. The entry is logged first, for undo.
+ */
 INDEX_TEMPLATE_ARGUMENTS
-auto BPLUSTREE_TYPE::TryBorrow(BPlusTreePage* page, BPlusTreePage* sibling_page, InternalPage* parent_page, bool is_left_sibling) -> bool {
-  if (sibling_page == nullptr || sibling_page->GetSize() <= sibling_page->GetMinSize()) {
-    return false;
-  }
-  int sibling_array_id = is_left_sibling ? sibling_page->GetSize() - 1 : (page->IsLeafPage() ? 0 : 1);
-  int parent_array_id = parent_page->ArrayIndex(page->GetPageId()) + is_left_sibling ? 0 : 1;
-
-  KeyType updated;
-
-  if (page->IsLeafPage()) {
-    auto leaf_page = static_cast<LeafPage*>(page);
-    auto leaf_sibling_page = static_cast<LeafPage*>(sibling_page);
-    leaf_page->Insert(leaf_sibling_page->KeyAt(sibling_array_id), leaf_sibling_page->ValueAt(sibling_array_id), comparator_);
-    leaf_sibling_page->Remove(leaf_sibling_page->KeyAt(sibling_array_id));
-    updated = is_left_sibling ? leaf_page->KeyAt(0) : leaf_sibling_page->KeyAt(0);
-  } else {
-    auto internal_page = static_cast<InternalPage*>(page);
-    auto internal_sibling_page = static_cast<InternalPage*>(sibling_page);
-    updated = internal_sibling_page->KeyAt(sibling_array_id);
-    /*
-      borrow from left sibling:
-        updated key = last key of array_ of left sibling
-      borrow from right sibling:
-        updated key =  first key of array_ of right sibling
-    */
-    page_id_t child_id;
-    if (is_left_sibling) {
-      internal_page->Insert(parent_page->KeyAt(parent_array_id), internal_page->ValueAt(0), comparator_);
-      internal_page->SetValueAt(0, internal_sibling_page->ValueAt(sibling_array_id));
-      child_id = internal_page->ValueAt(0);
-    } else {
-      internal_page->SetKV(internal_page->GetSize(), parent_page->KeyAt(parent_array_id), internal_sibling_page->ValueAt(0));
-      internal_page->IncreaseSize(1);
-      internal_sibling_page->SetKV(0, internal_sibling_page->KeyAt(0), internal_sibling_page->ValueAt(1));
-      child_id = internal_page->ValueAt(internal_page->GetSize() - 1);
-    }
-    internal_sibling_page->RemoveAt(sibling_array_id);
-    Page* page = buffer_pool_manager_->FetchPage(child_id);
-    auto child_page = reinterpret_cast<BPlusTreePage*>(page->GetData());
-    child_page->SetParentPageId(internal_page->GetPageId());
-    buffer_pool_manager_->UnpinPage(page->GetPageId(), true);
-  } 
-  parent_page->SetKeyAt(parent_array_id, updated);
-  return true;
+void BPLUSTREE_TYPE::RemoveFromLeaf(LeafPage *leaf, const KeyType &key, Transaction *transaction,
+                                    std::optional<lsn_t> undo_next_lsn) {
+  LogPageChange(LogRecordType::INDEX_DELETE, leaf, leaf->KeyIndex(key, comparator_), 1, 1, transaction,
+                undo_next_lsn);
+  leaf->RemoveAndDeleteRecord(key, comparator_);
 }
 
+/*
+ * Restore the minimum size of the page at the back of the context's write set, and of its ancestors in turn: borrow
+ * an entry from a sibling when the sibling can spare one, otherwise merge the right one of the two pages into the left
+ * one and remove it from the parent.
+ */
 INDEX_TEMPLATE_ARGUMENTS
-void BPLUSTREE_TYPE::MergePage(BPlusTreePage* left_page, BPlusTreePage* right_page, BPlusTreePage* parent_page, Transaction* trx) {
-  if (left_page->IsLeafPage()) {
-    auto left_leaf_page = static_cast<LeafPage*>(left_page);
-    auto right_leaf_page = static_cast<LeafPage*>(right_page);
-    for (int i = 0; i < right_leaf_page->GetSize(); ++i) {
-      left_leaf_page->Insert(right_leaf_page->KeyAt(i), right_leaf_page->ValueAt(i), comparator_);
+void BPLUSTREE_TYPE::HandleUnderflow(Context *ctx) {
+  while (true) {
+    // the whole path is latched only if the root may change, so the single page left is the root. Otherwise it was
+    // safe for the remove, it is the root exempt from the minimum size or a page that can lose an entry
+    if (ctx->write_set_.size() == 1) {
+      if (ctx->IsRootLocked()) {
+        AdjustRoot(ctx);
+      }
+      return;
     }
-    left_leaf_page->SetNextPageId(right_leaf_page->GetNextPageId());
-    auto removed_page_id = right_page->GetPageId();
-    // parent_page->RemoveAt(parent_page->ArrayIndex(right_page->GetPageId()));
-    parent_page->RemoveAt(parent_page->ArrayIndex(removed_page_id));
-    trx->AddIntoDeletedPageSet(removed_page_id);
-  } else {
-    auto left_internal_page = static_cast<InternalPage*>(left_page);
-    auto right_internal_page = static_cast<InternalPage*>(right_page);
-    left_internal_page->Insert(parent_page->KeyAt(ArrayIndex(right_page->GetPageId())), right_internal_page->ValueAt(0), comparator_);
-    SetPageParentId(right_internal_page->ValueAt(0), left_internal_page->GetPageId());
-    auto removed_page_id = right_page->GetPageId();
-    // parent_page->RemoveAt(parent_page->ArrayIndex(right_page->GetPageId()));
-    parent_page->RemoveAt(parent_page->ArrayIndex(removed_page_id));
-    trx->AddIntoDeletedPageSet(removed_page_id);
-    for (int i = 1; i < right_internal_page->GetSize(); ++i) {
-      left_internal_page->Insert(right_internal_page->KeyAt(i), right_internal_page->ValueAt(i), comparator_);
-      SetPageParentId(right_internal_page->ValueAt(i), left_internal_page->GetPageId());
+    auto &guard = ctx->write_set_.back();
+    if (guard.As<BPlusTreePage>()->GetSize() >= guard.As<BPlusTreePage>()->GetMinSize()) {
+      return;
+    }
+
+    auto *parent = ctx->write_set_[ctx->write_set_.size() - 2].AsMut<InternalPage>();
+    int index = parent->ValueIndex(guard.PageId());
+    // prefer the left sibling, the leftmost child only has a right one
+    bool left_sibling = index > 0;
+    int separator_index = left_sibling ? index : index + 1;
+    page_id_t sibling_page_id = parent->ValueAt(left_sibling ? index - 1 : index + 1);
+    WritePageGuard sibling_guard = buffer_pool_manager_->FetchPageWrite(sibling_page_id);
+    if (sibling_guard.PageId() == INVALID_PAGE_ID) {
+      throw Exception(ExceptionType::OUT_OF_MEMORY, "B+ tree: buffer pool is full");
     }
+    const auto *sibling_page = sibling_guard.As<BPlusTreePage>();
+
+    if (sibling_page->GetSize() > sibling_page->GetMinSize()) {
+      // redistribute: a single entry moves over and the separator in the parent is updated
+      if (sibling_page->IsLeafPage()) {
+        auto *node = guard.AsMut<LeafPage>();
+        auto *sibling = sibling_guard.AsMut<LeafPage>();
+        if (left_sibling) {
+          sibling->MoveLastToFrontOf(node);
+          parent->SetKeyAt(separator_index, node->KeyAt(0));
+          LogStructureChange(ctx, LogRecordType::INDEX_SPLICE, sibling, sibling->GetSize(), 1, 0);
+          LogStructureChange(ctx, LogRecordType::INDEX_SPLICE, node, 0, 0, 1);
+        } else {
+          sibling->MoveFirstToEndOf(node);
+          parent->SetKeyAt(separator_index, sibling->KeyAt(0));
+          LogStructureChange(ctx, LogRecordType::INDEX_SPLICE, sibling, 0, 1, 0);
+          LogStructureChange(ctx, LogRecordType::INDEX_SPLICE, node, node->GetSize() - 1, 0, 1);
+        }
+      } else {
+        auto *node = guard.AsMut<InternalPage>();
+        auto *sibling = sibling_guard.AsMut<InternalPage>();
+        if (left_sibling) {
+          sibling->MoveLastToFrontOf(node, parent->KeyAt(separator_index));
+          parent->SetKeyAt(separator_index, node->KeyAt(0));
+          LogStructureChange(ctx, LogRecordType::INDEX_SPLICE, sibling, sibling->GetSize(), 1, 0);
+          // the separator became the key of what was the first child
+          LogStructureChange(ctx, LogRecordType::INDEX_SPLICE, node, 0, 1, 2);
+        } else {
+          sibling->MoveFirstToEndOf(node, parent->KeyAt(separator_index));
+          parent->SetKeyAt(separator_index, sibling->KeyAt(0));
+          LogStructureChange(ctx, LogRecordType::INDEX_SPLICE, sibling, 0, 1, 0);
+          LogStructureChange(ctx, LogRecordType::INDEX_SPLICE, node, node->GetSize() - 1, 0, 1);
+        }
+      }
+      LogStructureChange(ctx, LogRecordType::INDEX_SPLICE, parent, separator_index, 1, 1);
+      ctx->smo_guards_.push_back(std::move(sibling_guard));
+      return;
+    }
+
+    // merge: both pages together fit into one
+    WritePageGuard &left_guard = left_sibling ? sibling_guard : guard;
+    WritePageGuard &right_guard = left_sibling ? guard : sibling_guard;
+    // the right page is deleted, only the left one needs to be logged
+    if (sibling_page->IsLeafPage()) {
+      auto *left = left_guard.AsMut<LeafPage>();
+      int left_size = left->GetSize();
+      right_guard.AsMut<LeafPage>()->MoveAllTo(left);
+      LogStructureChange(ctx, LogRecordType::INDEX_SPLICE, left, left_size, 0, left->GetSize() - left_size);
+    } else {
+      auto *left = left_guard.AsMut<InternalPage>();
+      int left_size = left->GetSize();
+      right_guard.AsMut<InternalPage>()->MoveAllTo(left, parent->KeyAt(separator_index));
+      LogStructureChange(ctx, LogRecordType::INDEX_SPLICE, left, left_size, 0, left->GetSize() - left_size);
+    }
+    ctx->deleted_pages_.push_back(right_guard.PageId());
+    parent->Remove(separator_index);
+    LogStructureChange(ctx, LogRecordType::INDEX_SPLICE, parent, separator_index, 1, 0);
+    // the pages merged stay latched, the right one is deleted once they are released
+    ctx->smo_guards_.push_back(std::move(sibling_guard));
+    ctx->smo_guards_.push_back(std::move(ctx->write_set_.back()));
+    ctx->write_set_.pop_back();
   }
 }
 
+/*
+ * Shrink the tree when the root underflowed: an internal root left with a single child is replaced by that child,
+ * and a leaf root left without entries makes the tree empty. The caller must hold the root latch.
+ */
 INDEX_TEMPLATE_ARGUMENTS
-void BPLUSTREE_TYPE::SetPageParentId(page_id_t child, page_id_t parent) {
-  auto page = buffer_pool_manager_->FetchPage(child);
-  auto child_node_page = reinterpret_cast<BPlusTreePage*>(page);
-  child_node_page->SetParentPageId(parent);
-  buffer_pool_manager_->UnpinPage(child, false);
+void BPLUSTREE_TYPE::AdjustRoot(Context *ctx) {
+  auto &root_guard = ctx->write_set_.back();
+  const auto *root = root_guard.As<BPlusTreePage>();
+  if (!root->IsLeafPage() && root->GetSize() == 1) {
+    ctx->deleted_pages_.push_back(root_guard.PageId());
+    root_page_id_ = root_guard.AsMut<InternalPage>()->RemoveAndReturnOnlyChild();
+    UpdateRootPageId(ctx);
+  } else if (root->IsLeafPage() && root->GetSize() == 0) {
+    ctx->deleted_pages_.push_back(root_guard.PageId());
+    root_page_id_ = INVALID_PAGE_ID;
+    UpdateRootPageId(ctx);
+  }
 }
 
+/*****************************************************************************
+ * UNDO
+ *****************************************************************************/
+/*
+ * The key a transaction inserted or removed is locked until the transaction ends, so after a crash it is still
+ * inserted, or still missing, wherever splits and merges took its neighbours. Undo just removes it or inserts it back,
+ * and an undo that finds it rolled back already changes nothing.
+ */
 INDEX_TEMPLATE_ARGUMENTS
-void BPLUSTREE_TYPE::GetSiblings(BPlusTreePage* page, page_id_t& left, page_id_t& right, Transaction* trx) {
-  if (page->IsRootPage) {
-    throw std::invalid_argument("tring to get siblings of the root node");
-  }
-  // auto parent_page = reinterpret_cast<InternalPage*>(buffer_pool_manager_->FetchPage(page->GetParentPageId())->GetData());
-  auto parent_page = reinterpret_cast<InternalPage*>(GetPageFromTrx(page->GetParentPageId(), trx)->GetData());
-  auto idx = parent_page->ArrayIndex(page->GetPageId());
-  if (idx == -1) {
-    throw std::logic_error("tree error");
-  }
-  left = right = INVALID_PAGE_ID;
-  if (idx != 0) {
-    left = parent_page->ValueAt(idx - 1);
+void BPLUSTREE_TYPE::UndoIndexChange(LogRecord *record, Transaction *transaction) {
+  IndexPageChange &change = record->GetIndexChange();
+  BUSTUB_ASSERT(change.entry_size_ == static_cast<int32_t>(sizeof(MappingType)), "index record of another tree");
+  // redo rebuilt the tree behind our back, its root is the one in the header page
+  root_latch_.WLock();
+  if (root_page_id_ == INVALID_PAGE_ID) {
+    ReadPageGuard guard = buffer_pool_manager_->FetchPageRead(HEADER_PAGE_ID);
+    // GetRootId() only reads the page
+    auto *header_page = const_cast<HeaderPage *>(guard.As<HeaderPage>());  // NOLINT
+    page_id_t root_page_id;
+    if (guard.PageId() != INVALID_PAGE_ID && header_page->GetRootId(index_name_, &root_page_id)) {
+      root_page_id_ = root_page_id;
+    }
   }
-  if (idx != parent_page->GetSize() - 1) {
-    right = parent_page->ValueAt(idx + 1);
+  root_latch_.WUnlock();
+
+  const auto *entries = reinterpret_cast<const MappingType *>(change.entries_.data());
+  ++num_undos_;
+  for (int i = 0; i < change.GetNumEntries(); i++) {
+    if (record->GetLogRecordType() == LogRecordType::INDEX_INSERT) {
+      RemoveEntry(entries[i].first, transaction, record->GetPrevLSN());
+    } else {
+      InsertEntry(entries[i].first, entries[i].second, transaction, record->GetPrevLSN());
+    }
   }
-  // 释放锁时会同时unpin
-  // buffer_pool_manager_->UnpinPage(parent_page->GetPageId(), false);
+  --num_undos_;
 }
 
 /*****************************************************************************
@@ -563,27 +652,12 @@ void BPLUSTREE_TYPE::GetSiblings(BPlusTreePage* page, page_id_t& left, page_id_t
  * @return : index iterator
  */
 INDEX_TEMPLATE_ARGUMENTS
-auto BPLUSTREE_TYPE::Begin() -> INDEXITERATOR_TYPE { 
-  root_latch_.RLock();
-  if (IsEmpty()) {
-    root_latch_.RUnlock();
+auto BPLUSTREE_TYPE::Begin() -> INDEXITERATOR_TYPE {
+  ReadPageGuard guard = FindLeafRead(KeyType{}, true);
+  if (guard.PageId() == INVALID_PAGE_ID) {
     return End();
   }
-  page_id_t next_page_id = root_page_id_;
-  while (true) {
-    Page* pg = buffer_pool_manager_->FetchPage(next_page_id);
-    auto tree_page = reinterpret_cast<BPlusTree*>(page->GetData());
-    if (tree_page->IsLeafPage()) {
-      return INDEXITERATOR_TYPE(tree_page->GetPageId(), 0, buffer_pool_manager_);
-    }
-    auto internal_page = static_cast<InternalPage*>(tree_page);
-    if (internal_page == nullptr) {
-      throw std::bad_cast();
-    }
-    next_page_id = internal_page->ValueAt(0);
-    buffer_pool_manager_->UnpinPage(internal_page->GetPageId(), false);
-  }
-  return INDEXITERATOR_TYPE(INVALID_PAGE_ID, 0, nullptr); 
+  return INDEXITERATOR_TYPE(this, buffer_pool_manager_, &comparator_, std::move(guard), 0, std::nullopt);
 }
 
 /*
@@ -592,11 +666,13 @@ auto BPLUSTREE_TYPE::Begin() -> INDEXITERATOR_TYPE {
  * @return : index iterator
  */
 INDEX_TEMPLATE_ARGUMENTS
-auto BPLUSTREE_TYPE::Begin(const KeyType &key) -> INDEXITERATOR_TYPE { 
-  
-  Page* page = GetLeafPage(key);
-  auto leaf_page = reinterpret_cast<LeafPage*>(page->GetData());
-  return INDEXITERATOR_TYPE(page->GetPageId(), leaf_page->Lowerbound(key, comparator_), buffer_pool_manager_);
+auto BPLUSTREE_TYPE::Begin(const KeyType &key) -> INDEXITERATOR_TYPE {
+  ReadPageGuard guard = FindLeafRead(key, false);
+  if (guard.PageId() == INVALID_PAGE_ID) {
+    return End();
+  }
+  int index = guard.As<LeafPage>()->KeyIndex(key, comparator_);
+  return INDEXITERATOR_TYPE(this, buffer_pool_manager_, &comparator_, std::move(guard), index, key);
 }
 
 /*
@@ -605,15 +681,13 @@ auto BPLUSTREE_TYPE::Begin(const KeyType &key) -> INDEXITERATOR_TYPE {
  * @return : index iterator
  */
 INDEX_TEMPLATE_ARGUMENTS
-auto BPLUSTREE_TYPE::End() -> INDEXITERATOR_TYPE { 
-  return INDEXITERATOR_TYPE(INVALID_PAGE_ID, 0, nullptr); 
-}
+auto BPLUSTREE_TYPE::End() -> INDEXITERATOR_TYPE { return INDEXITERATOR_TYPE(); }
 
 /**
  * @return Page id of the root of this tree
  */
 INDEX_TEMPLATE_ARGUMENTS
-auto BPLUSTREE_TYPE::GetRootPageId() -> page_id_t { return 0; }
+auto BPLUSTREE_TYPE::GetRootPageId() -> page_id_t { return root_page_id_; }
 
 /*****************************************************************************
  * UTILITIES AND DEBUG
@@ -625,18 +699,104 @@ auto BPLUSTREE_TYPE::GetRootPageId() -> page_id_t { return 0; }
  * @parameter: insert_record      defualt value is false. When set to true,
  * insert a record <index_name, root_page_id> into header page instead of
  * updating it.
+ * The change is part of the structure modification under way, the header page stays latched in the context.
  */
 INDEX_TEMPLATE_ARGUMENTS
-void BPLUSTREE_TYPE::UpdateRootPageId(int insert_record) {
-  auto *header_page = static_cast<HeaderPage *>(buffer_pool_manager_->FetchPage(HEADER_PAGE_ID));
-  if (insert_record != 0) {
-    // create a new record<index_name + root_page_id> in header_page
-    header_page->InsertRecord(index_name_, root_page_id_);
-  } else {
+void BPLUSTREE_TYPE::UpdateRootPageId(Context *ctx, int insert_record) {
+  WritePageGuard guard = buffer_pool_manager_->FetchPageWrite(HEADER_PAGE_ID);
+  auto *header_page = guard.AsMut<HeaderPage>();
+  // the record is still there when a tree that was emptied starts over
+  if (insert_record == 0 || !header_page->InsertRecord(index_name_, root_page_id_)) {
     // update root_page_id in header_page
     header_page->UpdateRecord(index_name_, root_page_id_);
   }
-  buffer_pool_manager_->UnpinPage(HEADER_PAGE_ID, true);
+  if (IsLogging()) {
+    ctx->smo_changes_.emplace_back(INVALID_TXN_ID, INVALID_LSN, LogRecordType::INDEX_ROOT, index_name_, root_page_id_);
+  }
+  ctx->smo_guards_.push_back(std::move(guard));
+}
+
+/*
+ * Only the bytes of the entries are logged, recovery doesn't need to know the key type to replay them.
+ */
+INDEX_TEMPLATE_ARGUMENTS
+template <class PageType>
+auto BPLUSTREE_TYPE::MakePageChange(PageType *page, int index, int num_removed, int num_entries) -> IndexPageChange {
+  IndexPageChange change;
+  change.page_type_ =
+      static_cast<int32_t>(page->IsLeafPage() ? IndexPageType::LEAF_PAGE : IndexPageType::INTERNAL_PAGE);
+  change.max_size_ = page->GetMaxSize();
+  if constexpr (std::is_same_v<PageType, LeafPage>) {
+    change.next_page_id_ = page->GetNextPageId();
+  }
+  change.index_ = index;
+  change.num_removed_ = num_removed;
+  change.entry_size_ = static_cast<int32_t>(sizeof(std::remove_reference_t<decltype(page->GetItem(0))>));
+  if (num_entries > 0) {
+    const auto *entries = reinterpret_cast<const char *>(&page->GetItem(index));
+    change.entries_.assign(entries, entries + static_cast<size_t>(num_entries) * change.entry_size_);
+  }
+  return change;
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+void BPLUSTREE_TYPE::LogPageChange(LogRecordType type, LeafPage *leaf, int index, int num_removed, int num_entries,
+                                   Transaction *transaction, std::optional<lsn_t> undo_next_lsn) {
+  if (!IsLogging()) {
+    return;
+  }
+  bool in_transaction = transaction != nullptr;
+  LogRecord record(in_transaction ? transaction->GetTransactionId() : INVALID_TXN_ID,
+                   in_transaction ? transaction->GetPrevLSN() : INVALID_LSN, type, leaf->GetPageId(),
+                   MakePageChange(leaf, index, num_removed, num_entries), in_transaction ? index_name_ : "");
+  if (in_transaction && undo_next_lsn.has_value()) {
+    record = LogRecord(std::move(record), *undo_next_lsn);
+  }
+  lsn_t lsn = log_manager_->AppendLogRecord(&record);
+  leaf->SetLSN(lsn);
+  if (in_transaction) {
+    transaction->SetPrevLSN(lsn);
+  }
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+template <class PageType>
+void BPLUSTREE_TYPE::LogStructureChange(Context *ctx, LogRecordType type, PageType *page, int index, int num_removed,
+                                        int num_entries) {
+  if (IsLogging()) {
+    ctx->smo_changes_.emplace_back(INVALID_TXN_ID, INVALID_LSN, type, page->GetPageId(),
+                                   MakePageChange(page, index, num_removed, num_entries));
+  }
+}
+
+/*
+ * The record is appended while every page the modification changed is latched, and each of them gets its LSN before
+ * being released. None of them can be written back before the record is durable, which has all of their changes.
+ */
+INDEX_TEMPLATE_ARGUMENTS
+void BPLUSTREE_TYPE::LogStructureModification(Context *ctx) {
+  if (ctx->smo_changes_.empty()) {
+    return;
+  }
+  LogRecord record(INVALID_TXN_ID, INVALID_LSN, LogRecordType::INDEX_SMO, std::move(ctx->smo_changes_));
+  ctx->smo_changes_.clear();
+  lsn_t lsn = log_manager_->AppendLogRecord(&record);
+  auto set_lsn = [&](WritePageGuard *guard) {
+    for (auto &change : record.GetStructureChanges()) {
+      page_id_t page_id =
+          change.GetLogRecordType() == LogRecordType::INDEX_ROOT ? HEADER_PAGE_ID : change.GetIndexPageId();
+      if (page_id == guard->PageId()) {
+        guard->AsMut<Page>()->SetLSN(lsn);
+        return;
+      }
+    }
+  };
+  for (auto &guard : ctx->write_set_) {
+    set_lsn(&guard);
+  }
+  for (auto &guard : ctx->smo_guards_) {
+    set_lsn(&guard);
+  }
 }
 
 /*
@@ -683,7 +843,7 @@ void BPLUSTREE_TYPE::Draw(BufferPoolManager *bpm, const std::string &outf) {
   }
   std::ofstream out(outf);
   out << "digraph G {" << std::endl;
-  ToGraph(reinterpret_cast<BPlusTreePage *>(bpm->FetchPage(root_page_id_)->GetData()), bpm, out);
+  ToGraph(root_page_id_, bpm, out);
   out << "}" << std::endl;
   out.flush();
   out.close();
@@ -698,7 +858,7 @@ void BPLUSTREE_TYPE::Print(BufferPoolManager *bpm) {
     LOG_WARN("Print an empty tree");
     return;
   }
-  ToString(reinterpret_cast<BPlusTreePage *>(bpm->FetchPage(root_page_id_)->GetData()), bpm);
+  ToString(root_page_id_, bpm);
 }
 
 /**
@@ -706,16 +866,18 @@ void BPLUSTREE_TYPE::Print(BufferPoolManager *bpm) {
  * @tparam KeyType
  * @tparam ValueType
  * @tparam KeyComparator
- * @param page
+ * @param page_id
  * @param bpm
  * @param out
  */
 INDEX_TEMPLATE_ARGUMENTS
-void BPLUSTREE_TYPE::ToGraph(BPlusTreePage *page, BufferPoolManager *bpm, std::ofstream &out) const {
+void BPLUSTREE_TYPE::ToGraph(page_id_t page_id, BufferPoolManager *bpm, std::ofstream &out) const {
   std::string leaf_prefix("LEAF_");
   std::string internal_prefix("INT_");
+  BasicPageGuard guard = bpm->FetchPageBasic(page_id);
+  const auto *page = guard.As<BPlusTreePage>();
   if (page->IsLeafPage()) {
-    auto *leaf = reinterpret_cast<LeafPage *>(page);
+    const auto *leaf = guard.As<LeafPage>();
     // Print node name
     out << leaf_prefix << leaf->GetPageId();
     // Print node properties
@@ -739,14 +901,8 @@ void BPLUSTREE_TYPE::ToGraph(BPlusTreePage *page, BufferPoolManager *bpm, std::o
       out << leaf_prefix << leaf->GetPageId() << " -> " << leaf_prefix << leaf->GetNextPageId() << ";\n";
       out << "{rank=same " << leaf_prefix << leaf->GetPageId() << " " << leaf_prefix << leaf->GetNextPageId() << "};\n";
     }
-
-    // Print parent links if there is a parent
-    if (leaf->GetParentPageId() != INVALID_PAGE_ID) {
-      out << internal_prefix << leaf->GetParentPageId() << ":p" << leaf->GetPageId() << " -> " << leaf_prefix
-          << leaf->GetPageId() << ";\n";
-    }
   } else {
-    auto *inner = reinterpret_cast<InternalPage *>(page);
+    const auto *inner = guard.As<InternalPage>();
     // Print node name
     out << internal_prefix << inner->GetPageId();
     // Print node properties
@@ -771,26 +927,23 @@ void BPLUSTREE_TYPE::ToGraph(BPlusTreePage *page, BufferPoolManager *bpm, std::o
     out << "</TR>";
     // Print table end
     out << "</TABLE>>];\n";
-    // Print Parent link
-    if (inner->GetParentPageId() != INVALID_PAGE_ID) {
-      out << internal_prefix << inner->GetParentPageId() << ":p" << inner->GetPageId() << " -> " << internal_prefix
-          << inner->GetPageId() << ";\n";
-    }
-    // Print leaves
+    // Print children, and the links to them
     for (int i = 0; i < inner->GetSize(); i++) {
-      auto child_page = reinterpret_cast<BPlusTreePage *>(bpm->FetchPage(inner->ValueAt(i))->GetData());
-      ToGraph(child_page, bpm, out);
+      BasicPageGuard child_guard = bpm->FetchPageBasic(inner->ValueAt(i));
+      const auto *child_page = child_guard.As<BPlusTreePage>();
+      ToGraph(child_page->GetPageId(), bpm, out);
+      out << internal_prefix << inner->GetPageId() << ":p" << child_page->GetPageId() << " -> "
+          << (child_page->IsLeafPage() ? leaf_prefix : internal_prefix) << child_page->GetPageId() << ";\n";
       if (i > 0) {
-        auto sibling_page = reinterpret_cast<BPlusTreePage *>(bpm->FetchPage(inner->ValueAt(i - 1))->GetData());
+        BasicPageGuard sibling_guard = bpm->FetchPageBasic(inner->ValueAt(i - 1));
+        const auto *sibling_page = sibling_guard.As<BPlusTreePage>();
         if (!sibling_page->IsLeafPage() && !child_page->IsLeafPage()) {
           out << "{rank=same " << internal_prefix << sibling_page->GetPageId() << " " << internal_prefix
               << child_page->GetPageId() << "};\n";
         }
-        bpm->UnpinPage(sibling_page->GetPageId(), false);
       }
     }
   }
-  bpm->UnpinPage(page->GetPageId(), false);
 }
 
 /**
@@ -798,33 +951,32 @@ void BPLUSTREE_TYPE::ToGraph(BPlusTreePage *page, BufferPoolManager *bpm, std::o
  * @tparam KeyType
  * @tparam ValueType
  * @tparam KeyComparator
- * @param page
+ * @param page_id
  * @param bpm
  */
 INDEX_TEMPLATE_ARGUMENTS
-void BPLUSTREE_TYPE::ToString(BPlusTreePage *page, BufferPoolManager *bpm) const {
-  if (page->IsLeafPage()) {
-    auto *leaf = reinterpret_cast<LeafPage *>(page);
-    std::cout << "Leaf Page: " << leaf->GetPageId() << " parent: " << leaf->GetParentPageId()
-              << " next: " << leaf->GetNextPageId() << std::endl;
+void BPLUSTREE_TYPE::ToString(page_id_t page_id, BufferPoolManager *bpm) const {
+  BasicPageGuard guard = bpm->FetchPageBasic(page_id);
+  if (guard.As<BPlusTreePage>()->IsLeafPage()) {
+    const auto *leaf = guard.As<LeafPage>();
+    std::cout << "Leaf Page: " << leaf->GetPageId() << " next: " << leaf->GetNextPageId() << std::endl;
     for (int i = 0; i < leaf->GetSize(); i++) {
       std::cout << leaf->KeyAt(i) << ",";
     }
     std::cout << std::endl;
     std::cout << std::endl;
   } else {
-    auto *internal = reinterpret_cast<InternalPage *>(page);
-    std::cout << "Internal Page: " << internal->GetPageId() << " parent: " << internal->GetParentPageId() << std::endl;
+    const auto *internal = guard.As<InternalPage>();
+    std::cout << "Internal Page: " << internal->GetPageId() << std::endl;
     for (int i = 0; i < internal->GetSize(); i++) {
       std::cout << internal->KeyAt(i) << ": " << internal->ValueAt(i) << ",";
     }
     std::cout << std::endl;
     std::cout << std::endl;
     for (int i = 0; i < internal->GetSize(); i++) {
-      ToString(reinterpret_cast<BPlusTreePage *>(bpm->FetchPage(internal->ValueAt(i))->GetData()), bpm);
+      ToString(internal->ValueAt(i), bpm);
     }
   }
-  bpm->UnpinPage(page->GetPageId(), false);
 }
 
 template class BPlusTree<GenericKey<4>, RID, GenericComparator<4>>;
@@ -2,52 +2,110 @@
  * index_iterator.cpp
  */
 #include <cassert>
+#include <utility>
 
+#include "buffer/buffer_pool_manager.h"
+#include "common/exception.h"
+#include "storage/index/b_plus_tree.h"
 #include "storage/index/index_iterator.h"
 
 namespace bustub {
 
-/*
- * NOTE: you can change the destructor/constructor method here
- * set your own input parameters
- */
 INDEX_TEMPLATE_ARGUMENTS
-INDEXITERATOR_TYPE::IndexIterator() = default;
+INDEXITERATOR_TYPE::IndexIterator(BPlusTree<KeyType, ValueType, KeyComparator> *tree, BufferPoolManager *bpm,
+                                  const KeyComparator *comparator, ReadPageGuard guard, int index,
+                                  std::optional<KeyType> start_key)
+    : tree_(tree),
+      bpm_(bpm),
+      comparator_(comparator),
+      guard_(std::move(guard)),
+      index_(index),
+      start_key_(std::move(start_key)) {
+  SkipExhaustedLeaves();
+}
 
 INDEX_TEMPLATE_ARGUMENTS
 INDEXITERATOR_TYPE::~IndexIterator() = default;  // NOLINT
 
 INDEX_TEMPLATE_ARGUMENTS
-auto INDEXITERATOR_TYPE::IsEnd() -> bool { 
-  return pg_id_ == INVALID_PAGE_ID;
-}
+auto INDEXITERATOR_TYPE::IsEnd() -> bool { return page_id_ == INVALID_PAGE_ID; }
 
 INDEX_TEMPLATE_ARGUMENTS
-auto INDEXITERATOR_TYPE::operator*() -> const MappingType & {  
-  return leaf_page_->array_[idx_];
+auto INDEXITERATOR_TYPE::operator*() -> const MappingType & {
+  return guard_.As<B_PLUS_TREE_LEAF_PAGE_TYPE>()->GetItem(index_);
 }
 
 INDEX_TEMPLATE_ARGUMENTS
-auto INDEXITERATOR_TYPE::operator++() -> INDEXITERATOR_TYPE & { 
-  if (pg_id_ == INVALID_PAGE_ID) {
+auto INDEXITERATOR_TYPE::operator++() -> INDEXITERATOR_TYPE & {
+  if (page_id_ == INVALID_PAGE_ID) {
     return *this;
   }
-  if (idx_ < leaf_page_->GetSize() - 1) {
-    ++idx;
-  } else {
-    idx_ = 0;
-    page_id_t cur_id = pg_id_;
-    page_id_t nxt_id = leaf_page_->GetNextPageId();
-    if (nxt_id == INVALID_PAGE_ID) {
-      pg_ = nullptr;
-      leaf_page_ = nullptr;
-    } else {
-      pg_ = index_bpm_->FetchPage(pg_id_);
-      leaf_page_ = reinterpret_cast<B_PLUS_TREE_LEAF_PAGE_TYPE*>(pg_->GetData());
+  ++index_;
+  SkipExhaustedLeaves();
+  return *this;
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+void INDEXITERATOR_TYPE::SkipExhaustedLeaves() {
+  while (guard_.PageId() != INVALID_PAGE_ID && index_ >= guard_.As<B_PLUS_TREE_LEAF_PAGE_TYPE>()->GetSize()) {
+    const auto *leaf = guard_.As<B_PLUS_TREE_LEAF_PAGE_TYPE>();
+    page_id_t leaf_page_id = guard_.PageId();
+    page_id_t next_page_id = leaf->GetNextPageId();
+    // a scan from a key may start past the last entry of its first leaf, without visiting any
+    if (leaf->GetSize() > 0 &&
+        (!start_key_.has_value() || (*comparator_)(leaf->KeyAt(leaf->GetSize() - 1), *start_key_) >= 0)) {
+      last_key_ = leaf->KeyAt(leaf->GetSize() - 1);
+    }
+    // the version of the leaf changes if anybody write-latches it from now on, such as a merge of the next leaf into it
+    uint64_t version;
+    bool can_validate = bpm_->OptimisticRead(leaf_page_id, &version) != nullptr;
+    // never hold two leaf latches at once: a remove latches the siblings of a leaf in either order
+    guard_.Drop();
+    index_ = 0;
+    if (next_page_id == INVALID_PAGE_ID) {
+      break;
+    }
+    guard_ = bpm_->FetchPageRead(next_page_id);
+    if (guard_.PageId() == INVALID_PAGE_ID) {
+      throw Exception(ExceptionType::OUT_OF_MEMORY, "index iterator: buffer pool is full");
+    }
+    // a leaf is only ever merged into its left neighbour, so if that one is unchanged while we hold the next leaf,
+    // the next leaf is still the one it links to. Otherwise the page may have been freed and reused since.
+    uint64_t current_version;
+    if (can_validate &&
+        (bpm_->OptimisticRead(leaf_page_id, &current_version) == nullptr || current_version != version)) {
+      Reseek();
+      return;
     }
-    index_bpm_->UnpinPage(cur_id, false);
   }
-  return *this;
+  // on entering a leaf, read the next one in the background while the entries of this one are consumed
+  if (guard_.PageId() != page_id_ && guard_.PageId() != INVALID_PAGE_ID) {
+    page_id_t next_page_id = guard_.As<B_PLUS_TREE_LEAF_PAGE_TYPE>()->GetNextPageId();
+    if (next_page_id != INVALID_PAGE_ID) {
+      bpm_->Prefetch({next_page_id});
+    }
+  }
+  page_id_ = guard_.PageId();
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+void INDEXITERATOR_TYPE::Reseek() {
+  guard_.Drop();
+  std::optional<KeyType> last_key = last_key_;
+  INDEXITERATOR_TYPE iterator;
+  if (last_key.has_value()) {
+    iterator = tree_->Begin(*last_key);
+    // the entry of last_key itself was visited already, if it is still there
+    if (!iterator.IsEnd() && (*comparator_)((*iterator).first, *last_key) == 0) {
+      ++iterator;
+    }
+    if (!iterator.last_key_.has_value()) {
+      iterator.last_key_ = last_key;
+    }
+  } else {
+    iterator = start_key_.has_value() ? tree_->Begin(*start_key_) : tree_->Begin();
+  }
+  *this = std::move(iterator);
 }
 
 template class IndexIterator<GenericKey<4>, RID, GenericComparator<4>>;
@@ -9,8 +9,8 @@
 //
 //===----------------------------------------------------------------------===//
 
-#include <iostream>
-#include <sstream>
+#include <algorithm>
+#include <vector>
 
 #include "common/exception.h"
 #include "storage/page/b_plus_tree_internal_page.h"
@@ -21,15 +21,13 @@ namespace bustub {
  *****************************************************************************/
 /*
  * Init method after creating a new internal page
- * Including set page type, set current size, set page id, set parent id and set
- * max page size
+ * Including set page type, set current size, set page id and set max page size
  */
 INDEX_TEMPLATE_ARGUMENTS
-void B_PLUS_TREE_INTERNAL_PAGE_TYPE::Init(page_id_t page_id, page_id_t parent_id, int max_size) {
+void B_PLUS_TREE_INTERNAL_PAGE_TYPE::Init(page_id_t page_id, int max_size) {
   SetPageType(IndexPageType::INTERNAL_PAGE);
   SetPageId(page_id);
   SetSize(0);
-  SetParentPageId(parent_id);
   SetMaxSize(max_size);
 }
 /*
@@ -37,82 +35,138 @@ void B_PLUS_TREE_INTERNAL_PAGE_TYPE::Init(page_id_t page_id, page_id_t parent_id
  * array offset)
  */
 INDEX_TEMPLATE_ARGUMENTS
-auto B_PLUS_TREE_INTERNAL_PAGE_TYPE::KeyAt(int index) const -> KeyType {
-  // replace with your own code
-  // KeyType key{};
-  auto p = static_cast<std::pair<KeyType, ValueType>*>(array_);
-  return *(p + index).first;
-  // return key;
-}
+auto B_PLUS_TREE_INTERNAL_PAGE_TYPE::KeyAt(int index) const -> KeyType { return array_[index].first; }
 
 INDEX_TEMPLATE_ARGUMENTS
-void B_PLUS_TREE_INTERNAL_PAGE_TYPE::SetKeyAt(int index, const KeyType &key) {
-  auto p = static_cast<std::pair<KeyType, ValueType>*>(array_) + index;
-  p->first = key;
-}
+void B_PLUS_TREE_INTERNAL_PAGE_TYPE::SetKeyAt(int index, const KeyType &key) { array_[index].first = key; }
 
 /*
- * Helper method to get the value associated with input "index"(a.k.a array
+ * Helper method to get/set the value associated with input "index"(a.k.a array
  * offset)
  */
 INDEX_TEMPLATE_ARGUMENTS
-auto B_PLUS_TREE_INTERNAL_PAGE_TYPE::ValueAt(int index) const -> ValueType { 
-  auto p = static_cast<std::pair<KeyType, ValueType>*>(array_) + index;
-  return p->second;
+auto B_PLUS_TREE_INTERNAL_PAGE_TYPE::ValueAt(int index) const -> ValueType { return array_[index].second; }
+
+INDEX_TEMPLATE_ARGUMENTS
+void B_PLUS_TREE_INTERNAL_PAGE_TYPE::SetValueAt(int index, const ValueType &value) { array_[index].second = value; }
+
+INDEX_TEMPLATE_ARGUMENTS
+auto B_PLUS_TREE_INTERNAL_PAGE_TYPE::GetItem(int index) const -> const MappingType & { return array_[index]; }
+
+INDEX_TEMPLATE_ARGUMENTS
+auto B_PLUS_TREE_INTERNAL_PAGE_TYPE::ValueIndex(const ValueType &value) const -> int {
+  for (int i = 0; i < GetSize(); ++i) {
+    if (array_[i].second == value) {
+      return i;
+    }
+  }
+  return -1;
 }
 
+/*****************************************************************************
+ * LOOKUP
+ *****************************************************************************/
 INDEX_TEMPLATE_ARGUMENTS
-void B_PLUS_TREE_INTERNAL_PAGE_TYPE::SetValueAt(int index, ValueType v) {
-  auto p = static_cast<std::pair<KeyType, ValueType>*>(array_) + index;
-  p->second = v;
+auto B_PLUS_TREE_INTERNAL_PAGE_TYPE::Lookup(const KeyType &key, const KeyComparator &comparator) const -> ValueType {
+  // find the first key greater than key, the first key is invalid and never compared
+  int left = 1;
+  int right = GetSize();
+  while (left < right) {
+    int mid = left + (right - left) / 2;
+    if (comparator(array_[mid].first, key) <= 0) {
+      left = mid + 1;
+    } else {
+      right = mid;
+    }
+  }
+  return array_[left - 1].second;
 }
 
+/*****************************************************************************
+ * INSERTION
+ *****************************************************************************/
 INDEX_TEMPLATE_ARGUMENTS
-void B_PLUS_TREE_INTERNAL_PAGE_TYPE::RemoveAt(int index) {
+void B_PLUS_TREE_INTERNAL_PAGE_TYPE::PopulateNewRoot(const ValueType &old_value, const KeyType &new_key,
+                                                     const ValueType &new_value) {
+  array_[0].second = old_value;
+  array_[1].first = new_key;
+  array_[1].second = new_value;
+  SetSize(2);
+}
 
-  int size = GetSize();
-  for (int i = index + 1; i < size; ++i) {
-    array_[i - 1] = array_[i];
-  }
-  SetSize(size - 1);
+INDEX_TEMPLATE_ARGUMENTS
+auto B_PLUS_TREE_INTERNAL_PAGE_TYPE::InsertNodeAfter(const ValueType &old_value, const KeyType &new_key,
+                                                     const ValueType &new_value) -> int {
+  int index = ValueIndex(old_value) + 1;
+  std::move_backward(array_ + index, array_ + GetSize(), array_ + GetSize() + 1);
+  array_[index].first = new_key;
+  array_[index].second = new_value;
+  IncreaseSize(1);
+  return GetSize();
 }
 
+INDEX_TEMPLATE_ARGUMENTS
+void B_PLUS_TREE_INTERNAL_PAGE_TYPE::InsertAndSplitTo(const ValueType &old_value, const KeyType &new_key,
+                                                      const ValueType &new_value, BPlusTreeInternalPage *recipient) {
+  // a full page has no room for one more entry, so sort the entries out in a scratch buffer
+  std::vector<MappingType> entries(array_, array_ + GetSize());
+  entries.insert(entries.begin() + ValueIndex(old_value) + 1, {new_key, new_value});
+  int left_size = static_cast<int>(entries.size()) / 2;
+  std::copy(entries.begin(), entries.begin() + left_size, array_);
+  SetSize(left_size);
+  std::copy(entries.begin() + left_size, entries.end(), recipient->array_);
+  recipient->SetSize(static_cast<int>(entries.size()) - left_size);
+}
 
+/*****************************************************************************
+ * REMOVE
+ *****************************************************************************/
 INDEX_TEMPLATE_ARGUMENTS
-void B_PLUS_TREE_INTERNAL_PAGE_TYPE::SetKV(int index, KeyType key, ValueType value) {
-  array_[index].first = key;
-  array_[index].second = value;
+void B_PLUS_TREE_INTERNAL_PAGE_TYPE::Remove(int index) {
+  std::move(array_ + index + 1, array_ + GetSize(), array_ + index);
+  IncreaseSize(-1);
 }
 
 INDEX_TEMPLATE_ARGUMENTS
-void B_PLUS_TREE_INTERNAL_PAGE_TYPE::Insert(const KeyType& key, const ValueType& value, const KeyComparator& comparator) {
-  int size = GetSize();
-  for (int i = 1; i < size; ++i) {
-    if (comparator(key, KeyAt(i)) > 0) {
-      for (int j = size; j > i + 1; --j) {
-        array_[j] = array_[j - 1];
-      }
-      IncreaseSize(1);
-      SetKV(i + 1, key, value);
-      break;
-    }
-  }
+auto B_PLUS_TREE_INTERNAL_PAGE_TYPE::RemoveAndReturnOnlyChild() -> ValueType {
+  BUSTUB_ASSERT(GetSize() == 1, "only a page with a single child can be collapsed");
+  SetSize(0);
+  return array_[0].second;
 }
+
+/*****************************************************************************
+ * MERGE AND REDISTRIBUTE
+ *****************************************************************************/
 INDEX_TEMPLATE_ARGUMENTS
-auto B_PLUS_TREE_INTERNAL_PAGE_TYPE::ArrayIndex(const page_id_t& child_id) const -> int {
-  int size = GetSize();
-  // using InternalPage = BPlusTreeInternalPage<KeyType, page_id_t, KeyComparator>;
-  for (int i = 0; i < size; ++i) {
-    if (ValueAt(i) == child_id) {
-      return i;
-    }
-  }
-  return -1;
+void B_PLUS_TREE_INTERNAL_PAGE_TYPE::MoveAllTo(BPlusTreeInternalPage *recipient, const KeyType &middle_key) {
+  // the separator comes down from the parent as the key of our first child
+  array_[0].first = middle_key;
+  std::copy(array_, array_ + GetSize(), recipient->array_ + recipient->GetSize());
+  recipient->IncreaseSize(GetSize());
+  SetSize(0);
 }
 
+INDEX_TEMPLATE_ARGUMENTS
+void B_PLUS_TREE_INTERNAL_PAGE_TYPE::MoveFirstToEndOf(BPlusTreeInternalPage *recipient, const KeyType &middle_key) {
+  recipient->array_[recipient->GetSize()].first = middle_key;
+  recipient->array_[recipient->GetSize()].second = array_[0].second;
+  recipient->IncreaseSize(1);
+  // our old second key is now KeyAt(0), the new separator for the parent
+  Remove(0);
+}
 
+INDEX_TEMPLATE_ARGUMENTS
+void B_PLUS_TREE_INTERNAL_PAGE_TYPE::MoveLastToFrontOf(BPlusTreeInternalPage *recipient, const KeyType &middle_key) {
+  std::move_backward(recipient->array_, recipient->array_ + recipient->GetSize(),
+                     recipient->array_ + recipient->GetSize() + 1);
+  recipient->array_[1].first = middle_key;
+  // our last key ends up as KeyAt(0) of the recipient, the new separator for the parent
+  recipient->array_[0] = array_[GetSize() - 1];
+  recipient->IncreaseSize(1);
+  IncreaseSize(-1);
+}
 
-// valuetype for internalNode should be page_id_t
+// valuetype for internalNode should be page id_t
 template class BPlusTreeInternalPage<GenericKey<4>, page_id_t, GenericComparator<4>>;
 template class BPlusTreeInternalPage<GenericKey<8>, page_id_t, GenericComparator<8>>;
 template class BPlusTreeInternalPage<GenericKey<16>, page_id_t, GenericComparator<16>>;
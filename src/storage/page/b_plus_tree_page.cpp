@@ -11,18 +11,18 @@
 
 #include "storage/page/b_plus_tree_page.h"
 
+#include <cstring>
+
 namespace bustub {
 
 /*
  * Helper methods to get/set page type
  * Page type enum class is defined in b_plus_tree_page.h
  */
-auto BPlusTreePage::IsLeafPage() const -> bool { 
-  return page_type_ == IndexPageType::LEAF_PAGE;
- }
-auto BPlusTreePage::IsRootPage() const -> bool { return page_type_ == IndexPageType::INVALID_INDEX_PAGE; }
+auto BPlusTreePage::IsLeafPage() const -> bool { return page_type_ == IndexPageType::LEAF_PAGE; }
 void BPlusTreePage::SetPageType(IndexPageType page_type) {
   page_type_ = page_type;
+  layout_version_ = Page::LAYOUT_VERSION;
 }
 
 /*
@@ -31,7 +31,7 @@ void BPlusTreePage::SetPageType(IndexPageType page_type) {
  */
 auto BPlusTreePage::GetSize() const -> int { return size_; }
 void BPlusTreePage::SetSize(int size) { size_ = size; }
-void BPlusTreePage::IncreaseSize(int amount = 1) { size_ += amount; }
+void BPlusTreePage::IncreaseSize(int amount) { size_ += amount; }
 
 /*
  * Helper methods to get/set max size (capacity) of the page
@@ -41,25 +41,19 @@ void BPlusTreePage::SetMaxSize(int size) { max_size_ = size; }
 
 /*
  * Helper method to get min page size
- * Generally, min page size == max page size / 2
- */
-auto BPlusTreePage::GetMinSize() const -> int { return max_size_ / 2; }
-
-/*
- * Helper methods to get/set parent page id
+ * A leaf page holds at least half of its capacity, an internal page at least half of its children, rounded up
  */
-auto BPlusTreePage::GetParentPageId() const -> page_id_t { return parent_page_id_; }
-void BPlusTreePage::SetParentPageId(page_id_t parent_page_id) { parent_page_id_ = parent_page_id; }
+auto BPlusTreePage::GetMinSize() const -> int { return IsLeafPage() ? max_size_ / 2 : (max_size_ + 1) / 2; }
 
 /*
  * Helper methods to get/set self page id
  */
 auto BPlusTreePage::GetPageId() const -> page_id_t { return page_id_; }
-void BPlusTreePage::SetPageId(page_id_t page_id) { page_id_ = page_id;}
+void BPlusTreePage::SetPageId(page_id_t page_id) { page_id_ = page_id; }
 
 /*
  * Helper methods to set lsn
  */
-void BPlusTreePage::SetLSN(lsn_t lsn) { lsn_ = lsn; }
+void BPlusTreePage::SetLSN(lsn_t lsn) { memcpy(lsn_, &lsn, sizeof(lsn_t)); }
 
 }  // namespace bustub
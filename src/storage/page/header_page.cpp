@@ -24,11 +24,14 @@ auto HeaderPage::InsertRecord(const std::string &name, const page_id_t root_id)
   assert(root_id > INVALID_PAGE_ID);
 
   int record_num = GetRecordCount();
-  int offset = 4 + record_num * 36;
+  size_t offset = OFFSET_RECORDS + record_num * RECORD_SIZE;
   // check for duplicate name
   if (FindRecord(name) != -1) {
     return false;
   }
+  if (record_num == 0) {
+    Init();
+  }
   // copy record content
   memcpy(GetData() + offset, name.c_str(), (name.length() + 1));
   memcpy((GetData() + offset + 32), &root_id, 4);
@@ -46,8 +49,8 @@ auto HeaderPage::DeleteRecord(const std::string &name) -> bool {
   if (index == -1) {
     return false;
   }
-  int offset = index * 36 + 4;
-  memmove(GetData() + offset, GetData() + offset + 36, (record_num - index - 1) * 36);
+  size_t offset = OFFSET_RECORDS + index * RECORD_SIZE;
+  memmove(GetData() + offset, GetData() + offset + RECORD_SIZE, (record_num - index - 1) * RECORD_SIZE);
 
   SetRecordCount(record_num - 1);
   return true;
@@ -61,7 +64,7 @@ auto HeaderPage::UpdateRecord(const std::string &name, const page_id_t root_id)
   if (index == -1) {
     return false;
   }
-  int offset = index * 36 + 4;
+  size_t offset = OFFSET_RECORDS + index * RECORD_SIZE;
   // update record content, only root_id
   memcpy((GetData() + offset + 32), &root_id, 4);
 
@@ -76,7 +79,7 @@ auto HeaderPage::GetRootId(const std::string &name, page_id_t *root_id) -> bool
   if (index == -1) {
     return false;
   }
-  int offset = (index + 1) * 36;
+  size_t offset = OFFSET_RECORDS + index * RECORD_SIZE + 32;
   *root_id = *reinterpret_cast<page_id_t *>(GetData() + offset);
 
   return true;
@@ -86,15 +89,15 @@ auto HeaderPage::GetRootId(const std::string &name, page_id_t *root_id) -> bool
  * helper functions
  */
 // record count
-auto HeaderPage::GetRecordCount() -> int { return *reinterpret_cast<int *>(GetData()); }
+auto HeaderPage::GetRecordCount() -> int { return *reinterpret_cast<int *>(GetData() + OFFSET_RECORD_COUNT); }
 
-void HeaderPage::SetRecordCount(int record_count) { memcpy(GetData(), &record_count, 4); }
+void HeaderPage::SetRecordCount(int record_count) { memcpy(GetData() + OFFSET_RECORD_COUNT, &record_count, 4); }
 
 auto HeaderPage::FindRecord(const std::string &name) -> int {
   int record_num = GetRecordCount();
 
   for (int i = 0; i < record_num; i++) {
-    char *raw_name = reinterpret_cast<char *>(GetData() + (4 + i * 36));
+    char *raw_name = reinterpret_cast<char *>(GetData() + OFFSET_RECORDS + i * RECORD_SIZE);
     if (strcmp(raw_name, name.c_str()) == 0) {
       return i;
     }
@@ -12,12 +12,25 @@
 
 #include "buffer/buffer_pool_manager_instance.h"
 
+#include <atomic>
+#include <cerrno>
+#include <chrono>  // NOLINT
+#include <condition_variable>  // NOLINT
+#include <cstdint>
 #include <cstdio>
+#include <mutex>  // NOLINT
 #include <random>
 #include <string>
+#include <thread>  // NOLINT
+#include <unordered_set>
+#include <vector>
 
 #include "buffer/buffer_pool_manager.h"
+#include "common/exception.h"
 #include "gtest/gtest.h"
+#include "recovery/log_manager.h"
+#include "storage/disk/disk_manager_memory.h"
+#include "storage/disk/disk_manager_mmap.h"
 
 namespace bustub {
 
@@ -145,4 +158,662 @@ TEST(BufferPoolManagerInstanceTest, SampleTest) {
   delete disk_manager;
 }
 
+// NOLINTNEXTLINE
+TEST(BufferPoolManagerInstanceTest, AccessStrategyTest) {
+  const size_t buffer_pool_size = 64;
+  const size_t k = 2;
+  const page_id_t num_hot_pages = 16;
+  const page_id_t num_pages = 256;
+
+  auto *disk_manager = new DiskManagerUnlimitedMemory();
+  auto *bpm = new BufferPoolManagerInstance(buffer_pool_size, disk_manager, k);
+
+  page_id_t page_id_temp;
+  for (page_id_t i = 0; i < num_pages; ++i) {
+    auto *page = bpm->NewPage(&page_id_temp);
+    ASSERT_NE(nullptr, page);
+    snprintf(page->GetData(), BUSTUB_PAGE_SIZE, "page %d", page_id_temp);
+    EXPECT_EQ(true, bpm->UnpinPage(page_id_temp, true));
+  }
+  for (page_id_t i = 0; i < num_hot_pages; ++i) {
+    ASSERT_NE(nullptr, bpm->FetchPage(i));
+    EXPECT_EQ(true, bpm->UnpinPage(i, false));
+  }
+
+  std::unordered_set<page_id_t> resident_before_scan;
+  for (size_t i = 0; i < buffer_pool_size; ++i) {
+    resident_before_scan.insert(bpm->GetPages()[i].GetPageId());
+  }
+
+  // Scenario: A large scan through a ring only ever brings in as many pages as its ring holds.
+  BufferAccessStrategy strategy(BufferAccessStrategyType::BULKREAD, buffer_pool_size);
+  EXPECT_EQ(buffer_pool_size / 8, strategy.GetRingSize());
+  for (page_id_t i = num_hot_pages; i < num_pages; ++i) {
+    auto *page = bpm->FetchPageWithStrategy(i, &strategy);
+    ASSERT_NE(nullptr, page);
+    EXPECT_EQ(0, strcmp(page->GetData(), ("page " + std::to_string(i)).c_str()));
+    EXPECT_EQ(true, bpm->UnpinPage(i, false));
+  }
+  size_t hot_frames = 0;
+  size_t scan_frames = 0;
+  for (size_t i = 0; i < buffer_pool_size; ++i) {
+    auto pid = bpm->GetPages()[i].GetPageId();
+    if (pid < num_hot_pages) {
+      hot_frames++;
+    } else if (resident_before_scan.count(pid) == 0) {
+      scan_frames++;
+    }
+  }
+  EXPECT_EQ(num_hot_pages, hot_frames);
+  EXPECT_GE(strategy.GetRingSize(), scan_frames);
+
+  // Scenario: A pinned ring frame is not recycled, the scan falls back to the shared pool instead.
+  auto *pinned = bpm->FetchPageWithStrategy(0, &strategy);
+  ASSERT_NE(nullptr, pinned);
+  for (page_id_t i = num_hot_pages; i < num_hot_pages * 2; ++i) {
+    ASSERT_NE(nullptr, bpm->FetchPageWithStrategy(i, &strategy));
+    EXPECT_EQ(true, bpm->UnpinPage(i, false));
+  }
+  EXPECT_EQ(0, strcmp(pinned->GetData(), "page 0"));
+  EXPECT_EQ(true, bpm->UnpinPage(0, false));
+
+  delete bpm;
+  delete disk_manager;
+}
+
+// NOLINTNEXTLINE
+TEST(BufferPoolManagerInstanceTest, BackgroundWriterTest) {
+  const size_t buffer_pool_size = 10;
+  const size_t k = 2;
+
+  auto *disk_manager = new DiskManagerUnlimitedMemory();
+  auto *bpm = new BufferPoolManagerInstance(buffer_pool_size, disk_manager, k);
+
+  page_id_t page_id_temp;
+  for (size_t i = 0; i < buffer_pool_size; ++i) {
+    auto *page = bpm->NewPage(&page_id_temp);
+    ASSERT_NE(nullptr, page);
+    snprintf(page->GetData(), BUSTUB_PAGE_SIZE, "page %d", page_id_temp);
+    EXPECT_EQ(true, bpm->UnpinPage(page_id_temp, true));
+  }
+
+  // Scenario: Flushing everything only writes the dirty pages.
+  bpm->FlushAllPages();
+  EXPECT_EQ(buffer_pool_size, bpm->GetForegroundWriteCount());
+  bpm->FlushAllPages();
+  EXPECT_EQ(buffer_pool_size, bpm->GetForegroundWriteCount());
+
+  // Scenario: The background writer cleans dirty unpinned pages, but leaves pinned ones alone.
+  for (page_id_t i = 0; i < 4; ++i) {
+    auto *page = bpm->FetchPage(i);
+    ASSERT_NE(nullptr, page);
+    snprintf(page->GetData(), BUSTUB_PAGE_SIZE, "dirty %d", i);
+    EXPECT_EQ(true, bpm->UnpinPage(i, true));
+  }
+  auto *pinned = bpm->FetchPage(4);
+  ASSERT_NE(nullptr, pinned);
+  snprintf(pinned->GetData(), BUSTUB_PAGE_SIZE, "dirty 4");
+  EXPECT_EQ(4, bpm->CleanDirtyPages(BG_WRITER_MAX_PAGES));
+  EXPECT_EQ(4, bpm->GetBackgroundWriteCount());
+  EXPECT_EQ(0, bpm->CleanDirtyPages(BG_WRITER_MAX_PAGES));
+  char buf[BUSTUB_PAGE_SIZE];
+  for (page_id_t i = 0; i < 4; ++i) {
+    disk_manager->ReadPage(i, buf);
+    EXPECT_EQ(0, strcmp(buf, ("dirty " + std::to_string(i)).c_str()));
+  }
+  EXPECT_EQ(true, bpm->UnpinPage(4, true));
+
+  // Scenario: At most half of the evictable frames are taken by a single round.
+  for (page_id_t i = 0; i < static_cast<page_id_t>(buffer_pool_size); ++i) {
+    ASSERT_NE(nullptr, bpm->FetchPage(i));
+    EXPECT_EQ(true, bpm->UnpinPage(i, true));
+  }
+  EXPECT_EQ(buffer_pool_size / 2, bpm->CleanDirtyPages(buffer_pool_size));
+
+  // Scenario: Evicting pages that were cleaned in the background does not write them again.
+  size_t foreground_writes = bpm->GetForegroundWriteCount();
+  std::vector<page_id_t> new_pages;
+  for (size_t i = 0; i < buffer_pool_size; ++i) {
+    ASSERT_NE(nullptr, bpm->NewPage(&page_id_temp));
+    new_pages.push_back(page_id_temp);
+  }
+  EXPECT_EQ(foreground_writes + buffer_pool_size / 2, bpm->GetForegroundWriteCount());
+  for (auto pid : new_pages) {
+    EXPECT_EQ(true, bpm->UnpinPage(pid, false));
+  }
+
+  // Scenario: Flushing a clean page that nobody holds writes nothing.
+  foreground_writes = bpm->GetForegroundWriteCount();
+  EXPECT_EQ(true, bpm->FlushPage(new_pages[0]));
+  EXPECT_EQ(foreground_writes, bpm->GetForegroundWriteCount());
+
+  // Scenario: The writer thread can be started and stopped repeatedly.
+  bpm->RunBackgroundWriter();
+  bpm->RunBackgroundWriter();
+  bpm->StopBackgroundWriter();
+  bpm->StopBackgroundWriter();
+  bpm->RunBackgroundWriter();
+
+  delete bpm;
+  delete disk_manager;
+}
+
+/** Holds the writes submitted asynchronously back until they are released. */
+class HeldWriteDiskManager : public DiskManagerUnlimitedMemory {
+ public:
+  void SubmitAsync(std::vector<DiskRequest> requests) override {
+    std::scoped_lock lock(latch_);
+    held_ = std::move(requests);
+    cv_.notify_all();
+  }
+
+  /** @return the page of the first write held back, once there is one */
+  auto WaitForWrites() -> page_id_t {
+    std::unique_lock lock(latch_);
+    cv_.wait(lock, [&] { return !held_.empty(); });
+    return held_[0].page_id_;
+  }
+
+  /** Complete the held writes, failing them with error if it is not 0. */
+  void ReleaseWrites(int error = 0) {
+    std::vector<DiskRequest> requests;
+    {
+      std::scoped_lock lock(latch_);
+      requests = std::move(held_);
+      held_.clear();
+    }
+    for (auto &request : requests) {
+      if (error == 0) {
+        WritePage(request.page_id_, request.data_);
+      }
+      request.callback_(error);
+    }
+  }
+
+ private:
+  std::mutex latch_;
+  std::condition_variable cv_;
+  std::vector<DiskRequest> held_;
+};
+
+// NOLINTNEXTLINE
+TEST(BufferPoolManagerInstanceTest, BackgroundWriteRaceTest) {
+  auto *disk_manager = new HeldWriteDiskManager();
+  auto *bpm = new BufferPoolManagerInstance(4, disk_manager, 2);
+  page_id_t page_id;
+  for (int i = 0; i < 2; i++) {
+    Page *page = bpm->NewPage(&page_id);
+    ASSERT_NE(nullptr, page);
+    snprintf(page->GetData(), BUSTUB_PAGE_SIZE, "old %d", page_id);
+    EXPECT_EQ(true, bpm->UnpinPage(page_id, true));
+  }
+  char buf[BUSTUB_PAGE_SIZE];
+
+  // Scenario: A page changed and flushed while the background writer writes an older copy of it back ends up on disk
+  // as flushed: the flush waits for the older write to land first. The page stays dirty until then.
+  std::thread writer([&] { EXPECT_EQ(1, bpm->CleanDirtyPages(BG_WRITER_MAX_PAGES)); });
+  page_id = disk_manager->WaitForWrites();
+  Page *page = bpm->FetchPage(page_id);
+  ASSERT_NE(nullptr, page);
+  snprintf(page->GetData(), BUSTUB_PAGE_SIZE, "new %d", page_id);
+  EXPECT_EQ(true, bpm->UnpinPage(page_id, true));
+  std::thread flusher([&] { EXPECT_EQ(true, bpm->FlushPage(page_id)); });
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  EXPECT_EQ(true, page->IsDirty());
+  disk_manager->ReleaseWrites();
+  writer.join();
+  flusher.join();
+  disk_manager->ReadPage(page_id, buf);
+  EXPECT_EQ("new " + std::to_string(page_id), std::string(buf));
+  EXPECT_EQ(false, page->IsDirty());
+
+  // Scenario: A page left alone while it is written back stays in the dirty page table until the write is done, and
+  // is clean after it.
+  std::thread second_writer([&] { EXPECT_EQ(1, bpm->CleanDirtyPages(BG_WRITER_MAX_PAGES)); });
+  page_id = disk_manager->WaitForWrites();
+  auto dirty_pages = bpm->GetDirtyPageTable();
+  EXPECT_EQ(1, dirty_pages.size());
+  EXPECT_EQ(page_id, dirty_pages[0].first);
+  disk_manager->ReleaseWrites();
+  second_writer.join();
+  EXPECT_TRUE(bpm->GetDirtyPageTable().empty());
+  disk_manager->ReadPage(page_id, buf);
+  EXPECT_EQ("old " + std::to_string(page_id), std::string(buf));
+
+  // Scenario: A page whose write fails stays dirty, and isn't counted as written.
+  page = bpm->FetchPage(page_id);
+  ASSERT_NE(nullptr, page);
+  snprintf(page->GetData(), BUSTUB_PAGE_SIZE, "lost %d", page_id);
+  EXPECT_EQ(true, bpm->UnpinPage(page_id, true));
+  std::thread failing_writer([&] { EXPECT_EQ(0, bpm->CleanDirtyPages(BG_WRITER_MAX_PAGES)); });
+  EXPECT_EQ(page_id, disk_manager->WaitForWrites());
+  disk_manager->ReleaseWrites(EIO);
+  failing_writer.join();
+  EXPECT_EQ(true, page->IsDirty());
+  EXPECT_EQ(1, bpm->GetDirtyPageTable().size());
+
+  delete bpm;
+  delete disk_manager;
+}
+
+// NOLINTNEXTLINE
+TEST(BufferPoolManagerInstanceTest, WriteAheadLogTest) {
+  auto *disk_manager = new DiskManager("test.db");
+  LogManager log_manager(disk_manager);
+  auto *bpm = new BufferPoolManagerInstance(2, disk_manager, 2, &log_manager, 4);
+  // a dirty page stamped with a record that is still in the log buffer
+  auto dirty_page = [&](page_id_t *page_id) {
+    Page *page = bpm->NewPage(page_id);
+    EXPECT_NE(nullptr, page);
+    LogRecord record(0, INVALID_LSN, LogRecordType::BEGIN);
+    lsn_t lsn = log_manager.AppendLogRecord(&record);
+    page->SetLSN(lsn);
+    EXPECT_EQ(true, bpm->UnpinPage(*page_id, true));
+    EXPECT_LT(log_manager.GetPersistentLSN(), lsn);
+    return lsn;
+  };
+  page_id_t page_id;
+  page_id_t other_page_id;
+
+  // Scenario: Every write-back of a page forces the log up to the LSN of the page first, be it a flush of the page,
+  // a flush of all pages, an eviction or a shrinking pool.
+  lsn_t lsn = dirty_page(&page_id);
+  EXPECT_EQ(true, bpm->FlushPage(page_id));
+  EXPECT_LE(lsn, log_manager.GetPersistentLSN());
+
+  lsn = dirty_page(&page_id);
+  bpm->FlushAllPages();
+  EXPECT_LE(lsn, log_manager.GetPersistentLSN());
+
+  lsn = dirty_page(&page_id);
+  ASSERT_NE(nullptr, bpm->NewPage(&other_page_id));
+  ASSERT_NE(nullptr, bpm->NewPage(&page_id));
+  EXPECT_LE(lsn, log_manager.GetPersistentLSN());
+  EXPECT_EQ(true, bpm->UnpinPage(other_page_id, false));
+  EXPECT_EQ(true, bpm->UnpinPage(page_id, false));
+
+  // the page goes to one of the frames added, which are the ones removed again
+  EXPECT_EQ(true, bpm->Resize(4));
+  lsn = dirty_page(&page_id);
+  EXPECT_EQ(true, bpm->Resize(2));
+  EXPECT_LE(lsn, log_manager.GetPersistentLSN());
+
+  delete bpm;
+  disk_manager->ShutDown();
+  delete disk_manager;
+  remove("test.db");
+  remove("test.log");
+}
+
+// NOLINTNEXTLINE
+TEST(BufferPoolManagerInstanceTest, FrameLayoutTest) {
+  // one pool smaller than a huge page, one larger
+  for (size_t buffer_pool_size : {10, BUSTUB_HUGE_PAGE_SIZE / BUSTUB_PAGE_SIZE + 1}) {
+    auto *disk_manager = new DiskManagerUnlimitedMemory();
+    auto *bpm = new BufferPoolManagerInstance(buffer_pool_size, disk_manager, 2);
+    Page *pages = bpm->GetPages();
+
+    // Scenario: Frame data is page-aligned and contiguous, descriptors are cache-line aligned.
+    for (size_t i = 0; i < buffer_pool_size; ++i) {
+      EXPECT_EQ(0, reinterpret_cast<uintptr_t>(pages[i].GetData()) % BUSTUB_PAGE_SIZE);
+      EXPECT_EQ(pages[0].GetData() + i * BUSTUB_PAGE_SIZE, pages[i].GetData());
+      EXPECT_EQ(0, reinterpret_cast<uintptr_t>(&pages[i]) % BUSTUB_CACHELINE_SIZE);
+    }
+    // a pool of huge page size starts on a huge page boundary
+    if (buffer_pool_size * BUSTUB_PAGE_SIZE >= BUSTUB_HUGE_PAGE_SIZE) {
+      EXPECT_EQ(0, reinterpret_cast<uintptr_t>(pages[0].GetData()) % BUSTUB_HUGE_PAGE_SIZE);
+    }
+
+    // Scenario: Every frame can be written to and read back through the buffer pool.
+    page_id_t page_id_temp;
+    for (size_t i = 0; i < buffer_pool_size; ++i) {
+      auto *page = bpm->NewPage(&page_id_temp);
+      ASSERT_NE(nullptr, page);
+      snprintf(page->GetData(), BUSTUB_PAGE_SIZE, "page %d", page_id_temp);
+      EXPECT_EQ(true, bpm->UnpinPage(page_id_temp, true));
+    }
+    ASSERT_NE(nullptr, bpm->NewPage(&page_id_temp));
+    EXPECT_EQ(true, bpm->UnpinPage(page_id_temp, false));
+    auto *page = bpm->FetchPage(0);
+    ASSERT_NE(nullptr, page);
+    EXPECT_EQ(0, strcmp(page->GetData(), "page 0"));
+    EXPECT_EQ(true, bpm->UnpinPage(0, false));
+
+    delete bpm;
+    delete disk_manager;
+  }
+}
+
+// NOLINTNEXTLINE
+TEST(BufferPoolManagerInstanceTest, OptimisticReadTest) {
+  const size_t buffer_pool_size = 2;
+  auto *disk_manager = new DiskManagerUnlimitedMemory();
+  auto *bpm = new BufferPoolManagerInstance(buffer_pool_size, disk_manager, 2);
+
+  page_id_t page_id;
+  auto *page = bpm->NewPage(&page_id);
+  snprintf(page->GetData(), BUSTUB_PAGE_SIZE, "Hello");
+  EXPECT_EQ(true, bpm->UnpinPage(page_id, true));
+
+  // Scenario: An optimistic read sees the content and validates, without pinning the page.
+  uint64_t version;
+  const Page *frame = bpm->OptimisticRead(page_id, &version);
+  ASSERT_EQ(page, frame);
+  EXPECT_EQ(0, version % 2);
+  EXPECT_EQ(0, strcmp(frame->GetData(), "Hello"));
+  EXPECT_EQ(0, page->GetPinCount());
+  EXPECT_TRUE(frame->ValidateVersion(version));
+
+  // Scenario: A writer invalidates reads that started before it, and no read starts while it holds the latch.
+  {
+    auto guard = bpm->FetchPageWrite(page_id);
+    EXPECT_FALSE(frame->ValidateVersion(version));
+    uint64_t during_write;
+    EXPECT_EQ(nullptr, bpm->OptimisticRead(page_id, &during_write));
+  }
+  frame = bpm->OptimisticRead(page_id, &version);
+  ASSERT_EQ(page, frame);
+  EXPECT_TRUE(frame->ValidateVersion(version));
+
+  // Scenario: Evicting the page invalidates reads of it, and pages that aren't resident can't be read.
+  std::vector<page_id_t> other_page_ids(buffer_pool_size);
+  for (auto &other_page_id : other_page_ids) {
+    ASSERT_NE(nullptr, bpm->NewPage(&other_page_id));
+  }
+  EXPECT_FALSE(frame->ValidateVersion(version));
+  EXPECT_EQ(nullptr, bpm->OptimisticRead(page_id, &version));
+  EXPECT_EQ(nullptr, bpm->OptimisticRead(INVALID_PAGE_ID, &version));
+  for (auto other_page_id : other_page_ids) {
+    EXPECT_EQ(true, bpm->UnpinPage(other_page_id, false));
+  }
+
+  // Scenario: Once fetched again, the page can be read optimistically wherever it landed.
+  auto guard = bpm->FetchPageRead(page_id);
+  frame = bpm->OptimisticRead(page_id, &version);
+  ASSERT_NE(nullptr, frame);
+  EXPECT_EQ(page_id, guard.PageId());
+  EXPECT_EQ(0, strcmp(frame->GetData(), "Hello"));
+  EXPECT_TRUE(frame->ValidateVersion(version));
+  guard.Drop();
+
+  delete bpm;
+  delete disk_manager;
+}
+
+/** A disk manager whose reads are slow, and counted. */
+class SlowReadDiskManager : public DiskManagerUnlimitedMemory {
+ public:
+  auto ReadPage(page_id_t page_id, char *page_data) -> int override {
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    ++num_reads_;
+    return DiskManagerUnlimitedMemory::ReadPage(page_id, page_data);
+  }
+
+  std::atomic<int> num_reads_{0};
+};
+
+// NOLINTNEXTLINE
+TEST(BufferPoolManagerInstanceTest, PrefetchTest) {
+  const size_t buffer_pool_size = 4;
+  auto *disk_manager = new SlowReadDiskManager();
+  char data[BUSTUB_PAGE_SIZE] = {0};
+  for (page_id_t page_id = 0; page_id < 6; page_id++) {
+    snprintf(data, BUSTUB_PAGE_SIZE, "page %d", page_id);
+    disk_manager->WritePage(page_id, data);
+    EXPECT_EQ(page_id, disk_manager->AllocatePage());
+  }
+  auto *bpm = new BufferPoolManagerInstance(buffer_pool_size, disk_manager, 2);
+
+  // Scenario: Fetching a page that is still being prefetched waits for that read instead of issuing another one.
+  bpm->Prefetch({0, 1, 2});
+  for (page_id_t page_id = 0; page_id < 3; page_id++) {
+    auto *page = bpm->FetchPage(page_id);
+    ASSERT_NE(nullptr, page);
+    EXPECT_EQ(0, strcmp(page->GetData(), ("page " + std::to_string(page_id)).c_str()));
+    EXPECT_EQ(1, page->GetPinCount());
+  }
+  EXPECT_EQ(3, disk_manager->num_reads_);
+  EXPECT_EQ(3, bpm->GetPrefetchReadCount());
+
+  // Scenario: Resident pages are not read again, and prefetching stops once every frame is pinned.
+  bpm->Prefetch({0, 3, 4, 5});
+  auto *page = bpm->FetchPage(3);
+  ASSERT_NE(nullptr, page);
+  EXPECT_EQ(0, strcmp(page->GetData(), "page 3"));
+  EXPECT_EQ(4, disk_manager->num_reads_);
+  EXPECT_EQ(4, bpm->GetPrefetchReadCount());
+
+  // Scenario: Prefetched pages can be evicted like any other once they have been read.
+  for (page_id_t page_id = 0; page_id < 4; page_id++) {
+    EXPECT_EQ(true, bpm->UnpinPage(page_id, false));
+  }
+  bpm->Prefetch({4, 5});
+  for (page_id_t page_id = 4; page_id < 6; page_id++) {
+    page = bpm->FetchPage(page_id);
+    ASSERT_NE(nullptr, page);
+    EXPECT_EQ(0, strcmp(page->GetData(), ("page " + std::to_string(page_id)).c_str()));
+    EXPECT_EQ(true, bpm->UnpinPage(page_id, false));
+  }
+  EXPECT_EQ(6, disk_manager->num_reads_);
+  EXPECT_EQ(6, bpm->GetPrefetchReadCount());
+
+  // the destructor waits for reads that are still in flight
+  bpm->Prefetch({0, 1, 2, 3});
+  delete bpm;
+  delete disk_manager;
+}
+
+// NOLINTNEXTLINE
+TEST(BufferPoolManagerInstanceTest, StatsTest) {
+  const size_t buffer_pool_size = 2;
+  auto *disk_manager = new DiskManagerUnlimitedMemory();
+  auto *bpm = new BufferPoolManagerInstance(buffer_pool_size, disk_manager, 2);
+
+  page_id_t page_id0;
+  page_id_t page_id1;
+  page_id_t page_id2;
+  ASSERT_NE(nullptr, bpm->NewPage(&page_id0));
+  ASSERT_NE(nullptr, bpm->NewPage(&page_id1));
+  // Scenario: Creating or fetching a page fails while every frame is pinned.
+  EXPECT_EQ(nullptr, bpm->NewPage(&page_id2));
+  EXPECT_EQ(nullptr, bpm->FetchPage(page_id1 + 1));
+  BufferPoolStats before = bpm->GetStats();
+  EXPECT_EQ(1, before.new_page_failures_);
+  EXPECT_EQ(1, before.fetch_failures_);
+
+  // Scenario: Hits, misses, evictions and write-backs are counted, and show up in a diff of two snapshots.
+  EXPECT_EQ(true, bpm->UnpinPage(page_id0, true));
+  EXPECT_EQ(true, bpm->UnpinPage(page_id1, false));
+  ASSERT_NE(nullptr, bpm->FetchPage(page_id1));
+  EXPECT_EQ(true, bpm->UnpinPage(page_id1, false));
+  // page 0 is evicted, and written back since it is dirty
+  ASSERT_NE(nullptr, bpm->NewPage(&page_id2));
+  EXPECT_EQ(true, bpm->UnpinPage(page_id2, false));
+  ASSERT_NE(nullptr, bpm->FetchPage(page_id0));
+  EXPECT_EQ(true, bpm->UnpinPage(page_id0, false));
+
+  BufferPoolStats diff = bpm->GetStats() - before;
+  EXPECT_EQ(1, diff.hits_);
+  EXPECT_EQ(1, diff.misses_);
+  EXPECT_DOUBLE_EQ(0.5, diff.HitRatio());
+  EXPECT_EQ(2, diff.evictions_);
+  EXPECT_EQ(1, diff.dirty_writebacks_);
+  EXPECT_EQ(0, diff.new_page_failures_);
+  EXPECT_EQ(1, diff.read_latency_.Count());
+  EXPECT_EQ(1, diff.write_latency_.Count());
+
+  delete bpm;
+  delete disk_manager;
+}
+
+// NOLINTNEXTLINE
+TEST(BufferPoolManagerInstanceTest, ResizeTest) {
+  const size_t buffer_pool_size = 4;
+  auto *disk_manager = new DiskManagerUnlimitedMemory();
+  auto *bpm = new BufferPoolManagerInstance(buffer_pool_size, disk_manager, 2, nullptr, 16);
+  EXPECT_EQ(16, bpm->GetMaxPoolSize());
+  EXPECT_EQ(false, bpm->Resize(0));
+  EXPECT_EQ(false, bpm->Resize(17));
+
+  // Scenario: Growing the pool while every frame is pinned makes room for more pages at once.
+  std::vector<page_id_t> page_ids(8);
+  for (size_t i = 0; i < buffer_pool_size; i++) {
+    Page *page = bpm->NewPage(&page_ids[i]);
+    ASSERT_NE(nullptr, page);
+    snprintf(page->GetData(), BUSTUB_PAGE_SIZE, "page %d", page_ids[i]);
+  }
+  EXPECT_EQ(nullptr, bpm->NewPage(&page_ids[4]));
+  EXPECT_EQ(true, bpm->Resize(8));
+  EXPECT_EQ(8, bpm->GetPoolSize());
+  for (size_t i = buffer_pool_size; i < 8; i++) {
+    Page *page = bpm->NewPage(&page_ids[i]);
+    ASSERT_NE(nullptr, page);
+    snprintf(page->GetData(), BUSTUB_PAGE_SIZE, "page %d", page_ids[i]);
+  }
+
+  // Scenario: Shrinking gives up when the frames to remove stay pinned, and the pool keeps its size.
+  EXPECT_EQ(false, bpm->Resize(2, std::chrono::milliseconds(10)));
+  EXPECT_EQ(8, bpm->GetPoolSize());
+
+  // Scenario: Shrinking waits for the frames to be unpinned, and writes back the dirty pages they hold.
+  std::thread unpinner([&] {
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    for (auto page_id : page_ids) {
+      EXPECT_EQ(true, bpm->UnpinPage(page_id, true));
+    }
+  });
+  EXPECT_EQ(true, bpm->Resize(2, std::chrono::seconds(10)));
+  unpinner.join();
+  EXPECT_EQ(2, bpm->GetPoolSize());
+
+  // Only two frames are left, but every page can still be read back.
+  for (auto page_id : page_ids) {
+    Page *page = bpm->FetchPage(page_id);
+    ASSERT_NE(nullptr, page);
+    EXPECT_EQ("page " + std::to_string(page_id), std::string(page->GetData()));
+    EXPECT_EQ(true, bpm->UnpinPage(page_id, false));
+  }
+  page_id_t page_id;
+  Page *page0 = bpm->NewPage(&page_id);
+  ASSERT_NE(nullptr, page0);
+  EXPECT_NE(nullptr, bpm->FetchPage(page_ids[0]));
+  EXPECT_EQ(nullptr, bpm->FetchPage(page_ids[1]));
+
+  // Scenario: Growing again reuses the frames given up before.
+  EXPECT_EQ(true, bpm->Resize(16));
+  EXPECT_NE(nullptr, bpm->FetchPage(page_ids[1]));
+
+  delete bpm;
+  delete disk_manager;
+}
+
+// NOLINTNEXTLINE
+TEST(BufferPoolManagerInstanceTest, CompressedCacheTest) {
+  const size_t buffer_pool_size = 2;
+  auto *disk_manager = new DiskManagerUnlimitedMemory();
+  auto *bpm = new BufferPoolManagerInstance(buffer_pool_size, disk_manager, 2, nullptr, 0, 256 * 1024);
+  ASSERT_NE(nullptr, bpm->GetCompressedCache());
+
+  std::vector<page_id_t> page_ids(8);
+  for (auto &page_id : page_ids) {
+    Page *page = bpm->NewPage(&page_id);
+    ASSERT_NE(nullptr, page);
+    snprintf(page->GetData(), BUSTUB_PAGE_SIZE, "page %d", page_id);
+    EXPECT_EQ(true, bpm->UnpinPage(page_id, true));
+  }
+
+  // Scenario: Evicted pages are fetched again from the compressed cache rather than from disk.
+  BufferPoolStats before = bpm->GetStats();
+  EXPECT_EQ(page_ids.size() - buffer_pool_size, before.compressed_stores_);
+  EXPECT_EQ(page_ids.size() - buffer_pool_size, bpm->GetCompressedCache()->GetNumPages());
+  for (size_t i = 0; i < page_ids.size() - buffer_pool_size; i++) {
+    Page *page = bpm->FetchPage(page_ids[i]);
+    ASSERT_NE(nullptr, page);
+    EXPECT_EQ("page " + std::to_string(page_ids[i]), std::string(page->GetData()));
+    EXPECT_EQ(true, bpm->UnpinPage(page_ids[i], false));
+  }
+  BufferPoolStats diff = bpm->GetStats() - before;
+  EXPECT_EQ(page_ids.size() - buffer_pool_size, diff.misses_);
+  EXPECT_EQ(page_ids.size() - buffer_pool_size, diff.compressed_hits_);
+  EXPECT_EQ(0, diff.read_latency_.Count());
+
+  // Scenario: A deleted page is dropped from the compressed cache, so its id can be reused safely.
+  size_t num_cached = bpm->GetCompressedCache()->GetNumPages();
+  EXPECT_EQ(true, bpm->DeletePage(page_ids[page_ids.size() - 1]));
+  EXPECT_EQ(num_cached - 1, bpm->GetCompressedCache()->GetNumPages());
+
+  delete bpm;
+  delete disk_manager;
+}
+
+// NOLINTNEXTLINE
+TEST(BufferPoolManagerInstanceTest, ReadOnlyMmapTest) {
+  const std::string db_name = "test.db";
+  const size_t buffer_pool_size = 4;
+  const page_id_t num_pages = 16;
+  {
+    DiskManager writer(db_name);
+    char data[BUSTUB_PAGE_SIZE] = {0};
+    for (page_id_t page_id = 0; page_id < num_pages; page_id++) {
+      snprintf(data, BUSTUB_PAGE_SIZE, "page %d", page_id);
+      writer.WritePage(page_id, data);
+    }
+    writer.ShutDown();
+  }
+  auto *disk_manager = new DiskManagerMmap(db_name);
+  auto *bpm = new BufferPoolManagerInstance(buffer_pool_size, disk_manager, 2);
+
+  // Scenario: Fetched pages are views into the mapping, not copies, also after their frames are reused.
+  for (page_id_t page_id = 0; page_id < num_pages; page_id++) {
+    Page *page = bpm->FetchPage(page_id);
+    ASSERT_NE(nullptr, page);
+    EXPECT_EQ(disk_manager->MappedPage(page_id), page->GetData());
+    EXPECT_EQ("page " + std::to_string(page_id), std::string(page->GetData()));
+    EXPECT_EQ(true, bpm->UnpinPage(page_id, false));
+  }
+  EXPECT_EQ(0, bpm->GetStats().read_latency_.Count());
+
+  // Scenario: Writes are rejected.
+  page_id_t new_page_id;
+  EXPECT_EQ(nullptr, bpm->NewPage(&new_page_id));
+  Page *page = bpm->FetchPage(0);
+  ASSERT_NE(nullptr, page);
+  EXPECT_EQ(false, bpm->UnpinPage(0, true));
+  EXPECT_EQ(false, page->IsDirty());
+  EXPECT_EQ(false, bpm->DeletePage(0));
+  EXPECT_THROW(disk_manager->WritePage(0, disk_manager->MappedPage(1)), Exception);
+  EXPECT_EQ(false, bpm->FlushPage(0));
+  bpm->FlushAllPages();
+
+  // Scenario: Only read guards are handed out, the others could write to the mapping.
+  EXPECT_EQ(true, bpm->IsReadOnly());
+  EXPECT_EQ(INVALID_PAGE_ID, bpm->FetchPageWrite(1).PageId());
+  EXPECT_EQ(INVALID_PAGE_ID, bpm->FetchPageBasic(1).PageId());
+  {
+    ReadPageGuard guard = bpm->FetchPageRead(1);
+    EXPECT_EQ("page 1", std::string(guard.GetData()));
+  }
+
+  // Scenario: Pages the primary appends after the file was mapped are read from the file.
+  {
+    DiskManager writer(db_name);
+    char data[BUSTUB_PAGE_SIZE] = {0};
+    for (page_id_t page_id = num_pages; page_id < num_pages + 2; page_id++) {
+      snprintf(data, BUSTUB_PAGE_SIZE, "page %d", page_id);
+      writer.WritePage(page_id, data);
+    }
+    writer.ShutDown();
+  }
+  page = bpm->FetchPage(num_pages + 1);
+  ASSERT_NE(nullptr, page);
+  EXPECT_EQ(nullptr, disk_manager->MappedPage(num_pages + 1));
+  EXPECT_EQ("page " + std::to_string(num_pages + 1), std::string(page->GetData()));
+  EXPECT_EQ(true, bpm->UnpinPage(num_pages + 1, false));
+
+  delete bpm;
+  delete disk_manager;
+  remove("test.db");
+  remove("test.log");
+}
+
 }  // namespace bustub
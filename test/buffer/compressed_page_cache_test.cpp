@@ -0,0 +1,92 @@
+//===----------------------------------------------------------------------===//
+//
+//                         BusTub
+//
+// compressed_page_cache_test.cpp
+//
+// Identification: test/buffer/compressed_page_cache_test.cpp
+//
+// Copyright (c) 2015-2022, Carnegie Mellon University Database Group
+//
+//===----------------------------------------------------------------------===//
+
+#include "buffer/compressed_page_cache.h"
+
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <string>
+
+#include "gtest/gtest.h"
+
+namespace bustub {
+
+static void FillPage(char *data, page_id_t page_id) {
+  std::memset(data, 0, BUSTUB_PAGE_SIZE);
+  for (int i = 0; i < BUSTUB_PAGE_SIZE / 64; i++) {
+    snprintf(data + i * 64, 64, "page %d, tuple %d", page_id, i);
+  }
+}
+
+// NOLINTNEXTLINE
+TEST(CompressedPageCacheTest, SampleTest) {
+  CompressedPageCache cache(64 * 1024);
+  char data[BUSTUB_PAGE_SIZE];
+  char expected[BUSTUB_PAGE_SIZE];
+
+  // Scenario: Cached pages are handed back intact, and only once.
+  for (page_id_t page_id = 0; page_id < 4; page_id++) {
+    FillPage(data, page_id);
+    EXPECT_EQ(true, cache.Insert(page_id, data));
+  }
+  EXPECT_EQ(4, cache.GetNumPages());
+  EXPECT_LT(cache.GetSize(), 4 * BUSTUB_PAGE_SIZE / 2);
+  EXPECT_EQ(true, cache.Take(2, data));
+  FillPage(expected, 2);
+  EXPECT_EQ(0, std::memcmp(expected, data, BUSTUB_PAGE_SIZE));
+  EXPECT_EQ(false, cache.Take(2, data));
+  EXPECT_EQ(false, cache.Take(4, data));
+
+  // Scenario: Inserting a page again replaces the cached version, and removed pages are gone.
+  FillPage(data, 100);
+  EXPECT_EQ(true, cache.Insert(1, data));
+  EXPECT_EQ(true, cache.Take(1, expected));
+  EXPECT_EQ(0, std::memcmp(expected, data, BUSTUB_PAGE_SIZE));
+  cache.Remove(0);
+  EXPECT_EQ(false, cache.Take(0, data));
+  EXPECT_EQ(1, cache.GetNumPages());
+
+  // Scenario: Pages that don't compress are not cached, and neither is a stale version of them.
+  std::mt19937 rng(15445);
+  for (auto &byte : data) {
+    byte = static_cast<char>(rng());
+  }
+  EXPECT_EQ(false, cache.Insert(3, data));
+  EXPECT_EQ(false, cache.Take(3, data));
+  EXPECT_EQ(0, cache.GetNumPages());
+  EXPECT_EQ(0, cache.GetSize());
+}
+
+// NOLINTNEXTLINE
+TEST(CompressedPageCacheTest, CapacityTest) {
+  const size_t capacity = 16 * 1024;
+  CompressedPageCache cache(capacity);
+  char data[BUSTUB_PAGE_SIZE];
+
+  // Scenario: The least recently inserted pages are dropped once the cache is full.
+  const page_id_t num_pages = 100;
+  for (page_id_t page_id = 0; page_id < num_pages; page_id++) {
+    FillPage(data, page_id);
+    EXPECT_EQ(true, cache.Insert(page_id, data));
+    EXPECT_LE(cache.GetSize(), capacity);
+  }
+  size_t num_cached = cache.GetNumPages();
+  EXPECT_GT(num_cached, capacity / BUSTUB_PAGE_SIZE);
+  EXPECT_LT(num_cached, num_pages);
+  for (page_id_t page_id = 0; page_id < num_pages; page_id++) {
+    bool cached = page_id >= num_pages - static_cast<page_id_t>(num_cached);
+    EXPECT_EQ(cached, cache.Take(page_id, data));
+  }
+}
+
+}  // namespace bustub
@@ -0,0 +1,57 @@
+//===----------------------------------------------------------------------===//
+//
+//                         BusTub
+//
+// crc32c_test.cpp
+//
+// Identification: test/common/crc32c_test.cpp
+//
+// Copyright (c) 2015-2022, Carnegie Mellon University Database Group
+//
+//===----------------------------------------------------------------------===//
+
+#include "common/util/crc32c.h"
+
+#include <numeric>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace bustub {
+
+// NOLINTNEXTLINE
+TEST(Crc32cTest, KnownValuesTest) {
+  // Scenario: The check value of the algorithm, and the test vectors of RFC 3720.
+  std::string check = "123456789";
+  EXPECT_EQ(0xe3069283, Crc32c::Value(check.data(), check.size()));
+  EXPECT_EQ(0, Crc32c::Value(nullptr, 0));
+
+  std::vector<char> data(32, 0);
+  EXPECT_EQ(0x8a9136aa, Crc32c::Value(data.data(), data.size()));
+  std::fill(data.begin(), data.end(), static_cast<char>(0xff));
+  EXPECT_EQ(0x62a8ab43, Crc32c::Value(data.data(), data.size()));
+  std::iota(data.begin(), data.end(), 0);
+  EXPECT_EQ(0x46dd794e, Crc32c::Value(data.data(), data.size()));
+}
+
+// NOLINTNEXTLINE
+TEST(Crc32cTest, ExtendTest) {
+  // Scenario: Checksumming data in pieces of any size, at any alignment, gives the checksum of the whole.
+  std::mt19937 generator(42);
+  std::vector<char> data(1000);
+  for (auto &byte : data) {
+    byte = static_cast<char>(generator());
+  }
+  uint32_t whole = Crc32c::Value(data.data(), data.size());
+  for (size_t split : {1, 3, 7, 8, 9, 500, 999}) {
+    uint32_t crc = Crc32c::Value(data.data(), split);
+    EXPECT_EQ(whole, Crc32c::Extend(crc, data.data() + split, data.size() - split)) << "split at " << split;
+  }
+  // a single flipped bit changes the checksum
+  data[321] ^= 0x10;
+  EXPECT_NE(whole, Crc32c::Value(data.data(), data.size()));
+}
+
+}  // namespace bustub
@@ -0,0 +1,98 @@
+//===----------------------------------------------------------------------===//
+//
+//                         BusTub
+//
+// latency_histogram_test.cpp
+//
+// Identification: test/common/latency_histogram_test.cpp
+//
+// Copyright (c) 2015-2022, Carnegie Mellon University Database Group
+//
+//===----------------------------------------------------------------------===//
+
+#include "common/latency_histogram.h"
+
+#include <cstdint>
+#include <thread>  // NOLINT
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace bustub {
+
+// NOLINTNEXTLINE
+TEST(LatencyHistogramTest, BucketTest) {
+  // small values get a bucket of their own
+  for (uint64_t nanos = 0; nanos < LatencyHistogram::SUB_BUCKETS; nanos++) {
+    EXPECT_EQ(nanos, LatencyHistogram::BucketIndex(nanos));
+  }
+  // buckets are contiguous, and every value falls into the bucket whose bounds contain it
+  for (size_t i = 1; i < LatencyHistogram::NUM_BUCKETS; i++) {
+    EXPECT_EQ(LatencyHistogram::BucketUpperBound(i - 1) + 1, LatencyHistogram::BucketLowerBound(i));
+  }
+  for (uint64_t nanos : {uint64_t{100}, uint64_t{1000}, uint64_t{123456}, uint64_t{987654321}}) {
+    size_t index = LatencyHistogram::BucketIndex(nanos);
+    EXPECT_LE(LatencyHistogram::BucketLowerBound(index), nanos);
+    EXPECT_GE(LatencyHistogram::BucketUpperBound(index), nanos);
+    // the relative error is bounded by the number of sub-buckets
+    EXPECT_LE(LatencyHistogram::BucketUpperBound(index) - nanos, nanos / LatencyHistogram::SUB_BUCKETS);
+  }
+  // huge values are clamped into the last bucket
+  EXPECT_EQ(LatencyHistogram::NUM_BUCKETS - 1, LatencyHistogram::BucketIndex(UINT64_MAX));
+}
+
+// NOLINTNEXTLINE
+TEST(LatencyHistogramTest, PercentileTest) {
+  LatencyHistogram histogram;
+  EXPECT_EQ(0, histogram.Count());
+  EXPECT_EQ(0, histogram.ValueAtPercentile(50));
+  EXPECT_EQ(0, histogram.Max());
+
+  // 1us to 1000us
+  for (uint64_t i = 1; i <= 1000; i++) {
+    histogram.Record(i * 1000);
+  }
+  EXPECT_EQ(1000, histogram.Count());
+  EXPECT_DOUBLE_EQ(500500, histogram.Mean());
+  auto expect_near = [](uint64_t expected, uint64_t actual) {
+    EXPECT_GE(actual, expected);
+    EXPECT_LE(actual, expected + expected / LatencyHistogram::SUB_BUCKETS);
+  };
+  expect_near(500000, histogram.ValueAtPercentile(50));
+  expect_near(990000, histogram.ValueAtPercentile(99));
+  expect_near(1000000, histogram.ValueAtPercentile(100));
+  expect_near(1000000, histogram.Max());
+  expect_near(1000, histogram.ValueAtPercentile(0));
+
+  // a snapshot subtracted from a later one leaves what was recorded in between
+  LatencyHistogram snapshot = histogram;
+  for (int i = 0; i < 10; i++) {
+    histogram.Record(5000000);
+  }
+  LatencyHistogram diff = histogram - snapshot;
+  EXPECT_EQ(1010, histogram.Count());
+  EXPECT_EQ(10, diff.Count());
+  EXPECT_DOUBLE_EQ(5000000, diff.Mean());
+  expect_near(5000000, diff.ValueAtPercentile(1));
+}
+
+// NOLINTNEXTLINE
+TEST(LatencyHistogramTest, ConcurrentRecordTest) {
+  LatencyHistogram histogram;
+  const int num_threads = 4;
+  const int num_records = 10000;
+  std::vector<std::thread> threads;
+  for (int tid = 0; tid < num_threads; tid++) {
+    threads.emplace_back([&histogram, tid] {
+      for (int i = 0; i < num_records; i++) {
+        histogram.Record(tid * 1000 + i % 100);
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(num_threads * num_records, histogram.Count());
+}
+
+}  // namespace bustub
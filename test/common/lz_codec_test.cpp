@@ -0,0 +1,99 @@
+//===----------------------------------------------------------------------===//
+//
+//                         BusTub
+//
+// lz_codec_test.cpp
+//
+// Identification: test/common/lz_codec_test.cpp
+//
+// Copyright (c) 2015-2022, Carnegie Mellon University Database Group
+//
+//===----------------------------------------------------------------------===//
+
+#include "common/util/lz_codec.h"
+
+#include <algorithm>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "common/config.h"
+#include "gtest/gtest.h"
+
+namespace bustub {
+
+static auto RoundTrip(const std::vector<char> &input) -> size_t {
+  std::vector<char> compressed(LzCodec::MaxCompressedSize(input.size()));
+  size_t compressed_size = LzCodec::Compress(input.data(), input.size(), compressed.data(), compressed.size());
+  EXPECT_NE(0, compressed_size);
+  std::vector<char> output(input.size());
+  EXPECT_EQ(input.size(), LzCodec::Decompress(compressed.data(), compressed_size, output.data(), output.size()));
+  EXPECT_EQ(input, output);
+  return compressed_size;
+}
+
+// NOLINTNEXTLINE
+TEST(LzCodecTest, RoundTripTest) {
+  // Scenario: A zeroed page shrinks to almost nothing.
+  std::vector<char> zeroes(BUSTUB_PAGE_SIZE, 0);
+  EXPECT_LT(RoundTrip(zeroes), 64);
+
+  // Scenario: Repetitive data, like the tuples of a table page, compresses well.
+  std::vector<char> tuples(BUSTUB_PAGE_SIZE);
+  for (size_t i = 0; i < tuples.size(); i += 32) {
+    std::string tuple = "id=" + std::to_string(i / 32) + ",name=tuple,value=" + std::to_string(i % 7);
+    std::memcpy(&tuples[i], tuple.data(), std::min<size_t>(tuple.size(), 32));
+  }
+  EXPECT_LT(RoundTrip(tuples), BUSTUB_PAGE_SIZE / 2);
+
+  // Scenario: Random data survives, even though it does not compress.
+  std::mt19937 rng(15445);
+  std::vector<char> random(BUSTUB_PAGE_SIZE);
+  for (auto &byte : random) {
+    byte = static_cast<char>(rng());
+  }
+  EXPECT_LE(RoundTrip(random), LzCodec::MaxCompressedSize(random.size()));
+
+  // Scenario: Tiny inputs and long literal and match runs at odd sizes.
+  for (size_t size : {0, 1, 5, 12, 13, 100, 300, 1000, 70000}) {
+    std::vector<char> input(size);
+    for (size_t i = 0; i < size; i++) {
+      input[i] = static_cast<char>(i < size / 2 ? rng() : 'x');
+    }
+    if (size > 0) {
+      RoundTrip(input);
+    }
+  }
+}
+
+// NOLINTNEXTLINE
+TEST(LzCodecTest, BoundsTest) {
+  std::mt19937 rng(15445);
+  std::vector<char> input(BUSTUB_PAGE_SIZE);
+  for (size_t i = 0; i < input.size(); i++) {
+    input[i] = static_cast<char>(i % 64 < 48 ? 'a' + i % 5 : rng());
+  }
+  std::vector<char> compressed(LzCodec::MaxCompressedSize(input.size()));
+  size_t compressed_size = LzCodec::Compress(input.data(), input.size(), compressed.data(), compressed.size());
+  ASSERT_NE(0, compressed_size);
+
+  // Scenario: Compressing into a buffer that is too small fails instead of writing past it.
+  EXPECT_EQ(0, LzCodec::Compress(input.data(), input.size(), compressed.data(), compressed_size - 1));
+
+  // Scenario: Decompressing into a buffer that is too small fails.
+  std::vector<char> output(input.size());
+  EXPECT_EQ(0, LzCodec::Decompress(compressed.data(), compressed_size, output.data(), output.size() - 1));
+
+  // Scenario: Truncated or garbled input is rejected or decoded into garbage, but never read or written out of bounds.
+  for (size_t size = 0; size < compressed_size; size += 7) {
+    EXPECT_NE(input.size(), LzCodec::Decompress(compressed.data(), size, output.data(), output.size()));
+  }
+  for (int i = 0; i < 1000; i++) {
+    std::vector<char> garbled(compressed.begin(), compressed.begin() + compressed_size);
+    garbled[rng() % garbled.size()] = static_cast<char>(rng());
+    EXPECT_LE(LzCodec::Decompress(garbled.data(), garbled.size(), output.data(), output.size()), output.size());
+  }
+}
+
+}  // namespace bustub
@@ -10,9 +10,17 @@
 //
 //===----------------------------------------------------------------------===//
 
+#include <algorithm>
+#include <chrono>  // NOLINT
+#include <csignal>
+#include <cstring>
+#include <fstream>
 #include <string>
+#include <thread>  // NOLINT
 #include <vector>
 
+#include <sys/resource.h>
+
 #include "buffer/buffer_pool_manager_instance.h"
 #include "common/bustub_instance.h"
 #include "common/config.h"
@@ -26,26 +34,47 @@
 #include "recovery/log_manager.h"
 #include "recovery/log_recovery.h"
 #include "storage/disk/disk_manager.h"
+#include "storage/index/b_plus_tree.h"
+#include "storage/page/header_page.h"
+#include "storage/page/table_page.h"
 #include "storage/table/table_heap.h"
 #include "storage/table/table_iterator.h"
 #include "storage/table/tuple.h"
+#include "test_util.h"  // NOLINT
 
 namespace bustub {
 
 class RecoveryTest : public ::testing::Test {
  protected:
   // This function is called before every test.
-  void SetUp() override {
-    remove("test.db");
-    remove("test.log");
-  }
+  void SetUp() override { RemoveFiles(); }
 
   // This function is called after every test.
   void TearDown() override {
     LOG_INFO("Tearing down the system..");
+    RemoveFiles();
+  };
+
+  static void RemoveFiles() {
     remove("test.db");
     remove("test.log");
-  };
+    remove("test.log.start");
+    // segments after the first one
+    for (int segment = 1; segment < 64; segment++) {
+      remove(("test.log." + std::to_string(segment)).c_str());
+    }
+  }
+
+  /** @return the records of the log blocks from offset on, one after the other */
+  static auto ReadRecords(DiskManager *disk_manager, size_t offset) -> std::vector<char> {
+    std::vector<char> log;
+    std::vector<char> records;
+    lsn_t first_lsn;
+    while ((offset = LogBlock::Read(disk_manager, offset, &records, &first_lsn)) != 0) {
+      log.insert(log.end(), records.begin(), records.end());
+    }
+    return log;
+  }
 };
 
 // NOLINTNEXTLINE
@@ -320,4 +349,1135 @@ TEST_F(RecoveryTest, DISABLED_CheckpointTest) {
   LOG_INFO("Shutdown System");
   delete bustub_instance;
 }
+// NOLINTNEXTLINE
+TEST_F(RecoveryTest, GroupCommitTest) {
+  // Scenario: many clients commit at once. Their commit records share flushes, and the log holds every record once,
+  // in LSN order.
+  auto *disk_manager = new DiskManager("test.db");
+  auto *log_manager = new LogManager(disk_manager, std::chrono::microseconds(1000), 8);
+  const int num_threads = 8;
+  const int commits_per_thread = 50;
+
+  std::vector<std::thread> threads;
+  for (int t = 0; t < num_threads; t++) {
+    threads.emplace_back([&, t] {
+      for (int i = 0; i < commits_per_thread; i++) {
+        LogRecord begin(t * commits_per_thread + i, INVALID_LSN, LogRecordType::BEGIN);
+        lsn_t prev_lsn = log_manager->AppendLogRecord(&begin);
+        LogRecord commit(t * commits_per_thread + i, prev_lsn, LogRecordType::COMMIT);
+        lsn_t lsn = log_manager->AppendLogRecord(&commit);
+        log_manager->FlushUntil(lsn);
+        ASSERT_GE(log_manager->GetPersistentLSN(), lsn);
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  const int num_records = 2 * num_threads * commits_per_thread;
+  // BEGIN and COMMIT records are just the header
+  const int header_size = LogRecord(0, INVALID_LSN, LogRecordType::BEGIN).GetSize();
+  EXPECT_EQ(num_records, log_manager->GetNextLSN());
+  EXPECT_EQ(num_records - 1, log_manager->GetPersistentLSN());
+  EXPECT_LT(disk_manager->GetNumFlushes(), num_threads * commits_per_thread);
+
+  std::vector<char> log = ReadRecords(disk_manager, 0);
+  // nothing past the last record
+  ASSERT_EQ(num_records * header_size, log.size());
+  for (int i = 0; i < num_records; i++) {
+    const char *header = log.data() + i * header_size;
+    EXPECT_EQ(header_size, *reinterpret_cast<const int32_t *>(header));
+    EXPECT_EQ(i, *reinterpret_cast<const lsn_t *>(header + sizeof(int32_t)));
+  }
+
+  delete log_manager;
+  disk_manager->ShutDown();
+  delete disk_manager;
+  remove("test.fsm");
+}
+// NOLINTNEXTLINE
+TEST_F(RecoveryTest, LogWriteFailureTest) {
+  // Scenario: the log can't be written past the file size limit. The commit waiting for the failed flush is not
+  // acknowledged, the persistent LSN stays before it, and nothing is made durable anymore once the limit is lifted.
+  // Recovery finds the transaction unfinished.
+  auto *disk_manager = new DiskManager("test.db");
+  {
+    LogManager log_manager(disk_manager, std::chrono::microseconds(0));
+    LogRecord begin(0, INVALID_LSN, LogRecordType::BEGIN);
+    lsn_t begin_lsn = log_manager.AppendLogRecord(&begin);
+    log_manager.FlushUntil(begin_lsn);
+
+    rlimit old_limit;
+    ASSERT_EQ(0, getrlimit(RLIMIT_FSIZE, &old_limit));
+    rlimit limit = old_limit;
+    limit.rlim_cur = disk_manager->GetLogEndOffset();
+    auto old_handler = signal(SIGXFSZ, SIG_IGN);
+    ASSERT_EQ(0, setrlimit(RLIMIT_FSIZE, &limit));
+    LogRecord commit(0, begin_lsn, LogRecordType::COMMIT);
+    EXPECT_THROW(log_manager.FlushUntil(log_manager.AppendLogRecord(&commit)), Exception);
+    setrlimit(RLIMIT_FSIZE, &old_limit);
+    signal(SIGXFSZ, old_handler);
+    EXPECT_EQ(begin_lsn, log_manager.GetPersistentLSN());
+    EXPECT_TRUE(log_manager.HasFailed());
+
+    LogRecord other_begin(1, INVALID_LSN, LogRecordType::BEGIN);
+    EXPECT_THROW(log_manager.FlushUntil(log_manager.AppendLogRecord(&other_begin)), Exception);
+    EXPECT_EQ(begin_lsn, log_manager.GetPersistentLSN());
+  }
+  {
+    LogRecovery recovery(disk_manager, nullptr);
+    recovery.Analyze();
+    ASSERT_EQ(1, recovery.GetActiveTransactions().size());
+    EXPECT_EQ(1, recovery.GetActiveTransactions().count(0));
+  }
+  disk_manager->ShutDown();
+  delete disk_manager;
+  remove("test.fsm");
+}
+// NOLINTNEXTLINE
+TEST_F(RecoveryTest, ConcurrentAppendTest) {
+  // Scenario: threads append records of different sizes without waiting, filling the log buffers many times over.
+  // Every record reaches the log once, LSNs follow the order of the records in the log, and each one is intact.
+  auto *disk_manager = new DiskManager("test.db");
+  auto *log_manager = new LogManager(disk_manager);
+  const int num_threads = 8;
+  const int records_per_thread = 2000;
+
+  std::vector<std::thread> threads;
+  for (int t = 0; t < num_threads; t++) {
+    threads.emplace_back([&, t] {
+      for (int i = 0; i < records_per_thread; i++) {
+        // the tuple carries the record's writer and number, so it can be checked once read back
+        int32_t length = 2 * sizeof(int32_t) + (t * 7 + i) % 50;
+        std::vector<char> raw(sizeof(int32_t) + length, static_cast<char>(t));
+        memcpy(raw.data(), &length, sizeof(int32_t));
+        memcpy(raw.data() + sizeof(int32_t), &t, sizeof(int32_t));
+        memcpy(raw.data() + 2 * sizeof(int32_t), &i, sizeof(int32_t));
+        Tuple tuple;
+        tuple.DeserializeFrom(raw.data());
+        LogRecord record(t, INVALID_LSN, LogRecordType::INSERT, RID(t, i), tuple);
+        log_manager->AppendLogRecord(&record);
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  log_manager->Flush();
+
+  const int num_records = num_threads * records_per_thread;
+  EXPECT_EQ(num_records, log_manager->GetNextLSN());
+  EXPECT_EQ(num_records - 1, log_manager->GetPersistentLSN());
+  EXPECT_GT(disk_manager->GetNumFlushes(), 10);
+
+  // header (size, lsn, txn id, prev lsn, type), rid, tuple length, then the tuple
+  std::vector<char> log = ReadRecords(disk_manager, 0);
+  std::vector<int> next_record(num_threads, 0);
+  size_t offset = 0;
+  for (int lsn = 0; lsn < num_records; lsn++) {
+    const char *record = log.data() + offset;
+    auto field = [&](size_t pos) { return *reinterpret_cast<const int32_t *>(record + pos); };
+    int32_t size = field(0);
+    ASSERT_EQ(lsn, *reinterpret_cast<const lsn_t *>(record + 4));
+    int32_t txn_id = field(12);
+    ASSERT_TRUE(txn_id >= 0 && txn_id < num_threads);
+    // a thread's records are in the order it appended them
+    int i = next_record[txn_id]++;
+    EXPECT_EQ(RID(txn_id, i), *reinterpret_cast<const RID *>(record + LogRecord::HEADER_SIZE));
+    EXPECT_EQ(size, LogRecord::HEADER_SIZE + static_cast<int32_t>(sizeof(RID)) + static_cast<int32_t>(sizeof(int32_t)) +
+                        field(36));
+    EXPECT_EQ(txn_id, field(40));
+    EXPECT_EQ(i, field(44));
+    offset += size;
+  }
+  EXPECT_EQ(log.size(), offset);
+
+  delete log_manager;
+  disk_manager->ShutDown();
+  delete disk_manager;
+  remove("test.fsm");
+}
+// NOLINTNEXTLINE
+TEST_F(RecoveryTest, CheckpointTruncatesLogTest) {
+  // Scenario: transactions fill a number of small log segments. With no transaction active and no page dirty, a
+  // checkpoint deletes every segment before its own records, and logging goes on where it left off.
+  DiskManagerOptions options;
+  options.log_segment_size_ = 256;
+  auto *bustub_instance = new BustubInstance("test.db", options);
+  auto *disk_manager = bustub_instance->disk_manager_;
+  bustub_instance->log_manager_->RunFlushThread();
+
+  auto run_transactions = [&](int count) {
+    for (int i = 0; i < count; i++) {
+      Transaction *txn = bustub_instance->txn_manager_->Begin();
+      bustub_instance->txn_manager_->Commit(txn);
+      delete txn;
+    }
+  };
+  run_transactions(50);
+  ASSERT_GT(disk_manager->GetNumLogSegments(), 5);
+  bustub_instance->buffer_pool_manager_->FlushAllPages();
+  size_t end = disk_manager->GetLogEndOffset();
+
+  bustub_instance->checkpoint_manager_->BeginCheckpoint();
+  bustub_instance->checkpoint_manager_->EndCheckpoint();
+  EXPECT_EQ(end, disk_manager->GetLogStartOffset());
+  EXPECT_LE(disk_manager->GetNumLogSegments(), 2);
+
+  run_transactions(20);
+  EXPECT_EQ(bustub_instance->log_manager_->GetNextLSN() - 1, bustub_instance->log_manager_->GetPersistentLSN());
+  EXPECT_GT(disk_manager->GetNumLogSegments(), 2);
+  // the last record is intact
+  std::vector<char> log = ReadRecords(disk_manager, disk_manager->GetLogStartOffset());
+  ASSERT_GE(log.size(), LogRecord::HEADER_SIZE);
+  char *commit = log.data() + log.size() - LogRecord::HEADER_SIZE;
+  EXPECT_EQ(bustub_instance->log_manager_->GetPersistentLSN(), *reinterpret_cast<lsn_t *>(commit + 4));
+  EXPECT_EQ(static_cast<int32_t>(LogRecordType::COMMIT), *reinterpret_cast<int32_t *>(commit + 24));
+
+  delete bustub_instance;
+  remove("test.fsm");
+}
+
+// NOLINTNEXTLINE
+TEST_F(RecoveryTest, FuzzyCheckpointTest) {
+  // Scenario: a transaction has dirtied a page and is still running when a checkpoint begins, and other transactions
+  // commit before it ends. The checkpoint keeps the log the running transaction and the dirty page need, and
+  // analysis finds both in it. Once they are gone, the next checkpoint truncates the log further.
+  DiskManagerOptions options;
+  options.log_segment_size_ = 256;
+  auto *bustub_instance = new BustubInstance("test.db", options);
+  auto *disk_manager = bustub_instance->disk_manager_;
+  auto *txn_manager = bustub_instance->txn_manager_;
+  bustub_instance->log_manager_->RunFlushThread();
+  bustub_instance->buffer_pool_manager_->FlushAllPages();
+
+  auto run_transactions = [&](int count) {
+    for (int i = 0; i < count; i++) {
+      Transaction *txn = txn_manager->Begin();
+      txn_manager->Commit(txn);
+      delete txn;
+    }
+  };
+  run_transactions(20);
+  Transaction *txn = txn_manager->Begin();
+  lsn_t begin_lsn = txn->GetPrevLSN();
+  // logs a NEWPAGE record and dirties the first page of the table
+  auto *table = new TableHeap(bustub_instance->buffer_pool_manager_, bustub_instance->lock_manager_,
+                              bustub_instance->log_manager_, txn);
+  page_id_t page_id = table->GetFirstPageId();
+  lsn_t new_page_lsn = txn->GetPrevLSN();
+  run_transactions(20);
+
+  bustub_instance->checkpoint_manager_->BeginCheckpoint();
+  run_transactions(20);
+  bustub_instance->checkpoint_manager_->EndCheckpoint();
+  size_t start = disk_manager->GetLogStartOffset();
+  EXPECT_GT(start, 0);
+
+  {
+    LogRecovery recovery(disk_manager, bustub_instance->buffer_pool_manager_);
+    recovery.Analyze();
+    EXPECT_NE(INVALID_LSN, recovery.GetCheckpointLSN());
+    EXPECT_GT(recovery.GetCheckpointLSN(), new_page_lsn);
+    ASSERT_EQ(1, recovery.GetActiveTransactions().size());
+    EXPECT_EQ(new_page_lsn, recovery.GetActiveTransactions().at(txn->GetTransactionId()));
+    ASSERT_EQ(1, recovery.GetDirtyPageTable().count(page_id));
+    EXPECT_LE(recovery.GetDirtyPageTable().at(page_id), new_page_lsn);
+    EXPECT_GT(recovery.GetDirtyPageTable().at(page_id), begin_lsn);
+    EXPECT_EQ(recovery.GetDirtyPageTable().at(page_id), recovery.GetRedoLSN());
+  }
+
+  txn_manager->Commit(txn);
+  bustub_instance->buffer_pool_manager_->FlushAllPages();
+  bustub_instance->checkpoint_manager_->BeginCheckpoint();
+  bustub_instance->checkpoint_manager_->EndCheckpoint();
+  EXPECT_GT(disk_manager->GetLogStartOffset(), start);
+  {
+    LogRecovery recovery(disk_manager, bustub_instance->buffer_pool_manager_);
+    recovery.Analyze();
+    EXPECT_TRUE(recovery.GetActiveTransactions().empty());
+    EXPECT_TRUE(recovery.GetDirtyPageTable().empty());
+    EXPECT_EQ(recovery.GetCheckpointLSN(), recovery.GetRedoLSN());
+  }
+
+  delete txn;
+  delete table;
+  delete bustub_instance;
+  remove("test.fsm");
+}
+
+// NOLINTNEXTLINE
+TEST_F(RecoveryTest, CheckpointWhilePinnedTest) {
+  // Scenario: a transaction formats a new page and commits, but the page is still pinned, so the buffer pool doesn't
+  // know it is dirty yet, when a checkpoint is taken. The page is in the checkpoint's dirty page table all the same,
+  // so the checkpoint keeps its record in the log, and redo formats the page again after a crash that lost it.
+  DiskManagerOptions options;
+  options.log_segment_size_ = 256;
+  auto *bustub_instance = new BustubInstance("test.db", options);
+  auto *disk_manager = bustub_instance->disk_manager_;
+  auto *txn_manager = bustub_instance->txn_manager_;
+  auto *bpm = bustub_instance->buffer_pool_manager_;
+  bustub_instance->log_manager_->RunFlushThread();
+  bpm->FlushAllPages();
+
+  auto run_transactions = [&](int count) {
+    for (int i = 0; i < count; i++) {
+      Transaction *txn = txn_manager->Begin();
+      txn_manager->Commit(txn);
+      delete txn;
+    }
+  };
+  run_transactions(20);
+  Transaction *txn = txn_manager->Begin();
+  page_id_t page_id;
+  auto *page = reinterpret_cast<TablePage *>(bpm->NewPage(&page_id));
+  ASSERT_NE(nullptr, page);
+  page->WLatch();
+  page->Init(page_id, BUSTUB_PAGE_SIZE, INVALID_PAGE_ID, bustub_instance->log_manager_, txn);
+  page->WUnlatch();
+  lsn_t new_page_lsn = page->GetLSN();
+  txn_manager->Commit(txn);
+  run_transactions(20);
+
+  bustub_instance->checkpoint_manager_->BeginCheckpoint();
+  bustub_instance->checkpoint_manager_->EndCheckpoint();
+  bpm->UnpinPage(page_id, true);
+  EXPECT_GT(disk_manager->GetLogStartOffset(), 0);
+
+  // the page never reached the disk, and recovery runs without logging
+  bustub_instance->log_manager_->StopFlushThread();
+  auto *restarted_bpm = new BufferPoolManagerInstance(8, disk_manager);
+  {
+    LogRecovery recovery(disk_manager, restarted_bpm);
+    recovery.Analyze();
+    ASSERT_EQ(1, recovery.GetDirtyPageTable().count(page_id));
+    EXPECT_LE(recovery.GetDirtyPageTable().at(page_id), new_page_lsn);
+    recovery.Redo();
+  }
+  {
+    auto guard = restarted_bpm->FetchPageRead(page_id);
+    EXPECT_EQ(page_id, guard.As<TablePage>()->GetTablePageId());
+  }
+
+  delete restarted_bpm;
+  delete txn;
+  delete bustub_instance;
+  remove("test.fsm");
+}
+
+// NOLINTNEXTLINE
+TEST_F(RecoveryTest, CheckpointOverflowTest) {
+  // Scenario: more pages are dirty than the BEGIN_CHECKPOINT record has room for when a checkpoint is taken, and
+  // none of them reaches the disk before the crash. The pages dirtied last are left out of the record, analysis finds
+  // them in the log all the same, and redo rebuilds every page.
+  const size_t max_pages = (LOG_BUFFER_SIZE / 2) / (sizeof(page_id_t) + sizeof(lsn_t));
+  const size_t num_pages = max_pages + 64;
+  auto *disk_manager = new DiskManager("test.db");
+  std::vector<page_id_t> page_ids;
+  {
+    LogManager log_manager(disk_manager);
+    BufferPoolManagerInstance bpm(num_pages + 8, disk_manager, LRUK_REPLACER_K, &log_manager);
+    LockManager lock_manager;
+    TransactionManager txn_manager(&lock_manager, &log_manager);
+    CheckpointManager checkpoint_manager(&txn_manager, &log_manager, &bpm);
+    // a zeroed page 0 looks like one initialized by the record with LSN 0
+    LogRecord begin(0, INVALID_LSN, LogRecordType::BEGIN);
+    log_manager.AppendLogRecord(&begin);
+    for (size_t i = 0; i < num_pages; i++) {
+      page_id_t page_id;
+      Page *page = bpm.NewPage(&page_id);
+      ASSERT_NE(nullptr, page);
+      LogRecord new_page(INVALID_TXN_ID, INVALID_LSN, LogRecordType::NEWPAGE, INVALID_PAGE_ID, page_id);
+      reinterpret_cast<TablePage *>(page)->Init(page_id, BUSTUB_PAGE_SIZE, INVALID_PAGE_ID, nullptr, nullptr);
+      page->SetLSN(log_manager.AppendLogRecord(&new_page));
+      bpm.UnpinPage(page_id, true);
+      page_ids.push_back(page_id);
+    }
+    checkpoint_manager.BeginCheckpoint();
+    checkpoint_manager.EndCheckpoint();
+  }
+
+  auto *bpm = new BufferPoolManagerInstance(64, disk_manager);
+  {
+    LogRecovery recovery(disk_manager, bpm);
+    recovery.Redo();
+    EXPECT_NE(INVALID_LSN, recovery.GetCheckpointLSN());
+    EXPECT_EQ(num_pages, recovery.GetDirtyPageTable().size());
+    EXPECT_EQ(num_pages, recovery.GetNumRedone());
+  }
+  for (page_id_t page_id : page_ids) {
+    auto guard = bpm->FetchPageRead(page_id);
+    EXPECT_EQ(page_id, guard.As<TablePage>()->GetTablePageId());
+  }
+
+  delete bpm;
+  disk_manager->ShutDown();
+  delete disk_manager;
+  remove("test.fsm");
+}
+
+// NOLINTNEXTLINE
+TEST_F(RecoveryTest, ParallelRedoTest) {
+  // Scenario: a chain of table pages is filled with tuples, but only the log reaches the disk before the crash. Redo
+  // with several workers and a buffer pool smaller than the table rebuilds every page, and replaying the log a second
+  // time changes nothing.
+  const int num_pages = 16;
+  const int tuples_per_page = 20;
+  Schema schema({Column{"a", TypeId::INTEGER}});
+  auto *disk_manager = new DiskManager("test.db");
+  std::vector<page_id_t> page_ids;
+  {
+    BufferPoolManagerInstance bpm(num_pages, disk_manager);
+    LogManager log_manager(disk_manager);
+    LogRecord begin(0, INVALID_LSN, LogRecordType::BEGIN);
+    lsn_t prev_lsn = log_manager.AppendLogRecord(&begin);
+    for (int p = 0; p < num_pages; p++) {
+      page_id_t page_id;
+      ASSERT_NE(nullptr, bpm.NewPage(&page_id));
+      // the page stays clean, so it is never written back
+      bpm.UnpinPage(page_id, false);
+      LogRecord new_page(0, prev_lsn, LogRecordType::NEWPAGE, p == 0 ? INVALID_PAGE_ID : page_ids.back(), page_id);
+      prev_lsn = log_manager.AppendLogRecord(&new_page);
+      page_ids.push_back(page_id);
+    }
+    // interleaved across the pages, as concurrent inserts would be
+    for (int i = 0; i < tuples_per_page; i++) {
+      for (int p = 0; p < num_pages; p++) {
+        Tuple tuple({Value(TypeId::INTEGER, p * 1000 + i)}, &schema);
+        LogRecord insert(0, prev_lsn, LogRecordType::INSERT, RID(page_ids[p], i), tuple);
+        prev_lsn = log_manager.AppendLogRecord(&insert);
+      }
+    }
+    LogRecord commit(0, prev_lsn, LogRecordType::COMMIT);
+    log_manager.FlushUntil(log_manager.AppendLogRecord(&commit));
+  }
+
+  auto *bpm = new BufferPoolManagerInstance(num_pages / 4, disk_manager);
+  {
+    LogRecovery recovery(disk_manager, bpm, 4);
+    recovery.Redo();
+    EXPECT_EQ(INVALID_LSN, recovery.GetCheckpointLSN());
+    EXPECT_TRUE(recovery.GetActiveTransactions().empty());
+    EXPECT_EQ(num_pages, recovery.GetDirtyPageTable().size());
+    // every page is initialized, linked to the next one but the last, and filled
+    EXPECT_EQ(num_pages + (num_pages - 1) + num_pages * tuples_per_page, recovery.GetNumRedone());
+  }
+  for (int p = 0; p < num_pages; p++) {
+    auto guard = bpm->FetchPageRead(page_ids[p]);
+    const auto *page = guard.As<TablePage>();
+    EXPECT_EQ(page_ids[p], page->GetTablePageId());
+    EXPECT_EQ(p == 0 ? INVALID_PAGE_ID : page_ids[p - 1], page->GetPrevPageId());
+    EXPECT_EQ(p == num_pages - 1 ? INVALID_PAGE_ID : page_ids[p + 1], page->GetNextPageId());
+    for (int i = 0; i < tuples_per_page; i++) {
+      Tuple tuple;
+      ASSERT_TRUE(page->GetTuple(RID(page_ids[p], i), &tuple, nullptr, nullptr));
+      EXPECT_EQ(p * 1000 + i, tuple.GetValue(&schema, 0).GetAs<int32_t>());
+    }
+  }
+
+  bpm->FlushAllPages();
+  {
+    LogRecovery recovery(disk_manager, bpm, 3);
+    recovery.Redo();
+    EXPECT_EQ(0, recovery.GetNumRedone());
+  }
+
+  delete bpm;
+  disk_manager->ShutDown();
+  delete disk_manager;
+  remove("test.fsm");
+}
+
+// NOLINTNEXTLINE
+TEST_F(RecoveryTest, PageAllocationRecoveryTest) {
+  // Scenario: a page is deleted after a record that stops using it is logged, and new pages are formatted, but only
+  // the log reaches the disk before the crash. The deletion made the log durable first, and redo takes the pages it
+  // replays as allocated, although the file ends before them, so a page allocated after the restart is a new one.
+  const int num_pages = 4;
+  auto *disk_manager = new DiskManager("test.db");
+  std::vector<page_id_t> page_ids;
+  {
+    LogManager log_manager(disk_manager);
+    BufferPoolManagerInstance bpm(8, disk_manager, LRUK_REPLACER_K, &log_manager);
+    LogRecord begin(0, INVALID_LSN, LogRecordType::BEGIN);
+    lsn_t prev_lsn = log_manager.AppendLogRecord(&begin);
+    for (int p = 0; p < num_pages; p++) {
+      page_id_t page_id;
+      ASSERT_NE(nullptr, bpm.NewPage(&page_id));
+      // the page stays clean, so it is never written back
+      bpm.UnpinPage(page_id, false);
+      LogRecord new_page(0, prev_lsn, LogRecordType::NEWPAGE, p == 0 ? INVALID_PAGE_ID : page_ids.back(), page_id);
+      prev_lsn = log_manager.AppendLogRecord(&new_page);
+      page_ids.push_back(page_id);
+    }
+    page_id_t unused_page_id;
+    ASSERT_NE(nullptr, bpm.NewPage(&unused_page_id));
+    bpm.UnpinPage(unused_page_id, false);
+    LogRecord commit(0, prev_lsn, LogRecordType::COMMIT);
+    lsn_t commit_lsn = log_manager.AppendLogRecord(&commit);
+    EXPECT_LT(log_manager.GetPersistentLSN(), commit_lsn);
+    ASSERT_TRUE(bpm.DeletePage(unused_page_id));
+    EXPECT_EQ(commit_lsn, log_manager.GetPersistentLSN());
+    EXPECT_EQ(1, disk_manager->GetNumFreePages());
+  }
+  disk_manager->ShutDown();
+  delete disk_manager;
+
+  disk_manager = new DiskManager("test.db");
+  EXPECT_EQ(0, disk_manager->GetNumPages());
+  auto *bpm = new BufferPoolManagerInstance(8, disk_manager);
+  {
+    LogRecovery recovery(disk_manager, bpm);
+    recovery.Redo();
+    EXPECT_EQ(num_pages + (num_pages - 1), recovery.GetNumRedone());
+  }
+  EXPECT_EQ(page_ids.back() + 1, disk_manager->GetNumPages());
+  page_id_t page_id;
+  ASSERT_NE(nullptr, bpm->NewPage(&page_id));
+  EXPECT_EQ(std::find(page_ids.begin(), page_ids.end(), page_id), page_ids.end());
+  bpm->UnpinPage(page_id, false);
+
+  delete bpm;
+  disk_manager->ShutDown();
+  delete disk_manager;
+  remove("test.fsm");
+}
+
+// NOLINTNEXTLINE
+TEST_F(RecoveryTest, HeaderPageLSNTest) {
+  // Scenario: a new B+ tree registers its root in the header page. The header page carries the LSN of the record
+  // logged for it, so writing it back forces the log up to that record first, and redo after a clean shutdown finds
+  // nothing to replay on it.
+  auto key_schema = ParseCreateStatement("a bigint");
+  GenericComparator<8> comparator(key_schema.get());
+  auto *disk_manager = new DiskManager("test.db");
+  {
+    LogManager log_manager(disk_manager);
+    BufferPoolManagerInstance bpm(16, disk_manager, LRUK_REPLACER_K, &log_manager);
+    page_id_t header_page_id;
+    ASSERT_NE(nullptr, bpm.NewPage(&header_page_id));
+    bpm.UnpinPage(header_page_id, true);
+    bpm.FlushPage(header_page_id);
+
+    log_manager.RunFlushThread();
+    BPlusTree<GenericKey<8>, RID, GenericComparator<8>> tree("foo_pk", &bpm, comparator, 16, 16, &log_manager);
+    Transaction txn(0);
+    GenericKey<8> index_key;
+    index_key.SetFromInteger(42);
+    ASSERT_TRUE(tree.Insert(index_key, RID(0, 42), &txn));
+    lsn_t header_lsn;
+    {
+      auto guard = bpm.FetchPageRead(HEADER_PAGE_ID);
+      header_lsn = const_cast<Page *>(guard.As<Page>())->GetLSN();  // NOLINT
+    }
+    EXPECT_NE(INVALID_LSN, header_lsn);
+    EXPECT_LT(header_lsn, log_manager.GetNextLSN());
+    bpm.FlushPage(HEADER_PAGE_ID);
+    EXPECT_GE(log_manager.GetPersistentLSN(), header_lsn);
+    bpm.FlushAllPages();
+    log_manager.StopFlushThread();
+  }
+
+  auto *bpm = new BufferPoolManagerInstance(16, disk_manager);
+  {
+    LogRecovery recovery(disk_manager, bpm);
+    recovery.Redo();
+    EXPECT_EQ(0, recovery.GetNumRedone());
+  }
+  page_id_t root_page_id;
+  auto *header_page = reinterpret_cast<HeaderPage *>(bpm->FetchPage(HEADER_PAGE_ID));
+  EXPECT_TRUE(header_page->GetRootId("foo_pk", &root_page_id));
+  EXPECT_EQ(1, header_page->GetRecordCount());
+  bpm->UnpinPage(HEADER_PAGE_ID, false);
+
+  delete bpm;
+  disk_manager->ShutDown();
+  delete disk_manager;
+  remove("test.fsm");
+}
+
+// NOLINTNEXTLINE
+TEST_F(RecoveryTest, IndexRecoveryTest) {
+  // Scenario: a B+ tree grows and shrinks through splits, merges and redistributions, then a transaction that never
+  // ends changes one of its leaves, and only the log reaches the disk before the crash. Redo rebuilds every page of
+  // the tree and its root in the header page, and undo rolls the unfinished transaction back with CLRs, which are
+  // all it takes to roll it back again after another crash.
+  using LeafPage = BPlusTreeLeafPage<GenericKey<8>, RID, GenericComparator<8>>;
+  using InternalPage = BPlusTreeInternalPage<GenericKey<8>, page_id_t, GenericComparator<8>>;
+  auto key_schema = ParseCreateStatement("a bigint");
+  GenericComparator<8> comparator(key_schema.get());
+  auto make_key = [](int64_t key) {
+    GenericKey<8> index_key;
+    index_key.SetFromInteger(key);
+    return index_key;
+  };
+  auto *disk_manager = new DiskManager("test.db");
+  {
+    BufferPoolManagerInstance bpm(64, disk_manager);
+    LogManager log_manager(disk_manager);
+    page_id_t header_page_id;
+    ASSERT_NE(nullptr, bpm.NewPage(&header_page_id));
+    ASSERT_EQ(HEADER_PAGE_ID, header_page_id);
+    bpm.UnpinPage(header_page_id, true);
+    // the index isn't registered in the header page on disk
+    bpm.FlushPage(header_page_id);
+
+    log_manager.RunFlushThread();
+    BPlusTree<GenericKey<8>, RID, GenericComparator<8>> tree("foo_pk", &bpm, comparator, 16, 16, &log_manager);
+    Transaction winner(0);
+    for (int64_t key = 0; key < 400; key += 2) {
+      ASSERT_TRUE(tree.Insert(make_key(key), RID(0, static_cast<uint32_t>(key)), &winner));
+    }
+    for (int64_t key = 200; key < 300; key += 2) {
+      tree.Remove(make_key(key), &winner);
+    }
+    LogRecord commit(0, winner.GetPrevLSN(), LogRecordType::COMMIT);
+    log_manager.AppendLogRecord(&commit);
+
+    // neither split nor merge the first leaf, keys 0 to 14
+    Transaction loser(1);
+    ASSERT_TRUE(tree.Insert(make_key(11), RID(0, 11), &loser));
+    ASSERT_TRUE(tree.Insert(make_key(13), RID(0, 13), &loser));
+    tree.Remove(make_key(12), &loser);
+    log_manager.StopFlushThread();
+  }
+
+  auto *bpm = new BufferPoolManagerInstance(16, disk_manager);
+  {
+    LogManager log_manager(disk_manager);
+    LogRecovery recovery(disk_manager, bpm, RECOVERY_REDO_WORKERS, &log_manager);
+    recovery.Redo();
+    EXPECT_EQ(1, recovery.GetActiveTransactions().size());
+    EXPECT_EQ(1, recovery.GetActiveTransactions().count(1));
+    EXPECT_LT(0, recovery.GetNumRedone());
+    recovery.Undo();
+    EXPECT_TRUE(recovery.GetActiveTransactions().empty());
+  }
+  // another crash, the CLRs redo the rollback on the leaf if it missed it
+  delete bpm;
+  bpm = new BufferPoolManagerInstance(16, disk_manager);
+  {
+    LogRecovery recovery(disk_manager, bpm);
+    recovery.Redo();
+    EXPECT_TRUE(recovery.GetActiveTransactions().empty());
+  }
+
+  page_id_t root_page_id;
+  auto *header_page = reinterpret_cast<HeaderPage *>(bpm->FetchPage(HEADER_PAGE_ID));
+  ASSERT_TRUE(header_page->GetRootId("foo_pk", &root_page_id));
+  bpm->UnpinPage(HEADER_PAGE_ID, false);
+  auto find = [&](int64_t key) {
+    page_id_t page_id = root_page_id;
+    while (true) {
+      auto guard = bpm->FetchPageRead(page_id);
+      if (!guard.As<BPlusTreePage>()->IsLeafPage()) {
+        page_id = guard.As<InternalPage>()->Lookup(make_key(key), comparator);
+        continue;
+      }
+      RID rid;
+      return guard.As<LeafPage>()->Lookup(make_key(key), &rid, comparator) && rid.GetSlotNum() == key;
+    }
+  };
+  std::vector<int64_t> expected;
+  for (int64_t key = 0; key < 400; key++) {
+    bool present = key % 2 == 0 && (key < 200 || key >= 300);
+    EXPECT_EQ(present, find(key)) << "key " << key;
+    if (present) {
+      expected.push_back(key);
+    }
+  }
+  // the leaves are linked in key order
+  page_id_t page_id = root_page_id;
+  while (true) {
+    auto guard = bpm->FetchPageRead(page_id);
+    if (guard.As<BPlusTreePage>()->IsLeafPage()) {
+      break;
+    }
+    page_id = guard.As<InternalPage>()->ValueAt(0);
+  }
+  std::vector<int64_t> keys;
+  while (page_id != INVALID_PAGE_ID) {
+    auto guard = bpm->FetchPageRead(page_id);
+    const auto *leaf = guard.As<LeafPage>();
+    for (int i = 0; i < leaf->GetSize(); i++) {
+      keys.push_back(leaf->ValueAt(i).GetSlotNum());
+    }
+    page_id = leaf->GetNextPageId();
+  }
+  EXPECT_EQ(expected, keys);
+
+  delete bpm;
+  disk_manager->ShutDown();
+  delete disk_manager;
+  remove("test.fsm");
+}
+
+// NOLINTNEXTLINE
+TEST_F(RecoveryTest, IndexStructureModificationTest) {
+  // Scenario: a leaf splits into a new root, then merges back into a leaf root. Each structure modification is logged
+  // as a single record, and every page it changed carries the LSN of that record, so no page reaches the disk with
+  // some of the changes while the log may miss the others. Only one of the pages is written back after each of them
+  // before the crash, and redo finishes the rest: every key is reachable through the root in the header page.
+  using LeafPage = BPlusTreeLeafPage<GenericKey<8>, RID, GenericComparator<8>>;
+  using InternalPage = BPlusTreeInternalPage<GenericKey<8>, page_id_t, GenericComparator<8>>;
+  auto key_schema = ParseCreateStatement("a bigint");
+  GenericComparator<8> comparator(key_schema.get());
+  auto make_key = [](int64_t key) {
+    GenericKey<8> index_key;
+    index_key.SetFromInteger(key);
+    return index_key;
+  };
+  auto page_lsn = [](BufferPoolManager *bpm, page_id_t page_id) {
+    auto guard = bpm->FetchPageRead(page_id);
+    return const_cast<Page *>(guard.As<Page>())->GetLSN();  // NOLINT
+  };
+  auto root_page_id = [](BufferPoolManager *bpm) {
+    page_id_t page_id = INVALID_PAGE_ID;
+    auto *header_page = reinterpret_cast<HeaderPage *>(bpm->FetchPage(HEADER_PAGE_ID));
+    EXPECT_TRUE(header_page->GetRootId("foo_pk", &page_id));
+    bpm->UnpinPage(HEADER_PAGE_ID, false);
+    return page_id;
+  };
+  auto *disk_manager = new DiskManager("test.db");
+  {
+    LogManager log_manager(disk_manager);
+    BufferPoolManagerInstance bpm(16, disk_manager, LRUK_REPLACER_K, &log_manager);
+    page_id_t header_page_id;
+    ASSERT_NE(nullptr, bpm.NewPage(&header_page_id));
+    bpm.UnpinPage(header_page_id, true);
+    bpm.FlushPage(header_page_id);
+
+    log_manager.RunFlushThread();
+    BPlusTree<GenericKey<8>, RID, GenericComparator<8>> tree("foo_pk", &bpm, comparator, 4, 4, &log_manager);
+    Transaction txn(0);
+    for (int64_t key : {0, 10, 20}) {
+      ASSERT_TRUE(tree.Insert(make_key(key), RID(0, static_cast<uint32_t>(key)), &txn));
+    }
+    bpm.FlushAllPages();
+
+    // [0, 10, 20, 30] splits into [0, 10] and [20, 30] under a new root
+    ASSERT_TRUE(tree.Insert(make_key(30), RID(0, 30), &txn));
+    page_id_t root = root_page_id(&bpm);
+    page_id_t left;
+    page_id_t right;
+    {
+      auto guard = bpm.FetchPageRead(root);
+      ASSERT_FALSE(guard.As<BPlusTreePage>()->IsLeafPage());
+      left = guard.As<InternalPage>()->ValueAt(0);
+      right = guard.As<InternalPage>()->ValueAt(1);
+    }
+    lsn_t split_lsn = page_lsn(&bpm, root);
+    EXPECT_EQ(split_lsn, page_lsn(&bpm, left));
+    EXPECT_EQ(split_lsn, page_lsn(&bpm, right));
+    EXPECT_EQ(split_lsn, page_lsn(&bpm, HEADER_PAGE_ID));
+    // the split leaf alone is written back, the log is forced up to the whole split first
+    bpm.FlushPage(left);
+    EXPECT_GE(log_manager.GetPersistentLSN(), split_lsn);
+
+    // [30] underflows and merges into [0, 10], which becomes the root again
+    tree.Remove(make_key(20), &txn);
+    EXPECT_EQ(left, root_page_id(&bpm));
+    lsn_t merge_lsn = page_lsn(&bpm, left);
+    EXPECT_LT(split_lsn, merge_lsn);
+    EXPECT_EQ(merge_lsn, page_lsn(&bpm, HEADER_PAGE_ID));
+    // the header page alone is written back, naming a root that misses the merge on disk
+    bpm.FlushPage(HEADER_PAGE_ID);
+    EXPECT_GE(log_manager.GetPersistentLSN(), merge_lsn);
+
+    LogRecord commit(0, txn.GetPrevLSN(), LogRecordType::COMMIT);
+    log_manager.AppendLogRecord(&commit);
+    log_manager.StopFlushThread();
+  }
+
+  auto *bpm = new BufferPoolManagerInstance(16, disk_manager);
+  {
+    LogRecovery recovery(disk_manager, bpm);
+    recovery.Redo();
+    EXPECT_TRUE(recovery.GetActiveTransactions().empty());
+  }
+  page_id_t page_id = root_page_id(bpm);
+  {
+    auto guard = bpm->FetchPageRead(page_id);
+    ASSERT_TRUE(guard.As<BPlusTreePage>()->IsLeafPage());
+    const auto *leaf = guard.As<LeafPage>();
+    std::vector<int64_t> keys;
+    for (int i = 0; i < leaf->GetSize(); i++) {
+      keys.push_back(leaf->ValueAt(i).GetSlotNum());
+    }
+    EXPECT_EQ((std::vector<int64_t>{0, 10, 30}), keys);
+    EXPECT_EQ(INVALID_PAGE_ID, leaf->GetNextPageId());
+  }
+
+  delete bpm;
+  disk_manager->ShutDown();
+  delete disk_manager;
+  remove("test.fsm");
+}
+
+// NOLINTNEXTLINE
+TEST_F(RecoveryTest, IndexUndoByKeyTest) {
+  // Scenario: a transaction that never ends inserts a key that its own split moves to a new leaf, and removes a key
+  // whose leaf is merged with that one. Another transaction then splits the merged leaf again, so both keys belong to
+  // leaves other than the one their records name. Undo looks them up through the tree: the key inserted is removed
+  // and the key removed goes back in order, and the CLRs name the leaves actually changed.
+  using LeafPage = BPlusTreeLeafPage<GenericKey<8>, RID, GenericComparator<8>>;
+  using InternalPage = BPlusTreeInternalPage<GenericKey<8>, page_id_t, GenericComparator<8>>;
+  using Tree = BPlusTree<GenericKey<8>, RID, GenericComparator<8>>;
+  auto key_schema = ParseCreateStatement("a bigint");
+  GenericComparator<8> comparator(key_schema.get());
+  auto make_key = [](int64_t key) {
+    GenericKey<8> index_key;
+    index_key.SetFromInteger(key);
+    return index_key;
+  };
+  // the keys in the leaves, in the order they are linked
+  auto leaf_keys = [](BufferPoolManager *bpm) {
+    page_id_t page_id;
+    auto *header_page = reinterpret_cast<HeaderPage *>(bpm->FetchPage(HEADER_PAGE_ID));
+    EXPECT_TRUE(header_page->GetRootId("foo_pk", &page_id));
+    bpm->UnpinPage(HEADER_PAGE_ID, false);
+    while (true) {
+      auto guard = bpm->FetchPageRead(page_id);
+      if (guard.As<BPlusTreePage>()->IsLeafPage()) {
+        break;
+      }
+      page_id = guard.As<InternalPage>()->ValueAt(0);
+    }
+    std::vector<int64_t> keys;
+    while (page_id != INVALID_PAGE_ID) {
+      auto guard = bpm->FetchPageRead(page_id);
+      const auto *leaf = guard.As<LeafPage>();
+      for (int i = 0; i < leaf->GetSize(); i++) {
+        keys.push_back(leaf->ValueAt(i).GetSlotNum());
+      }
+      page_id = leaf->GetNextPageId();
+    }
+    return keys;
+  };
+  auto *disk_manager = new DiskManager("test.db");
+  {
+    BufferPoolManagerInstance bpm(64, disk_manager);
+    LogManager log_manager(disk_manager);
+    page_id_t header_page_id;
+    ASSERT_NE(nullptr, bpm.NewPage(&header_page_id));
+    bpm.UnpinPage(header_page_id, true);
+    bpm.FlushPage(header_page_id);
+
+    log_manager.RunFlushThread();
+    Tree tree("foo_pk", &bpm, comparator, 4, 4, &log_manager);
+    Transaction winner(0);
+    Transaction loser(1);
+    for (int64_t key : {0, 20, 40}) {
+      ASSERT_TRUE(tree.Insert(make_key(key), RID(0, static_cast<uint32_t>(key)), &winner));
+    }
+    // [0, 20, 30, 40] splits, 30 moves to the new leaf
+    ASSERT_TRUE(tree.Insert(make_key(30), RID(0, 30), &loser));
+    // [0] underflows and takes [30, 40] in
+    tree.Remove(make_key(20), &loser);
+    // the first leaf ends up with [0, 1], 30 and 40 on a leaf of their own
+    for (int64_t key : {1, 2, 3}) {
+      ASSERT_TRUE(tree.Insert(make_key(key), RID(0, static_cast<uint32_t>(key)), &winner));
+    }
+    LogRecord commit(0, winner.GetPrevLSN(), LogRecordType::COMMIT);
+    log_manager.AppendLogRecord(&commit);
+    log_manager.StopFlushThread();
+  }
+
+  auto *bpm = new BufferPoolManagerInstance(16, disk_manager);
+  {
+    LogManager log_manager(disk_manager);
+    LogRecovery recovery(disk_manager, bpm, RECOVERY_REDO_WORKERS, &log_manager);
+    recovery.Redo();
+    EXPECT_EQ(1, recovery.GetActiveTransactions().count(1));
+    Tree tree("foo_pk", bpm, comparator, 4, 4, &log_manager);
+    recovery.RegisterIndex("foo_pk", &tree);
+    recovery.Undo();
+    EXPECT_TRUE(recovery.GetActiveTransactions().empty());
+
+    std::vector<RID> result;
+    EXPECT_FALSE(tree.GetValue(make_key(30), &result));
+    ASSERT_TRUE(tree.GetValue(make_key(20), &result));
+    EXPECT_EQ(20, result[0].GetSlotNum());
+  }
+  EXPECT_EQ((std::vector<int64_t>{0, 1, 2, 3, 20, 40}), leaf_keys(bpm));
+
+  // another crash, the CLRs redo the rollback on the leaves it was made on
+  delete bpm;
+  bpm = new BufferPoolManagerInstance(16, disk_manager);
+  {
+    LogRecovery recovery(disk_manager, bpm);
+    recovery.Redo();
+    EXPECT_TRUE(recovery.GetActiveTransactions().empty());
+  }
+  EXPECT_EQ((std::vector<int64_t>{0, 1, 2, 3, 20, 40}), leaf_keys(bpm));
+
+  delete bpm;
+  disk_manager->ShutDown();
+  delete disk_manager;
+  remove("test.fsm");
+}
+
+// NOLINTNEXTLINE
+TEST_F(RecoveryTest, UpdateDeltaTest) {
+  // Scenario: a wide tuple is updated twice, first in a single integer column, then in a varchar column that grows.
+  // The UPDATE records only carry the chunks that changed, and redo rebuilds the new tuples from the page.
+  std::vector<Column> columns;
+  for (int i = 0; i < 32; i++) {
+    columns.emplace_back("c" + std::to_string(i), TypeId::INTEGER);
+  }
+  columns.emplace_back("s", TypeId::VARCHAR, 64);
+  Schema schema(columns);
+  auto make_tuple = [&](int32_t changed, const std::string &text) {
+    std::vector<Value> values;
+    for (int32_t i = 0; i < 32; i++) {
+      values.emplace_back(TypeId::INTEGER, i == 7 ? changed : i);
+    }
+    values.emplace_back(TypeId::VARCHAR, text);
+    return Tuple(values, &schema);
+  };
+  auto same = [](const Tuple &a, const Tuple &b) {
+    return a.GetLength() == b.GetLength() && memcmp(a.GetData(), b.GetData(), a.GetLength()) == 0;
+  };
+  Tuple original = make_tuple(7, "short");
+  Tuple first = make_tuple(70000, "short");
+  Tuple second = make_tuple(70000, "a rather longer string");
+
+  LogRecord one_column(0, INVALID_LSN, LogRecordType::UPDATE, RID(1, 0), original, first);
+  // the header, the rid, both sizes, the chunk bitmap, and the old and new bytes of a single chunk
+  size_t num_chunks = (original.GetLength() + 3) / 4;
+  EXPECT_EQ(LogRecord::HEADER_SIZE + sizeof(RID) + 8 + (num_chunks + 7) / 8 + 8, one_column.GetSize());
+  EXPECT_TRUE(same(first, one_column.ApplyUpdate(original)));
+  EXPECT_TRUE(same(original, one_column.RevertUpdate(first)));
+  LogRecord grow(0, INVALID_LSN, LogRecordType::UPDATE, RID(1, 0), first, second);
+  EXPECT_TRUE(same(second, grow.ApplyUpdate(first)));
+  EXPECT_TRUE(same(first, grow.RevertUpdate(second)));
+
+  auto *disk_manager = new DiskManager("test.db");
+  page_id_t page_id;
+  {
+    BufferPoolManagerInstance bpm(4, disk_manager);
+    LogManager log_manager(disk_manager);
+    ASSERT_NE(nullptr, bpm.NewPage(&page_id));
+    bpm.UnpinPage(page_id, false);
+    LogRecord begin(0, INVALID_LSN, LogRecordType::BEGIN);
+    lsn_t prev_lsn = log_manager.AppendLogRecord(&begin);
+    LogRecord new_page(0, prev_lsn, LogRecordType::NEWPAGE, INVALID_PAGE_ID, page_id);
+    prev_lsn = log_manager.AppendLogRecord(&new_page);
+    LogRecord insert(0, prev_lsn, LogRecordType::INSERT, RID(page_id, 0), original);
+    prev_lsn = log_manager.AppendLogRecord(&insert);
+    LogRecord update(0, prev_lsn, LogRecordType::UPDATE, RID(page_id, 0), original, first);
+    prev_lsn = log_manager.AppendLogRecord(&update);
+    LogRecord update_again(0, prev_lsn, LogRecordType::UPDATE, RID(page_id, 0), first, second);
+    prev_lsn = log_manager.AppendLogRecord(&update_again);
+    LogRecord commit(0, prev_lsn, LogRecordType::COMMIT);
+    log_manager.FlushUntil(log_manager.AppendLogRecord(&commit));
+  }
+
+  auto *bpm = new BufferPoolManagerInstance(4, disk_manager);
+  {
+    LogRecovery recovery(disk_manager, bpm);
+    recovery.Redo();
+    EXPECT_EQ(4, recovery.GetNumRedone());
+  }
+  {
+    auto guard = bpm->FetchPageRead(page_id);
+    Tuple tuple;
+    ASSERT_TRUE(guard.As<TablePage>()->GetTuple(RID(page_id, 0), &tuple, nullptr, nullptr));
+    EXPECT_TRUE(same(second, tuple));
+    EXPECT_EQ(70000, tuple.GetValue(&schema, 7).GetAs<int32_t>());
+    EXPECT_EQ("a rather longer string", tuple.GetValue(&schema, 32).ToString());
+  }
+
+  delete bpm;
+  disk_manager->ShutDown();
+  delete disk_manager;
+  remove("test.fsm");
+}
+
+// NOLINTNEXTLINE
+TEST_F(RecoveryTest, TornLogBlockTest) {
+  // Scenario: the log is flushed in three blocks, with and without compression, and a crash tears the write of the
+  // last one. Recovery reads the first two and stops cleanly at the torn one, as if it had never been written, so the
+  // transaction that committed in it is a loser. The log is cut short there, so that the records appended after the
+  // restart are read by the next recovery.
+  const txn_id_t long_txn = 100;
+  std::vector<size_t> log_sizes;
+  for (bool compress : {false, true}) {
+    RemoveFiles();
+    auto *disk_manager = new DiskManager("test.db");
+    {
+      LogManager log_manager(disk_manager, std::chrono::microseconds(0), LOG_GROUP_COMMIT_MAX_BATCH, compress);
+      for (int block = 0; block < 3; block++) {
+        for (txn_id_t txn_id = 20 * block; txn_id < 20 * block + 20; txn_id++) {
+          LogRecord begin(txn_id, INVALID_LSN, LogRecordType::BEGIN);
+          LogRecord commit(txn_id, log_manager.AppendLogRecord(&begin), LogRecordType::COMMIT);
+          log_manager.AppendLogRecord(&commit);
+        }
+        if (block == 1) {
+          LogRecord begin(long_txn, INVALID_LSN, LogRecordType::BEGIN);
+          log_manager.AppendLogRecord(&begin);
+        } else if (block == 2) {
+          LogRecord commit(long_txn, INVALID_LSN, LogRecordType::COMMIT);
+          log_manager.AppendLogRecord(&commit);
+        }
+        log_manager.Flush();
+      }
+    }
+    EXPECT_EQ(3, disk_manager->GetNumFlushes());
+    log_sizes.push_back(disk_manager->GetLogEndOffset());
+    {
+      LogRecovery recovery(disk_manager, nullptr);
+      recovery.Analyze();
+      EXPECT_TRUE(recovery.GetActiveTransactions().empty());
+    }
+
+    // the end of the last block never made it to disk
+    {
+      std::fstream log_file("test.log", std::ios::binary | std::ios::in | std::ios::out);
+      log_file.seekp(static_cast<std::streamoff>(disk_manager->GetLogEndOffset() - 8));
+      const char zeroes[8] = {};
+      log_file.write(zeroes, sizeof(zeroes));
+    }
+    {
+      LogRecovery recovery(disk_manager, nullptr);
+      recovery.Analyze();
+      ASSERT_EQ(1, recovery.GetActiveTransactions().size());
+      EXPECT_EQ(1, recovery.GetActiveTransactions().count(long_txn));
+    }
+    // the log goes on where the torn block started, and the commit logged after the restart is found again
+    EXPECT_LT(disk_manager->GetLogEndOffset(), log_sizes.back());
+    {
+      LogManager log_manager(disk_manager);
+      LogRecord commit(long_txn, INVALID_LSN, LogRecordType::COMMIT);
+      log_manager.FlushUntil(log_manager.AppendLogRecord(&commit));
+    }
+    {
+      LogRecovery recovery(disk_manager, nullptr);
+      recovery.Analyze();
+      EXPECT_TRUE(recovery.GetActiveTransactions().empty());
+    }
+    disk_manager->ShutDown();
+    delete disk_manager;
+    remove("test.fsm");
+  }
+  // BEGIN and COMMIT records are mostly zeroes
+  EXPECT_LT(log_sizes[1], log_sizes[0] / 2);
+}
+
+// NOLINTNEXTLINE
+TEST_F(RecoveryTest, CompensationTest) {
+  // Scenario: two transactions interleave inserts, a delete and an update on a table page, and never end. An earlier
+  // recovery crashed after undoing the last insert of the second one, leaving a CLR for it. Undo rolls back both
+  // transactions at once, reading their records backwards through the block cache, skips the insert compensated
+  // already, and ends them with CLRs and ABORT records. Another crash before the pages are written loses nothing.
+  Schema schema({Column("a", TypeId::INTEGER), Column("s", TypeId::VARCHAR, 16)});
+  auto make_tuple = [&](int32_t a, const std::string &text) {
+    return Tuple({Value(TypeId::INTEGER, a), Value(TypeId::VARCHAR, text)}, &schema);
+  };
+  auto same = [](const Tuple &a, const Tuple &b) {
+    return a.GetLength() == b.GetLength() && memcmp(a.GetData(), b.GetData(), a.GetLength()) == 0;
+  };
+  Tuple a = make_tuple(1, "a");
+  Tuple b = make_tuple(2, "b");
+  Tuple updated = make_tuple(10, "a longer string");
+
+  auto *disk_manager = new DiskManager("test.db");
+  page_id_t page_id;
+  {
+    BufferPoolManagerInstance bpm(4, disk_manager);
+    LogManager log_manager(disk_manager);
+    ASSERT_NE(nullptr, bpm.NewPage(&page_id));
+    bpm.UnpinPage(page_id, false);
+    std::unordered_map<txn_id_t, lsn_t> prev_lsn;
+    auto prev = [&](txn_id_t txn_id) { return prev_lsn.count(txn_id) == 0 ? INVALID_LSN : prev_lsn[txn_id]; };
+    auto append = [&](LogRecord record) { return prev_lsn[record.GetTxnId()] = log_manager.AppendLogRecord(&record); };
+    append(LogRecord(0, prev(0), LogRecordType::BEGIN));
+    append(LogRecord(0, prev(0), LogRecordType::NEWPAGE, INVALID_PAGE_ID, page_id));
+    append(LogRecord(0, prev(0), LogRecordType::INSERT, RID(page_id, 0), a));
+    append(LogRecord(0, prev(0), LogRecordType::INSERT, RID(page_id, 1), b));
+    append(LogRecord(0, prev(0), LogRecordType::COMMIT));
+    log_manager.Flush();
+
+    append(LogRecord(1, prev(1), LogRecordType::BEGIN));
+    append(LogRecord(2, prev(2), LogRecordType::BEGIN));
+    append(LogRecord(1, prev(1), LogRecordType::INSERT, RID(page_id, 2), make_tuple(3, "c")));
+    lsn_t mark_delete = append(LogRecord(2, prev(2), LogRecordType::MARKDELETE, RID(page_id, 1), b));
+    log_manager.Flush();
+    append(LogRecord(1, prev(1), LogRecordType::UPDATE, RID(page_id, 0), a, updated));
+    append(LogRecord(2, prev(2), LogRecordType::INSERT, RID(page_id, 3), make_tuple(4, "d")));
+    LogRecord apply_delete(2, prev(2), LogRecordType::APPLYDELETE, RID(page_id, 3), make_tuple(4, "d"));
+    append(LogRecord(apply_delete, mark_delete));
+    log_manager.Flush();
+  }
+
+  auto check_page = [&](BufferPoolManager *bpm) {
+    auto guard = bpm->FetchPageRead(page_id);
+    const auto *table_page = guard.As<TablePage>();
+    Tuple tuple;
+    ASSERT_TRUE(table_page->GetTuple(RID(page_id, 0), &tuple, nullptr, nullptr));
+    EXPECT_TRUE(same(a, tuple));
+    ASSERT_TRUE(table_page->GetTuple(RID(page_id, 1), &tuple, nullptr, nullptr));
+    EXPECT_TRUE(same(b, tuple));
+    // the slots of the tuples inserted are left empty
+    EXPECT_FALSE(table_page->GetTuple(RID(page_id, 2), &tuple, nullptr, nullptr));
+    EXPECT_FALSE(table_page->GetTuple(RID(page_id, 3), &tuple, nullptr, nullptr));
+  };
+
+  auto *bpm = new BufferPoolManagerInstance(4, disk_manager);
+  lsn_t next_lsn;
+  {
+    LogManager log_manager(disk_manager);
+    LogRecovery recovery(disk_manager, bpm, 2, &log_manager);
+    recovery.Redo();
+    EXPECT_EQ(2, recovery.GetActiveTransactions().size());
+    recovery.Undo();
+    EXPECT_TRUE(recovery.GetActiveTransactions().empty());
+    next_lsn = log_manager.GetNextLSN();
+    // the records of both transactions but the CLR, and the insert it skips
+    EXPECT_EQ(6, recovery.GetNumUndone());
+    // two blocks read, the other records are found in them
+    EXPECT_EQ(std::make_pair(size_t{2}, size_t{4}), recovery.GetNumLogBlockReads());
+  }
+  check_page(bpm);
+
+  std::vector<char> log = ReadRecords(disk_manager, disk_manager->GetLogStartOffset());
+  std::unordered_map<txn_id_t, std::vector<LogRecordType>> compensations;
+  std::unordered_map<txn_id_t, int> aborts;
+  LogRecord record;
+  for (size_t pos = 0; LogRecovery::DeserializeLogRecord(log.data() + pos, log.size() - pos, &record);
+       pos += record.GetSize()) {
+    if (record.GetLogRecordType() == LogRecordType::CLR) {
+      compensations[record.GetTxnId()].push_back(record.GetCompensationType());
+    } else if (record.GetLogRecordType() == LogRecordType::ABORT) {
+      aborts[record.GetTxnId()]++;
+    }
+  }
+  EXPECT_EQ((std::vector<LogRecordType>{LogRecordType::UPDATE, LogRecordType::APPLYDELETE}), compensations[1]);
+  EXPECT_EQ((std::vector<LogRecordType>{LogRecordType::APPLYDELETE, LogRecordType::ROLLBACKDELETE}),
+            compensations[2]);
+  EXPECT_EQ(1, aborts[1]);
+  EXPECT_EQ(1, aborts[2]);
+
+  // the CLRs redo the rollback on the page, and nothing is left to undo
+  delete bpm;
+  bpm = new BufferPoolManagerInstance(4, disk_manager);
+  {
+    LogManager log_manager(disk_manager);
+    LogRecovery recovery(disk_manager, bpm, 2, &log_manager);
+    recovery.Redo();
+    EXPECT_TRUE(recovery.GetActiveTransactions().empty());
+    EXPECT_EQ(11, recovery.GetNumRedone());
+    // new records follow the ones of the log even though there is nothing to undo
+    EXPECT_EQ(next_lsn, log_manager.GetNextLSN());
+    recovery.Undo();
+    EXPECT_EQ(0, recovery.GetNumUndone());
+  }
+  check_page(bpm);
+
+  delete bpm;
+  disk_manager->ShutDown();
+  delete disk_manager;
+  remove("test.fsm");
+}
 }  // namespace bustub
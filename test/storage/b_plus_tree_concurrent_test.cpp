@@ -10,13 +10,16 @@
 //
 //===----------------------------------------------------------------------===//
 
+#include <atomic>
 #include <chrono>  // NOLINT
 #include <cstdio>
 #include <functional>
 #include <thread>  // NOLINT
+#include <vector>
 
 #include "buffer/buffer_pool_manager_instance.h"
 #include "gtest/gtest.h"
+#include "storage/disk/disk_manager_memory.h"
 #include "storage/index/b_plus_tree.h"
 #include "test_util.h"  // NOLINT
 
@@ -333,4 +336,59 @@ TEST(BPlusTreeConcurrentTest, DISABLED_MixTest) {
   remove("test.log");
 }
 
+// NOLINTNEXTLINE
+TEST(BPlusTreeConcurrentTest, ScanWhileMergingTest) {
+  auto key_schema = ParseCreateStatement("a bigint");
+  GenericComparator<8> comparator(key_schema.get());
+  auto *disk_manager = new DiskManagerUnlimitedMemory();
+  BufferPoolManager *bpm = new BufferPoolManagerInstance(64, disk_manager);
+  // small pages, so that the churn splits and merges leaves all the time and their pages get reused
+  BPlusTree<GenericKey<8>, RID, GenericComparator<8>> tree("foo_pk", bpm, comparator, 4, 4);
+  page_id_t page_id;
+  bpm->NewPage(&page_id);
+  const int64_t num_keys = 2000;
+  std::vector<int64_t> stable_keys;
+  std::vector<int64_t> churn_keys;
+  for (int64_t key = 0; key < num_keys; key++) {
+    (key % 4 == 0 ? stable_keys : churn_keys).push_back(key);
+  }
+  InsertHelper(&tree, stable_keys);
+
+  // Scenario: Scans running while leaves are split, merged and freed see every key that stays in the tree, in order,
+  // and nothing else: a scan never follows the link of a leaf into a page that was freed and reused meanwhile.
+  std::atomic<bool> done{false};
+  std::thread churner([&] {
+    for (int round = 0; round < 5; round++) {
+      InsertHelper(&tree, churn_keys);
+      DeleteHelper(&tree, churn_keys);
+    }
+    done = true;
+  });
+  auto scan = [&](int64_t start_key) {
+    while (!done) {
+      GenericKey<8> index_key;
+      index_key.SetFromInteger(start_key);
+      int64_t previous = -1;
+      int64_t num_stable = 0;
+      for (auto iterator = tree.Begin(index_key); iterator != tree.End(); ++iterator) {
+        int64_t key = (*iterator).second.GetSlotNum();
+        ASSERT_LT(previous, key);
+        ASSERT_LE(start_key, key);
+        previous = key;
+        num_stable += key % 4 == 0 ? 1 : 0;
+      }
+      ASSERT_EQ((num_keys + 3) / 4 - (start_key + 3) / 4, num_stable);
+    }
+  };
+  std::thread scanner(scan, 0);
+  std::thread range_scanner(scan, num_keys / 2 + 1);
+  churner.join();
+  scanner.join();
+  range_scanner.join();
+
+  bpm->UnpinPage(HEADER_PAGE_ID, true);
+  delete bpm;
+  delete disk_manager;
+}
+
 }  // namespace bustub
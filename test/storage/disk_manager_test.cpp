@@ -10,11 +10,32 @@
 //
 //===----------------------------------------------------------------------===//
 
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>  // NOLINT
+#include <csignal>
+#include <cstdint>
 #include <cstring>
+#include <mutex>  // NOLINT
+#include <random>
+#include <string>
+#include <thread>  // NOLINT
+#include <utility>
+#include <vector>
 
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "buffer/frame_arena.h"
 #include "common/exception.h"
 #include "gtest/gtest.h"
 #include "storage/disk/disk_manager.h"
+#include "storage/disk/disk_manager_memory.h"
+#include "storage/disk/disk_manager_mmap.h"
+#include "storage/disk/disk_manager_uring.h"
+#include "storage/page/page.h"
 
 namespace bustub {
 
@@ -24,12 +45,14 @@ class DiskManagerTest : public ::testing::Test {
   void SetUp() override {
     remove("test.db");
     remove("test.log");
+    remove("test.fsm");
   }
 
   // This function is called after every test.
   void TearDown() override {
     remove("test.db");
     remove("test.log");
+    remove("test.fsm");
   };
 };
 
@@ -72,6 +95,444 @@ TEST_F(DiskManagerTest, ReadWriteLogTest) {
   dm.ShutDown();
 }
 
+// NOLINTNEXTLINE
+TEST_F(DiskManagerTest, LogSegmentTest) {
+  // Scenario: the log spans several small segments. Reads cross segment boundaries, a reopened disk manager finds
+  // the end of the log again, and truncation deletes whole segments before an offset but never the last one.
+  std::string db_file("test.db");
+  DiskManagerOptions options;
+  options.log_segment_size_ = 100;
+  // WriteLog() insists on alternating buffers, as the log manager swaps them
+  char buffers[2][64];
+  std::vector<char> expected;
+  {
+    DiskManager dm(db_file, options);
+    for (int i = 0; i < 10; i++) {
+      std::memset(buffers[i % 2], 'a' + i, sizeof(buffers[i % 2]));
+      dm.WriteLog(buffers[i % 2], 30 + i);
+      expected.insert(expected.end(), buffers[i % 2], buffers[i % 2] + 30 + i);
+    }
+    EXPECT_EQ(expected.size(), dm.GetLogEndOffset());
+    EXPECT_EQ((expected.size() + 99) / 100, dm.GetNumLogSegments());
+    dm.ShutDown();
+  }
+
+  DiskManager dm(db_file, options);
+  EXPECT_EQ(expected.size(), dm.GetLogEndOffset());
+  EXPECT_EQ(0, dm.GetLogStartOffset());
+  std::vector<char> log(expected.size() + 10, 'x');
+  ASSERT_TRUE(dm.ReadLog(log.data(), static_cast<int>(log.size()), 0));
+  EXPECT_EQ(0, std::memcmp(log.data(), expected.data(), expected.size()));
+  // zeroed past the end
+  EXPECT_EQ(0, log[expected.size()]);
+  char buf[50];
+  ASSERT_TRUE(dm.ReadLog(buf, sizeof(buf), 180));
+  EXPECT_EQ(0, std::memcmp(buf, expected.data() + 180, sizeof(buf)));
+  EXPECT_FALSE(dm.ReadLog(buf, sizeof(buf), expected.size()));
+
+  // appending after reopening continues in the last segment
+  std::memset(buffers[0], 'z', sizeof(buffers[0]));
+  dm.WriteLog(buffers[0], 64);
+  expected.insert(expected.end(), buffers[0], buffers[0] + 64);
+  ASSERT_TRUE(dm.ReadLog(buf, 40, expected.size() - 64));
+  EXPECT_EQ(0, std::memcmp(buf, buffers[0], 40));
+
+  // segments 0 and 1 are before offset 250, segment 2 holds it
+  EXPECT_EQ(2, dm.TruncateLog(250));
+  EXPECT_EQ(250, dm.GetLogStartOffset());
+  EXPECT_FALSE(dm.ReadLog(buf, sizeof(buf), 200));
+  ASSERT_TRUE(dm.ReadLog(buf, sizeof(buf), 250));
+  EXPECT_EQ(0, std::memcmp(buf, expected.data() + 250, sizeof(buf)));
+  EXPECT_EQ(0, dm.TruncateLog(250));
+  EXPECT_EQ(0, dm.TruncateLog(100));
+  EXPECT_EQ(250, dm.GetLogStartOffset());
+
+  // the last segment is kept, so that the end of the log is found on restart
+  size_t end = dm.GetLogEndOffset();
+  dm.TruncateLog(end + 1000);
+  EXPECT_EQ(1, dm.GetNumLogSegments());
+  dm.ShutDown();
+  DiskManager reopened(db_file, options);
+  EXPECT_EQ(end, reopened.GetLogEndOffset());
+  EXPECT_EQ(end, reopened.GetLogStartOffset());
+  reopened.ShutDown();
+  for (size_t segment = 1; segment <= end / 100; segment++) {
+    remove(("test.log." + std::to_string(segment)).c_str());
+  }
+  remove("test.log.start");
+}
+
+// NOLINTNEXTLINE
+TEST_F(DiskManagerTest, LargeFileTest) {
+  // Scenario: a page is written 12 GiB into the database file, well past where 32-bit offsets overflow. The file is
+  // sparse, so only that page takes room on disk. The page reads back, with a 64-bit LSN in its header, the hole
+  // before it reads as zeroes, and a reopened disk manager counts the pages from the file size.
+  std::string db_file("test.db");
+  const page_id_t far_page_id = 3 * 1024 * 1024;
+  {
+    // no point in filling the disk where holes are not supported
+    int fd = open(db_file.c_str(), O_CREAT | O_WRONLY, 0644);
+    ASSERT_GE(fd, 0);
+    struct stat stat_buf;
+    ASSERT_EQ(0, ftruncate(fd, static_cast<off_t>(far_page_id) * BUSTUB_PAGE_SIZE));
+    ASSERT_EQ(0, fstat(fd, &stat_buf));
+    close(fd);
+    remove(db_file.c_str());
+    if (stat_buf.st_blocks * 512 > BUSTUB_PAGE_SIZE) {
+      GTEST_SKIP() << "the file system has no sparse files";
+    }
+  }
+
+  Page page;
+  std::memset(page.GetData(), 'p', BUSTUB_PAGE_SIZE);
+  const lsn_t far_lsn = (lsn_t{1} << 40) + 7;
+  page.SetLSN(far_lsn);
+  char buf[BUSTUB_PAGE_SIZE];
+  {
+    DiskManager dm(db_file);
+    dm.WritePage(far_page_id, page.GetData());
+    EXPECT_EQ(static_cast<size_t>(far_page_id + 1) * BUSTUB_PAGE_SIZE, dm.GetDbFileSize());
+    dm.ReadPage(far_page_id, buf);
+    EXPECT_EQ(0, std::memcmp(buf, page.GetData(), BUSTUB_PAGE_SIZE));
+    std::memset(buf, 'x', sizeof(buf));
+    dm.ReadPage(far_page_id - 1, buf);
+    EXPECT_TRUE(std::all_of(buf, buf + BUSTUB_PAGE_SIZE, [](char c) { return c == 0; }));
+    dm.ShutDown();
+  }
+
+  DiskManager dm(db_file);
+  EXPECT_EQ(far_page_id + 1, dm.GetNumPages());
+  EXPECT_EQ(far_page_id + 1, dm.AllocatePage());
+  std::memset(buf, 0, sizeof(buf));
+  dm.ReadPage(far_page_id, buf);
+  EXPECT_EQ(far_lsn, *reinterpret_cast<lsn_t *>(buf + Page::OFFSET_LSN));
+  dm.ShutDown();
+}
+
+// NOLINTNEXTLINE
+TEST_F(DiskManagerTest, AllocatePageTest) {
+  char data[BUSTUB_PAGE_SIZE] = {0};
+  std::string db_file("test.db");
+  {
+    auto dm = DiskManager(db_file);
+    for (page_id_t i = 0; i < 10; i++) {
+      EXPECT_EQ(i, dm.AllocatePage());
+      dm.WritePage(i, data);
+    }
+
+    // freed pages are reused before the file grows, the first one at or after the hint first
+    dm.DeallocatePage(3);
+    dm.DeallocatePage(7);
+    dm.DeallocatePage(7);
+    EXPECT_EQ(2, dm.GetNumFreePages());
+    EXPECT_EQ(7, dm.AllocatePage(5));
+    EXPECT_EQ(3, dm.AllocatePage(8));
+    EXPECT_EQ(10, dm.AllocatePage());
+    EXPECT_EQ(0, dm.GetNumFreePages());
+
+    dm.DeallocatePage(4);
+    dm.ShutDown();
+  }
+
+  // the allocation state survives a restart
+  auto dm = DiskManager(db_file);
+  EXPECT_EQ(10, dm.GetNumPages());
+  EXPECT_EQ(1, dm.GetNumFreePages());
+  EXPECT_EQ(4, dm.AllocatePage());
+  EXPECT_EQ(10, dm.AllocatePage());
+  dm.ShutDown();
+}
+
+// NOLINTNEXTLINE
+TEST_F(DiskManagerTest, ConcurrentReadWriteTest) {
+  const int num_threads = 8;
+  const int pages_per_thread = 64;
+  std::string db_file("test.db");
+  {
+    auto dm = DiskManager(db_file);
+    // every thread writes and reads back its own interleaved pages, all at the same time
+    std::vector<std::thread> threads;
+    for (int t = 0; t < num_threads; t++) {
+      threads.emplace_back([&, t] {
+        char data[BUSTUB_PAGE_SIZE];
+        char buf[BUSTUB_PAGE_SIZE];
+        for (int round = 0; round < 2; round++) {
+          for (int i = 0; i < pages_per_thread; i++) {
+            page_id_t page_id = i * num_threads + t;
+            std::memset(data, 0, sizeof(data));
+            snprintf(data, sizeof(data), "page %d round %d", page_id, round);
+            dm.WritePage(page_id, data);
+            dm.ReadPage(page_id, buf);
+            EXPECT_EQ(0, std::memcmp(buf, data, sizeof(buf)));
+          }
+        }
+      });
+    }
+    for (auto &thread : threads) {
+      thread.join();
+    }
+    EXPECT_EQ(num_threads * pages_per_thread * BUSTUB_PAGE_SIZE, dm.GetDbFileSize());
+    EXPECT_EQ(2 * num_threads * pages_per_thread, dm.GetNumWrites());
+
+    // the part of a page past the end of the file reads as zeroes
+    char buf[BUSTUB_PAGE_SIZE];
+    std::memset(buf, 'x', sizeof(buf));
+    dm.ReadPage(num_threads * pages_per_thread, buf);
+    EXPECT_EQ(0, buf[0]);
+    dm.ShutDown();
+  }
+
+  // the file size is picked up on restart
+  auto dm = DiskManager(db_file);
+  EXPECT_EQ(num_threads * pages_per_thread * BUSTUB_PAGE_SIZE, dm.GetDbFileSize());
+  EXPECT_EQ(num_threads * pages_per_thread, dm.GetNumPages());
+  char buf[BUSTUB_PAGE_SIZE];
+  dm.ReadPage(5, buf);
+  EXPECT_EQ("page 5 round 1", std::string(buf));
+  dm.ShutDown();
+}
+
+// NOLINTNEXTLINE
+TEST_F(DiskManagerTest, AsyncReadWriteTest) {
+  const int num_pages = 200;
+  std::string db_file("test.db");
+  // with io_uring if the kernel allows it, and with the thread pool it falls back to
+  for (bool use_uring : {true, false}) {
+    remove("test.db");
+    // a small queue depth, so that submissions have to wait for completions
+    DiskManagerUring dm(db_file, {}, 8, use_uring);
+    if (!use_uring) {
+      EXPECT_FALSE(dm.UsesUring());
+    }
+    std::vector<std::vector<char>> pages(num_pages, std::vector<char>(BUSTUB_PAGE_SIZE));
+    std::mutex latch;
+    std::condition_variable cv;
+    int num_done = 0;
+    int last_error = 0;
+    auto done = [&](int error) {
+      std::scoped_lock lock(latch);
+      last_error = error;
+      num_done++;
+      cv.notify_all();
+    };
+    auto wait_for = [&](int count) {
+      std::unique_lock lock(latch);
+      cv.wait(lock, [&] { return num_done == count; });
+    };
+
+    // Scenario: A batch of writes lands on disk, and the file size follows.
+    std::vector<DiskRequest> writes;
+    for (int i = 0; i < num_pages; i++) {
+      snprintf(pages[i].data(), BUSTUB_PAGE_SIZE, "page %d", i);
+      writes.push_back(DiskRequest{true, i, pages[i].data(), done});
+    }
+    dm.SubmitAsync(std::move(writes));
+    wait_for(num_pages);
+    EXPECT_EQ(num_pages * BUSTUB_PAGE_SIZE, dm.GetDbFileSize());
+    EXPECT_EQ(num_pages, dm.GetNumWrites());
+    char buf[BUSTUB_PAGE_SIZE];
+    dm.ReadPage(num_pages - 1, buf);
+    EXPECT_EQ("page " + std::to_string(num_pages - 1), std::string(buf));
+
+    // Scenario: Single reads, in reverse order, see what the batch wrote.
+    for (int i = num_pages - 1; i >= 0; i--) {
+      std::memset(pages[i].data(), 0, BUSTUB_PAGE_SIZE);
+      dm.ReadPageAsync(i, pages[i].data(), done);
+    }
+    wait_for(2 * num_pages);
+    for (int i = 0; i < num_pages; i++) {
+      EXPECT_EQ("page " + std::to_string(i), std::string(pages[i].data()));
+    }
+
+    // Scenario: A read at the end of the file gives a zeroed page, one past it leaves the buffer alone.
+    std::memset(buf, 'x', sizeof(buf));
+    dm.ReadPageAsync(num_pages, buf, done);
+    wait_for(2 * num_pages + 1);
+    EXPECT_EQ(0, buf[0]);
+    std::memset(buf, 'x', sizeof(buf));
+    dm.ReadPageAsync(num_pages + 1, buf, done);
+    wait_for(2 * num_pages + 2);
+    EXPECT_EQ('x', buf[0]);
+    EXPECT_EQ(0, last_error);
+
+    // Scenario: A write cut short by the file size limit is retried for the rest of the page, which fails, and its
+    // callback gets the error.
+    rlimit old_limit;
+    ASSERT_EQ(0, getrlimit(RLIMIT_FSIZE, &old_limit));
+    rlimit limit = old_limit;
+    limit.rlim_cur = dm.GetDbFileSize() + BUSTUB_PAGE_SIZE / 2;
+    auto old_handler = signal(SIGXFSZ, SIG_IGN);
+    ASSERT_EQ(0, setrlimit(RLIMIT_FSIZE, &limit));
+    dm.WritePageAsync(num_pages, pages[0].data(), done);
+    wait_for(2 * num_pages + 3);
+    setrlimit(RLIMIT_FSIZE, &old_limit);
+    signal(SIGXFSZ, old_handler);
+    EXPECT_EQ(EFBIG, last_error);
+    EXPECT_EQ(num_pages * BUSTUB_PAGE_SIZE, dm.GetDbFileSize());
+    dm.ShutDown();
+  }
+}
+
+// NOLINTNEXTLINE
+TEST_F(DiskManagerTest, WritePagesTest) {
+  std::string db_file("test.db");
+  // more adjacent pages than a single pwritev() takes, then a gap, then a few more
+  std::vector<page_id_t> page_ids;
+  for (page_id_t i = 0; i < static_cast<page_id_t>(DISK_MANAGER_MAX_WRITEV_PAGES) + 50; i++) {
+    page_ids.push_back(i);
+  }
+  page_ids.push_back(400);
+  page_ids.push_back(401);
+  page_ids.push_back(403);
+  std::mt19937 rng(15445);
+  std::shuffle(page_ids.begin(), page_ids.end(), rng);
+  std::vector<std::vector<char>> pages(page_ids.size(), std::vector<char>(BUSTUB_PAGE_SIZE));
+
+  // Scenario: Pages handed over in any order land where they belong, with buffered and direct I/O.
+  for (bool direct_io : {false, true}) {
+    remove("test.db");
+    DiskManagerOptions options;
+    options.direct_io_ = direct_io;
+    DiskManager dm(db_file, options);
+    std::vector<std::pair<page_id_t, const char *>> batch;
+    for (size_t i = 0; i < page_ids.size(); i++) {
+      snprintf(pages[i].data(), BUSTUB_PAGE_SIZE, "page %d direct %d", page_ids[i], direct_io);
+      batch.emplace_back(page_ids[i], pages[i].data());
+    }
+    dm.WritePages(std::move(batch));
+    EXPECT_EQ(page_ids.size(), dm.GetNumWrites());
+    EXPECT_EQ(404 * BUSTUB_PAGE_SIZE, dm.GetDbFileSize());
+
+    char buf[BUSTUB_PAGE_SIZE];
+    for (auto page_id : page_ids) {
+      dm.ReadPage(page_id, buf);
+      EXPECT_EQ("page " + std::to_string(page_id) + " direct " + std::to_string(direct_io), std::string(buf));
+    }
+    // the gap reads as zeroes
+    dm.ReadPage(402, buf);
+    EXPECT_EQ(0, buf[0]);
+    dm.ShutDown();
+  }
+
+  // Scenario: A disk manager without a file takes the pages one by one.
+  DiskManagerUnlimitedMemory memory_dm;
+  memory_dm.WritePages({{3, pages[0].data()}, {1, pages[1].data()}});
+  char buf[BUSTUB_PAGE_SIZE];
+  memory_dm.ReadPage(3, buf);
+  EXPECT_EQ(std::string(pages[0].data()), std::string(buf));
+  memory_dm.ReadPage(1, buf);
+  EXPECT_EQ(std::string(pages[1].data()), std::string(buf));
+}
+
+// NOLINTNEXTLINE
+TEST_F(DiskManagerTest, DirectIoTest) {
+  std::string db_file("test.db");
+  DiskManagerOptions options;
+  options.direct_io_ = true;
+  options.sync_policy_ = DbSyncPolicy::ON_SYNC;
+  for (bool use_uring : {true, false}) {
+    remove("test.db");
+    DiskManagerUring dm(db_file, options, 8, use_uring);
+    // frames of a buffer pool are handed to the file as they are, anything else goes through a bounce buffer
+    FrameArena aligned(2);
+    std::vector<char> unaligned_storage(BUSTUB_PAGE_SIZE + 1);
+    char *unaligned = unaligned_storage.data() + (reinterpret_cast<uintptr_t>(unaligned_storage.data()) % 2 == 0);
+
+    // Scenario: Aligned and unaligned buffers both round-trip through the synchronous path.
+    snprintf(aligned.FrameData(0), BUSTUB_PAGE_SIZE, "aligned");
+    snprintf(unaligned, BUSTUB_PAGE_SIZE, "unaligned");
+    dm.WritePage(0, aligned.FrameData(0));
+    dm.WritePage(1, unaligned);
+    dm.ReadPage(1, aligned.FrameData(1));
+    EXPECT_EQ("unaligned", std::string(aligned.FrameData(1)));
+    dm.ReadPage(0, unaligned);
+    EXPECT_EQ("aligned", std::string(unaligned));
+
+    // Scenario: The same goes for asynchronous reads and writes.
+    std::mutex latch;
+    std::condition_variable cv;
+    int num_done = 0;
+    auto done = [&](int /*error*/) {
+      std::scoped_lock lock(latch);
+      num_done++;
+      cv.notify_all();
+    };
+    auto wait_for = [&](int count) {
+      std::unique_lock lock(latch);
+      cv.wait(lock, [&] { return num_done == count; });
+    };
+    snprintf(unaligned, BUSTUB_PAGE_SIZE, "async unaligned");
+    dm.WritePageAsync(2, unaligned, done);
+    wait_for(1);
+    dm.ReadPageAsync(2, aligned.FrameData(0), done);
+    wait_for(2);
+    EXPECT_EQ("async unaligned", std::string(aligned.FrameData(0)));
+    std::memset(unaligned, 0, BUSTUB_PAGE_SIZE);
+    dm.ReadPageAsync(1, unaligned, done);
+    wait_for(3);
+    EXPECT_EQ("unaligned", std::string(unaligned));
+    EXPECT_EQ(3 * BUSTUB_PAGE_SIZE, dm.GetDbFileSize());
+
+    // Scenario: Sync() flushes the file with the ON_SYNC policy.
+    dm.Sync();
+    EXPECT_EQ(1, dm.GetNumSyncs());
+    dm.ShutDown();
+  }
+
+  // Scenario: With every write durable on its own, Sync() has nothing left to do.
+  remove("test.db");
+  options.sync_policy_ = DbSyncPolicy::EVERY_WRITE;
+  DiskManager dm(db_file, options);
+  FrameArena page(1);
+  dm.WritePage(0, page.FrameData(0));
+  dm.Sync();
+  EXPECT_EQ(0, dm.GetNumSyncs());
+  dm.ShutDown();
+}
+
+// NOLINTNEXTLINE
+TEST_F(DiskManagerTest, MmapTest) {
+  std::string db_file("test.db");
+  const page_id_t num_pages = 64;
+  {
+    DiskManager writer(db_file);
+    char data[BUSTUB_PAGE_SIZE] = {0};
+    for (page_id_t page_id = 0; page_id < num_pages; page_id++) {
+      snprintf(data, BUSTUB_PAGE_SIZE, "page %d", page_id);
+      writer.WritePage(page_id, data);
+    }
+    writer.ShutDown();
+  }
+  DiskManagerMmap dm(db_file);
+  EXPECT_TRUE(dm.IsReadOnly());
+  EXPECT_EQ(num_pages, dm.GetNumPages());
+
+  // Scenario: Pages are read from the mapping, and copied out or handed out in place.
+  char buf[BUSTUB_PAGE_SIZE];
+  dm.ReadPage(7, buf);
+  EXPECT_EQ("page 7", std::string(buf));
+  ASSERT_NE(nullptr, dm.MappedPage(9));
+  EXPECT_EQ("page 9", std::string(dm.MappedPage(9)));
+  EXPECT_EQ(nullptr, dm.MappedPage(num_pages));
+
+  // Scenario: The advised access pattern follows the reads.
+  for (page_id_t page_id = 0; page_id < DiskManagerMmap::ADVISE_STREAK + 1; page_id++) {
+    dm.MappedPage(page_id);
+  }
+  EXPECT_EQ(MmapAccessPattern::SEQUENTIAL, dm.GetAccessPattern());
+  std::mt19937 rng(15445);
+  for (int i = 0; i < 4 * DiskManagerMmap::ADVISE_STREAK; i++) {
+    dm.ReadPage(static_cast<page_id_t>(rng() % num_pages), buf);
+  }
+  EXPECT_EQ(MmapAccessPattern::RANDOM, dm.GetAccessPattern());
+
+  // Scenario: Every kind of write is rejected.
+  EXPECT_THROW(dm.WritePage(0, buf), Exception);
+  EXPECT_THROW(dm.WritePages({{0, buf}}), Exception);
+  EXPECT_THROW(dm.WritePageAsync(0, buf, [](int /*error*/) {}), Exception);
+  dm.ShutDown();
+}
+
 // NOLINTNEXTLINE
 TEST_F(DiskManagerTest, ThrowBadFileTest) { EXPECT_THROW(DiskManager("dev/null\\/foo/bar/baz/test.db"), Exception); }
 
@@ -0,0 +1,151 @@
+//===----------------------------------------------------------------------===//
+//
+//                         BusTub
+//
+// page_guard_test.cpp
+//
+// Identification: test/storage/page_guard_test.cpp
+//
+// Copyright (c) 2015-2022, Carnegie Mellon University Database Group
+//
+//===----------------------------------------------------------------------===//
+
+#include "storage/page/page_guard.h"
+
+#include <chrono>  // NOLINT
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <thread>  // NOLINT
+#include <utility>
+
+#include "buffer/buffer_pool_manager_instance.h"
+#include "gtest/gtest.h"
+#include "storage/disk/disk_manager_memory.h"
+
+namespace bustub {
+
+// NOLINTNEXTLINE
+TEST(PageGuardTest, BasicGuardTest) {
+  auto disk_manager = std::make_shared<DiskManagerUnlimitedMemory>();
+  auto bpm = std::make_shared<BufferPoolManagerInstance>(5, disk_manager.get(), 2);
+
+  page_id_t page_id;
+  auto *page = bpm->NewPage(&page_id);
+  {
+    BasicPageGuard guard(bpm.get(), page);
+    EXPECT_EQ(page_id, guard.PageId());
+    EXPECT_EQ(page->GetData(), guard.GetData());
+    EXPECT_EQ(1, page->GetPinCount());
+
+    // moving hands over the pin, it doesn't add one
+    BasicPageGuard moved(std::move(guard));
+    EXPECT_EQ(INVALID_PAGE_ID, guard.PageId());  // NOLINT
+    EXPECT_EQ(page_id, moved.PageId());
+    EXPECT_EQ(1, page->GetPinCount());
+
+    // reading the content doesn't make the page dirty
+    EXPECT_EQ('\0', moved.GetData()[0]);
+  }
+  EXPECT_EQ(0, page->GetPinCount());
+  EXPECT_FALSE(page->IsDirty());
+
+  // writing through a guard does
+  {
+    auto guard = bpm->FetchPageBasic(page_id);
+    EXPECT_EQ(1, page->GetPinCount());
+    snprintf(guard.GetDataMut(), BUSTUB_PAGE_SIZE, "Hello");
+    guard.Drop();
+    EXPECT_EQ(0, page->GetPinCount());
+    // dropping twice is harmless
+    guard.Drop();
+    EXPECT_EQ(0, page->GetPinCount());
+  }
+  EXPECT_TRUE(page->IsDirty());
+
+  // assigning to a guard releases the page it held
+  page_id_t other_page_id;
+  auto guard = bpm->NewPageGuarded(&other_page_id);
+  auto *other_page = bpm->FetchPage(other_page_id);
+  bpm->UnpinPage(other_page_id, false);
+  EXPECT_EQ(1, other_page->GetPinCount());
+  guard = bpm->FetchPageBasic(page_id);
+  EXPECT_EQ(0, other_page->GetPinCount());
+  EXPECT_EQ(1, page->GetPinCount());
+  EXPECT_EQ(0, strcmp(guard.GetData(), "Hello"));
+}
+
+// NOLINTNEXTLINE
+TEST(PageGuardTest, ReadWriteGuardTest) {
+  auto disk_manager = std::make_shared<DiskManagerUnlimitedMemory>();
+  auto bpm = std::make_shared<BufferPoolManagerInstance>(5, disk_manager.get(), 2);
+
+  page_id_t page_id;
+  auto *page = bpm->NewPage(&page_id);
+  bpm->UnpinPage(page_id, false);
+
+  {
+    auto writer = bpm->FetchPageWrite(page_id);
+    EXPECT_EQ(1, page->GetPinCount());
+    snprintf(writer.GetDataMut(), BUSTUB_PAGE_SIZE, "Hello");
+    // the page is write-latched until the guard goes away
+    auto reader = std::thread([&] {
+      auto guard = bpm->FetchPageRead(page_id);
+      EXPECT_EQ(0, strcmp(guard.GetData(), "World"));
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    snprintf(writer.GetDataMut(), BUSTUB_PAGE_SIZE, "World");
+    writer.Drop();
+    reader.join();
+  }
+  EXPECT_EQ(0, page->GetPinCount());
+  EXPECT_TRUE(page->IsDirty());
+
+  // read guards share the latch
+  {
+    auto first = bpm->FetchPageRead(page_id);
+    auto second = bpm->FetchPageRead(page_id);
+    EXPECT_EQ(2, page->GetPinCount());
+    ReadPageGuard moved;
+    moved = std::move(first);
+    EXPECT_EQ(INVALID_PAGE_ID, first.PageId());  // NOLINT
+    EXPECT_EQ(2, page->GetPinCount());
+  }
+  EXPECT_EQ(0, page->GetPinCount());
+
+  // upgrading keeps the pin and latches the page
+  {
+    auto basic = bpm->FetchPageBasic(page_id);
+    auto writer = basic.UpgradeWrite();
+    EXPECT_EQ(INVALID_PAGE_ID, basic.PageId());  // NOLINT
+    EXPECT_EQ(1, page->GetPinCount());
+    EXPECT_EQ(0, strcmp(writer.As<char>(), "World"));
+  }
+  EXPECT_EQ(0, page->GetPinCount());
+  // the page can be latched again once every guard is gone
+  auto writer = bpm->FetchPageWrite(page_id);
+  EXPECT_EQ(page_id, writer.PageId());
+}
+
+// NOLINTNEXTLINE
+TEST(PageGuardTest, FullPoolTest) {
+  auto disk_manager = std::make_shared<DiskManagerUnlimitedMemory>();
+  auto bpm = std::make_shared<BufferPoolManagerInstance>(1, disk_manager.get(), 2);
+
+  page_id_t page_id;
+  auto guard = bpm->NewPageGuarded(&page_id);
+  EXPECT_NE(INVALID_PAGE_ID, guard.PageId());
+
+  // a page that can't be brought in yields an empty guard
+  page_id_t other_page_id;
+  auto empty = bpm->NewPageGuarded(&other_page_id);
+  EXPECT_EQ(INVALID_PAGE_ID, empty.PageId());
+  auto empty_read = bpm->FetchPageRead(page_id + 1);
+  EXPECT_EQ(INVALID_PAGE_ID, empty_read.PageId());
+
+  guard.Drop();
+  auto write_guard = bpm->FetchPageWrite(page_id + 1);
+  EXPECT_EQ(page_id + 1, write_guard.PageId());
+}
+
+}  // namespace bustub
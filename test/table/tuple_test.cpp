@@ -19,8 +19,10 @@
 #include "buffer/buffer_pool_manager_instance.h"
 #include "gtest/gtest.h"
 #include "logging/common.h"
+#include "storage/disk/disk_manager_memory.h"
 #include "storage/table/table_heap.h"
 #include "storage/table/tuple.h"
+#include "type/value_factory.h"
 
 namespace bustub {
 // NOLINTNEXTLINE
@@ -71,4 +73,47 @@ TEST(TupleTest, DISABLED_TableHeapTest) {
   delete disk_manager;
 }
 
+// NOLINTNEXTLINE
+TEST(TupleTest, OpenTableHeapTest) {
+  Column col{"a", TypeId::VARCHAR, 200};
+  Schema schema{{col}};
+  std::vector<Value> values{ValueFactory::GetVarcharValue(std::string(200, 'a'))};
+  Tuple tuple(values, &schema);
+
+  auto *transaction = new Transaction(0);
+  auto *disk_manager = new DiskManagerUnlimitedMemory();
+  auto *buffer_pool_manager = new BufferPoolManagerInstance(50, disk_manager);
+  auto *lock_manager = new LockManager();
+  auto *table = new TableHeap(buffer_pool_manager, lock_manager, nullptr, transaction);
+  RID rid;
+  for (int i = 0; i < 200; ++i) {
+    ASSERT_TRUE(table->InsertTuple(tuple, &rid, transaction));
+  }
+  EXPECT_LT(1, table->GetNumPages());
+
+  // Scenario: A table heap opened on an existing chain of pages knows how many pages it has, and appends to its last
+  // page.
+  auto *opened = new TableHeap(buffer_pool_manager, lock_manager, nullptr, table->GetFirstPageId());
+  EXPECT_EQ(table->GetNumPages(), opened->GetNumPages());
+  RID bulk_rid;
+  BufferAccessStrategy strategy(BufferAccessStrategyType::BULKWRITE, buffer_pool_manager->GetPoolSize());
+  ASSERT_TRUE(opened->InsertTuple(tuple, &bulk_rid, transaction, &strategy));
+  EXPECT_EQ(rid.GetPageId(), bulk_rid.GetPageId());
+
+  // Scenario: A first page that was allocated but never written before a crash reads as zeroes. The heap opens on it
+  // and is left to recovery, rather than taken for an old layout.
+  page_id_t zeroed_page_id;
+  ASSERT_NE(nullptr, buffer_pool_manager->NewPage(&zeroed_page_id));
+  EXPECT_EQ(true, buffer_pool_manager->UnpinPage(zeroed_page_id, false));
+  TableHeap unformatted(buffer_pool_manager, lock_manager, nullptr, zeroed_page_id);
+  EXPECT_EQ(0, unformatted.GetNumPages());
+
+  delete opened;
+  delete table;
+  delete lock_manager;
+  delete buffer_pool_manager;
+  delete disk_manager;
+  delete transaction;
+}
+
 }  // namespace bustub
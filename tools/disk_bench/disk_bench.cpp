@@ -0,0 +1,280 @@
+// An fio-like microbenchmark of the disk manager backends: blocking pread / pwrite from a number of threads, the
+// thread pool serving asynchronous requests, and io_uring, on buffered or direct I/O. For writes, it also compares
+// writing batches of pages one pwrite() at a time with DiskManager::WritePages(), which coalesces adjacent pages.
+
+#include <algorithm>
+#include <chrono>              // NOLINT
+#include <condition_variable>  // NOLINT
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <mutex>  // NOLINT
+#include <random>
+#include <string>
+#include <thread>  // NOLINT
+#include <utility>
+#include <vector>
+
+#include "argparse/argparse.hpp"
+#include "buffer/frame_arena.h"
+#include "common/config.h"
+#include "common/latency_histogram.h"
+#include "fmt/core.h"
+#include "storage/disk/disk_manager.h"
+#include "storage/disk/disk_manager_uring.h"
+
+namespace {
+
+using bustub::BUSTUB_PAGE_SIZE;
+using bustub::page_id_t;
+
+struct Workload {
+  bool is_write_;
+  bool is_random_;
+  page_id_t num_pages_;
+  size_t num_ops_;
+  size_t depth_;
+  bustub::DiskManagerOptions options_;
+};
+
+struct BenchResult {
+  double seconds_{0};
+  bustub::LatencyHistogram latency_;
+};
+
+auto ElapsedNanos(std::chrono::steady_clock::time_point start) -> uint64_t {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+/** Picks the pages a workload touches, randomly or one after the other. */
+class PagePicker {
+ public:
+  PagePicker(const Workload &workload, uint32_t seed, page_id_t first)
+      : workload_(workload), rng_(seed), next_(first) {}
+
+  auto Next() -> page_id_t {
+    if (workload_.is_random_) {
+      return static_cast<page_id_t>(rng_() % workload_.num_pages_);
+    }
+    page_id_t page_id = next_;
+    next_ = (next_ + 1) % workload_.num_pages_;
+    return page_id;
+  }
+
+ private:
+  const Workload &workload_;
+  std::mt19937 rng_;
+  page_id_t next_;
+};
+
+/** depth threads each issue blocking reads or writes. */
+auto RunSync(bustub::DiskManager *dm, const Workload &workload) -> BenchResult {
+  BenchResult result;
+  std::vector<std::thread> threads;
+  // page-aligned, like the frames of a buffer pool, so that direct I/O needs no bounce buffer
+  bustub::FrameArena buffers(workload.depth_);
+  auto start = std::chrono::steady_clock::now();
+  for (size_t t = 0; t < workload.depth_; t++) {
+    threads.emplace_back([&, t] {
+      char *buf = buffers.FrameData(static_cast<bustub::frame_id_t>(t));
+      std::memset(buf, 'w', BUSTUB_PAGE_SIZE);
+      // sequential workloads split the file into one range per thread
+      PagePicker picker(workload, 15445 + t, static_cast<page_id_t>(workload.num_pages_ * t / workload.depth_));
+      for (size_t i = t; i < workload.num_ops_; i += workload.depth_) {
+        auto op_start = std::chrono::steady_clock::now();
+        if (workload.is_write_) {
+          dm->WritePage(picker.Next(), buf);
+        } else {
+          dm->ReadPage(picker.Next(), buf);
+        }
+        result.latency_.Record(ElapsedNanos(op_start));
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  result.seconds_ = static_cast<double>(ElapsedNanos(start)) / 1e9;
+  return result;
+}
+
+/** A single thread writes batches of depth pages, with WritePages() if vectored, else page by page. */
+auto RunBatched(bustub::DiskManager *dm, const Workload &workload, bool vectored) -> BenchResult {
+  BenchResult result;
+  bustub::FrameArena buffers(workload.depth_);
+  for (size_t i = 0; i < workload.depth_; i++) {
+    std::memset(buffers.FrameData(static_cast<bustub::frame_id_t>(i)), 'w', BUSTUB_PAGE_SIZE);
+  }
+  PagePicker picker(workload, 15445, 0);
+  auto start = std::chrono::steady_clock::now();
+  for (size_t done = 0; done < workload.num_ops_;) {
+    std::vector<std::pair<page_id_t, const char *>> batch;
+    // a batch holds every page at most once, as a flush would
+    while (batch.size() < workload.depth_ && done + batch.size() < workload.num_ops_) {
+      page_id_t page_id = picker.Next();
+      if (std::none_of(batch.begin(), batch.end(), [&](const auto &entry) { return entry.first == page_id; })) {
+        batch.emplace_back(page_id, buffers.FrameData(static_cast<bustub::frame_id_t>(batch.size())));
+      }
+    }
+    done += batch.size();
+    auto batch_start = std::chrono::steady_clock::now();
+    if (vectored) {
+      dm->WritePages(std::move(batch));
+    } else {
+      for (const auto &[page_id, data] : batch) {
+        dm->WritePage(page_id, data);
+      }
+    }
+    result.latency_.Record(ElapsedNanos(batch_start));
+  }
+  result.seconds_ = static_cast<double>(ElapsedNanos(start)) / 1e9;
+  return result;
+}
+
+/** Keeps depth asynchronous requests in flight, submitting every free slot as one batch. */
+auto RunAsync(bustub::DiskManager *dm, const Workload &workload) -> BenchResult {
+  BenchResult result;
+  bustub::FrameArena buffers(workload.depth_);
+  std::vector<size_t> free_slots;
+  for (size_t i = 0; i < workload.depth_; i++) {
+    std::memset(buffers.FrameData(static_cast<bustub::frame_id_t>(i)), 'w', BUSTUB_PAGE_SIZE);
+    free_slots.push_back(i);
+  }
+  std::mutex latch;
+  std::condition_variable cv;
+  size_t num_completed = 0;
+  PagePicker picker(workload, 15445, 0);
+
+  auto start = std::chrono::steady_clock::now();
+  size_t num_submitted = 0;
+  while (num_submitted < workload.num_ops_) {
+    std::vector<size_t> slots;
+    {
+      std::unique_lock lock(latch);
+      cv.wait(lock, [&] { return !free_slots.empty(); });
+      while (!free_slots.empty() && num_submitted + slots.size() < workload.num_ops_) {
+        slots.push_back(free_slots.back());
+        free_slots.pop_back();
+      }
+    }
+    std::vector<bustub::DiskRequest> requests;
+    auto op_start = std::chrono::steady_clock::now();
+    for (size_t slot : slots) {
+      auto callback = [&, slot, op_start](int /*error*/) {
+        result.latency_.Record(ElapsedNanos(op_start));
+        std::scoped_lock lock(latch);
+        free_slots.push_back(slot);
+        num_completed++;
+        cv.notify_all();
+      };
+      char *data = buffers.FrameData(static_cast<bustub::frame_id_t>(slot));
+      requests.push_back(bustub::DiskRequest{workload.is_write_, picker.Next(), data, callback});
+    }
+    num_submitted += requests.size();
+    dm->SubmitAsync(std::move(requests));
+  }
+  {
+    std::unique_lock lock(latch);
+    cv.wait(lock, [&] { return num_completed == workload.num_ops_; });
+  }
+  result.seconds_ = static_cast<double>(ElapsedNanos(start)) / 1e9;
+  return result;
+}
+
+void PrintResult(const std::string &backend, const Workload &workload, const BenchResult &result) {
+  double iops = static_cast<double>(workload.num_ops_) / result.seconds_;
+  auto us = [](uint64_t nanos) { return static_cast<double>(nanos) / 1e3; };
+  fmt::print("{:<8} {:>10.0f} IOPS {:>9.1f} MiB/s  lat us: mean {:.1f} p50 {:.1f} p99 {:.1f} p99.9 {:.1f} max {:.1f}\n",
+             backend, iops, iops * BUSTUB_PAGE_SIZE / (1024 * 1024), result.latency_.Mean() / 1e3,
+             us(result.latency_.ValueAtPercentile(50)), us(result.latency_.ValueAtPercentile(99)),
+             us(result.latency_.ValueAtPercentile(99.9)), us(result.latency_.Max()));
+}
+
+}  // namespace
+
+// NOLINTNEXTLINE
+auto main(int argc, char **argv) -> int {
+  argparse::ArgumentParser program("bustub-disk-bench");
+  program.add_argument("--file").default_value(std::string("disk-bench.db")).help("the database file to run on");
+  program.add_argument("--backend")
+      .default_value(std::string("all"))
+      .help("sync (blocking, one thread per depth), threads, uring, pwrite or pwritev (batches of writes), or all");
+  program.add_argument("--workload")
+      .default_value(std::string("randread"))
+      .help("randread, randwrite, seqread or seqwrite");
+  program.add_argument("--pages").default_value(std::string("16384")).help("size of the file in pages");
+  program.add_argument("--ops").default_value(std::string("50000")).help("number of reads or writes per backend");
+  program.add_argument("--depth")
+      .default_value(std::string("32"))
+      .help("requests in flight, threads for sync, or pages per batch");
+  program.add_argument("--direct").default_value(false).implicit_value(true).help("open the file with O_DIRECT");
+  program.add_argument("--fsync")
+      .default_value(std::string("none"))
+      .help("none, or every-write to open the file with O_DSYNC");
+
+  try {
+    program.parse_args(argc, argv);
+  } catch (const std::runtime_error &err) {
+    std::cerr << err.what() << std::endl;
+    std::cerr << program;
+    return 1;
+  }
+
+  auto file = program.get("--file");
+  auto backend = program.get("--backend");
+  auto workload_name = program.get("--workload");
+  Workload workload{workload_name.find("write") != std::string::npos, workload_name.rfind("rand", 0) == 0,
+                    static_cast<page_id_t>(std::stoi(program.get("--pages"))), std::stoul(program.get("--ops")),
+                    std::max<size_t>(std::stoul(program.get("--depth")), 1), bustub::DiskManagerOptions{}};
+  workload.options_.direct_io_ = program.get<bool>("--direct");
+  workload.options_.sync_policy_ =
+      program.get("--fsync") == "every-write" ? bustub::DbSyncPolicy::EVERY_WRITE : bustub::DbSyncPolicy::NONE;
+
+  // lay out the whole file first, so that reads hit written pages and writes don't grow the file
+  {
+    bustub::DiskManager dm(file);
+    if (dm.GetDbFileSize() < static_cast<size_t>(workload.num_pages_) * BUSTUB_PAGE_SIZE) {
+      std::vector<char> buf(BUSTUB_PAGE_SIZE, 'p');
+      for (page_id_t page_id = 0; page_id < workload.num_pages_; page_id++) {
+        dm.WritePage(page_id, buf.data());
+      }
+    }
+    dm.ShutDown();
+  }
+
+  fmt::print("{} on {}, {} pages, {} ops, depth {}\n", workload_name, file, workload.num_pages_, workload.num_ops_,
+             workload.depth_);
+  if (backend == "sync" || backend == "all") {
+    bustub::DiskManager dm(file, workload.options_);
+    if (workload.options_.direct_io_ && !dm.UsesDirectIo()) {
+      fmt::print("direct I/O is not supported by the file system, measuring buffered I/O\n");
+    }
+    PrintResult("sync", workload, RunSync(&dm, workload));
+    dm.ShutDown();
+  }
+  if (backend == "threads" || backend == "all") {
+    bustub::DiskManagerUring dm(file, workload.options_, workload.depth_, false);
+    PrintResult("threads", workload, RunAsync(&dm, workload));
+    dm.ShutDown();
+  }
+  if (backend == "uring" || backend == "all") {
+    bustub::DiskManagerUring dm(file, workload.options_, workload.depth_, true);
+    if (!dm.UsesUring()) {
+      fmt::print("uring    not supported by the kernel\n");
+    } else {
+      PrintResult("uring", workload, RunAsync(&dm, workload));
+    }
+    dm.ShutDown();
+  }
+  // latencies of the batched backends are per batch
+  for (bool vectored : {false, true}) {
+    std::string name = vectored ? "pwritev" : "pwrite";
+    if (!workload.is_write_ || (backend != name && backend != "all")) {
+      continue;
+    }
+    bustub::DiskManager dm(file, workload.options_);
+    PrintResult(name, workload, RunBatched(&dm, workload, vectored));
+    dm.ShutDown();
+  }
+  return 0;
+}
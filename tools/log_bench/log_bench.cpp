@@ -0,0 +1,161 @@
+// A microbenchmark of the log manager. In the commit workload, every client appends a BEGIN and a COMMIT record and
+// waits for the commit to be durable, as TransactionManager::Commit() does, to see the commit rate scale with group
+// commit. In the append workload, clients append INSERT records without waiting, to see how appending scales with the
+// number of threads. Put the file on a tmpfs such as /dev/shm to take the device out of the append numbers. Every run
+// is repeated with and without compression of the log blocks, to see what it costs and how many log bytes it saves.
+
+#include <algorithm>
+#include <chrono>  // NOLINT
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>  // NOLINT
+#include <vector>
+
+#include "argparse/argparse.hpp"
+#include "common/config.h"
+#include "common/latency_histogram.h"
+#include "fmt/core.h"
+#include "recovery/log_manager.h"
+#include "storage/disk/disk_manager.h"
+#include "storage/table/tuple.h"
+
+namespace {
+
+using bustub::lsn_t;
+
+auto ElapsedNanos(std::chrono::steady_clock::time_point start) -> uint64_t {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+/** Distinct tuples the appended records carry. */
+constexpr size_t NUM_TUPLES = 1024;
+
+struct RunResult {
+  double seconds_{0};
+  int num_flushes_{0};
+  size_t log_bytes_{0};
+  bustub::LatencyHistogram latency_;
+};
+
+/**
+ * clients threads run ops_per_client operations each, on a fresh log. An operation is a commit, or the append of an
+ * INSERT record carrying a tuple of record_size bytes.
+ */
+auto Run(const std::string &file, bool commit, size_t clients, size_t ops_per_client, size_t record_size,
+         std::chrono::microseconds delay, size_t max_batch, bool compress) -> RunResult {
+  RunResult result;
+  auto *disk_manager = new bustub::DiskManager(file);
+  auto *log_manager = new bustub::LogManager(disk_manager, delay, max_batch, compress);
+  // random letters, and more distinct tuples than a log buffer holds, so as not to flatter the compression
+  std::vector<bustub::Tuple> tuples(NUM_TUPLES);
+  std::mt19937 generator(42);
+  for (auto &tuple : tuples) {
+    // a serialized tuple is its length followed by its data
+    std::vector<char> raw_tuple(sizeof(int32_t) + record_size);
+    auto tuple_size = static_cast<int32_t>(record_size);
+    std::memcpy(raw_tuple.data(), &tuple_size, sizeof(int32_t));
+    for (size_t i = sizeof(int32_t); i < raw_tuple.size(); i++) {
+      raw_tuple[i] = static_cast<char>('a' + generator() % 26);
+    }
+    tuple.DeserializeFrom(raw_tuple.data());
+  }
+
+  std::vector<std::thread> threads;
+  auto start = std::chrono::steady_clock::now();
+  for (size_t c = 0; c < clients; c++) {
+    threads.emplace_back([&, c] {
+      for (size_t i = 0; i < ops_per_client; i++) {
+        auto op_start = std::chrono::steady_clock::now();
+        auto txn_id = static_cast<bustub::txn_id_t>(c * ops_per_client + i);
+        if (commit) {
+          bustub::LogRecord begin(txn_id, bustub::INVALID_LSN, bustub::LogRecordType::BEGIN);
+          lsn_t prev_lsn = log_manager->AppendLogRecord(&begin);
+          bustub::LogRecord commit_record(txn_id, prev_lsn, bustub::LogRecordType::COMMIT);
+          log_manager->FlushUntil(log_manager->AppendLogRecord(&commit_record));
+        } else {
+          bustub::LogRecord insert(txn_id, bustub::INVALID_LSN, bustub::LogRecordType::INSERT,
+                                   bustub::RID(static_cast<bustub::page_id_t>(c), static_cast<uint32_t>(i)),
+                                   tuples[(c * ops_per_client + i) % NUM_TUPLES]);
+          log_manager->AppendLogRecord(&insert);
+        }
+        result.latency_.Record(ElapsedNanos(op_start));
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  result.seconds_ = static_cast<double>(ElapsedNanos(start)) / 1e9;
+  result.num_flushes_ = disk_manager->GetNumFlushes();
+  result.log_bytes_ = disk_manager->GetLogEndOffset();
+  delete log_manager;
+  disk_manager->ShutDown();
+  delete disk_manager;
+  return result;
+}
+
+}  // namespace
+
+// NOLINTNEXTLINE
+auto main(int argc, char **argv) -> int {
+  argparse::ArgumentParser program("bustub-log-bench");
+  program.add_argument("--workload").default_value(std::string("commit")).help("commit or append");
+  program.add_argument("--file")
+      .default_value(std::string("log-bench.db"))
+      .help("the database file, the log is written next to it");
+  program.add_argument("--clients")
+      .default_value(std::string("1,2,4,8,16,32"))
+      .help("comma-separated numbers of concurrent clients");
+  program.add_argument("--ops").default_value(std::string("2000")).help("total number of commits or appends per run");
+  program.add_argument("--record-size").default_value(std::string("100")).help("tuple size of appended records");
+  program.add_argument("--delay-us")
+      .default_value(std::to_string(bustub::LOG_GROUP_COMMIT_DELAY_US))
+      .help("how long a group commit leader waits for more commits");
+  program.add_argument("--max-batch")
+      .default_value(std::to_string(bustub::LOG_GROUP_COMMIT_MAX_BATCH))
+      .help("the number of waiting commits that ends the leader's wait early");
+
+  try {
+    program.parse_args(argc, argv);
+  } catch (const std::runtime_error &err) {
+    std::cerr << err.what() << std::endl;
+    std::cerr << program;
+    return 1;
+  }
+
+  bool commit = program.get("--workload") == "commit";
+  auto file = program.get("--file");
+  size_t total_ops = std::stoul(program.get("--ops"));
+  size_t record_size = std::stoul(program.get("--record-size"));
+  std::chrono::microseconds delay(std::stol(program.get("--delay-us")));
+  size_t max_batch = std::stoul(program.get("--max-batch"));
+  std::string log_file = file.substr(0, file.rfind('.')) + ".log";
+
+  fmt::print("{} {} per run, group commit delay {} us, max batch {}\n", total_ops, commit ? "commits" : "appends",
+             delay.count(), max_batch);
+  std::stringstream clients_list(program.get("--clients"));
+  for (std::string item; std::getline(clients_list, item, ',');) {
+    size_t clients = std::max<size_t>(std::stoul(item), 1);
+    size_t ops_per_client = std::max<size_t>(total_ops / clients, 1);
+    for (bool compress : {false, true}) {
+      std::remove(log_file.c_str());
+      auto result = Run(file, commit, clients, ops_per_client, record_size, delay, max_batch, compress);
+      double ops = static_cast<double>(ops_per_client * clients);
+      auto us = [](uint64_t nanos) { return static_cast<double>(nanos) / 1e3; };
+      fmt::print(
+          "{:>4} clients {:>5} {:>10.0f} {}/s {:>8.1f} per flush {:>7.1f} log bytes/op  lat us: p50 {:.1f} p99 {:.1f} "
+          "max {:.1f}\n",
+          clients, compress ? "lz" : "plain", ops / result.seconds_, commit ? "commits" : "appends",
+          ops / std::max(result.num_flushes_, 1), static_cast<double>(result.log_bytes_) / ops,
+          us(result.latency_.ValueAtPercentile(50)), us(result.latency_.ValueAtPercentile(99)),
+          us(result.latency_.Max()));
+    }
+  }
+  std::remove(log_file.c_str());
+  return 0;
+}
@@ -27,12 +27,11 @@ auto GetWidthOfUtf8(const void *beg, const void *end, size_t *width) -> int {
 auto main(int argc, char **argv) -> int {
   ft_set_u8strwid_func(&GetWidthOfUtf8);
 
-  auto bustub = std::make_unique<bustub::BustubInstance>("test.db");
-
   auto default_prompt = "bustub> ";
   auto emoji_prompt = "\U0001f6c1> ";  // the bathtub emoji
   bool use_emoji_prompt = false;
   bool disable_tty = false;
+  bustub::DiskManagerOptions disk_options;
 
   for (int i = 1; i < argc; i++) {
     if (strcmp(argv[i], "--emoji-prompt") == 0) {
@@ -43,8 +42,13 @@ auto main(int argc, char **argv) -> int {
       disable_tty = true;
       break;
     }
+    if (strcmp(argv[i], "--direct-io") == 0) {
+      disk_options.direct_io_ = true;
+    }
   }
 
+  auto bustub = std::make_unique<bustub::BustubInstance>("test.db", disk_options);
+
   bustub->GenerateMockTable();
 
   if (bustub->buffer_pool_manager_ != nullptr) {